@@ -0,0 +1,1167 @@
+/*
+ * Archivo: bench_pubsub.c
+ * Descripcion: Generador de carga y medidor de latencia extremo a extremo para los brokers TCP, UDP y QUIC, y para
+ *              los subscribers locales por memoria compartida de broker_unificado (transporte shm).
+ *              Lanza M publishers y N subscribers (un hilo o una conexion QUIC por cliente, en un solo proceso),
+ *              publica los eventos de los Partido*.txt a un ritmo fijo y reporta rendimiento, perdida y
+ *              percentiles de latencia (p50/p90/p99/p99.9) en JSON para comparar corridas entre commits.
+ *
+ * MEDICION:
+ *    Cada publisher envia "PUBLISHER|bench/<t>|bench|@L<corrida>:<publisher>:<hora_us> <linea del partido>". La
+ *    hora es la programada para ese envio, no la real: si el publisher se atrasa (el broker no da abasto) el atraso
+ *    cuenta como latencia en lugar de desaparecer de la medicion (correccion de "coordinated omission"). Los
+ *    subscribers buscan la marca @L en lo que reciben (los tres brokers conservan el cuerpo del mensaje) y
+ *    registran ahora - hora_us en su propio histograma (../common/latency_histogram.h). Publishers y subscribers
+ *    comparten el reloj monotonico porque viven en el mismo proceso. Las marcas de otra corrida (por ejemplo
+ *    mensajes retenidos por el broker) se ignoran.
+ *
+ *    Perdida: cada subscriber del topic t deberia recibir todo lo enviado a t; esperados - recibidos. El
+ *    publisher p publica en bench/<p % T> y el subscriber s se suscribe a bench/<s % T>.
+ *
+ *    Eventos criticos (--criticos PCT): ese porcentaje de los mensajes sale con prioridad alta (hora "!bench", ver
+ *    ../common/event_priority.h) y el resto con prioridad baja, y la marca lleva un '!' despues de la hora
+ *    ("@L<corrida>:<publisher>:<hora_us>! ..."). Los subscribers los registran ademas en un histograma propio, que
+ *    se reporta como latencia_criticos_us: con --lectura-lenta los subscribers TCP/UDP leen despacio, la cola de
+ *    salida del broker crece y se ve si los criticos la saltean.
+ *
+ * MEMORIA COMPARTIDA (shm):
+ *    Los publishers son TCP, como en "tcp"; cada subscriber pide "SHM|bench/<t>" por una conexion TCP de control
+ *    a broker_unificado, mapea el anillo que le indica (../common/shm_ring.h) y lo consulta desde su hilo.
+ *    Corriendo "tcp" y "shm" contra el mismo broker_unificado se compara la entrega por loopback TCP con la
+ *    entrega por memoria compartida con los mismos publishers. Los mensajes que un lector pierde por atrasarse
+ *    cuentan como perdidos y ademas se informan como desbordes_shm.
+ *
+ * LIMITES:
+ *    El broker TCP atiende a lo sumo MAX_CLIENTS (20) publishers y 20 subscribers; en UDP un subscriber solo esta
+ *    listo cuando el broker proceso su datagrama de registro, por eso se espera --calentamiento ms antes de
+ *    publicar. En QUIC un subscriber esta listo al recibir SUBSCRIBED|<topic>.
+ *
+ * LIBRERIAS UTILIZADAS Y JUSTIFICACION:
+ *
+ * 1. msquic.h
+ *    - Por que: Clientes QUIC, igual que loadclient_quic.c.
+ *    - Funciones usadas: MsQuicOpen2(), MsQuic->RegistrationOpen(), MsQuic->ConfigurationOpen(),
+ *      MsQuic->ConfigurationLoadCredential(), MsQuic->ConnectionOpen(), MsQuic->ConnectionStart(),
+ *      MsQuic->ConnectionShutdown(), MsQuic->StreamOpen(), MsQuic->StreamStart(), MsQuic->StreamSend(),
+ *      MsQuic->SetCallbackHandler().
+ *
+ * 2. winsock2.h / ws2tcpip.h (Windows) - sys/socket.h, arpa/inet.h (Linux)
+ *    - Por que: Clientes TCP y UDP como publisher_tcp.c, subscriber_tcp.c y sus equivalentes UDP.
+ *    - Funciones usadas: socket(), connect(), send(), sendto(), recv(), recvfrom(), setsockopt(), shutdown(),
+ *      closesocket()/close(), inet_addr(), htons().
+ *
+ * 3. windows.h (via quic_platform.h; en Linux se emula sobre pthreads)
+ *    - Por que: Hilos por cliente, eventos para arrancar y terminar la corrida y contadores Interlocked*.
+ *    - Funciones usadas: PlatformThreadCreate(), PlatformThreadJoin(), CreateEventA(), SetEvent(),
+ *      WaitForSingleObject(), InterlockedIncrement(), Sleep().
+ *
+ * 4. stdio.h / stdlib.h / string.h (libreria estandar)
+ *    - Por que: Carga del corpus (../common/match_replay.h), reporte JSON y armado de mensajes.
+ *    - Funciones usadas: fopen(), fprintf(), calloc(), malloc(), free(), atoi(), snprintf(), strstr(), sscanf().
+ *    - Alternativa considerada: Lanzar los procesos publisher y subscriber de cada transporte y parsear su salida; descartado porque
+ *      la consola limita la tasa y los procesos no comparten un reloj para medir latencia extremo a extremo.
+ */
+
+#include <msquic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../QUIC/quic_platform.h"
+#include "../common/latency_histogram.h"
+#include "../common/match_replay.h"
+#include "../common/shm_ring.h"
+
+#ifdef _WIN32
+#include <ws2tcpip.h>
+#pragma comment(lib, "ws2_32.lib")
+#else
+#include <sys/socket.h>
+#include <sys/time.h>
+typedef int SOCKET;
+#define INVALID_SOCKET (-1)
+#define SOCKET_ERROR (-1)
+#define closesocket close
+#endif
+
+#define MESSAGE_MAX_LEN 512
+#define BODY_MAX_LEN 320
+#define MARKER "@L"
+#define ACK_PREFIX "SUBSCRIBED|"
+#define RECEIVE_TIMEOUT_MS 200
+#define READY_TIMEOUT_MS 10000
+#define CLOSE_TIMEOUT_MS 5000
+#define SHM_IDLE_SPINS 2000
+
+typedef enum BenchTransport {
+    BENCH_TCP = 0,
+    BENCH_UDP,
+    BENCH_QUIC,
+    BENCH_SHM
+} BenchTransport;
+
+typedef struct BenchOptions {
+    BenchTransport transport;
+    const char* server;
+    uint16_t port;
+    int publishers;
+    int subscribers;
+    int topics;
+    int rate;
+    int durationS;
+    int warmupMs;
+    int drainMs;
+    const char* corpusDirectory;
+    const char* jsonPath;
+    const char* label;
+    int criticalPct;
+    int slowReadMs;
+} BenchOptions;
+
+/* Linea incompleta de un flujo, a la espera del resto. */
+typedef struct BenchLine {
+    char text[MESSAGE_MAX_LEN];
+    uint32_t length;
+} BenchLine;
+
+/*
+ * Un subscriber solo se toca desde su hilo (TCP/UDP) o desde los callbacks de su conexion (QUIC); los dos streams de
+ * una conexion QUIC (el suyo y el de alta prioridad que abre el broker) se atienden en el mismo hilo de msquic.
+ */
+typedef struct BenchSubscriber {
+    int id;
+    int topic;
+    SOCKET socket;
+    HQUIC connection;
+    HQUIC stream;
+    PlatformThread thread;
+    int threadStarted;
+    LatencyHistogram latency;
+    LatencyHistogram criticalLatency;
+    uint64_t received;
+    uint64_t criticalReceived;
+    uint64_t ignored;
+    uint64_t lastReceiveUs;
+    BenchLine pending;
+    BenchLine priorityPending;
+    int ready;
+    char subscribe[MESSAGE_MAX_LEN];
+    QUIC_BUFFER subscribeBuffer;
+    ShmRing ring;
+    ShmRingReader reader;
+} BenchSubscriber;
+
+typedef struct BenchPublisher {
+    int id;
+    int topic;
+    SOCKET socket;
+    struct sockaddr_in broker;
+    HQUIC connection;
+    HQUIC stream;
+    HANDLE connectedEvent;
+    PlatformThread thread;
+    int threadStarted;
+    uint64_t sent;
+    uint64_t failed;
+} BenchPublisher;
+
+/* Mensaje QUIC en vuelo: msquic conserva el QUIC_BUFFER hasta SEND_COMPLETE. */
+typedef struct BenchSend {
+    QUIC_BUFFER quicBuffer;
+    uint8_t data[MESSAGE_MAX_LEN];
+} BenchSend;
+
+static BenchOptions Options;
+static BenchSubscriber* Subscribers = NULL;
+static BenchPublisher* Publishers = NULL;
+static char** Corpus = NULL;
+static int CorpusCount = 0;
+static uint32_t RunId = 0;
+static uint64_t StartUs = 0;
+static volatile LONG Running = 1;
+static volatile LONG ReadyCount = 0;
+static volatile LONG QuicOpened = 0;
+static volatile LONG QuicClosed = 0;
+static HANDLE StartEvent = NULL;
+static HANDLE AllClosedEvent = NULL;
+
+static const QUIC_API_TABLE* MsQuic = NULL;
+static HQUIC Registration = NULL;
+static HQUIC Configuration = NULL;
+static const char* const DEFAULT_ALPN = "sports-pubsub";
+
+/* ---------------------------------------------------------------------------------------------------------
+ * Corpus y mensajes
+ * --------------------------------------------------------------------------------------------------------- */
+
+static int LoadCorpus(const char* directory) {
+    MatchSchedule schedule;
+    if (LoadMatchSchedule(&schedule, directory, 0) == 0) {
+        return 0;
+    }
+
+    int capacity = 0;
+    char line[MESSAGE_MAX_LEN];
+    for (MatchSource* match = NextMatch(&schedule); match != NULL; match = NextMatch(&schedule)) {
+        if (!ReadMatchLine(&schedule, match, line, sizeof(line))) {
+            continue;
+        }
+        if (CorpusCount == capacity) {
+            capacity = capacity == 0 ? 256 : capacity * 2;
+            char** grown = (char**)realloc(Corpus, sizeof(char*) * (size_t)capacity);
+            if (grown == NULL) {
+                FreeMatchSchedule(&schedule);
+                return 0;
+            }
+            Corpus = grown;
+        }
+        /* El cuerpo se acota para que el mensaje completo quepa en un datagrama del broker UDP. */
+        size_t length = strlen(line);
+        if (length > BODY_MAX_LEN) {
+            length = BODY_MAX_LEN;
+        }
+        Corpus[CorpusCount] = (char*)malloc(length + 1);
+        if (Corpus[CorpusCount] == NULL) {
+            FreeMatchSchedule(&schedule);
+            return 0;
+        }
+        memcpy(Corpus[CorpusCount], line, length);
+        Corpus[CorpusCount][length] = '\0';
+        CorpusCount++;
+    }
+    FreeMatchSchedule(&schedule);
+    return CorpusCount;
+}
+
+static void FreeCorpus(void) {
+    for (int i = 0; i < CorpusCount; ++i) {
+        free(Corpus[i]);
+    }
+    free(Corpus);
+    Corpus = NULL;
+    CorpusCount = 0;
+}
+
+/* Reparte los criticos a lo largo de la corrida: 37 es coprimo con 100, asi cada centena tiene exactamente PCT. */
+static int IsCritical(uint64_t sequence) {
+    return Options.criticalPct > 0 && (int)((sequence * 37) % 100) < Options.criticalPct;
+}
+
+/* Arma el mensaje del publisher; UDP va sin '\n' porque cada datagrama es un mensaje. */
+static int FormatPublish(char* buffer, size_t capacity, const BenchPublisher* publisher, uint64_t scheduledUs, uint64_t sequence) {
+    const char* body = Corpus[(size_t)((sequence + (uint64_t)publisher->id) % (uint64_t)CorpusCount)];
+    int critical = IsCritical(sequence);
+    const char* priority = Options.criticalPct == 0 ? "" : (critical ? "!" : "~");
+    int length = snprintf(buffer, capacity, "PUBLISHER|bench/%d|%sbench|" MARKER "%u:%d:%llu%s %s%s",
+                          publisher->topic, priority, RunId, publisher->id, (unsigned long long)scheduledUs,
+                          critical ? "!" : "", body, Options.transport == BENCH_UDP ? "" : "\n");
+    return length < (int)capacity ? length : (int)capacity - 1;
+}
+
+/* Registra la latencia de una linea recibida si trae una marca de esta corrida. */
+static void HandleLine(BenchSubscriber* subscriber, const char* line) {
+    if (strncmp(line, ACK_PREFIX, sizeof(ACK_PREFIX) - 1) == 0) {
+        if (!subscriber->ready) {
+            subscriber->ready = 1;
+            InterlockedIncrement(&ReadyCount);
+        }
+        return;
+    }
+
+    const char* marker = strstr(line, MARKER);
+    unsigned int run = 0;
+    int publisher = 0;
+    unsigned long long scheduledUs = 0;
+    int markerEnd = 0;
+    if (marker == NULL || sscanf(marker + 2, "%u:%d:%llu%n", &run, &publisher, &scheduledUs, &markerEnd) != 3 ||
+        run != RunId) {
+        subscriber->ignored++;
+        return;
+    }
+
+    uint64_t nowUs = PlatformNowUs();
+    uint64_t latencyUs = nowUs > scheduledUs ? nowUs - scheduledUs : 0;
+    LatencyHistogramRecord(&subscriber->latency, latencyUs);
+    if (marker[2 + markerEnd] == '!') {
+        LatencyHistogramRecord(&subscriber->criticalLatency, latencyUs);
+        subscriber->criticalReceived++;
+    }
+    subscriber->received++;
+    subscriber->lastReceiveUs = nowUs;
+}
+
+/* Separa un flujo (TCP o stream QUIC) en lineas; un fragmento sin '\n' espera al siguiente. */
+static void HandleBytes(BenchSubscriber* subscriber, BenchLine* pending, const char* data, size_t length) {
+    while (length > 0) {
+        const char* newline = (const char*)memchr(data, '\n', length);
+        size_t chunk = newline != NULL ? (size_t)(newline - data) : length;
+        size_t space = sizeof(pending->text) - 1 - pending->length;
+        size_t copy = chunk < space ? chunk : space;
+        memcpy(pending->text + pending->length, data, copy);
+        pending->length += (uint32_t)copy;
+        if (newline == NULL) {
+            return;
+        }
+
+        pending->text[pending->length] = '\0';
+        if (pending->length > 0) {
+            HandleLine(subscriber, pending->text);
+        }
+        pending->length = 0;
+        data += chunk + 1;
+        length -= chunk + 1;
+    }
+}
+
+static void PaceUntil(uint64_t targetUs) {
+    for (;;) {
+        uint64_t nowUs = PlatformNowUs();
+        if (nowUs >= targetUs) {
+            return;
+        }
+        Sleep(targetUs - nowUs > 2000 ? 1 : 0);
+    }
+}
+
+/* ---------------------------------------------------------------------------------------------------------
+ * TCP y UDP
+ * --------------------------------------------------------------------------------------------------------- */
+
+/* En shm los publishers y la conexion de control de los subscribers son TCP. */
+static int UsesTcp(void) {
+    return Options.transport == BENCH_TCP || Options.transport == BENCH_SHM;
+}
+
+static void SetReceiveTimeout(SOCKET socketFd, int milliseconds) {
+#ifdef _WIN32
+    DWORD timeout = (DWORD)milliseconds;
+    setsockopt(socketFd, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout));
+#else
+    struct timeval timeout = { milliseconds / 1000, (milliseconds % 1000) * 1000 };
+    setsockopt(socketFd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+#endif
+}
+
+static void BrokerAddress(struct sockaddr_in* address) {
+    memset(address, 0, sizeof(*address));
+    address->sin_family = AF_INET;
+    address->sin_port = htons(Options.port);
+    address->sin_addr.s_addr = inet_addr(Options.server);
+}
+
+/* Abre el socket del cliente; en TCP ademas conecta y envia la identificacion. */
+static SOCKET OpenSocket(const char* hello, struct sockaddr_in* broker) {
+    BrokerAddress(broker);
+    SOCKET socketFd = UsesTcp()
+        ? socket(AF_INET, SOCK_STREAM, IPPROTO_TCP)
+        : socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (socketFd == INVALID_SOCKET) {
+        return INVALID_SOCKET;
+    }
+
+    int sent;
+    if (UsesTcp()) {
+        if (connect(socketFd, (struct sockaddr*)broker, sizeof(*broker)) == SOCKET_ERROR) {
+            closesocket(socketFd);
+            return INVALID_SOCKET;
+        }
+        sent = (int)send(socketFd, hello, (int)strlen(hello), 0);
+    } else {
+        sent = hello[0] == '\0' ? 0 : (int)sendto(socketFd, hello, (int)strlen(hello), 0, (struct sockaddr*)broker, sizeof(*broker));
+    }
+    if (sent == SOCKET_ERROR) {
+        closesocket(socketFd);
+        return INVALID_SOCKET;
+    }
+    return socketFd;
+}
+
+static PLATFORM_THREAD_ROUTINE(SocketSubscriberThread) {
+    BenchSubscriber* subscriber = (BenchSubscriber*)argument;
+    char buffer[MESSAGE_MAX_LEN * 4];
+
+    while (Running) {
+        int bytes = (int)recv(subscriber->socket, buffer, sizeof(buffer) - 1, 0);
+        if (bytes <= 0) {
+            if (bytes == 0 && Options.transport == BENCH_TCP) {
+                break;
+            }
+            continue;
+        }
+        if (Options.transport == BENCH_UDP) {
+            buffer[bytes] = '\0';
+            HandleLine(subscriber, buffer);
+        } else {
+            HandleBytes(subscriber, &subscriber->pending, buffer, (size_t)bytes);
+        }
+        if (Options.slowReadMs > 0) {
+            Sleep((DWORD)Options.slowReadMs);
+        }
+    }
+    return PLATFORM_THREAD_RETURN;
+}
+
+static int StartSocketSubscriber(BenchSubscriber* subscriber) {
+    struct sockaddr_in broker;
+    char hello[MESSAGE_MAX_LEN];
+    snprintf(hello, sizeof(hello), "SUBSCRIBER|bench/%d%s", subscriber->topic, Options.transport == BENCH_TCP ? "\n" : "");
+    subscriber->socket = OpenSocket(hello, &broker);
+    if (subscriber->socket == INVALID_SOCKET) {
+        return 0;
+    }
+    SetReceiveTimeout(subscriber->socket, RECEIVE_TIMEOUT_MS);
+
+    /* Sin confirmacion del broker: queda listo al enviar el registro (el calentamiento cubre el resto). */
+    subscriber->ready = 1;
+    InterlockedIncrement(&ReadyCount);
+    subscriber->threadStarted = PlatformThreadCreate(&subscriber->thread, SocketSubscriberThread, subscriber);
+    return subscriber->threadStarted;
+}
+
+/* ---------------------------------------------------------------------------------------------------------
+ * Memoria compartida
+ * --------------------------------------------------------------------------------------------------------- */
+
+/* Con el anillo vacio consulta SHM_IDLE_SPINS veces y despues cede el procesador, como subscriber_shm. */
+static PLATFORM_THREAD_ROUTINE(ShmSubscriberThread) {
+    BenchSubscriber* subscriber = (BenchSubscriber*)argument;
+    char message[SHM_RING_SLOT_BYTES + 1];
+    uint32_t length;
+    uint32_t idle = 0;
+
+    while (Running) {
+        if (!ShmRingRead(&subscriber->ring, &subscriber->reader, message, SHM_RING_SLOT_BYTES, &length)) {
+            if (++idle >= SHM_IDLE_SPINS) {
+                Sleep(0);
+            }
+            continue;
+        }
+        idle = 0;
+        if (length > 0 && message[length - 1] == '\n') {
+            length--;
+        }
+        message[length] = '\0';
+        HandleLine(subscriber, message);
+        if (Options.slowReadMs > 0) {
+            Sleep((DWORD)Options.slowReadMs);
+        }
+    }
+    return PLATFORM_THREAD_RETURN;
+}
+
+/* Pide el canal por TCP y espera "SHM|filtro|segmento|retenidos"; la conexion queda abierta mientras dure la corrida. */
+static int StartShmSubscriber(BenchSubscriber* subscriber) {
+    struct sockaddr_in broker;
+    char request[MESSAGE_MAX_LEN];
+    snprintf(request, sizeof(request), "SHM|bench/%d\n", subscriber->topic);
+    subscriber->socket = OpenSocket(request, &broker);
+    if (subscriber->socket == INVALID_SOCKET) {
+        return 0;
+    }
+    SetReceiveTimeout(subscriber->socket, READY_TIMEOUT_MS);
+
+    char reply[MESSAGE_MAX_LEN];
+    uint32_t length = 0;
+    char c;
+    while (length < sizeof(reply) - 1 && recv(subscriber->socket, &c, 1, 0) == 1 && c != '\n') {
+        reply[length++] = c;
+    }
+    reply[length] = '\0';
+    char* segment = strncmp(reply, "SHM|", 4) == 0 ? strchr(reply + 4, '|') : NULL;
+    char* retained = segment != NULL ? strchr(segment + 1, '|') : NULL;
+    if (retained == NULL) {
+        fprintf(stderr, "[BENCH] El broker no ofrecio memoria compartida: %s\n", reply);
+        return 0;
+    }
+    *retained = '\0';
+    if (!ShmRingOpen(&subscriber->ring, segment + 1)) {
+        fprintf(stderr, "[BENCH] No se pudo mapear %s.\n", segment + 1);
+        return 0;
+    }
+    /* Solo mensajes nuevos: los retenidos son de otra corrida y se ignorarian igual. */
+    ShmRingReaderInit(&subscriber->ring, &subscriber->reader, 0);
+
+    subscriber->ready = 1;
+    InterlockedIncrement(&ReadyCount);
+    subscriber->threadStarted = PlatformThreadCreate(&subscriber->thread, ShmSubscriberThread, subscriber);
+    return subscriber->threadStarted;
+}
+
+static int SendSocketMessage(BenchPublisher* publisher, const char* message, int length) {
+    int sent = UsesTcp()
+        ? (int)send(publisher->socket, message, length, 0)
+        : (int)sendto(publisher->socket, message, length, 0, (struct sockaddr*)&publisher->broker, sizeof(publisher->broker));
+    return sent != SOCKET_ERROR;
+}
+
+/* ---------------------------------------------------------------------------------------------------------
+ * QUIC
+ * --------------------------------------------------------------------------------------------------------- */
+
+static void QuicClientClosed(void) {
+    if (InterlockedIncrement(&QuicClosed) == QuicOpened) {
+        SetEvent(AllClosedEvent);
+    }
+}
+
+static
+QUIC_STATUS
+SubscriberStreamCallback(
+    HQUIC stream,
+    void* context,
+    QUIC_STREAM_EVENT* event
+    )
+{
+    BenchSubscriber* subscriber = (BenchSubscriber*)context;
+
+    switch (event->Type) {
+    case QUIC_STREAM_EVENT_RECEIVE:
+        for (uint32_t i = 0; i < event->RECEIVE.BufferCount; ++i) {
+            HandleBytes(subscriber, &subscriber->pending, (const char*)event->RECEIVE.Buffers[i].Buffer,
+                        event->RECEIVE.Buffers[i].Length);
+        }
+        break;
+
+    case QUIC_STREAM_EVENT_SHUTDOWN_COMPLETE:
+        MsQuic->StreamClose(stream);
+        subscriber->stream = NULL;
+        break;
+
+    default:
+        break;
+    }
+    return QUIC_STATUS_SUCCESS;
+}
+
+/* Stream unidireccional que abre el broker para los eventos de alta prioridad. */
+static
+QUIC_STATUS
+SubscriberPriorityStreamCallback(
+    HQUIC stream,
+    void* context,
+    QUIC_STREAM_EVENT* event
+    )
+{
+    BenchSubscriber* subscriber = (BenchSubscriber*)context;
+
+    switch (event->Type) {
+    case QUIC_STREAM_EVENT_RECEIVE:
+        for (uint32_t i = 0; i < event->RECEIVE.BufferCount; ++i) {
+            HandleBytes(subscriber, &subscriber->priorityPending, (const char*)event->RECEIVE.Buffers[i].Buffer,
+                        event->RECEIVE.Buffers[i].Length);
+        }
+        break;
+
+    case QUIC_STREAM_EVENT_SHUTDOWN_COMPLETE:
+        MsQuic->StreamClose(stream);
+        break;
+
+    default:
+        break;
+    }
+    return QUIC_STATUS_SUCCESS;
+}
+
+static
+QUIC_STATUS
+SubscriberConnectionCallback(
+    HQUIC connection,
+    void* context,
+    QUIC_CONNECTION_EVENT* event
+    )
+{
+    BenchSubscriber* subscriber = (BenchSubscriber*)context;
+
+    switch (event->Type) {
+    case QUIC_CONNECTION_EVENT_PEER_STREAM_STARTED:
+        MsQuic->SetCallbackHandler(event->PEER_STREAM_STARTED.Stream, (void*)SubscriberPriorityStreamCallback, subscriber);
+        break;
+
+    case QUIC_CONNECTION_EVENT_SHUTDOWN_COMPLETE:
+        MsQuic->ConnectionClose(connection);
+        subscriber->connection = NULL;
+        QuicClientClosed();
+        break;
+
+    default:
+        break;
+    }
+    return QUIC_STATUS_SUCCESS;
+}
+
+static
+QUIC_STATUS
+PublisherStreamCallback(
+    HQUIC stream,
+    void* context,
+    QUIC_STREAM_EVENT* event
+    )
+{
+    BenchPublisher* publisher = (BenchPublisher*)context;
+
+    switch (event->Type) {
+    case QUIC_STREAM_EVENT_SEND_COMPLETE:
+        free(event->SEND_COMPLETE.ClientContext);
+        break;
+
+    case QUIC_STREAM_EVENT_SHUTDOWN_COMPLETE:
+        MsQuic->StreamClose(stream);
+        publisher->stream = NULL;
+        break;
+
+    default:
+        break;
+    }
+    return QUIC_STATUS_SUCCESS;
+}
+
+static
+QUIC_STATUS
+PublisherConnectionCallback(
+    HQUIC connection,
+    void* context,
+    QUIC_CONNECTION_EVENT* event
+    )
+{
+    BenchPublisher* publisher = (BenchPublisher*)context;
+
+    switch (event->Type) {
+    case QUIC_CONNECTION_EVENT_CONNECTED:
+        SetEvent(publisher->connectedEvent);
+        break;
+
+    case QUIC_CONNECTION_EVENT_SHUTDOWN_COMPLETE:
+        MsQuic->ConnectionClose(connection);
+        publisher->connection = NULL;
+        SetEvent(publisher->connectedEvent);
+        QuicClientClosed();
+        break;
+
+    default:
+        break;
+    }
+    return QUIC_STATUS_SUCCESS;
+}
+
+static int InitializeQuic(void) {
+    QUIC_STATUS status = MsQuicOpen2(&MsQuic);
+    if (QUIC_FAILED(status)) {
+        fprintf(stderr, "[BENCH] MsQuicOpen fracaso (%u).\n", status);
+        return 0;
+    }
+
+    QUIC_REGISTRATION_CONFIG regConfig = { "BenchPubSub", QUIC_EXECUTION_PROFILE_LOW_LATENCY };
+    status = MsQuic->RegistrationOpen(&regConfig, &Registration);
+    if (QUIC_FAILED(status)) {
+        fprintf(stderr, "[BENCH] RegistrationOpen fracaso (%u).\n", status);
+        return 0;
+    }
+
+    QUIC_BUFFER alpn;
+    alpn.Buffer = (uint8_t*)DEFAULT_ALPN;
+    alpn.Length = (uint32_t)strlen(DEFAULT_ALPN);
+
+    QUIC_SETTINGS settings;
+    memset(&settings, 0, sizeof(settings));
+    settings.IsSet.IdleTimeoutMs = TRUE;
+    settings.IdleTimeoutMs = 600000;
+    /* El broker abre un stream unidireccional por subscriber para los eventos de alta prioridad. */
+    settings.IsSet.PeerUnidiStreamCount = TRUE;
+    settings.PeerUnidiStreamCount = 1;
+
+    status = MsQuic->ConfigurationOpen(Registration, &alpn, 1, &settings, sizeof(settings), NULL, &Configuration);
+    if (QUIC_FAILED(status)) {
+        fprintf(stderr, "[BENCH] ConfigurationOpen fracaso (%u).\n", status);
+        return 0;
+    }
+
+    QUIC_CREDENTIAL_CONFIG credConfig;
+    memset(&credConfig, 0, sizeof(credConfig));
+    credConfig.Type = QUIC_CREDENTIAL_TYPE_NONE;
+    credConfig.Flags = QUIC_CREDENTIAL_FLAG_CLIENT | QUIC_CREDENTIAL_FLAG_NO_CERTIFICATE_VALIDATION;
+    status = MsQuic->ConfigurationLoadCredential(Configuration, &credConfig);
+    if (QUIC_FAILED(status)) {
+        fprintf(stderr, "[BENCH] ConfigurationLoadCredential fracaso (%u).\n", status);
+        return 0;
+    }
+    return 1;
+}
+
+static void CleanupQuic(void) {
+    if (Configuration != NULL) {
+        MsQuic->ConfigurationClose(Configuration);
+        Configuration = NULL;
+    }
+    if (Registration != NULL) {
+        MsQuic->RegistrationClose(Registration);
+        Registration = NULL;
+    }
+    if (MsQuic != NULL) {
+        MsQuicClose(MsQuic);
+        MsQuic = NULL;
+    }
+}
+
+/* Abre conexion y stream; el stream se transmite al completar el handshake. */
+static int OpenQuicClient(HQUIC* connection, HQUIC* stream, QUIC_CONNECTION_CALLBACK_HANDLER connectionCallback,
+                          QUIC_STREAM_CALLBACK_HANDLER streamCallback, void* context) {
+    if (QUIC_FAILED(MsQuic->ConnectionOpen(Registration, connectionCallback, context, connection))) {
+        *connection = NULL;
+        return 0;
+    }
+    InterlockedIncrement(&QuicOpened);
+    if (QUIC_FAILED(MsQuic->StreamOpen(*connection, QUIC_STREAM_OPEN_FLAG_NONE, streamCallback, context, stream)) ||
+        QUIC_FAILED(MsQuic->StreamStart(*stream, QUIC_STREAM_START_FLAG_NONE))) {
+        MsQuic->ConnectionShutdown(*connection, QUIC_CONNECTION_SHUTDOWN_FLAG_NONE, 0);
+        return 0;
+    }
+    if (QUIC_FAILED(MsQuic->ConnectionStart(*connection, Configuration, QUIC_ADDRESS_FAMILY_UNSPEC, Options.server, Options.port))) {
+        MsQuic->ConnectionShutdown(*connection, QUIC_CONNECTION_SHUTDOWN_FLAG_NONE, 0);
+        return 0;
+    }
+    return 1;
+}
+
+static int StartQuicSubscriber(BenchSubscriber* subscriber) {
+    if (!OpenQuicClient(&subscriber->connection, &subscriber->stream, SubscriberConnectionCallback,
+                        SubscriberStreamCallback, subscriber)) {
+        return 0;
+    }
+    int length = snprintf(subscriber->subscribe, sizeof(subscriber->subscribe), "SUBSCRIBER|bench/%d\n", subscriber->topic);
+    subscriber->subscribeBuffer.Buffer = (uint8_t*)subscriber->subscribe;
+    subscriber->subscribeBuffer.Length = (uint32_t)length;
+    return QUIC_SUCCEEDED(MsQuic->StreamSend(subscriber->stream, &subscriber->subscribeBuffer, 1, QUIC_SEND_FLAG_NONE, NULL));
+}
+
+static int SendQuicMessage(BenchPublisher* publisher, const char* message, int length) {
+    BenchSend* send = (BenchSend*)malloc(sizeof(BenchSend));
+    if (send == NULL || publisher->stream == NULL) {
+        free(send);
+        return 0;
+    }
+    memcpy(send->data, message, (size_t)length);
+    send->quicBuffer.Buffer = send->data;
+    send->quicBuffer.Length = (uint32_t)length;
+    if (QUIC_FAILED(MsQuic->StreamSend(publisher->stream, &send->quicBuffer, 1, QUIC_SEND_FLAG_NONE, send))) {
+        free(send);
+        return 0;
+    }
+    return 1;
+}
+
+/* ---------------------------------------------------------------------------------------------------------
+ * Publishers
+ * --------------------------------------------------------------------------------------------------------- */
+
+static int ConnectPublisher(BenchPublisher* publisher) {
+    if (Options.transport == BENCH_QUIC) {
+        publisher->connectedEvent = CreateEventA(NULL, TRUE, FALSE, NULL);
+        if (publisher->connectedEvent == NULL ||
+            !OpenQuicClient(&publisher->connection, &publisher->stream, PublisherConnectionCallback,
+                            PublisherStreamCallback, publisher)) {
+            return 0;
+        }
+        return WaitForSingleObject(publisher->connectedEvent, READY_TIMEOUT_MS) == WAIT_OBJECT_0 &&
+               publisher->connection != NULL;
+    }
+
+    publisher->socket = OpenSocket(UsesTcp() ? "PUBLISHER|bench\n" : "", &publisher->broker);
+    return publisher->socket != INVALID_SOCKET;
+}
+
+static PLATFORM_THREAD_ROUTINE(PublisherThread) {
+    BenchPublisher* publisher = (BenchPublisher*)argument;
+    WaitForSingleObject(StartEvent, INFINITE);
+
+    uint64_t intervalUs = 1000000ULL / (uint64_t)Options.rate;
+    uint64_t total = (uint64_t)Options.rate * (uint64_t)Options.durationS;
+    /* Los publishers arrancan escalonados dentro del primer intervalo para no enviar en rafaga. */
+    uint64_t firstUs = StartUs + intervalUs * (uint64_t)publisher->id / (uint64_t)Options.publishers;
+    char message[MESSAGE_MAX_LEN];
+
+    for (uint64_t sequence = 0; sequence < total && Running; ++sequence) {
+        uint64_t scheduledUs = firstUs + sequence * intervalUs;
+        PaceUntil(scheduledUs);
+        int length = FormatPublish(message, sizeof(message), publisher, scheduledUs, sequence);
+        int ok = Options.transport == BENCH_QUIC
+            ? SendQuicMessage(publisher, message, length)
+            : SendSocketMessage(publisher, message, length);
+        if (ok) {
+            publisher->sent++;
+        } else {
+            publisher->failed++;
+        }
+    }
+    return PLATFORM_THREAD_RETURN;
+}
+
+/* ---------------------------------------------------------------------------------------------------------
+ * Reporte
+ * --------------------------------------------------------------------------------------------------------- */
+
+static const char* TransportName(BenchTransport transport) {
+    switch (transport) {
+    case BENCH_TCP: return "tcp";
+    case BENCH_UDP: return "udp";
+    case BENCH_SHM: return "shm";
+    default: return "quic";
+    }
+}
+
+static void WriteLatency(FILE* output, const char* name, const LatencyHistogram* latency, int last) {
+    fprintf(output, "  \"%s\": {\n", name);
+    fprintf(output, "    \"muestras\": %llu,\n", (unsigned long long)latency->total);
+    fprintf(output, "    \"min\": %llu,\n", (unsigned long long)(latency->total > 0 ? latency->min : 0));
+    fprintf(output, "    \"media\": %.1f,\n", LatencyHistogramMean(latency));
+    fprintf(output, "    \"p50\": %llu,\n", (unsigned long long)LatencyHistogramPercentile(latency, 50.0));
+    fprintf(output, "    \"p90\": %llu,\n", (unsigned long long)LatencyHistogramPercentile(latency, 90.0));
+    fprintf(output, "    \"p99\": %llu,\n", (unsigned long long)LatencyHistogramPercentile(latency, 99.0));
+    fprintf(output, "    \"p999\": %llu,\n", (unsigned long long)LatencyHistogramPercentile(latency, 99.9));
+    fprintf(output, "    \"max\": %llu\n", (unsigned long long)latency->max);
+    fprintf(output, "  }%s\n", last ? "" : ",");
+}
+
+static void WriteReport(FILE* output, const LatencyHistogram* latency, const LatencyHistogram* criticalLatency,
+                        uint64_t sent, uint64_t failed, uint64_t expected, uint64_t received, uint64_t ignored,
+                        uint64_t overruns, int ready, double windowS) {
+    uint64_t lost = expected > received ? expected - received : 0;
+    fprintf(output, "{\n");
+    fprintf(output, "  \"etiqueta\": \"%s\",\n", Options.label);
+    fprintf(output, "  \"fecha_unix\": %llu,\n", (unsigned long long)time(NULL));
+    fprintf(output, "  \"transporte\": \"%s\",\n", TransportName(Options.transport));
+    fprintf(output, "  \"publishers\": %d,\n", Options.publishers);
+    fprintf(output, "  \"subscribers\": %d,\n", Options.subscribers);
+    fprintf(output, "  \"subscribers_listos\": %d,\n", ready);
+    fprintf(output, "  \"topics\": %d,\n", Options.topics);
+    fprintf(output, "  \"ritmo_por_publisher\": %d,\n", Options.rate);
+    fprintf(output, "  \"duracion_s\": %d,\n", Options.durationS);
+    fprintf(output, "  \"enviados\": %llu,\n", (unsigned long long)sent);
+    fprintf(output, "  \"envios_fallidos\": %llu,\n", (unsigned long long)failed);
+    fprintf(output, "  \"esperados\": %llu,\n", (unsigned long long)expected);
+    fprintf(output, "  \"recibidos\": %llu,\n", (unsigned long long)received);
+    fprintf(output, "  \"ignorados\": %llu,\n", (unsigned long long)ignored);
+    fprintf(output, "  \"perdidos\": %llu,\n", (unsigned long long)lost);
+    fprintf(output, "  \"perdida_pct\": %.4f,\n", expected == 0 ? 0.0 : 100.0 * (double)lost / (double)expected);
+    if (Options.transport == BENCH_SHM) {
+        fprintf(output, "  \"desbordes_shm\": %llu,\n", (unsigned long long)overruns);
+    }
+    fprintf(output, "  \"publicados_msgs_s\": %.1f,\n", windowS > 0 ? (double)sent / windowS : 0.0);
+    fprintf(output, "  \"entregados_msgs_s\": %.1f,\n", windowS > 0 ? (double)received / windowS : 0.0);
+    if (Options.criticalPct > 0) {
+        fprintf(output, "  \"criticos_pct\": %d,\n", Options.criticalPct);
+        fprintf(output, "  \"lectura_lenta_ms\": %d,\n", Options.slowReadMs);
+    }
+    WriteLatency(output, "latencia_us", latency, Options.criticalPct == 0);
+    if (Options.criticalPct > 0) {
+        WriteLatency(output, "latencia_criticos_us", criticalLatency, 1);
+    }
+    fprintf(output, "}\n");
+}
+
+static void Report(void) {
+    /* Los histogramas combinados ocupan ~34 KB cada uno: estaticos para no cargar la pila. */
+    static LatencyHistogram latency;
+    static LatencyHistogram criticalLatency;
+    LatencyHistogramInit(&latency);
+    LatencyHistogramInit(&criticalLatency);
+
+    uint64_t* sentPerTopic = (uint64_t*)calloc((size_t)Options.topics, sizeof(uint64_t));
+    uint64_t sent = 0;
+    uint64_t failed = 0;
+    for (int i = 0; i < Options.publishers; ++i) {
+        sent += Publishers[i].sent;
+        failed += Publishers[i].failed;
+        if (sentPerTopic != NULL) {
+            sentPerTopic[Publishers[i].topic] += Publishers[i].sent;
+        }
+    }
+
+    uint64_t expected = 0;
+    uint64_t received = 0;
+    uint64_t ignored = 0;
+    uint64_t overruns = 0;
+    uint64_t lastUs = StartUs;
+    int ready = 0;
+    for (int i = 0; i < Options.subscribers; ++i) {
+        BenchSubscriber* subscriber = &Subscribers[i];
+        if (!subscriber->ready) {
+            continue;
+        }
+        ready++;
+        expected += sentPerTopic != NULL ? sentPerTopic[subscriber->topic] : 0;
+        received += subscriber->received;
+        ignored += subscriber->ignored;
+        overruns += subscriber->reader.lost;
+        if (subscriber->lastReceiveUs > lastUs) {
+            lastUs = subscriber->lastReceiveUs;
+        }
+        LatencyHistogramMerge(&latency, &subscriber->latency);
+        LatencyHistogramMerge(&criticalLatency, &subscriber->criticalLatency);
+    }
+    free(sentPerTopic);
+
+    /* Ventana: desde el primer envio hasta la ultima entrega (o la duracion pedida si no llego nada). */
+    double windowS = lastUs > StartUs ? (double)(lastUs - StartUs) / 1e6 : (double)Options.durationS;
+
+    fprintf(stderr, "[BENCH] %s: %llu enviados, %llu recibidos de %llu esperados, p50 %llu us, p99 %llu us, p99.9 %llu us\n",
+            TransportName(Options.transport), (unsigned long long)sent, (unsigned long long)received,
+            (unsigned long long)expected, (unsigned long long)LatencyHistogramPercentile(&latency, 50.0),
+            (unsigned long long)LatencyHistogramPercentile(&latency, 99.0),
+            (unsigned long long)LatencyHistogramPercentile(&latency, 99.9));
+    if (Options.criticalPct > 0) {
+        fprintf(stderr, "[BENCH] Criticos (%d%%): %llu recibidos, p50 %llu us, p99 %llu us, p99.9 %llu us\n",
+                Options.criticalPct, (unsigned long long)criticalLatency.total,
+                (unsigned long long)LatencyHistogramPercentile(&criticalLatency, 50.0),
+                (unsigned long long)LatencyHistogramPercentile(&criticalLatency, 99.0),
+                (unsigned long long)LatencyHistogramPercentile(&criticalLatency, 99.9));
+    }
+
+    FILE* output = stdout;
+    if (Options.jsonPath != NULL) {
+        output = fopen(Options.jsonPath, "w");
+        if (output == NULL) {
+            fprintf(stderr, "[BENCH] No se pudo escribir %s; el reporte va a la salida estandar.\n", Options.jsonPath);
+            output = stdout;
+        }
+    }
+    WriteReport(output, &latency, &criticalLatency, sent, failed, expected, received, ignored, overruns, ready, windowS);
+    if (output != stdout) {
+        fclose(output);
+        fprintf(stderr, "[BENCH] Reporte JSON en %s\n", Options.jsonPath);
+    }
+}
+
+/* ---------------------------------------------------------------------------------------------------------
+ * Argumentos y ejecucion
+ * --------------------------------------------------------------------------------------------------------- */
+
+static void PrintUsage(const char* program) {
+    fprintf(stderr, "Uso: %s <tcp|udp|quic|shm> <IP_BROKER> <PUERTO> [opciones]\n", program);
+    fprintf(stderr, "  shm: publishers TCP y subscribers por memoria compartida de broker_unificado (misma maquina)\n");
+    fprintf(stderr, "Opciones:\n");
+    fprintf(stderr, "  --publishers M        Publishers concurrentes (por defecto 1)\n");
+    fprintf(stderr, "  --subscribers N       Subscribers concurrentes (por defecto 4)\n");
+    fprintf(stderr, "  --topics T            Topics distintos bench/0..T-1 (por defecto = publishers)\n");
+    fprintf(stderr, "  --ritmo R             Mensajes por segundo de cada publisher (por defecto 100)\n");
+    fprintf(stderr, "  --duracion S          Segundos de publicacion (por defecto 10)\n");
+    fprintf(stderr, "  --calentamiento MS    Espera entre el registro de los subscribers y el primer envio (por defecto 1000)\n");
+    fprintf(stderr, "  --drenado MS          Espera despues del ultimo envio antes de contar (por defecto 2000)\n");
+    fprintf(stderr, "  --corpus DIR          Directorio con los Partido*.txt (por defecto ../TCP)\n");
+    fprintf(stderr, "  --json ARCHIVO        Escribe el reporte JSON en ARCHIVO (por defecto, salida estandar)\n");
+    fprintf(stderr, "  --etiqueta TEXTO      Identifica la corrida en el JSON (por ejemplo, el commit)\n");
+    fprintf(stderr, "  --criticos PCT        Publica PCT%% de los eventos con prioridad alta (y el resto baja) y reporta su latencia aparte\n");
+    fprintf(stderr, "  --lectura-lenta MS    Los subscribers TCP/UDP/SHM esperan MS ms despues de cada lectura (subscribers lentos)\n");
+    fprintf(stderr, "Ejemplo: %s tcp 127.0.0.1 8000 --publishers 2 --subscribers 8 --ritmo 500 --etiqueta $(git rev-parse --short HEAD)\n", program);
+}
+
+static int ParsePositive(const char* text, int* value) {
+    *value = atoi(text);
+    return *value > 0;
+}
+
+static int ParseArguments(int argc, char** argv) {
+    memset(&Options, 0, sizeof(Options));
+    Options.publishers = 1;
+    Options.subscribers = 4;
+    Options.rate = 100;
+    Options.durationS = 10;
+    Options.warmupMs = 1000;
+    Options.drainMs = 2000;
+    Options.corpusDirectory = "../TCP";
+    Options.label = "";
+
+    if (argc < 4) {
+        return 0;
+    }
+    if (strcmp(argv[1], "tcp") == 0) {
+        Options.transport = BENCH_TCP;
+    } else if (strcmp(argv[1], "udp") == 0) {
+        Options.transport = BENCH_UDP;
+    } else if (strcmp(argv[1], "quic") == 0) {
+        Options.transport = BENCH_QUIC;
+    } else if (strcmp(argv[1], "shm") == 0) {
+        Options.transport = BENCH_SHM;
+    } else {
+        fprintf(stderr, "[BENCH] Transporte desconocido: %s\n", argv[1]);
+        return 0;
+    }
+    Options.server = argv[2];
+    int port = atoi(argv[3]);
+    if (port <= 0 || port > 65535) {
+        fprintf(stderr, "[BENCH] Puerto invalido: %s\n", argv[3]);
+        return 0;
+    }
+    Options.port = (uint16_t)port;
+
+    for (int i = 4; i < argc; ++i) {
+        int ok = i + 1 < argc;
+        if (ok && strcmp(argv[i], "--publishers") == 0) {
+            ok = ParsePositive(argv[++i], &Options.publishers);
+        } else if (ok && strcmp(argv[i], "--subscribers") == 0) {
+            ok = ParsePositive(argv[++i], &Options.subscribers);
+        } else if (ok && strcmp(argv[i], "--topics") == 0) {
+            ok = ParsePositive(argv[++i], &Options.topics);
+        } else if (ok && strcmp(argv[i], "--ritmo") == 0) {
+            ok = ParsePositive(argv[++i], &Options.rate) && Options.rate <= 1000000;
+        } else if (ok && strcmp(argv[i], "--duracion") == 0) {
+            ok = ParsePositive(argv[++i], &Options.durationS);
+        } else if (ok && strcmp(argv[i], "--calentamiento") == 0) {
+            Options.warmupMs = atoi(argv[++i]);
+            ok = Options.warmupMs >= 0;
+        } else if (ok && strcmp(argv[i], "--drenado") == 0) {
+            Options.drainMs = atoi(argv[++i]);
+            ok = Options.drainMs >= 0;
+        } else if (ok && strcmp(argv[i], "--corpus") == 0) {
+            Options.corpusDirectory = argv[++i];
+        } else if (ok && strcmp(argv[i], "--json") == 0) {
+            Options.jsonPath = argv[++i];
+        } else if (ok && strcmp(argv[i], "--etiqueta") == 0) {
+            Options.label = argv[++i];
+        } else if (ok && strcmp(argv[i], "--criticos") == 0) {
+            Options.criticalPct = atoi(argv[++i]);
+            ok = Options.criticalPct >= 0 && Options.criticalPct <= 100;
+        } else if (ok && strcmp(argv[i], "--lectura-lenta") == 0) {
+            Options.slowReadMs = atoi(argv[++i]);
+            ok = Options.slowReadMs >= 0;
+        } else {
+            ok = 0;
+        }
+        if (!ok) {
+            fprintf(stderr, "[BENCH] Opcion invalida: %s\n", argv[i]);
+            return 0;
+        }
+    }
+    if (Options.topics == 0) {
+        Options.topics = Options.publishers;
+    }
+    if (UsesTcp() && (Options.publishers > 20 || Options.subscribers > 20)) {
+        fprintf(stderr, "[BENCH] Aviso: el broker TCP acepta a lo sumo 20 publishers y 20 subscribers.\n");
+    }
+    return 1;
+}
+
+static void StopClients(void) {
+    InterlockedDecrement(&Running);
+    for (int i = 0; i < Options.subscribers; ++i) {
+        BenchSubscriber* subscriber = &Subscribers[i];
+        if (subscriber->connection != NULL) {
+            MsQuic->ConnectionShutdown(subscriber->connection, QUIC_CONNECTION_SHUTDOWN_FLAG_NONE, 0);
+        }
+        if (subscriber->threadStarted) {
+            PlatformThreadJoin(subscriber->thread);
+        }
+        if (subscriber->socket != INVALID_SOCKET) {
+            closesocket(subscriber->socket);
+        }
+        ShmRingClose(&subscriber->ring);
+    }
+    for (int i = 0; i < Options.publishers; ++i) {
+        BenchPublisher* publisher = &Publishers[i];
+        if (publisher->connection != NULL) {
+            MsQuic->ConnectionShutdown(publisher->connection, QUIC_CONNECTION_SHUTDOWN_FLAG_NONE, 0);
+        }
+        if (publisher->socket != INVALID_SOCKET) {
+            closesocket(publisher->socket);
+        }
+    }
+    if (Options.transport == BENCH_QUIC && QuicOpened > 0 && QuicClosed < QuicOpened) {
+        WaitForSingleObject(AllClosedEvent, CLOSE_TIMEOUT_MS);
+    }
+    for (int i = 0; i < Options.publishers; ++i) {
+        if (Publishers[i].connectedEvent != NULL) {
+            CloseHandle(Publishers[i].connectedEvent);
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    if (!ParseArguments(argc, argv)) {
+        PrintUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (LoadCorpus(Options.corpusDirectory) == 0) {
+        fprintf(stderr, "[BENCH] No hay eventos en %s (se esperan archivos .txt).\n", Options.corpusDirectory);
+        return EXIT_FAILURE;
+    }
+    RunId = (uint32_t)(PlatformNowUs() ^ (uint64_t)time(NULL));
+
+#ifdef _WIN32
+    WSADATA wsaData;
+    if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
+        fprintf(stderr, "[BENCH] Error al inicializar Winsock.\n");
+        return EXIT_FAILURE;
+    }
+#endif
+    StartEvent = CreateEventA(NULL, TRUE, FALSE, NULL);
+    AllClosedEvent = CreateEventA(NULL, TRUE, FALSE, NULL);
+    Subscribers = (BenchSubscriber*)calloc((size_t)Options.subscribers, sizeof(BenchSubscriber));
+    Publishers = (BenchPublisher*)calloc((size_t)Options.publishers, sizeof(BenchPublisher));
+    if (StartEvent == NULL || AllClosedEvent == NULL || Subscribers == NULL || Publishers == NULL ||
+        (Options.transport == BENCH_QUIC && !InitializeQuic())) {
+        fprintf(stderr, "[BENCH] No se pudo inicializar la corrida.\n");
+        return EXIT_FAILURE;
+    }
+
+    fprintf(stderr, "[BENCH] %s %s:%u, %d publishers x %d msg/s durante %d s, %d subscribers, %d topics, %d eventos de corpus\n",
+            TransportName(Options.transport), Options.server, (unsigned)Options.port, Options.publishers, Options.rate,
+            Options.durationS, Options.subscribers, Options.topics, CorpusCount);
+
+    for (int i = 0; i < Options.subscribers; ++i) {
+        BenchSubscriber* subscriber = &Subscribers[i];
+        subscriber->id = i;
+        subscriber->topic = i % Options.topics;
+        subscriber->socket = INVALID_SOCKET;
+        LatencyHistogramInit(&subscriber->latency);
+        LatencyHistogramInit(&subscriber->criticalLatency);
+        int ok = Options.transport == BENCH_QUIC ? StartQuicSubscriber(subscriber)
+               : Options.transport == BENCH_SHM ? StartShmSubscriber(subscriber)
+               : StartSocketSubscriber(subscriber);
+        if (!ok) {
+            fprintf(stderr, "[BENCH] No se pudo iniciar el subscriber %d.\n", i);
+        }
+    }
+
+    uint64_t waitStartUs = PlatformNowUs();
+    while (ReadyCount < Options.subscribers && PlatformNowUs() - waitStartUs < (uint64_t)READY_TIMEOUT_MS * 1000ULL) {
+        Sleep(10);
+    }
+    fprintf(stderr, "[BENCH] %ld de %d subscribers listos.\n", (long)ReadyCount, Options.subscribers);
+    Sleep((DWORD)Options.warmupMs);
+
+    for (int i = 0; i < Options.publishers; ++i) {
+        BenchPublisher* publisher = &Publishers[i];
+        publisher->id = i;
+        publisher->topic = i % Options.topics;
+        publisher->socket = INVALID_SOCKET;
+        if (!ConnectPublisher(publisher)) {
+            fprintf(stderr, "[BENCH] No se pudo conectar el publisher %d.\n", i);
+            continue;
+        }
+        publisher->threadStarted = PlatformThreadCreate(&publisher->thread, PublisherThread, publisher);
+    }
+
+    StartUs = PlatformNowUs() + 10000;
+    SetEvent(StartEvent);
+    for (int i = 0; i < Options.publishers; ++i) {
+        if (Publishers[i].threadStarted) {
+            PlatformThreadJoin(Publishers[i].thread);
+        }
+    }
+    Sleep((DWORD)Options.drainMs);
+
+    StopClients();
+    Report();
+
+    if (Options.transport == BENCH_QUIC) {
+        CleanupQuic();
+    }
+    CloseHandle(StartEvent);
+    CloseHandle(AllClosedEvent);
+    free(Subscribers);
+    free(Publishers);
+    FreeCorpus();
+#ifdef _WIN32
+    WSACleanup();
+#endif
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,568 @@
+/*
+ * Archivo: replay_pcap.c
+ * Descripcion: Reproduce contra un broker en vivo el trafico de publishers capturado con Wireshark
+ *              (ArchivosWireshark/tcp_pubsub.pcap, udp_pubsub.pcap o cualquier captura de los mismos
+ *              protocolos), con la temporizacion original, acelerada N veces o a la maxima velocidad. Sirve
+ *              para repetir formas de trafico reales al comparar el rendimiento entre commits.
+ *
+ * LECTURA EN FLUJO:
+ *    La captura se lee paquete por paquete con ../common/pcap_stream.h (pcap clasico; enlaces y limites
+ *    descritos alli); en memoria solo queda el paquete actual y el estado de cada flujo, asi que el tamano de la
+ *    captura no importa.
+ *
+ * QUE SE REPRODUCE:
+ *    UDP: cada datagrama que empieza con "PUBLISHER|" se reenvia tal cual.
+ *    TCP: se reensambla cada conexion por numero de secuencia (se descartan retransmisiones y solapes; un hueco
+ *         de la captura descarta la linea incompleta) y se reproduce si sus primeros bytes son "PUBLISHER", como
+ *         decide broker_tcp.c. Cada linea completa (incluido el registro "PUBLISHER|topic") se envia en el
+ *         instante del paquete que la completo, y el FIN del publisher cierra su conexion reproducida.
+ *    Cada flujo capturado usa su propio socket hacia el broker, asi el broker ve tantos publishers como hubo.
+ *    Las suscripciones, respuestas del broker y el trafico ajeno (TLS, mDNS, ...) se ignoran.
+ *
+ * TEMPORIZACION:
+ *    El mensaje con marca t se envia en inicio + (t - t0) / velocidad, con t0 la marca del primer mensaje de la
+ *    pasada. Se duerme hasta ~1 ms antes y se espera activamente el resto. El atraso de cada envio respecto de su
+ *    hora programada se registra en un histograma (../common/latency_histogram.h): si crece, el que no da abasto
+ *    es el reproductor (o el broker, por contrapresion de TCP) y la forma del trafico ya no es la original.
+ *    Con --restampar la hora de cada "PUBLISHER|topic|hora|mensaje" se reemplaza por una marca de origen
+ *    (../common/latency_stamp.h) para que los subscribers midan la latencia por tramo.
+ *
+ * LIBRERIAS UTILIZADAS Y JUSTIFICACION:
+ *
+ * 1. stdio.h (libreria estandar)
+ *    - Por que: Reporte en consola (la captura se lee con ../common/pcap_stream.h).
+ *    - Funciones usadas: printf(), fprintf().
+ *
+ * 2. winsock2.h / ws2tcpip.h (Windows) - sys/socket.h, arpa/inet.h (Linux)
+ *    - Por que: Conexiones TCP y sockets UDP hacia el broker, como publisher_tcp.c y publisher_udp.c.
+ *    - Funciones usadas: socket(), connect(), send(), sendto(), closesocket()/close(), inet_addr(), htons().
+ *
+ * 3. windows.h (via ../QUIC/quic_platform.h; en Linux se emula)
+ *    - Por que: Sleep() con la misma firma en ambas plataformas.
+ *    - Funciones usadas: Sleep().
+ *
+ * 4. stdlib.h / string.h (libreria estandar)
+ *    - Por que: Tabla de flujos, buffers de linea y argumentos.
+ *    - Funciones usadas: calloc(), free(), atoi(), atof(), memcpy(), memcmp(), memchr(), strcmp().
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../QUIC/quic_platform.h"
+#include "../common/latency_histogram.h"
+#include "../common/latency_stamp.h"
+#include "../common/event_priority.h"
+#include "../common/pcap_stream.h"
+
+#ifdef _WIN32
+#include <ws2tcpip.h>
+#pragma comment(lib, "ws2_32.lib")
+#define SEND_FLAGS 0
+#else
+#include <sys/socket.h>
+typedef int SOCKET;
+#define INVALID_SOCKET (-1)
+#define SOCKET_ERROR (-1)
+#define closesocket close
+#define SEND_FLAGS MSG_NOSIGNAL
+#endif
+
+#define MAX_FLOWS 4096
+#define LINE_MAX_LEN 1024
+#define PUBLISHER_PREFIX "PUBLISHER"
+#define PUBLISHER_PREFIX_LEN 9
+#define SPIN_THRESHOLD_US 1500
+
+typedef enum ReplayMode {
+    REPLAY_TIMED = 0,
+    REPLAY_MAX_RATE
+} ReplayMode;
+
+typedef struct ReplayOptions {
+    const char* capturePath;
+    const char* server;
+    uint16_t port;
+    ReplayMode mode;
+    double speed;
+    int transport;
+    int capturePort;
+    int repeat;
+    int restamp;
+    int verbose;
+} ReplayOptions;
+
+typedef enum FlowState {
+    FLOW_UNKNOWN = 0,
+    FLOW_PUBLISHER,
+    FLOW_IGNORED,
+    FLOW_CLOSED
+} FlowState;
+
+/* Un flujo capturado (sentido cliente -> broker) y su reproduccion. */
+typedef struct ReplayFlow {
+    int inUse;
+    PcapFlowKey key;
+    FlowState state;
+    PcapTcpStream tcp;
+    int skipToNewline;
+    uint32_t lineLength;
+    char line[LINE_MAX_LEN];
+    SOCKET socket;
+    int connectFailed;
+} ReplayFlow;
+
+typedef struct ReplayStats {
+    uint64_t packets;
+    uint64_t messages;
+    uint64_t bytes;
+    uint64_t sendFailures;
+    uint64_t retransmissions;
+    uint64_t gaps;
+    uint64_t longLines;
+    uint64_t ignoredPackets;
+    uint64_t skippedPackets;
+    int flows;
+    LatencyHistogram lag;
+} ReplayStats;
+
+typedef struct ReplayRun {
+    ReplayOptions* options;
+    struct sockaddr_in broker;
+    ReplayFlow* flows;
+    int flowCount;
+    int transport;
+    int started;
+    uint64_t firstCaptureUs;
+    uint64_t startUs;
+    ReplayStats stats;
+} ReplayRun;
+
+/* ---------------------------------------------------------------------------------------------------------
+ * Flujos y envio
+ * --------------------------------------------------------------------------------------------------------- */
+
+static ReplayFlow* FindFlow(ReplayRun* run, const PcapFlowKey* key) {
+    uint32_t hash = PcapFlowHash(key);
+    for (uint32_t probe = 0; probe < MAX_FLOWS; ++probe) {
+        ReplayFlow* flow = &run->flows[(hash + probe) % MAX_FLOWS];
+        if (!flow->inUse) {
+            if (run->flowCount >= MAX_FLOWS * 3 / 4) {
+                return NULL;
+            }
+            memset(flow, 0, sizeof(*flow));
+            flow->inUse = 1;
+            flow->key = *key;
+            flow->socket = INVALID_SOCKET;
+            run->flowCount++;
+            return flow;
+        }
+        if (PcapFlowEquals(&flow->key, key)) {
+            return flow;
+        }
+    }
+    return NULL;
+}
+
+static void CloseFlowSocket(ReplayFlow* flow) {
+    if (flow->socket != INVALID_SOCKET) {
+        closesocket(flow->socket);
+        flow->socket = INVALID_SOCKET;
+    }
+}
+
+static int OpenFlowSocket(ReplayRun* run, ReplayFlow* flow) {
+    if (flow->socket != INVALID_SOCKET) {
+        return 1;
+    }
+    if (flow->connectFailed) {
+        return 0;
+    }
+    int tcp = flow->key.protocol == PCAP_PROTOCOL_TCP;
+    flow->socket = socket(AF_INET, tcp ? SOCK_STREAM : SOCK_DGRAM, tcp ? IPPROTO_TCP : IPPROTO_UDP);
+    if (flow->socket == INVALID_SOCKET) {
+        flow->connectFailed = 1;
+        return 0;
+    }
+    if (tcp && connect(flow->socket, (struct sockaddr*)&run->broker, sizeof(run->broker)) == SOCKET_ERROR) {
+        fprintf(stderr, "[REPLAY] No se pudo conectar el flujo %u -> %u al broker\n",
+                (unsigned)flow->key.sourcePort, (unsigned)flow->key.destinationPort);
+        closesocket(flow->socket);
+        flow->socket = INVALID_SOCKET;
+        flow->connectFailed = 1;
+        return 0;
+    }
+    run->stats.flows++;
+    return 1;
+}
+
+/* Espera hasta la hora programada del mensaje capturado en captureUs y registra el atraso. */
+static void WaitForSchedule(ReplayRun* run, uint64_t captureUs) {
+    uint64_t nowUs = LatencyStampNowNs() / 1000ULL;
+    if (!run->started) {
+        run->started = 1;
+        run->firstCaptureUs = captureUs;
+        run->startUs = nowUs;
+    }
+    if (run->options->mode == REPLAY_MAX_RATE) {
+        return;
+    }
+
+    uint64_t offsetUs = captureUs > run->firstCaptureUs ? captureUs - run->firstCaptureUs : 0;
+    uint64_t targetUs = run->startUs + (uint64_t)((double)offsetUs / run->options->speed);
+    while (nowUs < targetUs) {
+        uint64_t remainingUs = targetUs - nowUs;
+        Sleep(remainingUs > SPIN_THRESHOLD_US ? (DWORD)((remainingUs - 1000) / 1000) : 0);
+        nowUs = LatencyStampNowNs() / 1000ULL;
+    }
+    LatencyHistogramRecord(&run->stats.lag, nowUs - targetUs);
+}
+
+/* "PUBLISHER|topic|hora|mensaje" -> misma linea con una marca de origen nueva como hora (conserva la prioridad). */
+static uint32_t Restamp(const char* message, uint32_t length, char* output) {
+    const char* end = message + length;
+    const char* topic = (const char*)memchr(message, '|', length);
+    const char* hour = topic != NULL ? (const char*)memchr(topic + 1, '|', (size_t)(end - topic - 1)) : NULL;
+    const char* body = hour != NULL ? (const char*)memchr(hour + 1, '|', (size_t)(end - hour - 1)) : NULL;
+    if (body == NULL) {
+        memcpy(output, message, length);
+        return length;
+    }
+    uint32_t head = (uint32_t)(hour + 1 - message);
+    if (hour + 1 < body && (hour[1] == EVENT_PRIORITY_MARK_HIGH || hour[1] == EVENT_PRIORITY_MARK_LOW)) {
+        head++;
+    }
+    uint32_t tail = (uint32_t)(end - body);
+    if (head + LATENCY_STAMP_ORIGIN_LEN + tail > LINE_MAX_LEN) {
+        memcpy(output, message, length);
+        return length;
+    }
+    char stamp[LATENCY_STAMP_ORIGIN_LEN + 1];
+    LatencyStampOrigin(stamp);
+    memcpy(output, message, head);
+    memcpy(output + head, stamp, LATENCY_STAMP_ORIGIN_LEN);
+    memcpy(output + head + LATENCY_STAMP_ORIGIN_LEN, body, tail);
+    return head + LATENCY_STAMP_ORIGIN_LEN + tail;
+}
+
+static void SendMessage(ReplayRun* run, ReplayFlow* flow, uint64_t captureUs, const char* message, uint32_t length) {
+    char restamped[LINE_MAX_LEN];
+    if (!OpenFlowSocket(run, flow)) {
+        run->stats.sendFailures++;
+        return;
+    }
+    if (run->options->restamp) {
+        length = Restamp(message, length, restamped);
+        message = restamped;
+    }
+    WaitForSchedule(run, captureUs);
+
+    int sent;
+    if (flow->key.protocol == PCAP_PROTOCOL_TCP) {
+        sent = send(flow->socket, message, (int)length, SEND_FLAGS) == (int)length;
+    } else {
+        sent = sendto(flow->socket, message, (int)length, 0, (struct sockaddr*)&run->broker, sizeof(run->broker)) == (int)length;
+    }
+    if (!sent) {
+        run->stats.sendFailures++;
+        if (flow->key.protocol == PCAP_PROTOCOL_TCP) {
+            /* El broker cerro la conexion: el resto del flujo se descarta. */
+            CloseFlowSocket(flow);
+            flow->connectFailed = 1;
+        }
+        return;
+    }
+    run->stats.messages++;
+    run->stats.bytes += length;
+    if (run->options->verbose) {
+        printf("[REPLAY] %u -> %.*s\n", (unsigned)flow->key.sourcePort, (int)length, message);
+    }
+}
+
+static void ProcessUdp(ReplayRun* run, const PcapPacket* info) {
+    if (info->payloadLength < PUBLISHER_PREFIX_LEN + 1 ||
+        memcmp(info->payload, PUBLISHER_PREFIX "|", PUBLISHER_PREFIX_LEN + 1) != 0 ||
+        info->payloadLength > LINE_MAX_LEN) {
+        run->stats.ignoredPackets++;
+        return;
+    }
+    ReplayFlow* flow = FindFlow(run, &info->key);
+    if (flow == NULL) {
+        run->stats.ignoredPackets++;
+        return;
+    }
+    SendMessage(run, flow, info->timeUs, (const char*)info->payload, info->payloadLength);
+}
+
+/* Agrega bytes en orden al flujo y envia cada linea completa. */
+static void AppendTcpBytes(ReplayRun* run, ReplayFlow* flow, uint64_t timeUs, const uint8_t* data, uint32_t length) {
+    for (uint32_t i = 0; i < length; ++i) {
+        char c = (char)data[i];
+        if (flow->skipToNewline) {
+            flow->skipToNewline = c != '\n';
+            continue;
+        }
+        if (flow->lineLength == LINE_MAX_LEN) {
+            run->stats.longLines++;
+            flow->lineLength = 0;
+            flow->skipToNewline = c != '\n';
+            continue;
+        }
+        flow->line[flow->lineLength++] = c;
+
+        if (flow->state == FLOW_UNKNOWN && (flow->lineLength == PUBLISHER_PREFIX_LEN || c == '\n')) {
+            /* Igual que broker_tcp.c: el primer mensaje decide si la conexion es de un publisher. */
+            flow->state = flow->lineLength == PUBLISHER_PREFIX_LEN &&
+                                  memcmp(flow->line, PUBLISHER_PREFIX, PUBLISHER_PREFIX_LEN) == 0
+                              ? FLOW_PUBLISHER
+                              : FLOW_IGNORED;
+            if (flow->state == FLOW_IGNORED) {
+                return;
+            }
+        }
+        if (c == '\n') {
+            SendMessage(run, flow, timeUs, flow->line, flow->lineLength);
+            flow->lineLength = 0;
+        }
+    }
+}
+
+static void ProcessTcp(ReplayRun* run, const PcapPacket* info) {
+    ReplayFlow* flow = FindFlow(run, &info->key);
+    if (flow != NULL && (info->tcpFlags & PCAP_TCP_SYN) && flow->state != FLOW_UNKNOWN) {
+        /* Conexion nueva con el mismo puerto de origen que una anterior. */
+        CloseFlowSocket(flow);
+        flow->state = FLOW_UNKNOWN;
+        flow->lineLength = 0;
+        flow->skipToNewline = 0;
+        flow->connectFailed = 0;
+    }
+    if (flow == NULL || flow->state == FLOW_IGNORED || flow->state == FLOW_CLOSED) {
+        run->stats.ignoredPackets++;
+        return;
+    }
+
+    const uint8_t* data;
+    uint32_t length;
+    PcapTcpResult result = PcapTcpAccept(&flow->tcp, info, &data, &length);
+    if (result == PCAP_TCP_RETRANSMISSION) {
+        run->stats.retransmissions++;
+    } else if (result == PCAP_TCP_GAP) {
+        /* Faltan bytes en la captura: la linea en curso queda incompleta. */
+        run->stats.gaps++;
+        flow->lineLength = 0;
+        flow->skipToNewline = 1;
+    }
+    if (length > 0) {
+        AppendTcpBytes(run, flow, info->timeUs, data, length);
+    }
+
+    if ((info->tcpFlags & (PCAP_TCP_FIN | PCAP_TCP_RST)) && flow->state != FLOW_IGNORED) {
+        CloseFlowSocket(flow);
+        flow->state = FLOW_CLOSED;
+    }
+}
+
+/* ---------------------------------------------------------------------------------------------------------
+ * Pasadas y reporte
+ * --------------------------------------------------------------------------------------------------------- */
+
+static int ReplayPass(ReplayRun* run) {
+    PcapReader reader;
+    if (!PcapOpen(&reader, run->options->capturePath, "[REPLAY]")) {
+        return 0;
+    }
+
+    memset(run->flows, 0, MAX_FLOWS * sizeof(ReplayFlow));
+    run->flowCount = 0;
+    run->started = 0;
+    run->transport = run->options->transport;
+
+    uint64_t timeUs;
+    uint32_t length;
+    int result;
+    PcapPacket info;
+    while ((result = PcapNext(&reader, &timeUs, &length)) == 1) {
+        run->stats.packets++;
+        if (!PcapDecode(&reader, timeUs, length, &info)) {
+            run->stats.ignoredPackets++;
+            continue;
+        }
+        if (run->options->capturePort > 0 && info.key.destinationPort != run->options->capturePort) {
+            run->stats.ignoredPackets++;
+            continue;
+        }
+        /* Sin --transporte se reproduce el protocolo del primer mensaje de publisher de la captura. */
+        if (run->transport == 0 && info.payloadLength > PUBLISHER_PREFIX_LEN &&
+            memcmp(info.payload, PUBLISHER_PREFIX, PUBLISHER_PREFIX_LEN) == 0) {
+            run->transport = info.key.protocol;
+        }
+        if (info.key.protocol != run->transport && !(run->transport == 0 && info.key.protocol == PCAP_PROTOCOL_TCP)) {
+            run->stats.ignoredPackets++;
+            continue;
+        }
+        if (info.key.protocol == PCAP_PROTOCOL_TCP) {
+            ProcessTcp(run, &info);
+        } else {
+            ProcessUdp(run, &info);
+        }
+    }
+    if (result < 0) {
+        fprintf(stderr, "[REPLAY] La captura termina en medio de un paquete; se reprodujo hasta ahi.\n");
+    }
+    run->stats.skippedPackets = reader.skippedPackets;
+
+    for (int i = 0; i < MAX_FLOWS; ++i) {
+        if (run->flows[i].inUse) {
+            CloseFlowSocket(&run->flows[i]);
+        }
+    }
+    PcapClose(&reader);
+    return 1;
+}
+
+static void PrintReport(const ReplayRun* run, int pass, uint64_t elapsedUs) {
+    const ReplayStats* stats = &run->stats;
+    double seconds = (double)elapsedUs / 1e6;
+    printf("[REPLAY] Pasada %d: %llu mensajes (%llu bytes) de %d flujos en %.2f s (%.1f msg/s)\n", pass,
+           (unsigned long long)stats->messages, (unsigned long long)stats->bytes, stats->flows, seconds,
+           seconds > 0 ? (double)stats->messages / seconds : 0.0);
+    if (stats->lag.total > 0) {
+        printf("[REPLAY] Atraso respecto de la captura: p50 %llu us, p99 %llu us, max %llu us\n",
+               (unsigned long long)LatencyHistogramPercentile(&stats->lag, 50.0),
+               (unsigned long long)LatencyHistogramPercentile(&stats->lag, 99.0), (unsigned long long)stats->lag.max);
+    }
+    printf("[REPLAY] Paquetes %llu (ignorados %llu, omitidos %llu), retransmisiones %llu, huecos %llu, "
+           "lineas largas %llu, fallos de envio %llu\n",
+           (unsigned long long)stats->packets, (unsigned long long)stats->ignoredPackets,
+           (unsigned long long)stats->skippedPackets, (unsigned long long)stats->retransmissions,
+           (unsigned long long)stats->gaps, (unsigned long long)stats->longLines,
+           (unsigned long long)stats->sendFailures);
+}
+
+static void PrintUsage(const char* program) {
+    fprintf(stderr, "Uso: %s <CAPTURA.pcap> <IP_BROKER> <PUERTO_BROKER> [opciones]\n", program);
+    fprintf(stderr, "Opciones:\n");
+    fprintf(stderr, "  --velocidad N          Reproduce N veces mas rapido que la captura (por defecto 1 = original)\n");
+    fprintf(stderr, "  --max                  Sin esperas: envia todo tan rapido como acepte el broker\n");
+    fprintf(stderr, "  --transporte tcp|udp   Protocolo a reproducir (por defecto el del primer publisher capturado)\n");
+    fprintf(stderr, "  --puerto-captura P     Solo flujos hacia el puerto P en la captura (por ejemplo 8000 o 5000)\n");
+    fprintf(stderr, "  --repetir N            Reproduce la captura N veces seguidas (por defecto 1)\n");
+    fprintf(stderr, "  --restampar            Reemplaza la hora de cada mensaje por una marca de origen nueva\n");
+    fprintf(stderr, "  --verbose              Imprime cada mensaje enviado\n");
+    fprintf(stderr, "Ejemplo: %s ../ArchivosWireshark/tcp_pubsub.pcap 127.0.0.1 8000 --velocidad 10\n", program);
+}
+
+static int ParseArguments(int argc, char** argv, ReplayOptions* options) {
+    memset(options, 0, sizeof(*options));
+    options->speed = 1.0;
+    options->repeat = 1;
+    if (argc < 4) {
+        return 0;
+    }
+    options->capturePath = argv[1];
+    options->server = argv[2];
+    int port = atoi(argv[3]);
+    if (port <= 0 || port > 65535) {
+        fprintf(stderr, "[REPLAY] Puerto invalido: %s\n", argv[3]);
+        return 0;
+    }
+    options->port = (uint16_t)port;
+
+    for (int i = 4; i < argc; ++i) {
+        if (strcmp(argv[i], "--velocidad") == 0 && i + 1 < argc) {
+            options->speed = atof(argv[++i]);
+            if (options->speed <= 0.0) {
+                fprintf(stderr, "[REPLAY] Velocidad invalida: %s\n", argv[i]);
+                return 0;
+            }
+        } else if (strcmp(argv[i], "--max") == 0) {
+            options->mode = REPLAY_MAX_RATE;
+        } else if (strcmp(argv[i], "--transporte") == 0 && i + 1 < argc) {
+            const char* transport = argv[++i];
+            if (strcmp(transport, "tcp") == 0) {
+                options->transport = PCAP_PROTOCOL_TCP;
+            } else if (strcmp(transport, "udp") == 0) {
+                options->transport = PCAP_PROTOCOL_UDP;
+            } else {
+                fprintf(stderr, "[REPLAY] Transporte desconocido: %s\n", transport);
+                return 0;
+            }
+        } else if (strcmp(argv[i], "--puerto-captura") == 0 && i + 1 < argc) {
+            options->capturePort = atoi(argv[++i]);
+            if (options->capturePort <= 0 || options->capturePort > 65535) {
+                fprintf(stderr, "[REPLAY] Puerto de captura invalido: %s\n", argv[i]);
+                return 0;
+            }
+        } else if (strcmp(argv[i], "--repetir") == 0 && i + 1 < argc) {
+            options->repeat = atoi(argv[++i]);
+            if (options->repeat <= 0) {
+                fprintf(stderr, "[REPLAY] Cantidad de repeticiones invalida: %s\n", argv[i]);
+                return 0;
+            }
+        } else if (strcmp(argv[i], "--restampar") == 0) {
+            options->restamp = 1;
+        } else if (strcmp(argv[i], "--verbose") == 0) {
+            options->verbose = 1;
+        } else {
+            fprintf(stderr, "[REPLAY] Opcion desconocida o incompleta: %s\n", argv[i]);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int main(int argc, char** argv) {
+    ReplayOptions options;
+    if (!ParseArguments(argc, argv, &options)) {
+        PrintUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+#ifdef _WIN32
+    WSADATA wsaData;
+    if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
+        fprintf(stderr, "[REPLAY] Error al inicializar Winsock.\n");
+        return EXIT_FAILURE;
+    }
+#endif
+
+    /* ~4.5 MB de flujos y ~70 KB de histograma: fuera de la pila. */
+    ReplayRun* run = (ReplayRun*)calloc(1, sizeof(ReplayRun));
+    ReplayFlow* flows = (ReplayFlow*)calloc(MAX_FLOWS, sizeof(ReplayFlow));
+    if (run == NULL || flows == NULL) {
+        fprintf(stderr, "[REPLAY] Sin memoria para la tabla de flujos.\n");
+        free(run);
+        free(flows);
+        return EXIT_FAILURE;
+    }
+    run->options = &options;
+    run->flows = flows;
+    run->broker.sin_family = AF_INET;
+    run->broker.sin_port = htons(options.port);
+    run->broker.sin_addr.s_addr = inet_addr(options.server);
+
+    int status = EXIT_SUCCESS;
+    for (int pass = 1; pass <= options.repeat; ++pass) {
+        memset(&run->stats, 0, sizeof(run->stats));
+        LatencyHistogramInit(&run->stats.lag);
+        uint64_t beginUs = LatencyStampNowNs() / 1000ULL;
+        if (!ReplayPass(run)) {
+            status = EXIT_FAILURE;
+            break;
+        }
+        PrintReport(run, pass, LatencyStampNowNs() / 1000ULL - beginUs);
+        if (run->stats.messages == 0) {
+            fprintf(stderr, "[REPLAY] La captura no contiene mensajes de publisher reproducibles.\n");
+            status = EXIT_FAILURE;
+            break;
+        }
+    }
+
+    free(flows);
+    free(run);
+#ifdef _WIN32
+    WSACleanup();
+#endif
+    return status;
+}
@@ -9,7 +9,8 @@
  *      streams multiplexados y TLS 1.3 integrado.
  *    - Funciones usadas: MsQuicOpen(), MsQuicClose(), MsQuic->RegistrationOpen(), MsQuic->ConfigurationOpen(),
  *      MsQuic->ConfigurationLoadCredential(), MsQuic->ListenerOpen(), MsQuic->ListenerStart(),
- *      MsQuic->SetCallbackHandler(), MsQuic->ConnectionSetConfiguration(), MsQuic->StreamSend().
+ *      MsQuic->SetCallbackHandler(), MsQuic->ConnectionSetConfiguration(), MsQuic->StreamSend(),
+ *      MsQuic->StreamOpen(), MsQuic->StreamStart(), MsQuic->GetParam(), MsQuic->SetParam().
  *    - Alternativa considerada: Implementar QUIC manualmente sobre UDP; descartado por el alcance (>10k lineas) y riesgos.
  *
  * 2. stdio.h (libreria estandar)
@@ -24,32 +25,118 @@
  *    - Por que: Manipulacion de cadenas para procesar topics y mensajes.
  *    - Funciones usadas: strlen(), strcpy(), strncpy(), strcmp(), strtok(), memset().
  *
- * 5. windows.h
+ * 5. windows.h (via quic_platform.h; en Linux se emula sobre pthreads)
  *    - Por que: Necesario para sincronizacion con CRITICAL_SECTION utilizada al compartir la tabla de subscriptores
  *      entre callbacks concurrentes de msquic.
  *    - Funciones usadas: InitializeCriticalSection(), EnterCriticalSection(), LeaveCriticalSection(),
  *      DeleteCriticalSection(), Sleep().
  *    - Alternativa considerada: Implementar spinlocks manualmente; descartado para evitar condiciones de carrera.
  *
- * 6. wincrypt.h
+ * 6. wincrypt.h (solo Windows)
  *    - Por que: Permite importar certificados PKCS#12 (PFX) via PFXImportCertStore y obtener PCCERT_CONTEXT requerido por msquic.
  *    - Funciones usadas: PFXImportCertStore(), CertEnumCertificatesInStore(), CertFreeCertificateContext(), CertCloseStore().
  *    - Alternativa considerada: Cargar certificados manualmente usando APIs de bajo nivel; descartado para aprovechar utilidades CryptoAPI ya disponibles.
+ *    - En Linux el PFX se entrega a msquic como QUIC_CREDENTIAL_TYPE_CERTIFICATE_PKCS12, y tambien se aceptan
+ *      certificado y llave PEM (QUIC_CREDENTIAL_TYPE_CERTIFICATE_FILE) con --cert/--key.
  *
- * 7. winsock2.h
+ * 7. winsock2.h (arpa/inet.h en Linux)
  *    - Por que: Conversiones de orden de bytes y definiciones de INADDR_ANY requeridas al configurar el listener.
  *    - Funciones usadas: htons(), htonl().
  *    - Alternativa considerada: Reimplementar conversiones de endianess; descartado para reducir errores.
+ *
+ * OPCIONES DE EJECUCION:
+ *    --perfil latencia|throughput  Perfil de ejecucion de msquic (QUIC_EXECUTION_PROFILE_LOW_LATENCY por defecto,
+ *                                  o QUIC_EXECUTION_PROFILE_TYPE_MAX_THROUGHPUT para maximizar mensajes por segundo).
+ *    --ticket-key <archivo>        Llave (48 bytes: 16 de Id + 32 de material) para cifrar los tickets de reanudacion.
+ *                                  Sin ella msquic genera una llave aleatoria y los tickets no sobreviven a un reinicio.
+ *    --workers N                   Hilos de enrutamiento (por defecto 2; 0 enruta dentro del callback de msquic).
+ *    --cola N                      Capacidad de la cola de cada worker (potencia de dos, por defecto 1024).
+ *    --reporte S                   Segundos entre reportes del pipeline (por defecto 10; 0 los desactiva).
+ *    --verbose                     Imprime cada RECEIVE y cada evento enrutado.
+ *    --lote-ms N                   Agrupa los envios a cada subscriptor durante N ms (0 = desactivado).
+ *    --max-subscriptores N         Limite de la tabla de subscriptores (por defecto 131072); la tabla crece bajo demanda.
+ *    --retener N                   Mensajes retenidos por topic para subscriptores que llegan tarde (por defecto 8;
+ *                                  0 = desactivado).
+ *    --registro DIR                Guarda cada evento en un registro persistente por topic (../common/event_log.h).
+ *    --fsync no|grupo|siempre      Politica de sincronizacion del registro (por defecto grupo).
+ *    --fsync-ms N                  Intervalo del commit agrupado (por defecto 50 ms).
+ *    --metricas PUERTO             Endpoint HTTP de metricas en formato Prometheus, solo en 127.0.0.1.
+ *    --grupos carga|turno          Reparto dentro de los grupos de consumo "$share/<grupo>/<filtro>" (por defecto carga).
+ *
+ * PIPELINE DE ENRUTAMIENTO:
+ *    El callback de msquic solo separa y valida el mensaje del publisher y lo encola (RoutingQueue, cola MPMC
+ *    acotada y sin locks); los workers hacen el fan-out. Asi el hilo de msquic vuelve de inmediato a procesar
+ *    ACKs y otras conexiones. Cada topic se asigna siempre al mismo worker (hash del topic), lo que conserva el
+ *    orden de los eventos de un partido. Si la cola esta llena el callback no espera: consume el RECEIVE solo
+ *    hasta el mensaje rechazado y detiene la recepcion del stream (StreamReceiveSetEnabled), con lo que msquic
+ *    deja de abrir la ventana de flujo del publisher. El worker reanuda esos streams cuando su cola baja a la
+ *    mitad y msquic vuelve a entregar lo pendiente. Cada rechazo se cuenta como desborde.
+ *
+ * ENVIO AGRUPADO (--lote-ms):
+ *    Cada subscriptor retiene su ultimo mensaje pendiente. Al llegar uno nuevo, el retenido se entrega a msquic con
+ *    QUIC_SEND_FLAG_DELAY_SEND (se encola sin generar paquetes) y el nuevo pasa a ser el retenido. Un hilo de
+ *    descarga envia cada N ms el mensaje retenido sin la bandera, lo que obliga a msquic a transmitir todo lo
+ *    acumulado en ese stream: varios eventos comparten paquete UDP y cifrado. Los mensajes hacia subscriptores
+ *    terminan en '\n' para que el cliente pueda separarlos.
+ *
+ * ESTADO POR CONEXION:
+ *    Pensado para ~100k subscriptores casi inactivos. Topics y suscripciones viven en el nucleo de enrutamiento
+ *    comun (../common/routing.h): cada topic se interna una vez y cada suscripcion es una RoutingEntry enlazada
+ *    con las demas de su topic, de modo que el fan-out recorre solo los subscriptores del topic y el alta/baja es
+ *    O(1). El estado del envio agrupado (SubscriberBatch) es el estado extra de cada entrada. El buffer de
+ *    recepcion de cada stream solo existe mientras hay un mensaje partido entre dos RECEIVE.
+ *
+ * MENSAJES RETENIDOS (--retener):
+ *    El nucleo de enrutamiento guarda los ultimos N mensajes de cada topic en un anillo fijo. Un subscriptor nuevo
+ *    (o que cambia de topic) los recibe justo despues de SUBSCRIBED, concatenados en un unico StreamSend; el alta,
+ *    la confirmacion y el reenvio ocurren con SubscribersLock tomado, asi ningun evento en vivo se intercala.
+ *
+ * REGISTRO PERSISTENTE (--registro):
+ *    Los workers agregan cada evento al registro del topic (un memcpy al segmento mapeado, con SubscribersLock
+ *    tomado). Un cliente que envia REPLAY|<topic>|<offset o @hora_ms> queda suscrito y recibe primero el historial:
+ *    cada tramo del segmento se entrega a StreamSend apuntando directamente al mapeo, sin copiarlo (el envio tiene
+ *    un pin sobre el segmento hasta SEND_COMPLETE, asi la retencion no lo borra). Con --fsync grupo un hilo captura los tramos pendientes con el lock
+ *    y los sincroniza fuera de el, de modo que el disco nunca frena a los workers.
+ *
+ * MARCAS DE LATENCIA:
+ *    Si la hora del publisher es una marca de origen "#<ns>" (../common/latency_stamp.h), el broker la reenvia
+ *    como "#<origen>#<ingreso>", con el ingreso tomado al separar el mensaje en el callback. El subscriptor
+ *    separa asi la latencia publisher->broker de la latencia broker->subscriptor (cola, fan-out y envio).
+ *
+ * GRUPOS DE CONSUMO (--grupos):
+ *    Varios subscriptores con SUBSCRIBER|$share/<grupo>/<filtro> se reparten el flujo: cada mensaje llega a un solo
+ *    miembro (../common/routing.h). Con "carga" se elige el miembro con menos envios pendientes en msquic (los
+ *    SendContext aun sin SEND_COMPLETE, incluido el retenido por --lote-ms), asi un subscriptor lento deja de
+ *    recibir hasta ponerse al dia; con "turno" se reparte por turno sin mirar la cola.
+ *
+ * PRIORIDAD DE EVENTOS:
+ *    El publisher marca cada evento como alta, normal o baja (../common/event_priority.h). Si el subscriptor
+ *    habilita streams unidireccionales del servidor (PeerUnidiStreamCount), al registrarse el broker le abre un
+ *    stream unidireccional con QUIC_PARAM_STREAM_PRIORITY al maximo: msquic atiende primero los streams de mayor
+ *    prioridad al armar cada paquete, asi un gol no espera detras de los eventos ya encolados en el stream
+ *    principal. Los eventos de alta prioridad salen por ese stream de inmediato, sin pasar por --lote-ms; un
+ *    subscriptor que no lo habilita los recibe por su stream de siempre.
+ *
+ * METRICAS (--metricas):
+ *    Cada worker (y cada hilo de msquic que enruta o registra latencias) lleva sus propios contadores en
+ *    ../common/metrics.h; el endpoint los suma al responder, sin locks en el camino de los eventos. La
+ *    profundidad de las colas de enrutamiento se calcula en ese momento con el callback refresh.
  */
 
 #include <msquic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <windows.h>
+#include <stdatomic.h>
+#include "quic_platform.h"
+#include "../common/routing.h"
+#include "../common/event_log.h"
+#include "../common/latency_stamp.h"
+#include "../common/metrics.h"
+
+#ifdef _WIN32
 #include <wincrypt.h>
 #include <ncrypt.h>
-#include <winsock2.h>
 
 #ifndef PKCS12_ALLOW_EXPORT
 #define PKCS12_ALLOW_EXPORT 0x00000002
@@ -60,10 +147,22 @@
 #ifndef PKCS12_ALWAYS_CNG_KSP
 #define PKCS12_ALWAYS_CNG_KSP 0x00000080
 #endif
+#endif /* _WIN32 */
 
-#define MAX_SUBSCRIBERS 128
-#define TOPIC_NAME_LEN 64
 #define MESSAGE_MAX_LEN 512
+#define INITIAL_SUBSCRIBER_CAPACITY 1024
+#define DEFAULT_MAX_SUBSCRIBERS 131072
+#define PEER_BIDI_STREAMS 256
+#define PRIORITY_STREAM_PRIORITY 0xFFFF
+#define NO_INDEX ROUTING_NO_INDEX
+#define DEFAULT_ROUTING_WORKERS 2
+#define DEFAULT_ROUTING_QUEUE_CAPACITY 1024
+#define DEFAULT_REPORT_INTERVAL_S 10
+#define SEND_STATS_SAMPLE_US 100000
+#define DEFAULT_RETAINED_MESSAGES 8
+#define DEFAULT_LOG_SYNC_MS 50
+#define LOG_SYNC_BATCH 64
+#define CACHE_LINE_SIZE 64
 
 typedef enum ClientType {
     CLIENT_UNKNOWN = 0,
@@ -71,47 +170,175 @@ typedef enum ClientType {
     CLIENT_SUBSCRIBER
 } ClientType;
 
+typedef enum PriorityStreamState {
+    PRIORITY_STREAM_UNTRIED = 0,
+    PRIORITY_STREAM_OPEN,
+    PRIORITY_STREAM_UNAVAILABLE
+} PriorityStreamState;
+
+/*
+ * Estado por conexion, minimo para sostener ~100k subscriptores casi inactivos: el topic vive en la tabla de
+ * topics internados y la suscripcion se ubica por indice en la tabla de subscriptores.
+ */
 typedef struct ClientContext {
-    ClientType type;
-    char topic[TOPIC_NAME_LEN];
     HQUIC connection;
-    HQUIC activeStream;
-    int subscribed;
+    int32_t subscriberIndex;
+    uint8_t type;
+    atomic_uint pendingSends;   /* Envios del fan-out aun no completados; lo usa el reparto por carga. */
+    uint8_t priorityState;      /* PriorityStreamState; priorityStream se lee y se limpia con SubscribersLock. */
+    HQUIC priorityStream;       /* Stream unidireccional para los eventos de alta prioridad (o NULL). */
+    uint64_t sentPackets;       /* Ultima lectura de QUIC_STATISTICS_V2; solo la toca el hilo de msquic de la conexion. */
+    uint64_t sentBytes;
+    uint64_t statsSampledUs;
 } ClientContext;
 
-typedef struct SubscriberEntry {
-    int inUse;
-    char topic[TOPIC_NAME_LEN];
-    HQUIC connection;
-    HQUIC stream;
-    ClientContext* client;
-} SubscriberEntry;
+/*
+ * msquic conserva el puntero al QUIC_BUFFER hasta SEND_COMPLETE, por eso vive dentro del contexto. Los envios del
+ * registro persistente apuntan al segmento mapeado y no son duenos de su buffer: guardan el segmento con un pin.
+ */
+typedef struct SendContext {
+    QUIC_BUFFER quicBuffer;
+    uint8_t* buffer;
+    uint32_t length;
+    uint8_t ownsBuffer;
+    ClientContext* queuedFor;   /* Conexion a la que se descuenta el envio al liberarlo (o NULL). */
+    EventLogSegment* segment;   /* Segmento del registro al que apunta buffer (o NULL). */
+} SendContext;
 
+/*
+ * Estado del envio agrupado de cada suscripcion, guardado como estado extra de la tabla de enrutamiento
+ * (RoutingEntryExtra). En la RoutingEntry, handle es el stream del subscriptor y owner su ClientContext.
+ */
+typedef struct SubscriberBatch {
+    SendContext* heldBack;
+    uint64_t heldSinceUs;
+    uint32_t heldCount;
+    uint8_t pendingFlush;
+} SubscriberBatch;
+
+/* receiveBuffer solo se reserva mientras hay un fragmento de mensaje sin '\n' pendiente. */
 typedef struct StreamContext {
     ClientContext* client;
-    char receiveBuffer[MESSAGE_MAX_LEN];
-    size_t receiveLength;
+    HQUIC stream;
+    char* receiveBuffer;
+    uint16_t receiveLength;
+    uint8_t truncated;
+    struct RoutingQueue* pausedOn;          /* Cola llena que detuvo la recepcion; se lee con su pausedLock. */
+    struct StreamContext* nextPaused;
 } StreamContext;
 
-typedef struct SendContext {
-    uint8_t* buffer;
-    uint32_t length;
-} SendContext;
+typedef struct BrokerOptions {
+    int port;
+    const char* pfxPath;
+    const char* pfxPassword;
+    const char* certFile;
+    const char* keyFile;
+    const char* ticketKeyFile;
+    QUIC_EXECUTION_PROFILE profile;
+    int routingWorkers;
+    int queueCapacity;
+    int reportIntervalS;
+    int verbose;
+    int batchIntervalMs;
+    int maxSubscribers;
+    int retainedMessages;
+    const char* logDirectory;
+    EventLogSyncPolicy logSyncPolicy;
+    int logSyncMs;
+    int metricsPort;
+    RoutingGroupPolicy groupPolicy;
+} BrokerOptions;
+
+/* Mensaje de publisher ya separado, listo para el fan-out. */
+typedef struct RoutingJob {
+    char topic[ROUTING_TOPIC_LEN];
+    char payload[MESSAGE_MAX_LEN];
+    uint64_t receivedUs;
+    uint64_t enqueuedUs;
+    uint32_t receivedBytes;
+    EventPriority priority;
+} RoutingJob;
+
+typedef struct RoutingCell {
+    atomic_size_t sequence;
+    RoutingJob job;
+} RoutingCell;
+
+/* Cola MPMC acotada (esquema de Vyukov): cada celda lleva un numero de secuencia que indica si esta libre u ocupada. */
+typedef struct RoutingQueue {
+    RoutingCell* cells;
+    size_t mask;
+    char padding0[CACHE_LINE_SIZE];
+    atomic_size_t enqueuePos;
+    char padding1[CACHE_LINE_SIZE];
+    atomic_size_t dequeuePos;
+    char padding2[CACHE_LINE_SIZE];
+    HANDLE itemsAvailable;
+    PlatformThread worker;
+    CRITICAL_SECTION pausedLock;            /* Protege pausedStreams y el pausedOn de cada stream. */
+    StreamContext* pausedStreams;           /* Streams de publishers con la recepcion detenida por esta cola. */
+    atomic_int pausedCount;
+} RoutingQueue;
+
+typedef struct PipelineStats {
+    atomic_uint_fast64_t enqueued;
+    atomic_uint_fast64_t routed;
+    atomic_uint_fast64_t overflows;
+    atomic_uint_fast64_t ingressUsTotal;
+    atomic_uint_fast64_t waitUsTotal;
+    atomic_uint_fast64_t waitUsMax;
+    atomic_uint_fast64_t fanoutUsTotal;
+    atomic_uint_fast64_t fanoutUsMax;
+    atomic_uint_fast64_t delivered;
+    atomic_uint_fast64_t flushes;
+    atomic_uint_fast64_t flushedMessages;
+    atomic_uint_fast64_t holdUsTotal;
+    atomic_uint_fast64_t holdUsMax;
+    atomic_uint_fast64_t sentPackets;
+    atomic_uint_fast64_t sentBytes;
+} PipelineStats;
 
 static const QUIC_API_TABLE* MsQuic = NULL;
 static HQUIC Registration = NULL;
 static HQUIC Configuration = NULL;
 static HQUIC Listener = NULL;
+#ifdef _WIN32
 static HCERTSTORE BrokerCertStore = NULL;
 static PCERT_CONTEXT BrokerCertificate = NULL;
+#endif
 
-static SubscriberEntry Subscribers[MAX_SUBSCRIBERS];
+/* Topics y subscriptores (nucleo de enrutamiento comun); crecen bajo demanda y se protegen con SubscribersLock. */
+static RoutingTable Routes;
+static RoutingPlan FanoutPlan;
 static CRITICAL_SECTION SubscribersLock;
 
 static const char* const DEFAULT_ALPN = "sports-pubsub";
 
+static int Verbose = 0;
+static RoutingQueue* RoutingQueues = NULL;
+static int RoutingQueueCount = 0;
+static atomic_int RoutingRunning;
+static PipelineStats Stats;
+static HANDLE ReporterStopEvent = NULL;
+static PlatformThread ReporterThread;
+static int ReporterStarted = 0;
+static DWORD BatchIntervalMs = 0;
+static int32_t* PendingFlush = NULL;
+static int32_t PendingFlushCount = 0;
+static HANDLE FlusherStopEvent = NULL;
+static PlatformThread FlusherThread;
+static int FlusherStarted = 0;
+static EventLog Log;
+static int LogEnabled = 0;
+static HANDLE LogSyncStopEvent = NULL;
+static PlatformThread LogSyncThread;
+static int LogSyncStarted = 0;
+static Metrics BrokerMetrics;
+static MetricsServer MetricsEndpoint;
+static int MetricsEnabled = 0;
+
 static void RemoveSubscriberByClient(ClientContext* client);
-static void RemoveSubscriberByStream(HQUIC stream);
+static void AtomicStoreMax(atomic_uint_fast64_t* target, uint64_t value);
 
 static uint8_t* DuplicateBytes(const char* source, size_t length) {
     uint8_t* copy = (uint8_t*)malloc(length);
@@ -124,19 +351,19 @@ static uint8_t* DuplicateBytes(const char* source, size_t length) {
 static int ReadFileToBuffer(const char* path, uint8_t** buffer, uint32_t* length) {
     FILE* file = fopen(path, "rb");
     if (file == NULL) {
-        fprintf(stderr, "[BROKER] No se pudo abrir el certificado PFX: %s\n", path);
+        fprintf(stderr, "[BROKER] No se pudo abrir el archivo: %s\n", path);
         return 0;
     }
 
     if (fseek(file, 0, SEEK_END) != 0) {
-        fprintf(stderr, "[BROKER] Error al leer tamano del PFX.\n");
+        fprintf(stderr, "[BROKER] Error al leer tamano de %s.\n", path);
         fclose(file);
         return 0;
     }
 
     long fileSize = ftell(file);
     if (fileSize <= 0) {
-        fprintf(stderr, "[BROKER] El certificado PFX parece vacio.\n");
+        fprintf(stderr, "[BROKER] El archivo %s parece vacio.\n", path);
         fclose(file);
         return 0;
     }
@@ -144,7 +371,7 @@ static int ReadFileToBuffer(const char* path, uint8_t** buffer, uint32_t* length
 
     uint8_t* data = (uint8_t*)malloc((size_t)fileSize);
     if (data == NULL) {
-        fprintf(stderr, "[BROKER] Memoria insuficiente para cargar PFX.\n");
+        fprintf(stderr, "[BROKER] Memoria insuficiente para cargar %s.\n", path);
         fclose(file);
         return 0;
     }
@@ -153,7 +380,7 @@ static int ReadFileToBuffer(const char* path, uint8_t** buffer, uint32_t* length
     fclose(file);
 
     if (read != (size_t)fileSize) {
-        fprintf(stderr, "[BROKER] Error al leer el contenido completo del PFX.\n");
+        fprintf(stderr, "[BROKER] Error al leer el contenido completo de %s.\n", path);
         free(data);
         return 0;
     }
@@ -163,6 +390,7 @@ static int ReadFileToBuffer(const char* path, uint8_t** buffer, uint32_t* length
     return 1;
 }
 
+#ifdef _WIN32
 static PCCERT_CONTEXT ImportCertificateContext(
     const uint8_t* pfxBuffer,
     uint32_t length,
@@ -238,105 +466,451 @@ static PCCERT_CONTEXT ImportCertificateContext(
     return context;
 }
 
-static QUIC_STATUS SendTextOnStream(HQUIC stream, const char* text) {
-    size_t len = strlen(text);
-    if (len == 0) {
-        return QUIC_STATUS_SUCCESS;
+static void ReleaseBrokerCertificate(void) {
+    if (BrokerCertificate != NULL) {
+        CertFreeCertificateContext(BrokerCertificate);
+        BrokerCertificate = NULL;
+    }
+    if (BrokerCertStore != NULL) {
+        CertCloseStore(BrokerCertStore, 0);
+        BrokerCertStore = NULL;
+    }
+}
+#else
+static void ReleaseBrokerCertificate(void) {
+}
+#endif /* _WIN32 */
+
+static QUIC_STATUS LoadBrokerCredential(const BrokerOptions* options) {
+    QUIC_CREDENTIAL_CONFIG credConfig;
+    memset(&credConfig, 0, sizeof(credConfig));
+    credConfig.Flags = QUIC_CREDENTIAL_FLAG_NONE;
+
+    if (options->certFile != NULL) {
+        QUIC_CERTIFICATE_FILE certFile;
+        certFile.CertificateFile = options->certFile;
+        certFile.PrivateKeyFile = options->keyFile;
+        credConfig.Type = QUIC_CREDENTIAL_TYPE_CERTIFICATE_FILE;
+        credConfig.CertificateFile = &certFile;
+        return MsQuic->ConfigurationLoadCredential(Configuration, &credConfig);
+    }
+
+    uint8_t* pfxBuffer = NULL;
+    uint32_t pfxLength = 0;
+    if (!ReadFileToBuffer(options->pfxPath, &pfxBuffer, &pfxLength)) {
+        return QUIC_STATUS_INVALID_PARAMETER;
+    }
+
+#ifdef _WIN32
+    BrokerCertificate = (PCERT_CONTEXT)ImportCertificateContext(pfxBuffer, pfxLength, options->pfxPassword);
+    free(pfxBuffer);
+    if (BrokerCertificate == NULL) {
+        return QUIC_STATUS_INVALID_PARAMETER;
     }
 
+    credConfig.Type = QUIC_CREDENTIAL_TYPE_CERTIFICATE_CONTEXT;
+    credConfig.CertificateContext = (QUIC_CERTIFICATE*)BrokerCertificate;
+    QUIC_STATUS status = MsQuic->ConfigurationLoadCredential(Configuration, &credConfig);
+    if (QUIC_FAILED(status)) {
+        ReleaseBrokerCertificate();
+    }
+    return status;
+#else
+    QUIC_CERTIFICATE_PKCS12 pkcs12;
+    pkcs12.Asn1Blob = pfxBuffer;
+    pkcs12.Asn1BlobLength = pfxLength;
+    pkcs12.PrivateKeyPassword = options->pfxPassword;
+    credConfig.Type = QUIC_CREDENTIAL_TYPE_CERTIFICATE_PKCS12;
+    credConfig.CertificatePkcs12 = &pkcs12;
+    QUIC_STATUS status = MsQuic->ConfigurationLoadCredential(Configuration, &credConfig);
+    free(pfxBuffer);
+    return status;
+#endif
+}
+
+static SendContext* CreateSendContext(const char* text, size_t length) {
     SendContext* context = (SendContext*)malloc(sizeof(SendContext));
     if (context == NULL) {
-        return QUIC_STATUS_OUT_OF_MEMORY;
+        return NULL;
     }
 
-    context->buffer = DuplicateBytes(text, len);
+    context->buffer = DuplicateBytes(text, length);
     if (context->buffer == NULL) {
         free(context);
-        return QUIC_STATUS_OUT_OF_MEMORY;
+        return NULL;
     }
-    context->length = (uint32_t)len;
-
-    QUIC_BUFFER buffer;
-    buffer.Length = context->length;
-    buffer.Buffer = context->buffer;
+    context->length = (uint32_t)length;
+    context->ownsBuffer = 1;
+    context->queuedFor = NULL;
+    context->segment = NULL;
+    return context;
+}
 
-    QUIC_STATUS status =
-        MsQuic->StreamSend(stream, &buffer, 1, QUIC_SEND_FLAG_NONE, context);
-    if (QUIC_FAILED(status)) {
-        free(context->buffer);
+/*
+ * Tambien descuenta el envio de la conexion: msquic completa los envios de un stream antes de cerrarlo, asi que la
+ * conexion sigue viva cuando llega el ultimo SEND_COMPLETE.
+ */
+static void FreeSendContext(SendContext* context) {
+    if (context != NULL) {
+        if (context->queuedFor != NULL) {
+            atomic_fetch_sub_explicit(&context->queuedFor->pendingSends, 1, memory_order_relaxed);
+        }
+        if (context->ownsBuffer) {
+            free(context->buffer);
+        }
+        if (context->segment != NULL) {
+            EventLogUnpin(context->segment);
+        }
         free(context);
     }
+}
 
+/* Entrega el contexto a msquic (se libera en SEND_COMPLETE); si StreamSend falla, se libera aqui. */
+static QUIC_STATUS SendContextOnStream(HQUIC stream, SendContext* context, QUIC_SEND_FLAGS flags) {
+    context->quicBuffer.Length = context->length;
+    context->quicBuffer.Buffer = context->buffer;
+
+    QUIC_STATUS status = MsQuic->StreamSend(stream, &context->quicBuffer, 1, flags, context);
+    if (QUIC_FAILED(status)) {
+        FreeSendContext(context);
+    }
     return status;
 }
 
-static void AddOrUpdateSubscriber(const char* topic, ClientContext* client, HQUIC stream) {
-    EnterCriticalSection(&SubscribersLock);
+static QUIC_STATUS SendTextOnStream(HQUIC stream, const char* text) {
+    size_t len = strlen(text);
+    if (len == 0) {
+        return QUIC_STATUS_SUCCESS;
+    }
 
-    for (int i = 0; i < MAX_SUBSCRIBERS; ++i) {
-        if (Subscribers[i].inUse &&
-            Subscribers[i].client == client) {
-            strncpy(Subscribers[i].topic, topic, TOPIC_NAME_LEN - 1);
-            Subscribers[i].topic[TOPIC_NAME_LEN - 1] = '\0';
-            Subscribers[i].stream = stream;
-            LeaveCriticalSection(&SubscribersLock);
-            return;
-        }
+    SendContext* context = CreateSendContext(text, len);
+    if (context == NULL) {
+        return QUIC_STATUS_OUT_OF_MEMORY;
     }
+    return SendContextOnStream(stream, context, QUIC_SEND_FLAG_NONE);
+}
 
-    for (int i = 0; i < MAX_SUBSCRIBERS; ++i) {
-        if (!Subscribers[i].inUse) {
-            Subscribers[i].inUse = 1;
-            Subscribers[i].connection = client->connection;
-            Subscribers[i].stream = stream;
-            Subscribers[i].client = client;
-            strncpy(Subscribers[i].topic, topic, TOPIC_NAME_LEN - 1);
-            Subscribers[i].topic[TOPIC_NAME_LEN - 1] = '\0';
-            LeaveCriticalSection(&SubscribersLock);
-            return;
+static SubscriberBatch* BatchOf(int32_t index) {
+    return (SubscriberBatch*)RoutingEntryExtra(&Routes, index);
+}
+
+/* Debe llamarse con SubscribersLock tomado. */
+static void DiscardHeldBack(SubscriberBatch* batch) {
+    FreeSendContext(batch->heldBack);
+    batch->heldBack = NULL;
+    batch->heldCount = 0;
+}
+
+/*
+ * Modo agrupado: el mensaje retenido se encola con DELAY_SEND y el nuevo queda retenido hasta la siguiente
+ * descarga. Debe llamarse con SubscribersLock tomado.
+ */
+static QUIC_STATUS QueueBatchedSend(int32_t index, SendContext* context) {
+    SubscriberBatch* batch = BatchOf(index);
+
+    if (batch->heldBack != NULL) {
+        QUIC_STATUS status = SendContextOnStream((HQUIC)Routes.entries[index].handle, batch->heldBack, QUIC_SEND_FLAG_DELAY_SEND);
+        batch->heldBack = NULL;
+        if (QUIC_FAILED(status)) {
+            FreeSendContext(context);
+            return status;
+        }
+    } else {
+        batch->heldSinceUs = PlatformNowUs();
+        batch->heldCount = 0;
+        if (!batch->pendingFlush) {
+            batch->pendingFlush = 1;
+            PendingFlush[PendingFlushCount++] = index;
         }
     }
 
-    LeaveCriticalSection(&SubscribersLock);
-    fprintf(stderr, "[BROKER] Tabla de subscriptores llena, no se puede registrar %s.\n", topic);
+    batch->heldBack = context;
+    batch->heldCount++;
+    return QUIC_STATUS_SUCCESS;
 }
 
-static void BroadcastToTopic(const char* topic, const char* payload) {
+static void FlushBatchedSends(void) {
     EnterCriticalSection(&SubscribersLock);
 
-    for (int i = 0; i < MAX_SUBSCRIBERS; ++i) {
-        if (Subscribers[i].inUse &&
-            strcmp(Subscribers[i].topic, topic) == 0 &&
-            Subscribers[i].stream != NULL) {
-            QUIC_STATUS status = SendTextOnStream(Subscribers[i].stream, payload);
-            if (QUIC_FAILED(status)) {
-                fprintf(stderr, "[BROKER] Error enviando a subscriptor (%s). Se eliminaran sus datos.\n", topic);
-                Subscribers[i].inUse = 0;
-                Subscribers[i].stream = NULL;
-                if (Subscribers[i].client != NULL) {
-                    Subscribers[i].client->subscribed = 0;
-                    Subscribers[i].client->activeStream = NULL;
-                }
+    uint64_t nowUs = PlatformNowUs();
+    for (int32_t i = 0; i < PendingFlushCount; ++i) {
+        RoutingEntry* entry = &Routes.entries[PendingFlush[i]];
+        SubscriberBatch* batch = BatchOf(PendingFlush[i]);
+        batch->pendingFlush = 0;
+        if (!entry->inUse || batch->heldBack == NULL || entry->handle == NULL) {
+            continue;
+        }
+
+        uint64_t holdUs = nowUs - batch->heldSinceUs;
+        atomic_fetch_add_explicit(&Stats.flushes, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&Stats.flushedMessages, batch->heldCount, memory_order_relaxed);
+        atomic_fetch_add_explicit(&Stats.holdUsTotal, holdUs, memory_order_relaxed);
+        AtomicStoreMax(&Stats.holdUsMax, holdUs);
+
+        QUIC_STATUS status = SendContextOnStream((HQUIC)entry->handle, batch->heldBack, QUIC_SEND_FLAG_NONE);
+        batch->heldBack = NULL;
+        batch->heldCount = 0;
+        if (QUIC_FAILED(status)) {
+            if (MetricsEnabled) {
+                MetricsCountSendFailure(&BrokerMetrics);
             }
+            fprintf(stderr, "[BROKER] Error descargando lote de %s (0x%x).\n",
+                    RoutingTopicName(&Routes, entry->topicId), (unsigned)status);
         }
     }
+    PendingFlushCount = 0;
 
     LeaveCriticalSection(&SubscribersLock);
 }
 
-static void RemoveSubscriberByStream(HQUIC stream) {
-    EnterCriticalSection(&SubscribersLock);
+/* Hilo de descarga: cada BatchIntervalMs transmite lo acumulado; al detenerse hace una ultima descarga. */
+static PLATFORM_THREAD_ROUTINE(BatchFlusher) {
+    (void)argument;
+    while (WaitForSingleObject(FlusherStopEvent, BatchIntervalMs) == WAIT_TIMEOUT) {
+        FlushBatchedSends();
+    }
+    FlushBatchedSends();
+    return PLATFORM_THREAD_RETURN;
+}
 
-    for (int i = 0; i < MAX_SUBSCRIBERS; ++i) {
-        if (Subscribers[i].inUse && Subscribers[i].stream == stream) {
-            Subscribers[i].inUse = 0;
-            if (Subscribers[i].client != NULL) {
-                Subscribers[i].client->subscribed = 0;
-                Subscribers[i].client->activeStream = NULL;
-            }
-            Subscribers[i].stream = NULL;
-            Subscribers[i].client = NULL;
+/* Commit agrupado del registro: los tramos se capturan con el lock y se sincronizan sin el. */
+static void SyncEventLog(void) {
+    EventLogDirtyRange ranges[LOG_SYNC_BATCH];
+    int32_t count;
+    do {
+        EnterCriticalSection(&SubscribersLock);
+        count = EventLogCollectDirty(&Log, ranges, LOG_SYNC_BATCH);
+        if (count > 0) {
+            Log.syncs++;
+        }
+        LeaveCriticalSection(&SubscribersLock);
+        EventLogSyncRanges(ranges, count);
+    } while (count == LOG_SYNC_BATCH);
+}
+
+static PLATFORM_THREAD_ROUTINE(LogSyncer) {
+    (void)argument;
+    while (WaitForSingleObject(LogSyncStopEvent, Log.syncIntervalMs) == WAIT_TIMEOUT) {
+        SyncEventLog();
+    }
+    SyncEventLog();
+    return PLATFORM_THREAD_RETURN;
+}
+
+/*
+ * Sink del reenvio: el tramo se entrega a msquic apuntando al segmento mapeado; el pin lo mantiene mapeado hasta
+ * SEND_COMPLETE aunque la retencion lo saque del topic.
+ */
+static int QuicReplaySink(void* context, EventLogSegment* segment, uint32_t position, uint32_t length) {
+    SendContext* sendContext = (SendContext*)malloc(sizeof(SendContext));
+    if (sendContext == NULL) {
+        return 0;
+    }
+    EventLogPin(segment);
+    sendContext->buffer = (uint8_t*)segment->data + position;
+    sendContext->length = length;
+    sendContext->ownsBuffer = 0;
+    sendContext->queuedFor = NULL;
+    sendContext->segment = segment;
+    return QUIC_SUCCEEDED(SendContextOnStream((HQUIC)context, sendContext, QUIC_SEND_FLAG_NONE));
+}
+
+/* ---------------------------------------------------------------------------------------------------------
+ * Transporte QUIC del nucleo de enrutamiento (los callbacks se llaman con SubscribersLock tomado)
+ * --------------------------------------------------------------------------------------------------------- */
+
+static int QuicDeliver(void* context, RoutingTable* table, int32_t index, const char* message, uint32_t length) {
+    (void)context;
+    RoutingEntry* entry = &table->entries[index];
+
+    SendContext* sendContext = CreateSendContext(message, length);
+    QUIC_STATUS status = QUIC_STATUS_OUT_OF_MEMORY;
+    if (sendContext != NULL) {
+        sendContext->queuedFor = (ClientContext*)entry->owner;
+        if (sendContext->queuedFor != NULL) {
+            atomic_fetch_add_explicit(&sendContext->queuedFor->pendingSends, 1, memory_order_relaxed);
+        }
+        HQUIC priorityStream = table->deliveryPriority == EVENT_PRIORITY_HIGH && sendContext->queuedFor != NULL
+            ? sendContext->queuedFor->priorityStream
+            : NULL;
+        if (priorityStream != NULL) {
+            status = SendContextOnStream(priorityStream, sendContext, QUIC_SEND_FLAG_NONE);
+        } else {
+            status = BatchIntervalMs > 0
+                ? QueueBatchedSend(index, sendContext)
+                : SendContextOnStream((HQUIC)entry->handle, sendContext, QUIC_SEND_FLAG_NONE);
+        }
+    }
+    if (QUIC_FAILED(status)) {
+        if (MetricsEnabled) {
+            MetricsCountSendFailure(&BrokerMetrics);
+        }
+        fprintf(stderr, "[BROKER] Error enviando a subscriptor (%s). Se eliminaran sus datos.\n",
+                RoutingTopicName(table, entry->topicId));
+        return 0;
+    }
+    return 1;
+}
+
+/*
+ * Mensajes retenidos: los spans apuntan al anillo del topic, que el proximo publish puede sobrescribir, asi que se
+ * copian a un unico SendContext y se envian con un solo StreamSend (sin pasar por el envio agrupado, porque el
+ * subscriptor recien registrado no tiene mensaje retenido por --lote-ms).
+ */
+static int QuicDeliverBatch(void* context, RoutingTable* table, int32_t index, const RoutingSpan* spans, int32_t count) {
+    (void)context;
+    RoutingEntry* entry = &table->entries[index];
+
+    size_t total = 0;
+    for (int32_t i = 0; i < count; ++i) {
+        total += spans[i].length;
+    }
+
+    QUIC_STATUS status = QUIC_STATUS_OUT_OF_MEMORY;
+    SendContext* sendContext = (SendContext*)malloc(sizeof(SendContext));
+    if (sendContext != NULL) {
+        sendContext->buffer = (uint8_t*)malloc(total);
+        if (sendContext->buffer == NULL) {
+            free(sendContext);
+            sendContext = NULL;
+        }
+    }
+    if (sendContext != NULL) {
+        size_t offset = 0;
+        for (int32_t i = 0; i < count; ++i) {
+            memcpy(sendContext->buffer + offset, spans[i].data, spans[i].length);
+            offset += spans[i].length;
+        }
+        sendContext->length = (uint32_t)total;
+        sendContext->ownsBuffer = 1;
+        sendContext->queuedFor = NULL;
+        sendContext->segment = NULL;
+        status = SendContextOnStream((HQUIC)entry->handle, sendContext, QUIC_SEND_FLAG_NONE);
+    }
+    if (QUIC_FAILED(status)) {
+        if (MetricsEnabled) {
+            MetricsCountSendFailure(&BrokerMetrics);
+        }
+        fprintf(stderr, "[BROKER] Error enviando mensajes retenidos (%s). Se eliminaran sus datos.\n",
+                RoutingTopicName(table, entry->topicId));
+        return 0;
+    }
+    return 1;
+}
+
+/*
+ * Baja de una suscripcion. pendingFlush se conserva: si el indice sigue en PendingFlush, el hilo de descarga lo
+ * descarta al ver que no tiene mensaje retenido.
+ */
+static void QuicRelease(void* context, RoutingTable* table, int32_t index) {
+    (void)context;
+    DiscardHeldBack(BatchOf(index));
+    ClientContext* client = (ClientContext*)table->entries[index].owner;
+    if (client != NULL) {
+        client->subscriberIndex = NO_INDEX;
+    }
+}
+
+/* PendingFlush puede contener a todos los subscriptores, asi que crece junto con la tabla. */
+static int QuicGrow(void* context, int32_t capacity) {
+    (void)context;
+    int32_t* pending = (int32_t*)realloc(PendingFlush, sizeof(int32_t) * (size_t)capacity);
+    if (pending == NULL) {
+        return 0;
+    }
+    PendingFlush = pending;
+    return 1;
+}
+
+/* Profundidad de la cola de salida para el reparto por carga de los grupos de consumo. */
+static uint32_t QuicQueueDepth(void* context, RoutingTable* table, int32_t index) {
+    (void)context;
+    ClientContext* client = (ClientContext*)table->entries[index].owner;
+    return client != NULL ? atomic_load_explicit(&client->pendingSends, memory_order_relaxed) : 0;
+}
+
+static const RoutingTransport QuicTransport = {
+    "quic", NULL, QuicDeliver, QuicRelease, QuicGrow, QuicDeliverBatch, QuicQueueDepth
+};
+
+static void FreeSubscriberTables(void) {
+    for (int32_t i = 0; i < Routes.highWater; ++i) {
+        FreeSendContext(BatchOf(i)->heldBack);
+    }
+    RoutingTableFree(&Routes);
+    RoutingFreePlan(&FanoutPlan);
+    free(PendingFlush);
+    PendingFlush = NULL;
+    PendingFlushCount = 0;
+}
+
+/*
+ * Debe llamarse con SubscribersLock tomado. Devuelve 0 si no se pudo registrar; *isNew indica si la suscripcion
+ * es nueva o cambio de topic (y por lo tanto debe recibir los mensajes retenidos).
+ */
+static int AddOrUpdateSubscriber(const char* topic, ClientContext* client, HQUIC stream, int* isNew) {
+    *isNew = 0;
+    int32_t index = client->subscriberIndex;
+    if (index != NO_INDEX) {
+        int changed = RoutingChangeTopic(&Routes, index, topic);
+        if (changed < 0) {
+            fprintf(stderr, "[BROKER] Sin memoria para el topic %s.\n", topic);
+            return 0;
+        }
+        if (changed > 0) {
+            /* Cambio de topic: lo retenido pertenece al topic anterior. */
+            DiscardHeldBack(BatchOf(index));
+            *isNew = 1;
         }
+        Routes.entries[index].handle = stream;
+        return 1;
+    }
+
+    index = RoutingSubscribe(&Routes, topic, stream, client);
+    if (index == NO_INDEX) {
+        fprintf(stderr, "[BROKER] Tabla de subscriptores llena (%ld) o sin memoria, no se puede registrar %s.\n",
+                (long)Routes.maxSubscribers, topic);
+        return 0;
+    }
+    client->subscriberIndex = index;
+    *isNew = 1;
+    return 1;
+}
+
+/* Debe llamarse con SubscribersLock tomado: Routes.active cambia tambien cuando un envio fallido da de baja al subscriptor. */
+static void UpdateSubscriberGauge(void) {
+    if (MetricsEnabled) {
+        MetricsSetSubscribers(&BrokerMetrics, Routes.active);
+    }
+}
+
+/* Devuelve la cantidad de subscriptores a los que se entrego el evento. */
+static int32_t BroadcastToTopic(const char* topic, const char* payload, uint32_t length, EventPriority priority) {
+    EnterCriticalSection(&SubscribersLock);
+
+    if (LogEnabled) {
+        (void)EventLogAppend(&Log, topic, payload, length);
+    }
+    FanoutPlan.priority = priority;
+    int32_t delivered = RoutingPublishTo(&Routes, &FanoutPlan, topic, payload, length);
+    if (delivered < 0) {
+        fprintf(stderr, "[BROKER] Memoria insuficiente para enrutar un evento de %s; no se entrego.\n", topic);
+        delivered = 0;
+    }
+    atomic_fetch_add_explicit(&Stats.delivered, (uint64_t)delivered, memory_order_relaxed);
+    UpdateSubscriberGauge();
+
+    LeaveCriticalSection(&SubscribersLock);
+    return delivered;
+}
+
+static void RemoveSubscriberByStream(ClientContext* client, HQUIC stream) {
+    EnterCriticalSection(&SubscribersLock);
+
+    int32_t index = client->subscriberIndex;
+    if (index != NO_INDEX && Routes.entries[index].handle == stream) {
+        RoutingUnsubscribe(&Routes, index);
+        UpdateSubscriberGauge();
     }
 
     LeaveCriticalSection(&SubscribersLock);
@@ -345,85 +919,774 @@ static void RemoveSubscriberByStream(HQUIC stream) {
 static void RemoveSubscriberByClient(ClientContext* client) {
     EnterCriticalSection(&SubscribersLock);
 
-    for (int i = 0; i < MAX_SUBSCRIBERS; ++i) {
-        if (Subscribers[i].inUse &&
-            Subscribers[i].client == client) {
-            Subscribers[i].inUse = 0;
-            Subscribers[i].stream = NULL;
-            Subscribers[i].client = NULL;
-        }
+    if (client->subscriberIndex != NO_INDEX) {
+        RoutingUnsubscribe(&Routes, client->subscriberIndex);
+        UpdateSubscriberGauge();
     }
 
     LeaveCriticalSection(&SubscribersLock);
 }
 
-static void ProcessPublisherMessage(ClientContext* client, const char* message) {
-    (void)client;
-    char working[MESSAGE_MAX_LEN];
-    strncpy(working, message + 10, MESSAGE_MAX_LEN - 1);
-    working[MESSAGE_MAX_LEN - 1] = '\0';
+/* ---------------------------------------------------------------------------------------------------------
+ * Pipeline de enrutamiento
+ * --------------------------------------------------------------------------------------------------------- */
+
+static void AtomicStoreMax(atomic_uint_fast64_t* target, uint64_t value) {
+    uint_fast64_t current = atomic_load_explicit(target, memory_order_relaxed);
+    while (value > current &&
+           !atomic_compare_exchange_weak_explicit(target, &current, value, memory_order_relaxed, memory_order_relaxed)) {
+    }
+}
+
+static int RoutingQueueInit(RoutingQueue* queue, size_t capacity) {
+    queue->cells = (RoutingCell*)malloc(capacity * sizeof(RoutingCell));
+    if (queue->cells == NULL) {
+        return 0;
+    }
+    for (size_t i = 0; i < capacity; ++i) {
+        atomic_init(&queue->cells[i].sequence, i);
+    }
+    queue->mask = capacity - 1;
+    atomic_init(&queue->enqueuePos, 0);
+    atomic_init(&queue->dequeuePos, 0);
+    queue->itemsAvailable = CreateSemaphoreA(NULL, 0, (LONG)capacity + 16, NULL);
+    if (queue->itemsAvailable == NULL) {
+        free(queue->cells);
+        queue->cells = NULL;
+        return 0;
+    }
+    InitializeCriticalSection(&queue->pausedLock);
+    queue->pausedStreams = NULL;
+    atomic_init(&queue->pausedCount, 0);
+    return 1;
+}
+
+static int RoutingQueuePush(RoutingQueue* queue, const RoutingJob* job) {
+    size_t position = atomic_load_explicit(&queue->enqueuePos, memory_order_relaxed);
+    for (;;) {
+        RoutingCell* cell = &queue->cells[position & queue->mask];
+        size_t sequence = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+        intptr_t difference = (intptr_t)sequence - (intptr_t)position;
+        if (difference == 0) {
+            if (atomic_compare_exchange_weak_explicit(
+                    &queue->enqueuePos, &position, position + 1, memory_order_relaxed, memory_order_relaxed)) {
+                cell->job = *job;
+                atomic_store_explicit(&cell->sequence, position + 1, memory_order_release);
+                return 1;
+            }
+        } else if (difference < 0) {
+            return 0;
+        } else {
+            position = atomic_load_explicit(&queue->enqueuePos, memory_order_relaxed);
+        }
+    }
+}
+
+static int RoutingQueuePop(RoutingQueue* queue, RoutingJob* job) {
+    size_t position = atomic_load_explicit(&queue->dequeuePos, memory_order_relaxed);
+    for (;;) {
+        RoutingCell* cell = &queue->cells[position & queue->mask];
+        size_t sequence = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+        intptr_t difference = (intptr_t)sequence - (intptr_t)(position + 1);
+        if (difference == 0) {
+            if (atomic_compare_exchange_weak_explicit(
+                    &queue->dequeuePos, &position, position + 1, memory_order_relaxed, memory_order_relaxed)) {
+                *job = cell->job;
+                atomic_store_explicit(&cell->sequence, position + queue->mask + 1, memory_order_release);
+                return 1;
+            }
+        } else if (difference < 0) {
+            return 0;
+        } else {
+            position = atomic_load_explicit(&queue->dequeuePos, memory_order_relaxed);
+        }
+    }
+}
+
+static size_t RoutingQueueDepth(RoutingQueue* queue) {
+    size_t enqueued = atomic_load_explicit(&queue->enqueuePos, memory_order_relaxed);
+    size_t dequeued = atomic_load_explicit(&queue->dequeuePos, memory_order_relaxed);
+    return enqueued > dequeued ? enqueued - dequeued : 0;
+}
+
+static void RouteJob(const RoutingJob* job) {
+    uint64_t startUs = PlatformNowUs();
+    uint64_t waitUs = startUs - job->enqueuedUs;
+
+    if (Verbose) {
+        printf("[BROKER] Evento %s -> %s", job->topic, job->payload);
+    }
+    uint32_t length = (uint32_t)strlen(job->payload);
+    int32_t delivered = BroadcastToTopic(job->topic, job->payload, length, job->priority);
+
+    uint64_t doneUs = PlatformNowUs();
+    uint64_t fanoutUs = doneUs - startUs;
+    if (MetricsEnabled) {
+        /* El tramo del broker va del ingreso en el callback hasta terminar el fan-out, con la espera en cola incluida. */
+        MetricsCountPublish(&BrokerMetrics, job->topic, job->receivedBytes, delivered, length);
+        MetricsRecordLatency(&BrokerMetrics, METRICS_LATENCY_BROKER, doneUs - job->receivedUs);
+    }
+    atomic_fetch_add_explicit(&Stats.routed, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&Stats.waitUsTotal, waitUs, memory_order_relaxed);
+    atomic_fetch_add_explicit(&Stats.fanoutUsTotal, fanoutUs, memory_order_relaxed);
+    AtomicStoreMax(&Stats.waitUsMax, waitUs);
+    AtomicStoreMax(&Stats.fanoutUsMax, fanoutUs);
+}
+
+/* El stream deja de recibir hasta que el worker de la cola lo reanude; lo llama el callback del stream. */
+static void PauseStream(RoutingQueue* queue, StreamContext* ctx) {
+    EnterCriticalSection(&queue->pausedLock);
+    if (ctx->pausedOn == NULL) {
+        ctx->pausedOn = queue;
+        ctx->nextPaused = queue->pausedStreams;
+        queue->pausedStreams = ctx;
+        atomic_fetch_add_explicit(&queue->pausedCount, 1, memory_order_relaxed);
+    }
+    LeaveCriticalSection(&queue->pausedLock);
+}
+
+/* Antes de StreamClose: el worker no debe reanudar un stream cerrado. */
+static void UnpauseStream(StreamContext* ctx) {
+    RoutingQueue* queue = ctx->pausedOn;
+    if (queue == NULL) {
+        return;
+    }
+    EnterCriticalSection(&queue->pausedLock);
+    for (StreamContext** link = &queue->pausedStreams; *link != NULL; link = &(*link)->nextPaused) {
+        if (*link == ctx) {
+            *link = ctx->nextPaused;
+            atomic_fetch_sub_explicit(&queue->pausedCount, 1, memory_order_relaxed);
+            break;
+        }
+    }
+    ctx->pausedOn = NULL;
+    ctx->nextPaused = NULL;
+    LeaveCriticalSection(&queue->pausedLock);
+}
+
+/*
+ * Desde el worker: StreamReceiveSetEnabled fuera del hilo de la conexion solo encola la operacion, asi que puede
+ * llamarse con pausedLock tomado; el lock impide que el stream se cierre mientras tanto. msquic vuelve a entregar
+ * en un RECEIVE los bytes que el callback no consumio.
+ */
+static void ResumePausedStreams(RoutingQueue* queue) {
+    EnterCriticalSection(&queue->pausedLock);
+    StreamContext* ctx = queue->pausedStreams;
+    queue->pausedStreams = NULL;
+    atomic_store_explicit(&queue->pausedCount, 0, memory_order_relaxed);
+    while (ctx != NULL) {
+        StreamContext* next = ctx->nextPaused;
+        ctx->pausedOn = NULL;
+        ctx->nextPaused = NULL;
+        (void)MsQuic->StreamReceiveSetEnabled(ctx->stream, TRUE);
+        ctx = next;
+    }
+    LeaveCriticalSection(&queue->pausedLock);
+}
+
+static PLATFORM_THREAD_ROUTINE(RoutingWorker) {
+    RoutingQueue* queue = (RoutingQueue*)argument;
+    RoutingJob job;
+
+    for (;;) {
+        WaitForSingleObject(queue->itemsAvailable, INFINITE);
+        if (RoutingQueuePop(queue, &job)) {
+            /* Con la cola a la mitad los publishers detenidos vuelven a recibir; la histeresis evita pausar por cada evento. */
+            if (atomic_load_explicit(&queue->pausedCount, memory_order_relaxed) > 0 &&
+                RoutingQueueDepth(queue) <= (queue->mask + 1) / 2) {
+                ResumePausedStreams(queue);
+            }
+            RouteJob(&job);
+        } else if (!atomic_load(&RoutingRunning)) {
+            break;
+        }
+    }
+    return PLATFORM_THREAD_RETURN;
+}
 
-    char* topic = strtok(working, "|");
-    char* timestamp = strtok(NULL, "|");
-    char* rest = strtok(NULL, "");
+/*
+ * Llamado desde el callback de msquic: encola el mensaje en el worker de su topic (o lo enruta si no hay workers).
+ * Devuelve 0 si la cola esta llena; el stream ya quedo registrado como detenido y el callback debe dejar de
+ * consumir. Enrutar en linea romperia el orden del topic.
+ */
+static int SubmitRoutingJob(RoutingJob* job, StreamContext* ctx) {
+    if (RoutingQueueCount == 0) {
+        job->enqueuedUs = PlatformNowUs();
+        atomic_fetch_add_explicit(&Stats.ingressUsTotal, job->enqueuedUs - job->receivedUs, memory_order_relaxed);
+        RouteJob(job);
+        return 1;
+    }
+
+    RoutingQueue* queue = &RoutingQueues[RoutingHashTopic(job->topic) % (uint32_t)RoutingQueueCount];
+    job->enqueuedUs = PlatformNowUs();
+    if (!RoutingQueuePush(queue, job)) {
+        atomic_fetch_add_explicit(&Stats.overflows, 1, memory_order_relaxed);
+        /* Registrar antes de reintentar: si el reintento falla la cola sigue llena y algun pop vera el registro. */
+        PauseStream(queue, ctx);
+        if (!RoutingQueuePush(queue, job)) {
+            return 0;
+        }
+        UnpauseStream(ctx);
+    }
+    atomic_fetch_add_explicit(&Stats.ingressUsTotal, job->enqueuedUs - job->receivedUs, memory_order_relaxed);
+    atomic_fetch_add_explicit(&Stats.enqueued, 1, memory_order_relaxed);
+    ReleaseSemaphore(queue->itemsAvailable, 1, NULL);
+    return 1;
+}
+
+/*
+ * Paquetes y bytes enviados por msquic a los subscriptores. Cada conexion suma a Stats la diferencia desde su
+ * ultima lectura de QUIC_STATISTICS_V2, y solo desde sus propios callbacks (SEND_COMPLETE y SHUTDOWN_COMPLETE):
+ * ahi GetParam se resuelve en linea, sin SubscribersLock y sin esperar al hilo de otra conexion. Fuera del cierre
+ * se lee a lo sumo cada SEND_STATS_SAMPLE_US.
+ */
+static void SampleSendStatistics(ClientContext* client, int force) {
+    if (client->type != CLIENT_SUBSCRIBER) {
+        return;
+    }
+    uint64_t nowUs = PlatformNowUs();
+    if (!force && nowUs - client->statsSampledUs < SEND_STATS_SAMPLE_US) {
+        return;
+    }
+    client->statsSampledUs = nowUs;
+
+    QUIC_STATISTICS_V2 statistics;
+    uint32_t size = sizeof(statistics);
+    if (QUIC_FAILED(MsQuic->GetParam(client->connection, QUIC_PARAM_CONN_STATISTICS_V2, &size, &statistics))) {
+        return;
+    }
+    if (statistics.SendTotalPackets > client->sentPackets) {
+        atomic_fetch_add_explicit(&Stats.sentPackets, statistics.SendTotalPackets - client->sentPackets,
+                                  memory_order_relaxed);
+        client->sentPackets = statistics.SendTotalPackets;
+    }
+    if (statistics.SendTotalBytes > client->sentBytes) {
+        atomic_fetch_add_explicit(&Stats.sentBytes, statistics.SendTotalBytes - client->sentBytes,
+                                  memory_order_relaxed);
+        client->sentBytes = statistics.SendTotalBytes;
+    }
+}
+
+static PLATFORM_THREAD_ROUTINE(PipelineReporter) {
+    DWORD intervalMs = (DWORD)(uintptr_t)argument;
+    uint64_t previousRouted = 0;
+    uint64_t previousWaitUs = 0;
+    uint64_t previousFanoutUs = 0;
+    uint64_t previousIngressUs = 0;
+    uint64_t previousOverflows = 0;
+    uint64_t previousDelivered = 0;
+    uint64_t previousPackets = 0;
+    uint64_t previousBytes = 0;
+    uint64_t previousFlushes = 0;
+    uint64_t previousFlushed = 0;
+    uint64_t previousHoldUs = 0;
+
+    while (WaitForSingleObject(ReporterStopEvent, intervalMs) == WAIT_TIMEOUT) {
+        uint64_t routed = atomic_load(&Stats.routed);
+        uint64_t waitUs = atomic_load(&Stats.waitUsTotal);
+        uint64_t fanoutUs = atomic_load(&Stats.fanoutUsTotal);
+        uint64_t ingressUs = atomic_load(&Stats.ingressUsTotal);
+        uint64_t overflows = atomic_load(&Stats.overflows);
+        uint64_t waitMax = atomic_exchange(&Stats.waitUsMax, 0);
+        uint64_t fanoutMax = atomic_exchange(&Stats.fanoutUsMax, 0);
+
+        size_t depth = 0;
+        for (int i = 0; i < RoutingQueueCount; ++i) {
+            depth += RoutingQueueDepth(&RoutingQueues[i]);
+        }
+
+        uint64_t count = routed - previousRouted;
+        double divisor = count > 0 ? (double)count : 1.0;
+        printf("[BROKER] Pipeline: %llu eventos/%lus, cola=%zu, desbordes=%llu | ingreso prom %.1f us | "
+               "espera prom %.1f us (max %llu) | fan-out prom %.1f us (max %llu)\n",
+               (unsigned long long)count,
+               (unsigned long)(intervalMs / 1000),
+               depth,
+               (unsigned long long)(overflows - previousOverflows),
+               (double)(ingressUs - previousIngressUs) / divisor,
+               (double)(waitUs - previousWaitUs) / divisor,
+               (unsigned long long)waitMax,
+               (double)(fanoutUs - previousFanoutUs) / divisor,
+               (unsigned long long)fanoutMax);
+
+        previousRouted = routed;
+        previousWaitUs = waitUs;
+        previousFanoutUs = fanoutUs;
+        previousIngressUs = ingressUs;
+        previousOverflows = overflows;
+
+        uint64_t delivered = atomic_load(&Stats.delivered);
+        uint64_t packets = atomic_load(&Stats.sentPackets);
+        uint64_t bytes = atomic_load(&Stats.sentBytes);
+        uint64_t packetCount = packets - previousPackets;
+        uint64_t deliveredCount = delivered - previousDelivered;
+        double seconds = (double)intervalMs / 1000.0;
+        printf("[BROKER] Entrega: %ld subscriptores en %ld topics, %.0f envios/s, %.0f paquetes/s (%.1f kB/s) hacia "
+               "subscriptores, %.2f eventos/paquete",
+               (long)Routes.active,
+               (long)Routes.topicCount,
+               (double)deliveredCount / seconds,
+               (double)packetCount / seconds,
+               (double)(bytes - previousBytes) / 1024.0 / seconds,
+               packetCount > 0 ? (double)deliveredCount / (double)packetCount : 0.0);
+        if (BatchIntervalMs > 0) {
+            uint64_t flushes = atomic_load(&Stats.flushes);
+            uint64_t flushed = atomic_load(&Stats.flushedMessages);
+            uint64_t holdUs = atomic_load(&Stats.holdUsTotal);
+            uint64_t holdMax = atomic_exchange(&Stats.holdUsMax, 0);
+            uint64_t flushCount = flushes - previousFlushes;
+            double flushDivisor = flushCount > 0 ? (double)flushCount : 1.0;
+            printf(" | lotes: %llu, prom %.1f eventos, retencion prom %.1f us (max %llu)",
+                   (unsigned long long)flushCount,
+                   (double)(flushed - previousFlushed) / flushDivisor,
+                   (double)(holdUs - previousHoldUs) / flushDivisor,
+                   (unsigned long long)holdMax);
+            previousFlushes = flushes;
+            previousFlushed = flushed;
+            previousHoldUs = holdUs;
+        }
+        printf("\n");
+
+        previousDelivered = delivered;
+        previousPackets = packets;
+        previousBytes = bytes;
+    }
+    return PLATFORM_THREAD_RETURN;
+}
+
+static int StartRoutingPipeline(const BrokerOptions* options) {
+    memset(&Stats, 0, sizeof(Stats));
+    atomic_store(&RoutingRunning, 1);
+
+    if (options->routingWorkers > 0) {
+        RoutingQueues = (RoutingQueue*)calloc((size_t)options->routingWorkers, sizeof(RoutingQueue));
+        if (RoutingQueues == NULL) {
+            fprintf(stderr, "[BROKER] Sin memoria para las colas de enrutamiento.\n");
+            return 0;
+        }
+        for (int i = 0; i < options->routingWorkers; ++i) {
+            RoutingQueue* queue = &RoutingQueues[i];
+            if (!RoutingQueueInit(queue, (size_t)options->queueCapacity)) {
+                fprintf(stderr, "[BROKER] Sin memoria para la cola del worker %d.\n", i);
+                return 0;
+            }
+            if (!PlatformThreadCreate(&queue->worker, RoutingWorker, queue)) {
+                fprintf(stderr, "[BROKER] No se pudo iniciar el worker de enrutamiento %d.\n", i);
+                CloseHandle(queue->itemsAvailable);
+                DeleteCriticalSection(&queue->pausedLock);
+                free(queue->cells);
+                return 0;
+            }
+            RoutingQueueCount = i + 1;
+        }
+    }
+
+    if (options->reportIntervalS > 0) {
+        ReporterStopEvent = CreateEventA(NULL, TRUE, FALSE, NULL);
+        if (ReporterStopEvent != NULL &&
+            PlatformThreadCreate(&ReporterThread,
+                                 PipelineReporter,
+                                 (void*)(uintptr_t)((DWORD)options->reportIntervalS * 1000))) {
+            ReporterStarted = 1;
+        }
+    }
+
+    BatchIntervalMs = (DWORD)options->batchIntervalMs;
+    if (BatchIntervalMs > 0) {
+        FlusherStopEvent = CreateEventA(NULL, TRUE, FALSE, NULL);
+        if (FlusherStopEvent == NULL || !PlatformThreadCreate(&FlusherThread, BatchFlusher, NULL)) {
+            fprintf(stderr, "[BROKER] No se pudo iniciar el hilo de descarga de lotes; envio inmediato.\n");
+            BatchIntervalMs = 0;
+        } else {
+            FlusherStarted = 1;
+        }
+    }
+
+    if (LogEnabled && Log.policy == EVENT_LOG_SYNC_GROUP) {
+        LogSyncStopEvent = CreateEventA(NULL, TRUE, FALSE, NULL);
+        if (LogSyncStopEvent == NULL || !PlatformThreadCreate(&LogSyncThread, LogSyncer, NULL)) {
+            fprintf(stderr, "[BROKER] No se pudo iniciar el hilo de commit del registro.\n");
+            return 0;
+        }
+        LogSyncStarted = 1;
+    }
+    return 1;
+}
+
+/*
+ * Detiene los workers despues de vaciar sus colas. Va despues de RegistrationClose: con conexiones vivas un
+ * callback podria encolar en una cola ya liberada.
+ */
+static void StopRoutingPipeline(void) {
+    atomic_store(&RoutingRunning, 0);
+    for (int i = 0; i < RoutingQueueCount; ++i) {
+        ReleaseSemaphore(RoutingQueues[i].itemsAvailable, 1, NULL);
+        PlatformThreadJoin(RoutingQueues[i].worker);
+        CloseHandle(RoutingQueues[i].itemsAvailable);
+        DeleteCriticalSection(&RoutingQueues[i].pausedLock);
+        free(RoutingQueues[i].cells);
+    }
+    free(RoutingQueues);
+    RoutingQueues = NULL;
+    RoutingQueueCount = 0;
+
+    /* Despues de los workers: ya no llegan mensajes nuevos y la ultima descarga vacia lo retenido. */
+    if (FlusherStarted) {
+        SetEvent(FlusherStopEvent);
+        PlatformThreadJoin(FlusherThread);
+        FlusherStarted = 0;
+    }
+    BatchIntervalMs = 0;
+    if (FlusherStopEvent != NULL) {
+        CloseHandle(FlusherStopEvent);
+        FlusherStopEvent = NULL;
+    }
+
+    if (LogSyncStarted) {
+        SetEvent(LogSyncStopEvent);
+        PlatformThreadJoin(LogSyncThread);
+        LogSyncStarted = 0;
+    }
+    if (LogSyncStopEvent != NULL) {
+        CloseHandle(LogSyncStopEvent);
+        LogSyncStopEvent = NULL;
+    }
+
+    if (ReporterStarted) {
+        SetEvent(ReporterStopEvent);
+        PlatformThreadJoin(ReporterThread);
+        ReporterStarted = 0;
+    }
+    if (ReporterStopEvent != NULL) {
+        CloseHandle(ReporterStopEvent);
+        ReporterStopEvent = NULL;
+    }
+}
+
+/* Callback refresh del endpoint de metricas: profundidad total de las colas de enrutamiento al momento de responder. */
+static void RefreshQueueDepth(void* context, Metrics* metrics) {
+    (void)context;
+    size_t depth = 0;
+    for (int i = 0; i < RoutingQueueCount; ++i) {
+        depth += RoutingQueueDepth(&RoutingQueues[i]);
+    }
+    MetricsSetQueueDepth(metrics, (int64_t)depth);
+}
 
-    if (topic == NULL || timestamp == NULL || rest == NULL) {
+/* Antes de StopRoutingPipeline: el endpoint no debe leer las colas ya liberadas. */
+static void StopMetricsEndpoint(void) {
+    if (MetricsEnabled) {
+        MetricsServerStop(&MetricsEndpoint);
+    }
+}
+
+/* Despues de MsQuicClose: ningun worker ni callback de msquic vuelve a registrar. */
+static void ReleaseMetrics(void) {
+    if (MetricsEnabled) {
+        MetricsEnabled = 0;
+        MetricsFree(&BrokerMetrics);
+    }
+}
+
+/* Devuelve 0 solo si la cola del topic esta llena; un mensaje malformado se descarta y cuenta como consumido. */
+static int ProcessPublisherMessage(StreamContext* ctx, const char* message) {
+    /* Mismo reloj que PlatformNowUs: el ingreso en ns viaja al subscriptor y en us alimenta las estadisticas. */
+    uint64_t ingressNs = LatencyStampNowNs();
+    uint64_t receivedUs = ingressNs / 1000ULL;
+    char working[MESSAGE_MAX_LEN];
+    size_t length = strlen(message);
+    memcpy(working, message, length + 1);
+
+    RoutingPublish publish;
+    if (!RoutingParsePublish(working, length, &publish)) {
         fprintf(stderr, "[BROKER] Mensaje de publisher malformado: %s\n", message);
+        return 1;
+    }
+
+    RoutingJob job;
+    memcpy(job.topic, publish.topic, sizeof(job.topic));
+    char stamps[LATENCY_STAMP_FORWARD_LEN + 1];
+    const char* timestamp = LatencyStampForward(publish.timestamp, ingressNs, stamps);
+    int written = snprintf(job.payload, sizeof(job.payload), "%s|%s\n", timestamp, publish.body);
+    if (written < 0 || (size_t)written >= sizeof(job.payload)) {
+        /* Truncado: el subscriptor separa por '\n', asi que el ultimo caracter debe seguir siendolo. */
+        job.payload[sizeof(job.payload) - 2] = '\n';
+    }
+    job.receivedUs = receivedUs;
+    job.receivedBytes = (uint32_t)length;
+    job.priority = publish.priority;
+
+    /* Un mensaje rechazado vuelve a llegar cuando el stream se reanuda; se mide solo al encolarlo. */
+    if (!SubmitRoutingJob(&job, ctx)) {
+        return 0;
+    }
+    uint64_t originNs;
+    if (MetricsEnabled && timestamp == stamps && LatencyStampDecode(stamps, &originNs) && ingressNs >= originNs) {
+        MetricsRecordLatency(&BrokerMetrics, METRICS_LATENCY_INGRESS, (ingressNs - originNs) / 1000ULL);
+    }
+    return 1;
+}
+
+static
+QUIC_STATUS
+PriorityStreamCallback(
+    HQUIC stream,
+    void* context,
+    QUIC_STREAM_EVENT* event
+    )
+{
+    ClientContext* client = (ClientContext*)context;
+
+    switch (event->Type) {
+    case QUIC_STREAM_EVENT_SEND_COMPLETE:
+        FreeSendContext((SendContext*)event->SEND_COMPLETE.ClientContext);
+        SampleSendStatistics(client, 0);
+        break;
+
+    case QUIC_STREAM_EVENT_SHUTDOWN_COMPLETE:
+        /* Llega antes que el SHUTDOWN_COMPLETE de la conexion, asi que client sigue vivo. */
+        EnterCriticalSection(&SubscribersLock);
+        client->priorityStream = NULL;
+        client->priorityState = PRIORITY_STREAM_UNAVAILABLE;
+        LeaveCriticalSection(&SubscribersLock);
+        MsQuic->StreamClose(stream);
+        break;
+
+    default:
+        break;
+    }
+
+    return QUIC_STATUS_SUCCESS;
+}
+
+/*
+ * Se llama desde el callback de un stream de la conexion (hilo de msquic de esa conexion), donde GetParam y
+ * SetParam se resuelven en linea: desde un worker de enrutamiento esperarian a ese hilo con SubscribersLock tomado.
+ */
+static void OpenPriorityStream(ClientContext* client) {
+    client->priorityState = PRIORITY_STREAM_UNAVAILABLE;
+
+    uint16_t available = 0;
+    uint32_t size = sizeof(available);
+    if (QUIC_FAILED(MsQuic->GetParam(client->connection, QUIC_PARAM_CONN_LOCAL_UNIDI_STREAM_COUNT, &size, &available)) ||
+        available == 0) {
         return;
     }
 
-    char outbound[MESSAGE_MAX_LEN];
-    snprintf(outbound, sizeof(outbound), "%s|%s", timestamp, rest);
+    HQUIC stream = NULL;
+    if (QUIC_FAILED(MsQuic->StreamOpen(client->connection, QUIC_STREAM_OPEN_FLAG_UNIDIRECTIONAL,
+                                       PriorityStreamCallback, client, &stream))) {
+        return;
+    }
+    uint16_t priority = PRIORITY_STREAM_PRIORITY;
+    (void)MsQuic->SetParam(stream, QUIC_PARAM_STREAM_PRIORITY, sizeof(priority), &priority);
+    if (QUIC_FAILED(MsQuic->StreamStart(stream, QUIC_STREAM_START_FLAG_IMMEDIATE))) {
+        MsQuic->StreamClose(stream);
+        return;
+    }
 
-    printf("[BROKER] Evento %s @ %s -> %s\n", topic, timestamp, rest);
-    BroadcastToTopic(topic, outbound);
+    EnterCriticalSection(&SubscribersLock);
+    client->priorityStream = stream;
+    client->priorityState = PRIORITY_STREAM_OPEN;
+    LeaveCriticalSection(&SubscribersLock);
+    if (Verbose) {
+        printf("[BROKER] Stream de alta prioridad %p abierto.\n", stream);
+    }
 }
 
-static void ProcessSubscriberMessage(ClientContext* client, StreamContext* streamContext, HQUIC stream, const char* message) {
+/*
+ * SUBSCRIBER|<topic> o REPLAY|<topic>|<desde>; topic apunta despues del prefijo. Con replayFrom el subscriptor
+ * recibe el historial del registro en lugar de los mensajes retenidos.
+ */
+static void ProcessSubscriberMessage(ClientContext* client, StreamContext* streamContext, HQUIC stream, const char* topic,
+                                     const EventLogStart* replayFrom) {
     (void)streamContext;
-    const char* topic = message + 11;
     if (strlen(topic) == 0) {
         fprintf(stderr, "[BROKER] Solicitud de suscripcion sin topic.\n");
         return;
     }
 
+    char topicName[ROUTING_TOPIC_LEN];
+    if (RoutingNormalizeTopic(topicName, topic, strlen(topic)) == 0) {
+        fprintf(stderr, "[BROKER] Solicitud de suscripcion sin topic.\n");
+        return;
+    }
+    topic = topicName;
+
     client->type = CLIENT_SUBSCRIBER;
-    strncpy(client->topic, topic, TOPIC_NAME_LEN - 1);
-    client->topic[TOPIC_NAME_LEN - 1] = '\0';
-    client->subscribed = 1;
-    client->activeStream = stream;
-    AddOrUpdateSubscriber(topic, client, stream);
+    if (client->priorityState == PRIORITY_STREAM_UNTRIED) {
+        OpenPriorityStream(client);
+    }
+
+    /*
+     * Alta, confirmacion y mensajes retenidos bajo el mismo lock: ningun worker puede enviar un evento en vivo
+     * entre SUBSCRIBED y los retenidos, ni entregar uno que ya venga incluido entre ellos.
+     */
+    EnterCriticalSection(&SubscribersLock);
+    int isNew = 0;
+    int registered = AddOrUpdateSubscriber(topic, client, stream, &isNew);
 
+    /* El cliente solo recibe SUBSCRIBED si quedo registrado; asi un cliente de carga puede medir la disponibilidad real. */
     char ack[MESSAGE_MAX_LEN];
-    snprintf(ack, sizeof(ack), "SUBSCRIBED|%s", topic);
+    snprintf(ack, sizeof(ack), "%s|%s\n", registered ? "SUBSCRIBED" : "ERROR", topic);
     (void)SendTextOnStream(stream, ack);
 
-    printf("[BROKER] Subscriptor registrado para %s\n", topic);
+    int32_t retained = 0;
+    int64_t replayed = 0;
+    if (registered && replayFrom != NULL) {
+        /* El historial ya incluye lo que estuviera retenido por --lote-ms. */
+        DiscardHeldBack(BatchOf(client->subscriberIndex));
+        replayed = LogEnabled ? EventLogReplay(&Log, topic, replayFrom, QuicReplaySink, stream) : 0;
+        if (replayed < 0) {
+            fprintf(stderr, "[BROKER] Error reenviando el registro de %s.\n", topic);
+            RoutingUnsubscribe(&Routes, client->subscriberIndex);
+        }
+    } else if (registered && isNew) {
+        retained = RoutingReplayRetained(&Routes, client->subscriberIndex);
+    }
+    UpdateSubscriberGauge();
+    LeaveCriticalSection(&SubscribersLock);
+
+    if (Verbose) {
+        printf("[BROKER] Subscriptor registrado para %s (%d mensajes retenidos, %lld bytes de historial)\n", topic,
+               retained > 0 ? (int)retained : 0, (long long)(replayed > 0 ? replayed : 0));
+    }
 }
 
-static void HandleReceivedData(HQUIC stream, StreamContext* ctx, const QUIC_STREAM_EVENT* event) {
-    size_t total = ctx->receiveLength;
-    for (uint32_t i = 0; i < event->RECEIVE.BufferCount; ++i) {
-        const QUIC_BUFFER* buffer = &event->RECEIVE.Buffers[i];
-        size_t remaining = MESSAGE_MAX_LEN - 1 - total;
-        size_t toCopy = buffer->Length < remaining ? buffer->Length : remaining;
-        memcpy(ctx->receiveBuffer + total, buffer->Buffer, toCopy);
-        total += toCopy;
-        if (toCopy < buffer->Length) {
-            fprintf(stderr, "[BROKER] Mensaje truncado (excede %d bytes).\n", MESSAGE_MAX_LEN);
-            break;
-        }
+static void ProcessReplayMessage(ClientContext* client, StreamContext* streamContext, HQUIC stream, const char* message) {
+    const char* topic = message + 7;
+    const char* separator = strchr(topic, '|');
+    EventLogStart start;
+    char topicName[ROUTING_TOPIC_LEN];
+    size_t length = RoutingNormalizeTopic(topicName, topic, strlen(topic));
+    if (length == 0 || strpbrk(topicName, "+#") != NULL || !EventLogParseStart(separator != NULL ? separator + 1 : NULL, &start)) {
+        char error[MESSAGE_MAX_LEN];
+        snprintf(error, sizeof(error), "ERROR|%s\n", topicName);
+        (void)SendTextOnStream(stream, error);
+        fprintf(stderr, "[BROKER] Solicitud REPLAY invalida: %s\n", message);
+        return;
+    }
+    if (!LogEnabled) {
+        fprintf(stderr, "[BROKER] REPLAY sin registro activo (--registro); solo eventos en vivo.\n");
+    }
+    ProcessSubscriberMessage(client, streamContext, stream, topicName, &start);
+}
+
+/* Devuelve 0 si el mensaje no se pudo encolar y debe volver a entregarse (ver SubmitRoutingJob). */
+static int DispatchMessage(HQUIC stream, StreamContext* ctx, const char* data, size_t length, int truncated) {
+    char message[MESSAGE_MAX_LEN];
+    if (length > MESSAGE_MAX_LEN - 1) {
+        length = MESSAGE_MAX_LEN - 1;
+        truncated = 1;
+    }
+    memcpy(message, data, length);
+    message[length] = '\0';
+    if (length > 0 && message[length - 1] == '\r') {
+        message[length - 1] = '\0';
+    }
+    if (truncated) {
+        fprintf(stderr, "[BROKER] Mensaje truncado (excede %d bytes).\n", MESSAGE_MAX_LEN);
+    }
+
+    if (message[0] == '\0') {
+        return 1;
     }
-    ctx->receiveBuffer[total] = '\0';
-    ctx->receiveLength = 0;
 
-    if (strncmp(ctx->receiveBuffer, "SUBSCRIBER|", 11) == 0) {
-        ProcessSubscriberMessage(ctx->client, ctx, stream, ctx->receiveBuffer);
-    } else if (strncmp(ctx->receiveBuffer, "PUBLISHER|", 10) == 0) {
+    if (strncmp(message, "SUBSCRIBER|", 11) == 0) {
+        ProcessSubscriberMessage(ctx->client, ctx, stream, message + 11, NULL);
+    } else if (strncmp(message, "REPLAY|", 7) == 0) {
+        ProcessReplayMessage(ctx->client, ctx, stream, message);
+    } else if (strncmp(message, "PUBLISHER|", 10) == 0) {
         ctx->client->type = CLIENT_PUBLISHER;
-        ProcessPublisherMessage(ctx->client, ctx->receiveBuffer);
+        return ProcessPublisherMessage(ctx, message);
     } else {
-        fprintf(stderr, "[BROKER] Mensaje desconocido: %s\n", ctx->receiveBuffer);
+        fprintf(stderr, "[BROKER] Mensaje desconocido: %s\n", message);
+    }
+    return 1;
+}
+
+/* Acumula un fragmento sin '\n'; el buffer se reserva aqui y se libera al completar el mensaje. */
+static void AppendPending(StreamContext* ctx, const char* data, size_t length) {
+    if (ctx->receiveBuffer == NULL) {
+        ctx->receiveBuffer = (char*)malloc(MESSAGE_MAX_LEN);
+        if (ctx->receiveBuffer == NULL) {
+            fprintf(stderr, "[BROKER] Sin memoria para el fragmento pendiente.\n");
+            ctx->truncated = 1;
+            return;
+        }
+    }
+
+    size_t remaining = MESSAGE_MAX_LEN - 1 - ctx->receiveLength;
+    size_t toCopy = length < remaining ? length : remaining;
+    memcpy(ctx->receiveBuffer + ctx->receiveLength, data, toCopy);
+    ctx->receiveLength = (uint16_t)(ctx->receiveLength + toCopy);
+    if (toCopy < length) {
+        ctx->truncated = 1;
+    }
+}
+
+/* Si la cola esta llena el fragmento se conserva y devuelve 0. */
+static int DispatchPending(HQUIC stream, StreamContext* ctx) {
+    if (ctx->receiveBuffer != NULL) {
+        if (!DispatchMessage(stream, ctx, ctx->receiveBuffer, ctx->receiveLength, ctx->truncated)) {
+            return 0;
+        }
+    } else if (ctx->truncated) {
+        fprintf(stderr, "[BROKER] Se descarto un mensaje por falta de memoria.\n");
+    }
+    free(ctx->receiveBuffer);
+    ctx->receiveBuffer = NULL;
+    ctx->receiveLength = 0;
+    ctx->truncated = 0;
+    return 1;
+}
+
+/*
+ * Los mensajes del stream terminan en '\n'. Un RECEIVE puede traer varios mensajes (el publisher agrupa eventos
+ * en un solo StreamSend) o solo una parte de uno. Los mensajes completos se despachan directamente desde el
+ * buffer de msquic; solo un fragmento pendiente se copia a receiveBuffer. Si la cola de enrutamiento esta llena
+ * el callback consume solo hasta el mensaje rechazado y detiene la recepcion del stream: msquic deja de dar
+ * credito de flujo al publisher y le vuelve a entregar el resto cuando el worker lo reanuda.
+ */
+static void HandleReceivedData(HQUIC stream, StreamContext* ctx, QUIC_STREAM_EVENT* event) {
+    uint64_t consumed = 0;
+    for (uint32_t i = 0; i < event->RECEIVE.BufferCount; ++i) {
+        const QUIC_BUFFER* buffer = &event->RECEIVE.Buffers[i];
+        const char* cursor = (const char*)buffer->Buffer;
+        size_t available = buffer->Length;
+
+        while (available > 0) {
+            const char* newline = (const char*)memchr(cursor, '\n', available);
+            size_t chunk = newline != NULL ? (size_t)(newline - cursor) : available;
+            int accepted = 1;
+
+            if (newline != NULL && ctx->receiveLength == 0 && !ctx->truncated) {
+                accepted = DispatchMessage(stream, ctx, cursor, chunk, 0);
+            } else {
+                uint16_t pendingLength = ctx->receiveLength;
+                uint8_t pendingTruncated = ctx->truncated;
+                AppendPending(ctx, cursor, chunk);
+                if (newline != NULL && !DispatchPending(stream, ctx)) {
+                    /* El trozo vuelve a llegar; se quita para no duplicarlo en el fragmento. */
+                    ctx->receiveLength = pendingLength;
+                    ctx->truncated = pendingTruncated;
+                    accepted = 0;
+                }
+            }
+
+            if (!accepted) {
+                (void)MsQuic->StreamReceiveSetEnabled(stream, FALSE);
+                event->RECEIVE.TotalBufferLength = consumed;
+                return;
+            }
+            if (newline == NULL) {
+                consumed += available;
+                break;
+            }
+            cursor = newline + 1;
+            available -= chunk + 1;
+            consumed += chunk + 1;
+        }
     }
 }
 
@@ -439,29 +1702,45 @@ ServerStreamCallback(
 
     switch (event->Type) {
     case QUIC_STREAM_EVENT_RECEIVE:
-        printf("[BROKER] Stream %p recibio %u buffers.\n",
-               stream,
-               event->RECEIVE.BufferCount);
+        if (Verbose) {
+            printf("[BROKER] Stream %p recibio %u buffers.\n",
+                   stream,
+                   event->RECEIVE.BufferCount);
+        }
         HandleReceivedData(stream, streamContext, event);
         break;
 
     case QUIC_STREAM_EVENT_SEND_COMPLETE: {
         SendContext* sendContext = (SendContext*)event->SEND_COMPLETE.ClientContext;
-        if (sendContext != NULL) {
-            free(sendContext->buffer);
-            free(sendContext);
-        }
+        FreeSendContext(sendContext);
+        SampleSendStatistics(streamContext->client, 0);
         break;
     }
 
     case QUIC_STREAM_EVENT_PEER_SEND_SHUTDOWN:
-        printf("[BROKER] Stream %p peer envio shutdown.\n", stream);
+        if (Verbose) {
+            printf("[BROKER] Stream %p peer envio shutdown.\n", stream);
+        }
+        /* Un cliente que no termina su ultimo mensaje en '\n' lo entrega al cerrar su lado del stream. */
+        if ((streamContext->receiveLength > 0 || streamContext->truncated) && !DispatchPending(stream, streamContext)) {
+            /* Ya no habra otro RECEIVE que lo reintente. */
+            fprintf(stderr, "[BROKER] Cola llena al cerrar el stream %p; se descarta su ultimo mensaje.\n", stream);
+            UnpauseStream(streamContext);
+            free(streamContext->receiveBuffer);
+            streamContext->receiveBuffer = NULL;
+            streamContext->receiveLength = 0;
+            streamContext->truncated = 0;
+        }
         break;
 
     case QUIC_STREAM_EVENT_SHUTDOWN_COMPLETE:
-        printf("[BROKER] Stream %p shutdown completo.\n", stream);
-        RemoveSubscriberByStream(stream);
+        if (Verbose) {
+            printf("[BROKER] Stream %p shutdown completo.\n", stream);
+        }
+        RemoveSubscriberByStream(streamContext->client, stream);
+        UnpauseStream(streamContext);
         MsQuic->StreamClose(stream);
+        free(streamContext->receiveBuffer);
         free(streamContext);
         break;
 
@@ -484,11 +1763,18 @@ ServerConnectionCallback(
 
     switch (event->Type) {
     case QUIC_CONNECTION_EVENT_CONNECTED:
-        printf("[BROKER] Conexion establecida.\n");
+        if (Verbose) {
+            printf("[BROKER] Conexion establecida (%s).\n",
+                   event->CONNECTED.SessionResumed ? "reanudada" : "handshake completo");
+        }
+        /* Ticket para que el cliente pueda reconectarse con handshake reanudado y datos 0-RTT. */
+        MsQuic->ConnectionSendResumptionTicket(connection, QUIC_SEND_RESUMPTION_FLAG_NONE, 0, NULL);
         break;
 
     case QUIC_CONNECTION_EVENT_PEER_STREAM_STARTED: {
-        printf("[BROKER] Conexion %p inicio stream entrante.\n", connection);
+        if (Verbose) {
+            printf("[BROKER] Conexion %p inicio stream entrante.\n", connection);
+        }
         StreamContext* streamContext = (StreamContext*)calloc(1, sizeof(StreamContext));
         if (streamContext == NULL) {
             fprintf(stderr, "[BROKER] Sin memoria para stream context.\n");
@@ -500,6 +1786,7 @@ ServerConnectionCallback(
         }
 
         streamContext->client = client;
+        streamContext->stream = event->PEER_STREAM_STARTED.Stream;
         MsQuic->SetCallbackHandler(
             event->PEER_STREAM_STARTED.Stream,
             (void*)ServerStreamCallback,
@@ -513,10 +1800,13 @@ ServerConnectionCallback(
         break;
 
     case QUIC_CONNECTION_EVENT_SHUTDOWN_INITIATED_BY_PEER:
-        printf("[BROKER] Peer cerro conexion.\n");
+        if (Verbose) {
+            printf("[BROKER] Peer cerro conexion.\n");
+        }
         break;
 
     case QUIC_CONNECTION_EVENT_SHUTDOWN_COMPLETE:
+        SampleSendStatistics(client, 1);
         RemoveSubscriberByClient(client);
         MsQuic->ConnectionClose(connection);
         free(client);
@@ -549,6 +1839,7 @@ ServerListenerCallback(
         }
 
         client->connection = event->NEW_CONNECTION.Connection;
+        client->subscriberIndex = NO_INDEX;
         MsQuic->SetCallbackHandler(
             event->NEW_CONNECTION.Connection,
             (void*)ServerConnectionCallback,
@@ -580,18 +1871,227 @@ ServerListenerCallback(
     return QUIC_STATUS_SUCCESS;
 }
 
-int main(int argc, char** argv) {
-    if (argc != 4) {
-        fprintf(stderr, "Uso: %s <PUERTO> <RUTA_CERTIFICADO_PFX> <PASSWORD_PFX>\n", argv[0]);
-        fprintf(stderr, "Ejemplo: %s 5000 broker_dev.pfx PfxStrongPassword\n", argv[0]);
-        return EXIT_FAILURE;
+static int LoadTicketKey(const char* path) {
+    uint8_t* keyBuffer = NULL;
+    uint32_t keyLength = 0;
+    if (!ReadFileToBuffer(path, &keyBuffer, &keyLength)) {
+        return 0;
+    }
+
+    QUIC_TICKET_KEY_CONFIG keyConfig;
+    memset(&keyConfig, 0, sizeof(keyConfig));
+    if (keyLength < sizeof(keyConfig.Id) + 32) {
+        fprintf(stderr, "[BROKER] La llave de tickets debe tener al menos 48 bytes.\n");
+        free(keyBuffer);
+        return 0;
     }
 
-    int portValue = atoi(argv[1]);
-    if (portValue <= 0 || portValue > 65535) {
+    uint32_t materialLength = keyLength - (uint32_t)sizeof(keyConfig.Id);
+    if (materialLength > sizeof(keyConfig.Material)) {
+        materialLength = sizeof(keyConfig.Material);
+    }
+    memcpy(keyConfig.Id, keyBuffer, sizeof(keyConfig.Id));
+    memcpy(keyConfig.Material, keyBuffer + sizeof(keyConfig.Id), materialLength);
+    keyConfig.MaterialLength = (uint8_t)materialLength;
+    free(keyBuffer);
+
+    QUIC_STATUS status = MsQuic->SetParam(
+        Configuration,
+        QUIC_PARAM_CONFIGURATION_TICKET_KEYS,
+        sizeof(keyConfig),
+        &keyConfig);
+    if (QUIC_FAILED(status)) {
+        fprintf(stderr, "[BROKER] No se pudo configurar la llave de tickets (%u).\n", status);
+        return 0;
+    }
+    return 1;
+}
+
+static void PrintUsage(const char* program) {
+    fprintf(stderr, "Uso: %s <PUERTO> <RUTA_CERTIFICADO_PFX> <PASSWORD_PFX> [opciones]\n", program);
+    fprintf(stderr, "     %s <PUERTO> --cert <CERTIFICADO_PEM> --key <LLAVE_PEM> [opciones]\n", program);
+    fprintf(stderr, "Opciones:\n");
+    fprintf(stderr, "  --perfil latencia|throughput   Perfil de ejecucion de msquic (por defecto: latencia)\n");
+    fprintf(stderr, "  --ticket-key <archivo>         Llave de 48 bytes para tickets de reanudacion 0-RTT\n");
+    fprintf(stderr, "  --workers N                    Hilos de enrutamiento (por defecto %d; 0 = en el callback)\n", DEFAULT_ROUTING_WORKERS);
+    fprintf(stderr, "  --cola N                       Capacidad de cola por worker, potencia de dos (por defecto %d)\n", DEFAULT_ROUTING_QUEUE_CAPACITY);
+    fprintf(stderr, "  --reporte S                    Segundos entre reportes del pipeline (por defecto %d; 0 = nunca)\n", DEFAULT_REPORT_INTERVAL_S);
+    fprintf(stderr, "  --verbose                      Imprime cada mensaje recibido\n");
+    fprintf(stderr, "  --lote-ms N                    Agrupa envios a subscriptores cada N ms (por defecto 0 = inmediato)\n");
+    fprintf(stderr, "  --max-subscriptores N          Tamano maximo de la tabla de subscriptores (por defecto %d)\n", DEFAULT_MAX_SUBSCRIBERS);
+    fprintf(stderr, "  --retener N                    Mensajes retenidos por topic para nuevos subscriptores (por defecto %d; 0 = no)\n", DEFAULT_RETAINED_MESSAGES);
+    fprintf(stderr, "  --registro DIR                 Registro persistente de eventos por topic (habilita REPLAY|topic|offset)\n");
+    fprintf(stderr, "  --fsync no|grupo|siempre       Sincronizacion del registro (por defecto grupo)\n");
+    fprintf(stderr, "  --fsync-ms N                   Intervalo del commit agrupado (por defecto %d ms)\n", DEFAULT_LOG_SYNC_MS);
+    fprintf(stderr, "  --metricas PUERTO              Expone metricas de Prometheus en http://127.0.0.1:PUERTO/metrics\n");
+    fprintf(stderr, "  --grupos carga|turno           Reparto en grupos $share/<grupo>/<filtro> (por defecto carga)\n");
+    fprintf(stderr, "Ejemplo: %s 5000 broker_dev.pfx PfxStrongPassword\n", program);
+    fprintf(stderr, "Ejemplo: %s 5000 --cert broker.crt --key broker.key --perfil throughput\n", program);
+}
+
+static int ParseArguments(int argc, char** argv, BrokerOptions* options) {
+    memset(options, 0, sizeof(*options));
+    options->profile = QUIC_EXECUTION_PROFILE_LOW_LATENCY;
+    options->routingWorkers = DEFAULT_ROUTING_WORKERS;
+    options->queueCapacity = DEFAULT_ROUTING_QUEUE_CAPACITY;
+    options->reportIntervalS = DEFAULT_REPORT_INTERVAL_S;
+    options->maxSubscribers = DEFAULT_MAX_SUBSCRIBERS;
+    options->retainedMessages = DEFAULT_RETAINED_MESSAGES;
+    options->logSyncPolicy = EVENT_LOG_SYNC_GROUP;
+    options->logSyncMs = DEFAULT_LOG_SYNC_MS;
+    options->groupPolicy = ROUTING_GROUP_LEAST_LOADED;
+
+    if (argc < 2) {
+        return 0;
+    }
+
+    options->port = atoi(argv[1]);
+    if (options->port <= 0 || options->port > 65535) {
         fprintf(stderr, "[BROKER] Puerto invalido: %s\n", argv[1]);
+        return 0;
+    }
+
+    int positional = 0;
+    for (int i = 2; i < argc; ++i) {
+        if (strcmp(argv[i], "--cert") == 0 && i + 1 < argc) {
+            options->certFile = argv[++i];
+        } else if (strcmp(argv[i], "--key") == 0 && i + 1 < argc) {
+            options->keyFile = argv[++i];
+        } else if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc) {
+            options->routingWorkers = atoi(argv[++i]);
+            if (options->routingWorkers < 0 || options->routingWorkers > 64) {
+                fprintf(stderr, "[BROKER] Numero de workers invalido: %s\n", argv[i]);
+                return 0;
+            }
+        } else if (strcmp(argv[i], "--cola") == 0 && i + 1 < argc) {
+            options->queueCapacity = atoi(argv[++i]);
+            if (options->queueCapacity < 2 || (options->queueCapacity & (options->queueCapacity - 1)) != 0) {
+                fprintf(stderr, "[BROKER] La capacidad de la cola debe ser potencia de dos: %s\n", argv[i]);
+                return 0;
+            }
+        } else if (strcmp(argv[i], "--reporte") == 0 && i + 1 < argc) {
+            options->reportIntervalS = atoi(argv[++i]);
+            if (options->reportIntervalS < 0) {
+                options->reportIntervalS = 0;
+            }
+        } else if (strcmp(argv[i], "--verbose") == 0) {
+            options->verbose = 1;
+        } else if (strcmp(argv[i], "--max-subscriptores") == 0 && i + 1 < argc) {
+            options->maxSubscribers = atoi(argv[++i]);
+            if (options->maxSubscribers <= 0) {
+                fprintf(stderr, "[BROKER] Maximo de subscriptores invalido: %s\n", argv[i]);
+                return 0;
+            }
+        } else if (strcmp(argv[i], "--retener") == 0 && i + 1 < argc) {
+            options->retainedMessages = atoi(argv[++i]);
+            if (options->retainedMessages < 0 || options->retainedMessages > 1024) {
+                fprintf(stderr, "[BROKER] Cantidad de mensajes retenidos invalida (0..1024): %s\n", argv[i]);
+                return 0;
+            }
+        } else if (strcmp(argv[i], "--registro") == 0 && i + 1 < argc) {
+            options->logDirectory = argv[++i];
+        } else if (strcmp(argv[i], "--fsync") == 0 && i + 1 < argc) {
+            const char* policy = argv[++i];
+            if (strcmp(policy, "no") == 0) {
+                options->logSyncPolicy = EVENT_LOG_SYNC_NONE;
+            } else if (strcmp(policy, "grupo") == 0) {
+                options->logSyncPolicy = EVENT_LOG_SYNC_GROUP;
+            } else if (strcmp(policy, "siempre") == 0) {
+                options->logSyncPolicy = EVENT_LOG_SYNC_ALWAYS;
+            } else {
+                fprintf(stderr, "[BROKER] Politica de fsync invalida: %s\n", policy);
+                return 0;
+            }
+        } else if (strcmp(argv[i], "--fsync-ms") == 0 && i + 1 < argc) {
+            options->logSyncMs = atoi(argv[++i]);
+            if (options->logSyncMs <= 0) {
+                fprintf(stderr, "[BROKER] Intervalo de fsync invalido: %s\n", argv[i]);
+                return 0;
+            }
+        } else if (strcmp(argv[i], "--metricas") == 0 && i + 1 < argc) {
+            options->metricsPort = atoi(argv[++i]);
+            if (options->metricsPort <= 0 || options->metricsPort > 65535) {
+                fprintf(stderr, "[BROKER] Puerto de metricas invalido: %s\n", argv[i]);
+                return 0;
+            }
+        } else if (strcmp(argv[i], "--lote-ms") == 0 && i + 1 < argc) {
+            options->batchIntervalMs = atoi(argv[++i]);
+            if (options->batchIntervalMs < 0 || options->batchIntervalMs > 1000) {
+                fprintf(stderr, "[BROKER] Intervalo de lote invalido (0..1000 ms): %s\n", argv[i]);
+                return 0;
+            }
+        } else if (strcmp(argv[i], "--ticket-key") == 0 && i + 1 < argc) {
+            options->ticketKeyFile = argv[++i];
+        } else if (strcmp(argv[i], "--grupos") == 0 && i + 1 < argc) {
+            const char* policy = argv[++i];
+            if (strcmp(policy, "carga") == 0) {
+                options->groupPolicy = ROUTING_GROUP_LEAST_LOADED;
+            } else if (strcmp(policy, "turno") == 0) {
+                options->groupPolicy = ROUTING_GROUP_ROUND_ROBIN;
+            } else {
+                fprintf(stderr, "[BROKER] Reparto de grupos desconocido: %s\n", policy);
+                return 0;
+            }
+        } else if (strcmp(argv[i], "--perfil") == 0 && i + 1 < argc) {
+            /*
+             * Solo cambia el perfil de msquic: los valores por defecto se fijan antes del bucle, asi que --perfil
+             * puede ir antes o despues de --workers, --cola y --reporte sin pisarlos.
+             */
+            const char* profile = argv[++i];
+            if (strcmp(profile, "latencia") == 0) {
+                options->profile = QUIC_EXECUTION_PROFILE_LOW_LATENCY;
+            } else if (strcmp(profile, "throughput") == 0) {
+                options->profile = QUIC_EXECUTION_PROFILE_TYPE_MAX_THROUGHPUT;
+            } else {
+                fprintf(stderr, "[BROKER] Perfil desconocido: %s\n", profile);
+                return 0;
+            }
+        } else if (strncmp(argv[i], "--", 2) == 0) {
+            fprintf(stderr, "[BROKER] Opcion desconocida o incompleta: %s\n", argv[i]);
+            return 0;
+        } else if (positional == 0) {
+            options->pfxPath = argv[i];
+            ++positional;
+        } else if (positional == 1) {
+            options->pfxPassword = argv[i];
+            ++positional;
+        } else {
+            fprintf(stderr, "[BROKER] Argumento inesperado: %s\n", argv[i]);
+            return 0;
+        }
+    }
+
+    if (options->certFile != NULL || options->keyFile != NULL) {
+        if (options->certFile == NULL || options->keyFile == NULL || options->pfxPath != NULL) {
+            fprintf(stderr, "[BROKER] --cert y --key van juntos y no se combinan con un PFX.\n");
+            return 0;
+        }
+        return 1;
+    }
+
+    if (positional != 2) {
+        return 0;
+    }
+    return 1;
+}
+
+int main(int argc, char** argv) {
+    BrokerOptions options;
+    if (!ParseArguments(argc, argv, &options)) {
+        PrintUsage(argv[0]);
         return EXIT_FAILURE;
     }
+    Verbose = options.verbose;
+    RoutingTableInit(&Routes, &QuicTransport, sizeof(SubscriberBatch), INITIAL_SUBSCRIBER_CAPACITY, options.maxSubscribers);
+    RoutingSetRetainDepth(&Routes, (uint32_t)options.retainedMessages);
+    RoutingSetGroupPolicy(&Routes, options.groupPolicy);
+    if (options.logDirectory != NULL) {
+        if (!EventLogOpen(&Log, options.logDirectory, options.logSyncPolicy, (uint32_t)options.logSyncMs)) {
+            return EXIT_FAILURE;
+        }
+        LogEnabled = 1;
+        printf("[BROKER] Registro de eventos en %s\n", options.logDirectory);
+    }
 
     InitializeCriticalSection(&SubscribersLock);
 
@@ -602,7 +2102,7 @@ int main(int argc, char** argv) {
         return EXIT_FAILURE;
     }
 
-    QUIC_REGISTRATION_CONFIG regConfig = { "BrokerApp", QUIC_EXECUTION_PROFILE_LOW_LATENCY };
+    QUIC_REGISTRATION_CONFIG regConfig = { "BrokerApp", options.profile };
     status = MsQuic->RegistrationOpen(&regConfig, &Registration);
     if (QUIC_FAILED(status)) {
         fprintf(stderr, "[BROKER] RegistrationOpen fracaso (%u).\n", status);
@@ -625,6 +2125,11 @@ int main(int argc, char** argv) {
     settings.SendIdleTimeoutMs = 600000;
     settings.IsSet.KeepAliveIntervalMs = TRUE;
     settings.KeepAliveIntervalMs = 15000; /* keep-alive cada 15s */
+    settings.IsSet.ServerResumptionLevel = TRUE;
+    settings.ServerResumptionLevel = QUIC_SERVER_RESUME_AND_ZERORTT;
+    /* Un publisher en modo --multi abre un stream por partido sobre la misma conexion. */
+    settings.IsSet.PeerBidiStreamCount = TRUE;
+    settings.PeerBidiStreamCount = PEER_BIDI_STREAMS;
 
     status = MsQuic->ConfigurationOpen(
         Registration,
@@ -642,9 +2147,9 @@ int main(int argc, char** argv) {
         return EXIT_FAILURE;
     }
 
-    uint8_t* pfxBuffer = NULL;
-    uint32_t pfxLength = 0;
-    if (!ReadFileToBuffer(argv[2], &pfxBuffer, &pfxLength)) {
+    status = LoadBrokerCredential(&options);
+    if (QUIC_FAILED(status)) {
+        fprintf(stderr, "[BROKER] ConfigurationLoadCredential fracaso (%u).\n", status);
         MsQuic->ConfigurationClose(Configuration);
         MsQuic->RegistrationClose(Registration);
         MsQuicClose(MsQuic);
@@ -652,38 +2157,50 @@ int main(int argc, char** argv) {
         return EXIT_FAILURE;
     }
 
-    BrokerCertificate = (PCERT_CONTEXT)ImportCertificateContext(pfxBuffer, pfxLength, argv[3]);
-    free(pfxBuffer);
-    if (BrokerCertificate == NULL) {
+    if (options.ticketKeyFile != NULL && !LoadTicketKey(options.ticketKeyFile)) {
         MsQuic->ConfigurationClose(Configuration);
         MsQuic->RegistrationClose(Registration);
         MsQuicClose(MsQuic);
+        ReleaseBrokerCertificate();
         DeleteCriticalSection(&SubscribersLock);
         return EXIT_FAILURE;
     }
 
-    QUIC_CREDENTIAL_CONFIG credConfig;
-    memset(&credConfig, 0, sizeof(credConfig));
-    credConfig.Type = QUIC_CREDENTIAL_TYPE_CERTIFICATE_CONTEXT;
-    credConfig.CertificateContext = (QUIC_CERTIFICATE*)BrokerCertificate;
-    credConfig.Flags = QUIC_CREDENTIAL_FLAG_NONE;
-
-    status = MsQuic->ConfigurationLoadCredential(Configuration, &credConfig);
-    if (QUIC_FAILED(status)) {
-        fprintf(stderr, "[BROKER] ConfigurationLoadCredential fracaso (%u).\n", status);
-        CertFreeCertificateContext(BrokerCertificate);
-        BrokerCertificate = NULL;
-        if (BrokerCertStore != NULL) {
-            CertCloseStore(BrokerCertStore, 0);
-            BrokerCertStore = NULL;
-        }
+    if (!StartRoutingPipeline(&options)) {
+        StopRoutingPipeline();
         MsQuic->ConfigurationClose(Configuration);
         MsQuic->RegistrationClose(Registration);
         MsQuicClose(MsQuic);
+        ReleaseBrokerCertificate();
         DeleteCriticalSection(&SubscribersLock);
         return EXIT_FAILURE;
     }
 
+    /* Despues del pipeline: el callback refresh recorre RoutingQueues desde el hilo del endpoint. */
+    if (options.metricsPort > 0) {
+        if (!MetricsInit(&BrokerMetrics, "quic")) {
+            fprintf(stderr, "[BROKER] Sin memoria para las metricas.\n");
+        } else {
+            BrokerMetrics.refresh = RefreshQueueDepth;
+            if (MetricsServerStart(&MetricsEndpoint, &BrokerMetrics, (uint16_t)options.metricsPort)) {
+                MetricsEnabled = 1;
+                printf("[BROKER] Metricas en http://127.0.0.1:%d/metrics\n", options.metricsPort);
+            } else {
+                fprintf(stderr, "[BROKER] No se pudo abrir el puerto de metricas %d.\n", options.metricsPort);
+                MetricsFree(&BrokerMetrics);
+            }
+        }
+        if (!MetricsEnabled) {
+            StopRoutingPipeline();
+            MsQuic->ConfigurationClose(Configuration);
+            MsQuic->RegistrationClose(Registration);
+            MsQuicClose(MsQuic);
+            ReleaseBrokerCertificate();
+            DeleteCriticalSection(&SubscribersLock);
+            return EXIT_FAILURE;
+        }
+    }
+
     status = MsQuic->ListenerOpen(
         Registration,
         ServerListenerCallback,
@@ -691,9 +2208,13 @@ int main(int argc, char** argv) {
         &Listener);
     if (QUIC_FAILED(status)) {
         fprintf(stderr, "[BROKER] ListenerOpen fracaso (%u).\n", status);
+        StopMetricsEndpoint();
+        StopRoutingPipeline();
         MsQuic->ConfigurationClose(Configuration);
         MsQuic->RegistrationClose(Registration);
         MsQuicClose(MsQuic);
+        ReleaseMetrics();
+        ReleaseBrokerCertificate();
         DeleteCriticalSection(&SubscribersLock);
         return EXIT_FAILURE;
     }
@@ -701,7 +2222,7 @@ int main(int argc, char** argv) {
     QUIC_ADDR address;
     memset(&address, 0, sizeof(address));
     address.Ipv4.sin_family = AF_INET;
-    address.Ipv4.sin_port = htons((uint16_t)portValue);
+    address.Ipv4.sin_port = htons((uint16_t)options.port);
     address.Ipv4.sin_addr.s_addr = htonl(INADDR_ANY);
 
     status = MsQuic->ListenerStart(
@@ -712,29 +2233,52 @@ int main(int argc, char** argv) {
     if (QUIC_FAILED(status)) {
         fprintf(stderr, "[BROKER] ListenerStart fracaso (%u).\n", status);
         MsQuic->ListenerClose(Listener);
+        StopMetricsEndpoint();
+        StopRoutingPipeline();
         MsQuic->ConfigurationClose(Configuration);
         MsQuic->RegistrationClose(Registration);
         MsQuicClose(MsQuic);
+        ReleaseMetrics();
+        ReleaseBrokerCertificate();
         DeleteCriticalSection(&SubscribersLock);
         return EXIT_FAILURE;
     }
 
-    printf("[BROKER] Escuchando en puerto %d (ALPN: %s).\n", portValue, DEFAULT_ALPN);
+    printf("[BROKER] Escuchando en puerto %d (ALPN: %s, perfil: %s, workers: %d).\n",
+           options.port,
+           DEFAULT_ALPN,
+           options.profile == QUIC_EXECUTION_PROFILE_TYPE_MAX_THROUGHPUT ? "throughput" : "latencia",
+           options.routingWorkers);
+    printf("[BROKER] Estado propio por subscriptor: %zu bytes (ClientContext %zu + StreamContext %zu + "
+           "RoutingEntry %zu + SubscriberBatch %zu), maximo %ld subscriptores.\n",
+           sizeof(ClientContext) + sizeof(StreamContext) + sizeof(RoutingEntry) + sizeof(SubscriberBatch),
+           sizeof(ClientContext),
+           sizeof(StreamContext),
+           sizeof(RoutingEntry),
+           sizeof(SubscriberBatch),
+           (long)Routes.maxSubscribers);
     printf("[BROKER] Presiona ENTER para detener el broker.\n");
     (void)getchar();
 
+    /*
+     * Primero las conexiones: RegistrationClose espera el SHUTDOWN_COMPLETE de todas, y desde ahi ningun callback
+     * vuelve a encolar trabajos ni a tocar un stream. Recien entonces se vacian las colas y se liberan.
+     */
     MsQuic->ListenerStop(Listener);
     MsQuic->ListenerClose(Listener);
+    MsQuic->RegistrationShutdown(Registration, QUIC_CONNECTION_SHUTDOWN_FLAG_NONE, 0);
     MsQuic->ConfigurationClose(Configuration);
     MsQuic->RegistrationClose(Registration);
+    StopMetricsEndpoint();
+    StopRoutingPipeline();
     MsQuicClose(MsQuic);
-    if (BrokerCertificate != NULL) {
-        CertFreeCertificateContext(BrokerCertificate);
-        BrokerCertificate = NULL;
-    }
-    if (BrokerCertStore != NULL) {
-        CertCloseStore(BrokerCertStore, 0);
-        BrokerCertStore = NULL;
+    ReleaseMetrics();
+    ReleaseBrokerCertificate();
+    FreeSubscriberTables();
+    /* Despues de cerrar el registro de msquic: ya no hay envios apuntando a los segmentos. */
+    if (LogEnabled) {
+        EventLogClose(&Log);
+        LogEnabled = 0;
     }
     DeleteCriticalSection(&SubscribersLock);
 
@@ -0,0 +1,611 @@
+/*
+ * Archivo: loadclient_quic.c
+ * Descripcion: Cliente de carga que abre N conexiones QUIC concurrentes contra el broker, suscribe cada una a un
+ *              topic y mide la "tormenta" de handshakes (por ejemplo, todos los subscriptores reconectandose
+ *              despues de reiniciar el broker).
+ *
+ * MEDICIONES (por fase):
+ *    - Latencia de handshake (ConnectionStart -> CONNECTED): p50, p90, p99 y maximo.
+ *    - Tasa de aceptacion: conexiones establecidas por segundo entre el primer ConnectionStart y el ultimo CONNECTED.
+ *    - Tiempo hasta disponibilidad total: desde el inicio de la fase hasta el ultimo "SUBSCRIBED|<topic>" recibido.
+ *    - Memoria del broker por conexion (--broker-pid): crecimiento del RSS del proceso del broker dividido entre las
+ *      conexiones listas. En Linux se lee VmRSS de /proc/<pid>/status; en Windows el working set del proceso.
+ *
+ * FASES:
+ *    - fria: handshake completo en todas las conexiones. Los tickets de reanudacion que entrega el broker se
+ *      guardan en memoria, uno por conexion.
+ *    - reanudada: se vuelve a abrir el mismo numero de conexiones usando esos tickets (handshake reanudado y la
+ *      suscripcion como dato 0-RTT).
+ *
+ * LIBRERIAS UTILIZADAS Y JUSTIFICACION:
+ *
+ * 1. msquic.h
+ *    - Por que: Conexiones y streams QUIC, igual que subscriber_quic.c.
+ *    - Funciones usadas: MsQuicOpen2(), MsQuic->RegistrationOpen(), MsQuic->ConfigurationOpen(),
+ *      MsQuic->ConfigurationLoadCredential(), MsQuic->ConnectionOpen(), MsQuic->ConnectionStart(),
+ *      MsQuic->ConnectionShutdown(), MsQuic->StreamOpen(), MsQuic->StreamStart(), MsQuic->StreamSend(),
+ *      MsQuic->SetParam() (QUIC_PARAM_CONN_RESUMPTION_TICKET).
+ *
+ * 2. stdio.h / stdlib.h / string.h (libreria estandar)
+ *    - Por que: Reportes, memoria de los contextos por conexion y ordenamiento de latencias.
+ *    - Funciones usadas: printf(), fprintf(), fopen(), fgets(), calloc(), malloc(), free(), qsort(), atoi(),
+ *      memcpy(), memcmp(), snprintf().
+ *
+ * 3. windows.h / psapi.h (via quic_platform.h; en Linux se emula sobre pthreads)
+ *    - Por que: Eventos para esperar el fin de cada fase, contadores Interlocked* actualizados desde los
+ *      callbacks y lectura de la memoria del broker.
+ *    - Funciones usadas: CreateEventA(), SetEvent(), WaitForSingleObject(), CloseHandle(), InterlockedIncrement(),
+ *      Sleep(), OpenProcess(), GetProcessMemoryInfo().
+ *    - Alternativa considerada: Un proceso subscriber_quic por conexion; descartado porque miles de procesos miden
+ *      el costo de crear procesos y no el del broker.
+ */
+
+#include <msquic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "quic_platform.h"
+#ifdef _WIN32
+#include <psapi.h>
+#endif
+
+#define MESSAGE_MAX_LEN 512
+#define ACK_PREFIX "SUBSCRIBED|"
+#define ERROR_PREFIX "ERROR|"
+#define DEFAULT_PHASE_TIMEOUT_S 60
+#define TICKET_WAIT_MS 2000
+
+typedef struct LoadConnection {
+    HQUIC connection;
+    HQUIC stream;
+    uint64_t startUs;
+    uint64_t connectedUs;
+    uint64_t readyUs;
+    int resumed;
+    int finished;
+    uint8_t* ticket;
+    uint32_t ticketLength;
+    int ticketApplied;
+    uint8_t ackBuffer[32];
+    uint32_t ackLength;
+    QUIC_BUFFER quicBuffer;
+} LoadConnection;
+
+typedef struct LoadOptions {
+    const char* server;
+    uint16_t port;
+    const char* topic;
+    int connections;
+    int rate;
+    long brokerPid;
+    int runCold;
+    int runResumed;
+    int timeoutS;
+} LoadOptions;
+
+static const QUIC_API_TABLE* MsQuic = NULL;
+static HQUIC Registration = NULL;
+static HQUIC Configuration = NULL;
+
+static const char* const DEFAULT_ALPN = "sports-pubsub";
+
+static LoadConnection* Connections = NULL;
+static int ConnectionCount = 0;
+static char SubscribeMessage[MESSAGE_MAX_LEN];
+static uint32_t SubscribeLength = 0;
+
+static volatile LONG ConnectedCount = 0;
+static volatile LONG ReadyCount = 0;
+static volatile LONG RejectedCount = 0;
+static volatile LONG FinishedCount = 0;
+static volatile LONG ClosedCount = 0;
+static volatile LONG TicketCount = 0;
+static HANDLE PhaseDoneEvent = NULL;
+static HANDLE AllClosedEvent = NULL;
+
+/* Una conexion "termina" la fase al recibir el ack, un rechazo o al cerrarse antes de estar lista. */
+static void MarkFinished(LoadConnection* entry) {
+    if (entry->finished) {
+        return;
+    }
+    entry->finished = 1;
+    if (InterlockedIncrement(&FinishedCount) == ConnectionCount) {
+        SetEvent(PhaseDoneEvent);
+    }
+}
+
+/* El ack es corto pero puede llegar partido en varios RECEIVE; basta con acumular hasta el primer '\n'. */
+static void HandleAck(LoadConnection* entry, const QUIC_STREAM_EVENT* event) {
+    for (uint32_t i = 0; i < event->RECEIVE.BufferCount && !entry->finished; ++i) {
+        const QUIC_BUFFER* buffer = &event->RECEIVE.Buffers[i];
+        for (uint32_t j = 0; j < buffer->Length; ++j) {
+            uint8_t byte = buffer->Buffer[j];
+            if (byte == '\n' || entry->ackLength == sizeof(entry->ackBuffer)) {
+                if (entry->ackLength >= strlen(ACK_PREFIX) &&
+                    memcmp(entry->ackBuffer, ACK_PREFIX, strlen(ACK_PREFIX)) == 0) {
+                    entry->readyUs = PlatformNowUs();
+                    InterlockedIncrement(&ReadyCount);
+                } else if (entry->ackLength >= strlen(ERROR_PREFIX) &&
+                           memcmp(entry->ackBuffer, ERROR_PREFIX, strlen(ERROR_PREFIX)) == 0) {
+                    InterlockedIncrement(&RejectedCount);
+                }
+                MarkFinished(entry);
+                break;
+            }
+            entry->ackBuffer[entry->ackLength++] = byte;
+        }
+    }
+}
+
+static
+QUIC_STATUS
+LoadStreamCallback(
+    HQUIC stream,
+    void* context,
+    QUIC_STREAM_EVENT* event
+    )
+{
+    LoadConnection* entry = (LoadConnection*)context;
+
+    switch (event->Type) {
+    case QUIC_STREAM_EVENT_SEND_COMPLETE:
+        break;
+
+    case QUIC_STREAM_EVENT_RECEIVE:
+        HandleAck(entry, event);
+        break;
+
+    case QUIC_STREAM_EVENT_SHUTDOWN_COMPLETE:
+        MsQuic->StreamClose(stream);
+        entry->stream = NULL;
+        break;
+
+    default:
+        break;
+    }
+
+    return QUIC_STATUS_SUCCESS;
+}
+
+static
+QUIC_STATUS
+LoadConnectionCallback(
+    HQUIC connection,
+    void* context,
+    QUIC_CONNECTION_EVENT* event
+    )
+{
+    LoadConnection* entry = (LoadConnection*)context;
+
+    switch (event->Type) {
+    case QUIC_CONNECTION_EVENT_CONNECTED:
+        entry->connectedUs = PlatformNowUs();
+        entry->resumed = event->CONNECTED.SessionResumed;
+        InterlockedIncrement(&ConnectedCount);
+        break;
+
+    case QUIC_CONNECTION_EVENT_RESUMPTION_TICKET_RECEIVED: {
+        uint32_t length = event->RESUMPTION_TICKET_RECEIVED.ResumptionTicketLength;
+        uint8_t* copy = (uint8_t*)malloc(length);
+        if (copy != NULL) {
+            memcpy(copy, event->RESUMPTION_TICKET_RECEIVED.ResumptionTicket, length);
+            free(entry->ticket);
+            entry->ticket = copy;
+            entry->ticketLength = length;
+            InterlockedIncrement(&TicketCount);
+        }
+        break;
+    }
+
+    case QUIC_CONNECTION_EVENT_SHUTDOWN_COMPLETE:
+        MarkFinished(entry);
+        MsQuic->ConnectionClose(connection);
+        entry->connection = NULL;
+        if (InterlockedIncrement(&ClosedCount) == ConnectionCount) {
+            SetEvent(AllClosedEvent);
+        }
+        break;
+
+    default:
+        break;
+    }
+
+    return QUIC_STATUS_SUCCESS;
+}
+
+static int InitializeQuic(void) {
+    QUIC_STATUS status = MsQuicOpen2(&MsQuic);
+    if (QUIC_FAILED(status)) {
+        fprintf(stderr, "[CARGA] MsQuicOpen fracaso (%u).\n", status);
+        return 0;
+    }
+
+    QUIC_REGISTRATION_CONFIG regConfig = { "LoadClientApp", QUIC_EXECUTION_PROFILE_LOW_LATENCY };
+    status = MsQuic->RegistrationOpen(&regConfig, &Registration);
+    if (QUIC_FAILED(status)) {
+        fprintf(stderr, "[CARGA] RegistrationOpen fracaso (%u).\n", status);
+        return 0;
+    }
+
+    QUIC_BUFFER alpn;
+    alpn.Buffer = (uint8_t*)DEFAULT_ALPN;
+    alpn.Length = (uint32_t)strlen(DEFAULT_ALPN);
+
+    QUIC_SETTINGS settings;
+    memset(&settings, 0, sizeof(settings));
+    settings.IsSet.HandshakeIdleTimeoutMs = TRUE;
+    settings.HandshakeIdleTimeoutMs = 30000;
+    settings.IsSet.IdleTimeoutMs = TRUE;
+    settings.IdleTimeoutMs = 600000;
+
+    status = MsQuic->ConfigurationOpen(Registration, &alpn, 1, &settings, sizeof(settings), NULL, &Configuration);
+    if (QUIC_FAILED(status)) {
+        fprintf(stderr, "[CARGA] ConfigurationOpen fracaso (%u).\n", status);
+        return 0;
+    }
+
+    QUIC_CREDENTIAL_CONFIG credConfig;
+    memset(&credConfig, 0, sizeof(credConfig));
+    credConfig.Type = QUIC_CREDENTIAL_TYPE_NONE;
+    credConfig.Flags = QUIC_CREDENTIAL_FLAG_CLIENT |
+                       QUIC_CREDENTIAL_FLAG_NO_CERTIFICATE_VALIDATION;
+
+    status = MsQuic->ConfigurationLoadCredential(Configuration, &credConfig);
+    if (QUIC_FAILED(status)) {
+        fprintf(stderr, "[CARGA] ConfigurationLoadCredential fracaso (%u).\n", status);
+        return 0;
+    }
+    return 1;
+}
+
+static void CleanupQuic(void) {
+    if (Configuration != NULL) {
+        MsQuic->ConfigurationClose(Configuration);
+        Configuration = NULL;
+    }
+    if (Registration != NULL) {
+        MsQuic->RegistrationClose(Registration);
+        Registration = NULL;
+    }
+    if (MsQuic != NULL) {
+        MsQuicClose(MsQuic);
+        MsQuic = NULL;
+    }
+}
+
+/* RSS del broker en bytes; 0 si no se indico --broker-pid o no se pudo leer. */
+static uint64_t ReadBrokerRss(long pid) {
+    if (pid <= 0) {
+        return 0;
+    }
+#ifdef _WIN32
+    HANDLE process = OpenProcess(PROCESS_QUERY_INFORMATION | PROCESS_VM_READ, FALSE, (DWORD)pid);
+    if (process == NULL) {
+        return 0;
+    }
+    PROCESS_MEMORY_COUNTERS counters;
+    uint64_t rss = 0;
+    if (GetProcessMemoryInfo(process, &counters, sizeof(counters))) {
+        rss = (uint64_t)counters.WorkingSetSize;
+    }
+    CloseHandle(process);
+    return rss;
+#else
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%ld/status", pid);
+    FILE* file = fopen(path, "r");
+    if (file == NULL) {
+        return 0;
+    }
+    char line[256];
+    uint64_t rss = 0;
+    while (fgets(line, sizeof(line), file) != NULL) {
+        unsigned long long kilobytes = 0;
+        if (sscanf(line, "VmRSS: %llu kB", &kilobytes) == 1) {
+            rss = (uint64_t)kilobytes * 1024ULL;
+            break;
+        }
+    }
+    fclose(file);
+    return rss;
+#endif
+}
+
+/*
+ * Abre la conexion y, sin esperar CONNECTED, su stream con la suscripcion: msquic la transmite al terminar el
+ * handshake, o como 0-RTT si la conexion lleva ticket.
+ */
+static int StartLoadConnection(LoadConnection* entry, const LoadOptions* options, int useTicket) {
+    QUIC_STATUS status = MsQuic->ConnectionOpen(Registration, LoadConnectionCallback, entry, &entry->connection);
+    if (QUIC_FAILED(status)) {
+        entry->connection = NULL;
+        return 0;
+    }
+
+    entry->ticketApplied = 0;
+    if (useTicket && entry->ticket != NULL) {
+        entry->ticketApplied = QUIC_SUCCEEDED(MsQuic->SetParam(
+            entry->connection,
+            QUIC_PARAM_CONN_RESUMPTION_TICKET,
+            entry->ticketLength,
+            entry->ticket));
+    }
+
+    entry->startUs = PlatformNowUs();
+    status = MsQuic->ConnectionStart(entry->connection, Configuration, AF_UNSPEC, options->server, options->port);
+    if (QUIC_FAILED(status)) {
+        MsQuic->ConnectionClose(entry->connection);
+        entry->connection = NULL;
+        return 0;
+    }
+
+    status = MsQuic->StreamOpen(entry->connection, QUIC_STREAM_OPEN_FLAG_NONE, LoadStreamCallback, entry, &entry->stream);
+    if (QUIC_FAILED(status)) {
+        entry->stream = NULL;
+        MsQuic->ConnectionShutdown(entry->connection, QUIC_CONNECTION_SHUTDOWN_FLAG_NONE, 0);
+        return 1;
+    }
+
+    status = MsQuic->StreamStart(entry->stream, QUIC_STREAM_START_FLAG_IMMEDIATE | QUIC_STREAM_START_FLAG_SHUTDOWN_ON_FAIL);
+    if (QUIC_SUCCEEDED(status)) {
+        /* El mensaje es igual para todas las conexiones y vive hasta el final del programa. */
+        entry->quicBuffer.Buffer = (uint8_t*)SubscribeMessage;
+        entry->quicBuffer.Length = SubscribeLength;
+        status = MsQuic->StreamSend(
+            entry->stream,
+            &entry->quicBuffer,
+            1,
+            entry->ticketApplied ? QUIC_SEND_FLAG_ALLOW_0_RTT : QUIC_SEND_FLAG_NONE,
+            NULL);
+    }
+    if (QUIC_FAILED(status)) {
+        MsQuic->ConnectionShutdown(entry->connection, QUIC_CONNECTION_SHUTDOWN_FLAG_NONE, 0);
+    }
+    return 1;
+}
+
+static int CompareUint64(const void* left, const void* right) {
+    uint64_t a = *(const uint64_t*)left;
+    uint64_t b = *(const uint64_t*)right;
+    return (a > b) - (a < b);
+}
+
+static double PercentileMs(const uint64_t* sorted, int count, double percentile) {
+    if (count == 0) {
+        return 0.0;
+    }
+    int index = (int)(percentile * (double)(count - 1) + 0.5);
+    return (double)sorted[index] / 1000.0;
+}
+
+static void ReportPhase(const char* name, const LoadOptions* options, uint64_t phaseStartUs, uint64_t rssBefore, uint64_t rssAfter) {
+    uint64_t* latencies = (uint64_t*)malloc(sizeof(uint64_t) * (size_t)ConnectionCount);
+    int connected = 0;
+    int resumed = 0;
+    int ready = 0;
+    uint64_t firstStartUs = UINT64_MAX;
+    uint64_t lastConnectedUs = 0;
+    uint64_t lastReadyUs = 0;
+
+    for (int i = 0; i < ConnectionCount; ++i) {
+        LoadConnection* entry = &Connections[i];
+        if (entry->startUs != 0 && entry->startUs < firstStartUs) {
+            firstStartUs = entry->startUs;
+        }
+        if (entry->connectedUs != 0) {
+            if (latencies != NULL) {
+                latencies[connected] = entry->connectedUs - entry->startUs;
+            }
+            connected++;
+            resumed += entry->resumed ? 1 : 0;
+            if (entry->connectedUs > lastConnectedUs) {
+                lastConnectedUs = entry->connectedUs;
+            }
+        }
+        if (entry->readyUs != 0) {
+            ready++;
+            if (entry->readyUs > lastReadyUs) {
+                lastReadyUs = entry->readyUs;
+            }
+        }
+    }
+
+    printf("\n[CARGA] ===== Fase %s: %d conexiones a %s:%u =====\n", name, ConnectionCount, options->server, (unsigned)options->port);
+    printf("[CARGA] Establecidas: %d (reanudadas: %d) | listas: %d | rechazadas: %ld | fallidas: %d\n",
+           connected, resumed, ready, (long)RejectedCount, ConnectionCount - ready - (int)RejectedCount);
+
+    if (connected > 0 && latencies != NULL) {
+        qsort(latencies, (size_t)connected, sizeof(uint64_t), CompareUint64);
+        printf("[CARGA] Handshake: p50 %.3f ms | p90 %.3f ms | p99 %.3f ms | max %.3f ms\n",
+               PercentileMs(latencies, connected, 0.50),
+               PercentileMs(latencies, connected, 0.90),
+               PercentileMs(latencies, connected, 0.99),
+               (double)latencies[connected - 1] / 1000.0);
+        double acceptSeconds = (double)(lastConnectedUs - firstStartUs) / 1000000.0;
+        printf("[CARGA] Tasa de aceptacion: %.0f handshakes/s\n",
+               acceptSeconds > 0.0 ? (double)connected / acceptSeconds : 0.0);
+    }
+    if (ready > 0) {
+        printf("[CARGA] Tiempo hasta disponibilidad total: %.3f ms%s\n",
+               (double)(lastReadyUs - phaseStartUs) / 1000.0,
+               ready < ConnectionCount ? " (incompleta)" : "");
+    }
+    if (rssBefore > 0 && rssAfter > 0 && ready > 0) {
+        double perConnection = rssAfter > rssBefore ? (double)(rssAfter - rssBefore) / (double)ready : 0.0;
+        printf("[CARGA] RSS del broker: %.1f MiB -> %.1f MiB (%.0f bytes por conexion)\n",
+               (double)rssBefore / (1024.0 * 1024.0),
+               (double)rssAfter / (1024.0 * 1024.0),
+               perConnection);
+    }
+    free(latencies);
+}
+
+static void RunPhase(const char* name, const LoadOptions* options, int useTickets) {
+    ConnectedCount = 0;
+    ReadyCount = 0;
+    RejectedCount = 0;
+    FinishedCount = 0;
+    ClosedCount = 0;
+    TicketCount = 0;
+    ResetEvent(PhaseDoneEvent);
+    ResetEvent(AllClosedEvent);
+
+    for (int i = 0; i < ConnectionCount; ++i) {
+        LoadConnection* entry = &Connections[i];
+        entry->connection = NULL;
+        entry->stream = NULL;
+        entry->startUs = 0;
+        entry->connectedUs = 0;
+        entry->readyUs = 0;
+        entry->resumed = 0;
+        entry->finished = 0;
+        entry->ackLength = 0;
+    }
+
+    uint64_t rssBefore = ReadBrokerRss(options->brokerPid);
+    uint64_t phaseStartUs = PlatformNowUs();
+    int failedStarts = 0;
+
+    for (int i = 0; i < ConnectionCount; ++i) {
+        if (options->rate > 0) {
+            /* Ritmo fijo: la conexion i sale en phaseStart + i / rate. */
+            uint64_t dueUs = phaseStartUs + (uint64_t)i * 1000000ULL / (uint64_t)options->rate;
+            uint64_t nowUs = PlatformNowUs();
+            if (dueUs > nowUs + 1000) {
+                Sleep((DWORD)((dueUs - nowUs) / 1000));
+            }
+        }
+        if (!StartLoadConnection(&Connections[i], options, useTickets)) {
+            failedStarts++;
+            MarkFinished(&Connections[i]);
+            if (InterlockedIncrement(&ClosedCount) == ConnectionCount) {
+                SetEvent(AllClosedEvent);
+            }
+        }
+    }
+    if (failedStarts > 0) {
+        fprintf(stderr, "[CARGA] %d conexiones no se pudieron iniciar.\n", failedStarts);
+    }
+
+    if (WaitForSingleObject(PhaseDoneEvent, (DWORD)options->timeoutS * 1000) == WAIT_TIMEOUT) {
+        fprintf(stderr, "[CARGA] Tiempo de espera agotado: %ld de %d conexiones listas.\n", (long)ReadyCount, ConnectionCount);
+    }
+
+    uint64_t rssAfter = ReadBrokerRss(options->brokerPid);
+    ReportPhase(name, options, phaseStartUs, rssBefore, rssAfter);
+
+    /* El broker entrega el ticket justo despues del handshake; se espera un poco para no cortar su envio. */
+    uint64_t ticketDeadlineUs = PlatformNowUs() + (uint64_t)TICKET_WAIT_MS * 1000ULL;
+    while (TicketCount < ConnectedCount && PlatformNowUs() < ticketDeadlineUs) {
+        Sleep(10);
+    }
+
+    for (int i = 0; i < ConnectionCount; ++i) {
+        if (Connections[i].connection != NULL) {
+            MsQuic->ConnectionShutdown(Connections[i].connection, QUIC_CONNECTION_SHUTDOWN_FLAG_NONE, 0);
+        }
+    }
+    if (WaitForSingleObject(AllClosedEvent, (DWORD)options->timeoutS * 1000) == WAIT_TIMEOUT) {
+        fprintf(stderr, "[CARGA] No se cerraron todas las conexiones (%ld de %d).\n", (long)ClosedCount, ConnectionCount);
+    }
+}
+
+static void PrintUsage(const char* program) {
+    fprintf(stderr, "Uso: %s <IP_BROKER> <PUERTO> <TOPIC> <CONEXIONES> [opciones]\n", program);
+    fprintf(stderr, "Opciones:\n");
+    fprintf(stderr, "  --ritmo R               Conexiones iniciadas por segundo (por defecto 0 = todas de golpe)\n");
+    fprintf(stderr, "  --broker-pid PID        PID del broker para medir su memoria por conexion\n");
+    fprintf(stderr, "  --fase fria|reanudada|ambas   Fases a ejecutar (por defecto ambas)\n");
+    fprintf(stderr, "  --timeout S             Espera maxima por fase en segundos (por defecto %d)\n", DEFAULT_PHASE_TIMEOUT_S);
+    fprintf(stderr, "Ejemplo: %s 127.0.0.1 5000 partido1 2000 --broker-pid 4242\n", program);
+}
+
+static int ParseArguments(int argc, char** argv, LoadOptions* options) {
+    memset(options, 0, sizeof(*options));
+    options->runCold = 1;
+    options->runResumed = 1;
+    options->timeoutS = DEFAULT_PHASE_TIMEOUT_S;
+
+    if (argc < 5) {
+        return 0;
+    }
+
+    options->server = argv[1];
+    int port = atoi(argv[2]);
+    if (port <= 0 || port > 65535) {
+        fprintf(stderr, "[CARGA] Puerto invalido: %s\n", argv[2]);
+        return 0;
+    }
+    options->port = (uint16_t)port;
+    options->topic = argv[3];
+    options->connections = atoi(argv[4]);
+    if (options->connections <= 0) {
+        fprintf(stderr, "[CARGA] Numero de conexiones invalido: %s\n", argv[4]);
+        return 0;
+    }
+
+    for (int i = 5; i < argc; ++i) {
+        if (strcmp(argv[i], "--ritmo") == 0 && i + 1 < argc) {
+            options->rate = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--broker-pid") == 0 && i + 1 < argc) {
+            options->brokerPid = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--timeout") == 0 && i + 1 < argc) {
+            options->timeoutS = atoi(argv[++i]);
+            if (options->timeoutS <= 0) {
+                options->timeoutS = DEFAULT_PHASE_TIMEOUT_S;
+            }
+        } else if (strcmp(argv[i], "--fase") == 0 && i + 1 < argc) {
+            const char* phase = argv[++i];
+            options->runCold = strcmp(phase, "fria") == 0 || strcmp(phase, "ambas") == 0;
+            options->runResumed = strcmp(phase, "reanudada") == 0 || strcmp(phase, "ambas") == 0;
+            if (!options->runCold && !options->runResumed) {
+                fprintf(stderr, "[CARGA] Fase desconocida: %s\n", phase);
+                return 0;
+            }
+        } else {
+            fprintf(stderr, "[CARGA] Opcion desconocida: %s\n", argv[i]);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int main(int argc, char** argv) {
+    LoadOptions options;
+    if (!ParseArguments(argc, argv, &options)) {
+        PrintUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    snprintf(SubscribeMessage, sizeof(SubscribeMessage), "SUBSCRIBER|%s\n", options.topic);
+    SubscribeLength = (uint32_t)strlen(SubscribeMessage);
+
+    ConnectionCount = options.connections;
+    Connections = (LoadConnection*)calloc((size_t)ConnectionCount, sizeof(LoadConnection));
+    PhaseDoneEvent = CreateEventA(NULL, TRUE, FALSE, NULL);
+    AllClosedEvent = CreateEventA(NULL, TRUE, FALSE, NULL);
+    if (Connections == NULL || PhaseDoneEvent == NULL || AllClosedEvent == NULL) {
+        fprintf(stderr, "[CARGA] No se pudo reservar el estado para %d conexiones.\n", ConnectionCount);
+        return EXIT_FAILURE;
+    }
+
+    if (!InitializeQuic()) {
+        CleanupQuic();
+        return EXIT_FAILURE;
+    }
+
+    /* La fase reanudada necesita los tickets de una fase fria previa en este mismo proceso. */
+    RunPhase(options.runCold ? "fria" : "fria (para obtener tickets)", &options, 0);
+    if (options.runResumed) {
+        RunPhase("reanudada", &options, 1);
+    }
+
+    CleanupQuic();
+    for (int i = 0; i < ConnectionCount; ++i) {
+        free(Connections[i].ticket);
+    }
+    free(Connections);
+    CloseHandle(PhaseDoneEvent);
+    CloseHandle(AllClosedEvent);
+    return EXIT_SUCCESS;
+}
@@ -8,7 +8,8 @@
  *    - Por que: Facilita el establecimiento de conexiones QUIC seguras y manejo de streams bidireccionales.
  *    - Funciones usadas: MsQuicOpen(), MsQuic->RegistrationOpen(), MsQuic->ConfigurationOpen(),
  *      MsQuic->ConfigurationLoadCredential(), MsQuic->ConnectionOpen(), MsQuic->ConnectionStart(),
- *      MsQuic->StreamOpen(), MsQuic->StreamStart(), MsQuic->StreamSend().
+ *      MsQuic->StreamOpen(), MsQuic->StreamStart(), MsQuic->StreamSend(), MsQuic->SetParam() (ticket de
+ *      reanudacion para handshakes reanudados, ver quic_resumption.h).
  *    - Alternativa considerada: Implementar QUIC manualmente sobre UDP; descartado por complejidad y riesgo.
  *
  * 2. stdio.h (libreria estandar)
@@ -23,26 +24,66 @@
  *    - Por que: Construccion de mensajes y sanitizacion de lineas leidas.
  *    - Funciones usadas: strlen(), strcpy(), strncpy(), strcspn(), memset().
  *
- * 5. time.h (libreria estandar)
- *    - Por que: Generacion de timestamps para los eventos publicados.
- *    - Funciones usadas: time(), localtime(), strftime().
+ * 5. ../common/latency_stamp.h
+ *    - Por que: Marca de origen de cada evento (nanosegundos de reloj monotonico) con la que broker y
+ *      subscriptores miden la latencia de cada tramo.
+ *    - Funciones usadas: LatencyStampOrigin().
+ *    - Alternativa considerada: time()/localtime()/strftime() ("HH:MM:SS"); descartado porque un segundo de
+ *      resolucion no alcanza para medir al broker y localtime se pagaba en cada linea.
  *
- * 6. windows.h
+ * 6. ../common/event_priority.h
+ *    - Por que: Marca de prioridad de cada evento ("!" goles y rojas, "~" jugadas de rutina) para que el broker
+ *      los entregue por carriles distintos.
+ *    - Funciones usadas: EventPriorityClassify(), EventPriorityMark().
+ *
+ * 7. windows.h (via quic_platform.h; en Linux se emula sobre pthreads)
  *    - Por que: Eventos de sincronizacion (CreateEvent/WaitForSingleObject) y atomicos (Interlocked*),
  *      necesarios para coordinar envio asincrono con los callbacks de msquic.
  *    - Funciones usadas: CreateEventA(), SetEvent(), WaitForSingleObject(), CloseHandle(), InterlockedIncrement(),
- *      InterlockedDecrement().
+ *      InterlockedDecrement(), InterlockedExchangeAdd().
  *    - Alternativa considerada: Implementar sincronizacion manual con busy-wait; descartado para evitar consumo excesivo de CPU.
+ *
+ * CONTROL DE FLUJO:
+ *    Los eventos se agrupan en lotes (SendContext) de hasta SEND_BATCH_MAX_EVENTS lineas; cada lote es un unico
+ *    StreamSend con un QUIC_BUFFER por evento. La reserva del lote empieza chica y se duplica a medida que se
+ *    agregan eventos, asi un lote de un solo evento no ocupa lo mismo que uno lleno. Los bytes en vuelo se limitan a la ventana que sugiere msquic con
+ *    QUIC_STREAM_EVENT_IDEAL_SEND_BUFFER_SIZE: cuando la ventana esta llena el hilo principal se bloquea en
+ *    SendWindowEvent hasta que un SEND_COMPLETE libere espacio. Asi la memoria no crece con el tamano del archivo.
+ *    Cada evento termina en '\n' para que el broker pueda separar eventos que llegan en un mismo RECEIVE.
+ *
+ * REANUDACION:
+ *    Con un ticket guardado el handshake es reanudado y el hilo principal no lo espera: lee el archivo y arma el
+ *    primer lote mientras tanto. Los eventos no viajan como 0-RTT (un dato 0-RTT puede repetirse y el broker
+ *    publicaria el evento dos veces), asi que el primer FlushBatch espera CONNECTED, acotado por
+ *    CONNECT_TIMEOUT_MS y cortando en cuanto la conexion se cierra si el handshake falla.
+ *
+ * MODO --multi:
+ *    Un solo proceso reproduce todos los partidos de un directorio o manifiesto (ver ../common/match_replay.h)
+ *    sobre una unica conexion, con un stream QUIC por partido para que una perdida en un partido no retrase a
+ *    los demas. Cada partido acumula su propio lote; los lotes pendientes se envian antes de dormir hasta el
+ *    proximo evento o cuando se llenan. La ventana de bytes en vuelo es comun a toda la conexion.
  */
 
 #include <msquic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <time.h>
-#include <windows.h>
+#include "quic_platform.h"
+#include "quic_resumption.h"
+#include "../common/match_replay.h"
+#include "../common/latency_stamp.h"
+#include "../common/event_priority.h"
 
 #define MESSAGE_MAX_LEN 512
+#define SEND_BATCH_MAX_EVENTS 64
+#define SEND_BATCH_MAX_BYTES (SEND_BATCH_MAX_EVENTS * MESSAGE_MAX_LEN)
+#define SEND_BATCH_INITIAL_EVENTS 4
+#define SEND_BATCH_INITIAL_BYTES (2 * MESSAGE_MAX_LEN)
+#define SEND_WINDOW_INITIAL (64 * 1024)
+#define SEND_WINDOW_MIN (16 * 1024)
+#define SEND_WINDOW_MAX (8 * 1024 * 1024)
+#define CONNECT_TIMEOUT_MS 15000
+#define CONNECT_POLL_MS 50
 
 static const QUIC_API_TABLE* MsQuic = NULL;
 static HQUIC Registration = NULL;
@@ -52,28 +93,51 @@ static HQUIC Stream = NULL;
 
 static const char* const DEFAULT_ALPN = "sports-pubsub";
 
+/*
+ * Lote de eventos: una sola reserva de memoria y un solo StreamSend para varias lineas. A los bufferCapacity
+ * QUIC_BUFFER les siguen byteCapacity bytes de datos (BatchData); los punteros Buffer se fijan al enviar, porque
+ * la reserva se mueve al crecer.
+ */
 typedef struct SendContext {
-    uint8_t* buffer;
+    uint32_t bufferCount;
+    uint32_t bufferCapacity;
     uint32_t length;
+    uint32_t byteCapacity;
+    QUIC_BUFFER buffers[];
 } SendContext;
 
 typedef struct PublisherContext {
     HANDLE ConnectedEvent;
     HANDLE ConnectionShutdownEvent;
     HANDLE StreamShutdownEvent;
-    volatile LONG OutstandingSends;
+    HANDLE SendWindowEvent;
+    volatile LONG InFlightBytes;
+    volatile LONG SendWindowBytes;
+    volatile LONG OpenStreams;
+    uint64_t HandshakeStartUs;
+    int ResumptionAttempted;
+    int FirstSendDone;
+    char TicketPath[260];
 } PublisherContext;
 
-static PublisherContext AppContext = { NULL, NULL, NULL, 0 };
+static PublisherContext AppContext = { NULL, NULL, NULL, NULL, 0, SEND_WINDOW_INITIAL, 0, 0, 0, 0, {0} };
+
+/* Stream y lote pendiente de un partido en modo --multi (MatchSource.transport). */
+typedef struct MatchStream {
+    HQUIC stream;
+    SendContext* batch;
+} MatchStream;
 
 static int InitializeEvents(void) {
     AppContext.ConnectedEvent = CreateEventA(NULL, TRUE, FALSE, NULL);
     AppContext.ConnectionShutdownEvent = CreateEventA(NULL, TRUE, FALSE, NULL);
     AppContext.StreamShutdownEvent = CreateEventA(NULL, TRUE, FALSE, NULL);
+    AppContext.SendWindowEvent = CreateEventA(NULL, FALSE, FALSE, NULL);
 
     if (!AppContext.ConnectedEvent ||
         !AppContext.ConnectionShutdownEvent ||
-        !AppContext.StreamShutdownEvent) {
+        !AppContext.StreamShutdownEvent ||
+        !AppContext.SendWindowEvent) {
         fprintf(stderr, "[PUBLISHER] No se pudieron crear eventos de sincronizacion.\n");
         return 0;
     }
@@ -93,57 +157,134 @@ static void DisposeEvents(void) {
         CloseHandle(AppContext.StreamShutdownEvent);
         AppContext.StreamShutdownEvent = NULL;
     }
+    if (AppContext.SendWindowEvent) {
+        CloseHandle(AppContext.SendWindowEvent);
+        AppContext.SendWindowEvent = NULL;
+    }
 }
 
-static uint8_t* DuplicateBytes(const char* source, size_t length) {
-    uint8_t* copy = (uint8_t*)malloc(length);
-    if (copy != NULL) {
-        memcpy(copy, source, length);
-    }
-    return copy;
+static uint8_t* BatchData(SendContext* batch) {
+    return (uint8_t*)(batch->buffers + batch->bufferCapacity);
 }
 
-static QUIC_STATUS QueueSend(const char* text) {
-    size_t length = strlen(text);
-    if (length == 0) {
-        return QUIC_STATUS_SUCCESS;
+/* Agranda (o crea, con batch NULL) la reserva del lote; los datos ya copiados se corren detras de los QUIC_BUFFER. */
+static SendContext* ResizeBatch(SendContext* batch, uint32_t bufferCapacity, uint32_t byteCapacity) {
+    uint32_t previousBuffers = batch != NULL ? batch->bufferCapacity : 0;
+    SendContext* grown = (SendContext*)realloc(
+        batch, sizeof(SendContext) + sizeof(QUIC_BUFFER) * bufferCapacity + byteCapacity);
+    if (grown == NULL) {
+        return NULL;
+    }
+    if (batch == NULL) {
+        grown->bufferCount = 0;
+        grown->length = 0;
+    } else if (bufferCapacity != previousBuffers) {
+        memmove(grown->buffers + bufferCapacity, grown->buffers + previousBuffers, grown->length);
+    }
+    grown->bufferCapacity = bufferCapacity;
+    grown->byteCapacity = byteCapacity;
+    return grown;
+}
+
+static SendContext* AllocateBatch(void) {
+    return ResizeBatch(NULL, SEND_BATCH_INITIAL_EVENTS, SEND_BATCH_INITIAL_BYTES);
+}
+
+/* Devuelve 0 si el lote esta lleno (o no pudo crecer): el llamador lo envia y empieza otro. */
+static int BatchAppend(SendContext** slot, const char* text, size_t length) {
+    SendContext* batch = *slot;
+    if (batch->bufferCount == SEND_BATCH_MAX_EVENTS ||
+        batch->length + length > SEND_BATCH_MAX_BYTES) {
+        return 0;
     }
 
-    SendContext* ctx = (SendContext*)malloc(sizeof(SendContext));
-    if (ctx == NULL) {
-        return QUIC_STATUS_OUT_OF_MEMORY;
+    if (batch->bufferCount == batch->bufferCapacity || batch->length + length > batch->byteCapacity) {
+        uint32_t bufferCapacity = batch->bufferCapacity;
+        uint32_t byteCapacity = batch->byteCapacity;
+        if (batch->bufferCount == bufferCapacity) {
+            bufferCapacity = bufferCapacity * 2 > SEND_BATCH_MAX_EVENTS ? SEND_BATCH_MAX_EVENTS : bufferCapacity * 2;
+        }
+        while (batch->length + length > byteCapacity) {
+            byteCapacity = byteCapacity * 2 > SEND_BATCH_MAX_BYTES ? SEND_BATCH_MAX_BYTES : byteCapacity * 2;
+        }
+        SendContext* grown = ResizeBatch(batch, bufferCapacity, byteCapacity);
+        if (grown == NULL) {
+            return 0;
+        }
+        *slot = batch = grown;
     }
 
-    ctx->buffer = DuplicateBytes(text, length);
-    if (ctx->buffer == NULL) {
-        free(ctx);
-        return QUIC_STATUS_OUT_OF_MEMORY;
+    memcpy(BatchData(batch) + batch->length, text, length);
+    batch->buffers[batch->bufferCount].Length = (uint32_t)length;
+    batch->bufferCount++;
+    batch->length += (uint32_t)length;
+    return 1;
+}
+
+/* Bloquea (sin espera activa) hasta que el lote quepa en la ventana de envio sugerida por msquic. */
+static void WaitForSendWindow(uint32_t length) {
+    while (AppContext.InFlightBytes > 0 &&
+           AppContext.InFlightBytes + (LONG)length > AppContext.SendWindowBytes) {
+        WaitForSingleObject(AppContext.SendWindowEvent, INFINITE);
     }
-    ctx->length = (uint32_t)length;
+}
 
-    QUIC_BUFFER buffer;
-    buffer.Buffer = ctx->buffer;
-    buffer.Length = ctx->length;
+/* Espera CONNECTED; devuelve 0 si la conexion se cerro antes (handshake fallido) o vencio timeoutMs. */
+static int WaitForConnection(DWORD timeoutMs) {
+    for (DWORD waited = 0; waited < timeoutMs; waited += CONNECT_POLL_MS) {
+        if (WaitForSingleObject(AppContext.ConnectedEvent, CONNECT_POLL_MS) == WAIT_OBJECT_0) {
+            return 1;
+        }
+        if (WaitForSingleObject(AppContext.ConnectionShutdownEvent, 0) == WAIT_OBJECT_0) {
+            return 0;
+        }
+    }
+    return 0;
+}
 
-    InterlockedIncrement(&AppContext.OutstandingSends);
-    QUIC_STATUS status = MsQuic->StreamSend(Stream, &buffer, 1, QUIC_SEND_FLAG_NONE, ctx);
-    if (QUIC_FAILED(status)) {
-        InterlockedDecrement(&AppContext.OutstandingSends);
-        free(ctx->buffer);
-        free(ctx);
+/* Espera a que msquic confirme todos los lotes en vuelo antes de cerrar el stream. */
+static void WaitForSendsToDrain(DWORD timeoutMs) {
+    while (AppContext.InFlightBytes > 0) {
+        if (WaitForSingleObject(AppContext.SendWindowEvent, timeoutMs) != WAIT_OBJECT_0) {
+            fprintf(stderr, "[PUBLISHER] Timeout esperando confirmacion de %ld bytes.\n",
+                    (long)AppContext.InFlightBytes);
+            return;
+        }
     }
-    return status;
 }
 
-static void BuildTimestamp(char* destination, size_t capacity) {
-    time_t now = time(NULL);
-    struct tm* info = localtime(&now);
-    if (info != NULL) {
-        strftime(destination, capacity, "%H:%M:%S", info);
-    } else {
-        strncpy(destination, "00:00:00", capacity - 1);
-        destination[capacity - 1] = '\0';
+static QUIC_STATUS FlushBatch(HQUIC stream, SendContext* batch) {
+    if (batch->bufferCount == 0) {
+        free(batch);
+        return QUIC_STATUS_SUCCESS;
+    }
+
+    /* Sin QUIC_SEND_FLAG_ALLOW_0_RTT: con ticket, el primer lote espera aqui el final del handshake reanudado. */
+    if (!AppContext.FirstSendDone) {
+        if (!WaitForConnection(CONNECT_TIMEOUT_MS)) {
+            fprintf(stderr, "[PUBLISHER] No se pudo establecer la conexion con el broker.\n");
+            free(batch);
+            return QUIC_STATUS_ABORTED;
+        }
+        AppContext.FirstSendDone = 1;
+    }
+
+    WaitForSendWindow(batch->length);
+
+    uint8_t* data = BatchData(batch);
+    for (uint32_t i = 0; i < batch->bufferCount; ++i) {
+        batch->buffers[i].Buffer = data;
+        data += batch->buffers[i].Length;
+    }
+
+    LONG length = (LONG)batch->length;
+    InterlockedExchangeAdd(&AppContext.InFlightBytes, length);
+    QUIC_STATUS status = MsQuic->StreamSend(stream, batch->buffers, batch->bufferCount, QUIC_SEND_FLAG_NONE, batch);
+    if (QUIC_FAILED(status)) {
+        InterlockedExchangeAdd(&AppContext.InFlightBytes, -length);
+        free(batch);
     }
+    return status;
 }
 
 static
@@ -154,24 +295,38 @@ PublisherStreamCallback(
     QUIC_STREAM_EVENT* event
     )
 {
-    (void)stream;
-    (void)context;
-
     switch (event->Type) {
     case QUIC_STREAM_EVENT_SEND_COMPLETE: {
         SendContext* ctx = (SendContext*)event->SEND_COMPLETE.ClientContext;
         if (ctx != NULL) {
-            free(ctx->buffer);
+            InterlockedExchangeAdd(&AppContext.InFlightBytes, -(LONG)ctx->length);
             free(ctx);
         }
-        InterlockedDecrement(&AppContext.OutstandingSends);
+        SetEvent(AppContext.SendWindowEvent);
+        break;
+    }
+
+    case QUIC_STREAM_EVENT_IDEAL_SEND_BUFFER_SIZE: {
+        uint64_t ideal = event->IDEAL_SEND_BUFFER_SIZE.ByteCount;
+        if (ideal < SEND_WINDOW_MIN) {
+            ideal = SEND_WINDOW_MIN;
+        } else if (ideal > SEND_WINDOW_MAX) {
+            ideal = SEND_WINDOW_MAX;
+        }
+        AppContext.SendWindowBytes = (LONG)ideal;
+        SetEvent(AppContext.SendWindowEvent);
         break;
     }
 
     case QUIC_STREAM_EVENT_SHUTDOWN_COMPLETE:
-        SetEvent(AppContext.StreamShutdownEvent);
         MsQuic->StreamClose(stream);
-        Stream = NULL;
+        if (context == NULL) {
+            SetEvent(AppContext.StreamShutdownEvent);
+            Stream = NULL;
+        } else if (InterlockedDecrement(&AppContext.OpenStreams) == 0) {
+            /* Modo --multi: el ultimo stream de partido que se cierra libera al hilo principal. */
+            SetEvent(AppContext.StreamShutdownEvent);
+        }
         break;
 
     default:
@@ -193,10 +348,23 @@ PublisherConnectionCallback(
     (void)context;
 
     switch (event->Type) {
-    case QUIC_CONNECTION_EVENT_CONNECTED:
-        printf("[PUBLISHER] Conexion QUIC establecida.\n");
+    case QUIC_CONNECTION_EVENT_CONNECTED: {
+        uint64_t elapsedUs = PlatformNowUs() - AppContext.HandshakeStartUs;
+        printf("[PUBLISHER] Conexion QUIC establecida. Handshake %s en %.3f ms.\n",
+               event->CONNECTED.SessionResumed ? "reanudado" : "completo",
+               elapsedUs / 1000.0);
         SetEvent(AppContext.ConnectedEvent);
         break;
+    }
+
+    case QUIC_CONNECTION_EVENT_RESUMPTION_TICKET_RECEIVED:
+        if (!SaveResumptionTicket(
+                AppContext.TicketPath,
+                event->RESUMPTION_TICKET_RECEIVED.ResumptionTicket,
+                event->RESUMPTION_TICKET_RECEIVED.ResumptionTicketLength)) {
+            fprintf(stderr, "[PUBLISHER] No se pudo guardar el ticket de reanudacion en %s\n", AppContext.TicketPath);
+        }
+        break;
 
     case QUIC_CONNECTION_EVENT_SHUTDOWN_COMPLETE:
         printf("[PUBLISHER] Conexion finalizada.\n");
@@ -310,6 +478,9 @@ static int StartConnection(const char* serverName, uint16_t port) {
         return 0;
     }
 
+    AppContext.ResumptionAttempted = ApplyResumptionTicket(MsQuic, Connection, AppContext.TicketPath);
+    AppContext.HandshakeStartUs = PlatformNowUs();
+
     status = MsQuic->ConnectionStart(
         Connection,
         Configuration,
@@ -325,26 +496,27 @@ static int StartConnection(const char* serverName, uint16_t port) {
     return 1;
 }
 
-static int OpenStream(void) {
+/* context NULL identifica el stream unico; en modo --multi es el MatchStream del partido. */
+static int OpenStream(HQUIC* stream, void* context) {
     QUIC_STATUS status = MsQuic->StreamOpen(
         Connection,
         QUIC_STREAM_OPEN_FLAG_NONE,
         PublisherStreamCallback,
-        NULL,
-        &Stream);
+        context,
+        stream);
     if (QUIC_FAILED(status)) {
         fprintf(stderr, "[PUBLISHER] StreamOpen fracaso (%u).\n", status);
         return 0;
     }
 
     status = MsQuic->StreamStart(
-        Stream,
+        *stream,
         QUIC_STREAM_START_FLAG_IMMEDIATE |
         QUIC_STREAM_START_FLAG_SHUTDOWN_ON_FAIL);
     if (QUIC_FAILED(status)) {
         fprintf(stderr, "[PUBLISHER] StreamStart fracaso (%u).\n", status);
-        MsQuic->StreamClose(Stream);
-        Stream = NULL;
+        MsQuic->StreamClose(*stream);
+        *stream = NULL;
         return 0;
     }
     return 1;
@@ -359,6 +531,7 @@ static int PublishEvents(const char* topic, const char* filePath) {
 
     printf("[PUBLISHER] Publicando eventos de %s para el partido %s\n", filePath, topic);
 
+    SendContext* batch = NULL;
     char line[MESSAGE_MAX_LEN];
     int lineNumber = 1;
     while (fgets(line, sizeof(line), file) != NULL) {
@@ -367,32 +540,229 @@ static int PublishEvents(const char* topic, const char* filePath) {
             continue;
         }
 
-        char timestamp[16];
-        BuildTimestamp(timestamp, sizeof(timestamp));
+        char timestamp[LATENCY_STAMP_ORIGIN_LEN + 1];
+        LatencyStampOrigin(timestamp);
 
         char outbound[MESSAGE_MAX_LEN];
-        snprintf(outbound, sizeof(outbound), "PUBLISHER|%s|%s|%s", topic, timestamp, line);
+        int written = snprintf(outbound, sizeof(outbound), "PUBLISHER|%s|%s%s|%s\n", topic,
+                               EventPriorityMark(EventPriorityClassify(line)), timestamp, line);
+        size_t length = (size_t)written;
+        if (written < 0 || length >= sizeof(outbound)) {
+            length = sizeof(outbound) - 1;
+            outbound[length - 1] = '\n';
+        }
 
-        QUIC_STATUS status = QueueSend(outbound);
-        if (QUIC_FAILED(status)) {
-            fprintf(stderr, "[PUBLISHER] Error enviando linea %d (%u).\n", lineNumber, status);
-            fclose(file);
-            return 0;
+        if (batch != NULL && !BatchAppend(&batch, outbound, length)) {
+            QUIC_STATUS status = FlushBatch(Stream, batch);
+            batch = NULL;
+            if (QUIC_FAILED(status)) {
+                fprintf(stderr, "[PUBLISHER] Error enviando lote hasta la linea %d (%u).\n", lineNumber, status);
+                fclose(file);
+                return 0;
+            }
+        }
+
+        if (batch == NULL) {
+            batch = AllocateBatch();
+            if (batch == NULL) {
+                fprintf(stderr, "[PUBLISHER] Memoria insuficiente para el lote de envio.\n");
+                fclose(file);
+                return 0;
+            }
+            (void)BatchAppend(&batch, outbound, length);
         }
-        printf("[PUBLISHER] Mensaje enviado: %s\n", outbound);
+        printf("[PUBLISHER] Mensaje encolado: %.*s\n", (int)(length - 1), outbound);
         ++lineNumber;
     }
 
     fclose(file);
+
+    if (batch != NULL) {
+        QUIC_STATUS status = FlushBatch(Stream, batch);
+        if (QUIC_FAILED(status)) {
+            fprintf(stderr, "[PUBLISHER] Error enviando el ultimo lote (%u).\n", status);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Envia el lote pendiente de un partido (si tiene) por su stream. */
+static int FlushMatchBatch(MatchSource* match) {
+    MatchStream* matchStream = (MatchStream*)match->transport;
+    if (matchStream->batch == NULL) {
+        return 1;
+    }
+
+    QUIC_STATUS status = FlushBatch(matchStream->stream, matchStream->batch);
+    matchStream->batch = NULL;
+    if (QUIC_FAILED(status)) {
+        fprintf(stderr, "[PUBLISHER] Error enviando lote del partido %s (%u).\n", match->topic, status);
+        return 0;
+    }
+    return 1;
+}
+
+static int FlushAllMatchBatches(MatchSchedule* schedule) {
+    for (int i = 0; i < schedule->count; ++i) {
+        if (schedule->sources[i].transport != NULL && !FlushMatchBatch(&schedule->sources[i])) {
+            return 0;
+        }
+    }
     return 1;
 }
 
+/* Cierra el stream de un partido: ordenado al terminar su archivo, abortado ante un error. */
+static void ShutdownMatchStream(MatchSource* match, int abort) {
+    MatchStream* matchStream = (MatchStream*)match->transport;
+    if (matchStream->stream == NULL) {
+        return;
+    }
+    free(matchStream->batch);
+    matchStream->batch = NULL;
+    MsQuic->StreamShutdown(
+        matchStream->stream,
+        abort ? QUIC_STREAM_SHUTDOWN_FLAG_ABORT_SEND : QUIC_STREAM_SHUTDOWN_FLAG_GRACEFUL,
+        0);
+    matchStream->stream = NULL;
+}
+
+static int QueueMatchEvent(MatchSource* match, const char* line) {
+    MatchStream* matchStream = (MatchStream*)match->transport;
+
+    char timestamp[LATENCY_STAMP_ORIGIN_LEN + 1];
+    LatencyStampOrigin(timestamp);
+
+    char outbound[MESSAGE_MAX_LEN];
+    int written = snprintf(outbound, sizeof(outbound), "PUBLISHER|%s|%s%s|%s\n", match->topic,
+                           EventPriorityMark(EventPriorityClassify(line)), timestamp, line);
+    size_t length = (size_t)written;
+    if (written < 0 || length >= sizeof(outbound)) {
+        length = sizeof(outbound) - 1;
+        outbound[length - 1] = '\n';
+    }
+
+    if (matchStream->batch != NULL && !BatchAppend(&matchStream->batch, outbound, length)) {
+        if (!FlushMatchBatch(match)) {
+            return 0;
+        }
+    }
+    if (matchStream->batch == NULL) {
+        matchStream->batch = AllocateBatch();
+        if (matchStream->batch == NULL) {
+            fprintf(stderr, "[PUBLISHER] Memoria insuficiente para el lote de envio.\n");
+            return 0;
+        }
+        (void)BatchAppend(&matchStream->batch, outbound, length);
+    }
+    return 1;
+}
+
+/*
+ * Modo --multi: abre un stream por partido y reproduce todos los archivos con el planificador comun. Devuelve al
+ * volver con todos los streams ya cerrados (o con el cierre solicitado) y AppContext.OpenStreams descontado.
+ */
+static int PublishMatches(const char* source, uint32_t intervalMs) {
+    MatchSchedule schedule;
+    if (LoadMatchSchedule(&schedule, source, intervalMs) == 0) {
+        fprintf(stderr, "[PUBLISHER] No hay partidos para publicar en %s\n", source);
+        FreeMatchSchedule(&schedule);
+        return 0;
+    }
+
+    MatchStream* matchStreams = (MatchStream*)calloc((size_t)schedule.count, sizeof(MatchStream));
+    if (matchStreams == NULL) {
+        fprintf(stderr, "[PUBLISHER] Memoria insuficiente para %d partidos.\n", schedule.count);
+        FreeMatchSchedule(&schedule);
+        return 0;
+    }
+
+    /* La referencia propia evita que el evento se active mientras todavia se estan abriendo streams. */
+    AppContext.OpenStreams = 1;
+    ResetEvent(AppContext.StreamShutdownEvent);
+
+    int ok = 1;
+    for (int i = 0; ok && i < schedule.count; ++i) {
+        MatchSource* match = &schedule.sources[i];
+        match->transport = &matchStreams[i];
+        if (match->finished) {
+            continue;
+        }
+        InterlockedIncrement(&AppContext.OpenStreams);
+        if (!OpenStream(&matchStreams[i].stream, &matchStreams[i])) {
+            InterlockedDecrement(&AppContext.OpenStreams);
+            ok = 0;
+        }
+    }
+
+    if (ok) {
+        printf("[PUBLISHER] Publicando %d partidos desde %s, un stream por partido (intervalo %u ms).\n",
+               schedule.active, source, intervalMs);
+    }
+
+    MatchSource* match;
+    char line[MESSAGE_MAX_LEN];
+    uint64_t published = 0;
+    while (ok && (match = NextMatch(&schedule)) != NULL) {
+        if (match->nextDueMs > ReplayNowMs()) {
+            ok = FlushAllMatchBatches(&schedule);
+            if (ok) {
+                ReplaySleepUntil(match->nextDueMs);
+            }
+            continue;
+        }
+
+        if (!ReadMatchLine(&schedule, match, line, sizeof(line))) {
+            ok = FlushMatchBatch(match);
+            ShutdownMatchStream(match, !ok);
+            printf("[PUBLISHER] Fin del partido %s (%u eventos).\n", match->topic, match->sent);
+            continue;
+        }
+        ok = QueueMatchEvent(match, line);
+        ++published;
+    }
+
+    for (int i = 0; i < schedule.count; ++i) {
+        if (schedule.sources[i].transport != NULL) {
+            ShutdownMatchStream(&schedule.sources[i], !ok);
+        }
+    }
+    if (InterlockedDecrement(&AppContext.OpenStreams) == 0) {
+        SetEvent(AppContext.StreamShutdownEvent);
+    }
+
+    printf("[PUBLISHER] %llu eventos encolados en %d partidos.\n", (unsigned long long)published, schedule.count);
+    free(matchStreams);
+    FreeMatchSchedule(&schedule);
+    return ok;
+}
+
+static void PrintUsage(const char* program) {
+    fprintf(stderr, "Uso: %s <IP_BROKER> <PUERTO> <TOPIC> <ARCHIVO_MENSAJES> [--ticket <RUTA_TICKET>]\n", program);
+    fprintf(stderr, "     %s <IP_BROKER> <PUERTO> --multi <DIRECTORIO|MANIFIESTO> [--intervalo <MS>] [--ticket <RUTA_TICKET>]\n",
+            program);
+}
+
 int main(int argc, char** argv) {
-    if (argc != 5) {
-        fprintf(stderr, "Uso: %s <IP_BROKER> <PUERTO> <TOPIC> <ARCHIVO_MENSAJES>\n", argv[0]);
+    if (argc < 5) {
+        PrintUsage(argv[0]);
         return EXIT_FAILURE;
     }
 
+    int multiMode = strcmp(argv[3], "--multi") == 0;
+    const char* ticketPath = NULL;
+    uint32_t intervalMs = 0;
+    for (int i = 5; i < argc; ++i) {
+        if (strcmp(argv[i], "--ticket") == 0 && i + 1 < argc) {
+            ticketPath = argv[++i];
+        } else if (multiMode && strcmp(argv[i], "--intervalo") == 0 && i + 1 < argc) {
+            intervalMs = (uint32_t)atoi(argv[++i]);
+        } else {
+            PrintUsage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
     const char* brokerAddress = argv[1];
     int portValue = atoi(argv[2]);
     if (portValue <= 0 || portValue > 65535) {
@@ -400,6 +770,13 @@ int main(int argc, char** argv) {
         return EXIT_FAILURE;
     }
 
+    if (ticketPath != NULL) {
+        strncpy(AppContext.TicketPath, ticketPath, sizeof(AppContext.TicketPath) - 1);
+        AppContext.TicketPath[sizeof(AppContext.TicketPath) - 1] = '\0';
+    } else {
+        BuildResumptionTicketPath(AppContext.TicketPath, sizeof(AppContext.TicketPath), brokerAddress, (uint16_t)portValue);
+    }
+
     if (!InitializeEvents()) {
         DisposeEvents();
         return EXIT_FAILURE;
@@ -416,31 +793,36 @@ int main(int argc, char** argv) {
         return EXIT_FAILURE;
     }
 
-    DWORD waitResult = WaitForSingleObject(AppContext.ConnectedEvent, 15000);
-    if (waitResult != WAIT_OBJECT_0) {
-        fprintf(stderr, "[PUBLISHER] Timeout esperando la conexion.\n");
-        CleanupQuic();
-        DisposeEvents();
-        return EXIT_FAILURE;
-    }
-
-    if (!OpenStream()) {
+    if (AppContext.ResumptionAttempted) {
+        printf("[PUBLISHER] Ticket de reanudacion cargado (%s); el primer lote se arma durante el handshake.\n",
+               AppContext.TicketPath);
+    } else if (!WaitForConnection(CONNECT_TIMEOUT_MS)) {
+        fprintf(stderr, "[PUBLISHER] No se pudo establecer la conexion con el broker.\n");
         CleanupQuic();
         DisposeEvents();
         return EXIT_FAILURE;
     }
 
-    if (!PublishEvents(argv[3], argv[4])) {
-        MsQuic->StreamShutdown(Stream, QUIC_STREAM_SHUTDOWN_FLAG_ABORT_SEND, 0);
+    int published;
+    if (multiMode) {
+        published = PublishMatches(argv[4], intervalMs);
     } else {
-        MsQuic->StreamShutdown(Stream, QUIC_STREAM_SHUTDOWN_FLAG_GRACEFUL, 0);
+        if (!OpenStream(&Stream, NULL)) {
+            CleanupQuic();
+            DisposeEvents();
+            return EXIT_FAILURE;
+        }
+
+        published = PublishEvents(argv[3], argv[4]);
+        if (!published) {
+            MsQuic->StreamShutdown(Stream, QUIC_STREAM_SHUTDOWN_FLAG_ABORT_SEND, 0);
+        } else {
+            MsQuic->StreamShutdown(Stream, QUIC_STREAM_SHUTDOWN_FLAG_GRACEFUL, 0);
+        }
     }
 
     WaitForSingleObject(AppContext.StreamShutdownEvent, 15000);
-
-    while (AppContext.OutstandingSends > 0) {
-        Sleep(10);
-    }
+    WaitForSendsToDrain(5000);
 
     MsQuic->ConnectionShutdown(Connection, QUIC_CONNECTION_SHUTDOWN_FLAG_NONE, 0);
     WaitForSingleObject(AppContext.ConnectionShutdownEvent, 5000);
@@ -449,5 +831,5 @@ int main(int argc, char** argv) {
     DisposeEvents();
 
     printf("[PUBLISHER] Finalizado.\n");
-    return EXIT_SUCCESS;
+    return published ? EXIT_SUCCESS : EXIT_FAILURE;
 }
@@ -0,0 +1,281 @@
+/*
+ * Archivo: quic_platform.h
+ * Descripcion: Capa minima de portabilidad Windows/Linux para los programas QUIC (broker, publisher, subscriber).
+ *
+ * En Windows solo incluye windows.h/winsock2.h. En Linux reproduce, sobre pthreads, el subconjunto de la API
+ * Win32 que ya usaban los programas (CRITICAL_SECTION, eventos, semaforos, Interlocked*, Sleep), de modo que el
+ * codigo de los callbacks de msquic no necesita ramas por plataforma. Los hilos propios (PlatformThread*) tienen
+ * una interfaz neutra porque la firma de las rutinas difiere entre CreateThread y pthread_create.
+ *
+ * LIBRERIAS UTILIZADAS Y JUSTIFICACION:
+ *
+ * 1. pthread.h (solo Linux)
+ *    - Por que: Mutex y variables de condicion para emular CRITICAL_SECTION y los eventos de Win32. Los semaforos
+ *      llevan el contador en un atomico (__atomic_*) y un contador de hilos dormidos: liberar sin nadie esperando
+ *      no toma el mutex, y con un hilo esperando se despierta uno solo (pthread_cond_signal).
+ *    - Funciones usadas: pthread_mutex_*(), pthread_cond_*(), pthread_create(), pthread_join().
+ *    - Alternativa considerada: Semaforos POSIX; descartado porque no modelan eventos de reinicio manual.
+ *
+ * 2. time.h / unistd.h (solo Linux)
+ *    - Por que: Esperas con timeout, Sleep() y reloj monotonico.
+ *    - Funciones usadas: clock_gettime(), usleep().
+ */
+
+#ifndef QUIC_PLATFORM_H
+#define QUIC_PLATFORM_H
+
+#include <stdint.h>
+
+#ifdef _WIN32
+
+#include <winsock2.h>
+#include <windows.h>
+
+#else
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+#ifndef TRUE
+#define TRUE 1
+#endif
+#ifndef FALSE
+#define FALSE 0
+#endif
+
+typedef int BOOL;
+typedef unsigned long DWORD;
+typedef int32_t LONG;
+
+#define INFINITE 0xFFFFFFFFu
+#define WAIT_OBJECT_0 0u
+#define WAIT_ABANDONED 0x80u
+#define WAIT_TIMEOUT 258u
+#define WAIT_FAILED 0xFFFFFFFFu
+
+typedef pthread_mutex_t CRITICAL_SECTION;
+
+#define InitializeCriticalSection(lock) pthread_mutex_init((lock), NULL)
+#define EnterCriticalSection(lock) pthread_mutex_lock(lock)
+#define LeaveCriticalSection(lock) pthread_mutex_unlock(lock)
+#define DeleteCriticalSection(lock) pthread_mutex_destroy(lock)
+
+#define InterlockedIncrement(target) __atomic_add_fetch((target), 1, __ATOMIC_SEQ_CST)
+#define InterlockedDecrement(target) __atomic_sub_fetch((target), 1, __ATOMIC_SEQ_CST)
+#define InterlockedExchangeAdd(target, value) __atomic_fetch_add((target), (value), __ATOMIC_SEQ_CST)
+
+#define GetLastError() ((DWORD)errno)
+
+static inline void Sleep(DWORD milliseconds) {
+    usleep((useconds_t)milliseconds * 1000);
+}
+
+/*
+ * Evento o semaforo: para un semaforo 'signaled' es el contador disponible y se modifica con atomicos; el mutex y
+ * la variable de condicion solo se usan cuando hay algun hilo dormido (waiters > 0).
+ */
+typedef struct PlatformEvent {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    int manualReset;
+    int semaphore;
+    long signaled;
+    int waiters;
+} PlatformEvent;
+
+typedef PlatformEvent* HANDLE;
+
+static inline HANDLE CreateEventA(void* attributes, BOOL manualReset, BOOL initialState, const char* name) {
+    (void)attributes;
+    (void)name;
+    PlatformEvent* event = (PlatformEvent*)calloc(1, sizeof(PlatformEvent));
+    if (event == NULL) {
+        return NULL;
+    }
+    pthread_mutex_init(&event->mutex, NULL);
+    pthread_cond_init(&event->cond, NULL);
+    event->manualReset = manualReset;
+    event->signaled = initialState;
+    return event;
+}
+
+static inline BOOL SetEvent(HANDLE event) {
+    pthread_mutex_lock(&event->mutex);
+    event->signaled = 1;
+    if (event->manualReset) {
+        pthread_cond_broadcast(&event->cond);
+    } else {
+        pthread_cond_signal(&event->cond);
+    }
+    pthread_mutex_unlock(&event->mutex);
+    return TRUE;
+}
+
+static inline BOOL ResetEvent(HANDLE event) {
+    pthread_mutex_lock(&event->mutex);
+    event->signaled = 0;
+    pthread_mutex_unlock(&event->mutex);
+    return TRUE;
+}
+
+/* Toma una unidad del semaforo sin bloquear; devuelve 0 si el contador estaba en 0. */
+static inline int PlatformSemaphoreTryTake(HANDLE semaphore) {
+    long available = __atomic_load_n(&semaphore->signaled, __ATOMIC_SEQ_CST);
+    while (available > 0) {
+        if (__atomic_compare_exchange_n(&semaphore->signaled, &available, available - 1, 0, __ATOMIC_SEQ_CST,
+                                        __ATOMIC_SEQ_CST)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static inline DWORD WaitForSingleObject(HANDLE event, DWORD timeoutMs) {
+    if (event->semaphore && PlatformSemaphoreTryTake(event)) {
+        return WAIT_OBJECT_0;
+    }
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    if (timeoutMs != INFINITE) {
+        deadline.tv_sec += timeoutMs / 1000;
+        deadline.tv_nsec += (long)(timeoutMs % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec += 1;
+            deadline.tv_nsec -= 1000000000L;
+        }
+    }
+
+    DWORD result = WAIT_OBJECT_0;
+    pthread_mutex_lock(&event->mutex);
+    if (event->semaphore) {
+        /*
+         * Se anota como dormido antes de volver a mirar el contador: ReleaseSemaphore suma y despues lee waiters,
+         * asi que o este hilo ve la unidad nueva o el que libera lo ve anotado y lo despierta.
+         */
+        __atomic_add_fetch(&event->waiters, 1, __ATOMIC_SEQ_CST);
+        while (!PlatformSemaphoreTryTake(event)) {
+            int rc = timeoutMs == INFINITE
+                ? pthread_cond_wait(&event->cond, &event->mutex)
+                : pthread_cond_timedwait(&event->cond, &event->mutex, &deadline);
+            if (rc == ETIMEDOUT) {
+                if (!PlatformSemaphoreTryTake(event)) {
+                    result = WAIT_TIMEOUT;
+                }
+                break;
+            }
+            if (rc != 0) {
+                result = WAIT_FAILED;
+                break;
+            }
+        }
+        __atomic_sub_fetch(&event->waiters, 1, __ATOMIC_SEQ_CST);
+        pthread_mutex_unlock(&event->mutex);
+        return result;
+    }
+    while (event->signaled == 0) {
+        int rc = timeoutMs == INFINITE
+            ? pthread_cond_wait(&event->cond, &event->mutex)
+            : pthread_cond_timedwait(&event->cond, &event->mutex, &deadline);
+        if (rc == ETIMEDOUT) {
+            result = WAIT_TIMEOUT;
+            break;
+        }
+        if (rc != 0) {
+            result = WAIT_FAILED;
+            break;
+        }
+    }
+    if (result == WAIT_OBJECT_0 && !event->manualReset) {
+        event->signaled = 0;
+    }
+    pthread_mutex_unlock(&event->mutex);
+    return result;
+}
+
+static inline HANDLE CreateSemaphoreA(void* attributes, LONG initialCount, LONG maximumCount, const char* name) {
+    (void)maximumCount;
+    HANDLE semaphore = CreateEventA(attributes, FALSE, FALSE, name);
+    if (semaphore != NULL) {
+        semaphore->semaphore = 1;
+        semaphore->signaled = initialCount;
+    }
+    return semaphore;
+}
+
+/* Sin hilos dormidos es solo una suma atomica: el worker ocupado toma la unidad en su proximo WaitForSingleObject. */
+static inline BOOL ReleaseSemaphore(HANDLE semaphore, LONG releaseCount, LONG* previousCount) {
+    long previous = __atomic_fetch_add(&semaphore->signaled, (long)releaseCount, __ATOMIC_SEQ_CST);
+    if (previousCount != NULL) {
+        *previousCount = (LONG)previous;
+    }
+    if (__atomic_load_n(&semaphore->waiters, __ATOMIC_SEQ_CST) > 0) {
+        pthread_mutex_lock(&semaphore->mutex);
+        if (releaseCount == 1) {
+            pthread_cond_signal(&semaphore->cond);
+        } else {
+            pthread_cond_broadcast(&semaphore->cond);
+        }
+        pthread_mutex_unlock(&semaphore->mutex);
+    }
+    return TRUE;
+}
+
+static inline BOOL CloseHandle(HANDLE event) {
+    pthread_cond_destroy(&event->cond);
+    pthread_mutex_destroy(&event->mutex);
+    free(event);
+    return TRUE;
+}
+
+#endif /* _WIN32 */
+
+#ifdef _WIN32
+typedef HANDLE PlatformThread;
+#define PLATFORM_THREAD_ROUTINE(name) DWORD WINAPI name(LPVOID argument)
+#define PLATFORM_THREAD_RETURN 0
+#else
+typedef pthread_t PlatformThread;
+#define PLATFORM_THREAD_ROUTINE(name) void* name(void* argument)
+#define PLATFORM_THREAD_RETURN NULL
+#endif
+
+static inline int PlatformThreadCreate(PlatformThread* thread, PLATFORM_THREAD_ROUTINE((*routine)), void* argument) {
+#ifdef _WIN32
+    *thread = CreateThread(NULL, 0, routine, argument, 0, NULL);
+    return *thread != NULL;
+#else
+    return pthread_create(thread, NULL, routine, argument) == 0;
+#endif
+}
+
+static inline void PlatformThreadJoin(PlatformThread thread) {
+#ifdef _WIN32
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+#else
+    pthread_join(thread, NULL);
+#endif
+}
+
+/* Reloj monotonico en microsegundos, usado para medir handshakes y latencias. */
+static inline uint64_t PlatformNowUs(void) {
+#ifdef _WIN32
+    LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (uint64_t)(counter.QuadPart / frequency.QuadPart) * 1000000ULL +
+           (uint64_t)(counter.QuadPart % frequency.QuadPart) * 1000000ULL / (uint64_t)frequency.QuadPart;
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000ULL + (uint64_t)now.tv_nsec / 1000ULL;
+#endif
+}
+
+#endif /* QUIC_PLATFORM_H */
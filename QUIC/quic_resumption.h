@@ -0,0 +1,89 @@
+/*
+ * Archivo: quic_resumption.h
+ * Descripcion: Cache en disco de tickets de reanudacion TLS 1.3 para los clientes QUIC (publisher y subscriber).
+ *
+ * El broker entrega un ticket despues de cada handshake (QUIC_CONNECTION_EVENT_RESUMPTION_TICKET_RECEIVED).
+ * El cliente lo guarda en un archivo y en la siguiente ejecucion lo entrega a msquic con
+ * QUIC_PARAM_CONN_RESUMPTION_TICKET antes de ConnectionStart(), lo que permite un handshake reanudado y
+ * enviar datos 0-RTT sin esperar el evento CONNECTED.
+ *
+ * LIBRERIAS UTILIZADAS Y JUSTIFICACION:
+ *
+ * 1. msquic.h
+ *    - Por que: Parametro QUIC_PARAM_CONN_RESUMPTION_TICKET de la conexion.
+ *    - Funciones usadas: MsQuic->SetParam().
+ *
+ * 2. stdio.h / stdlib.h / string.h (libreria estandar)
+ *    - Por que: Lectura y escritura binaria del ticket.
+ *    - Funciones usadas: fopen(), fread(), fwrite(), fclose(), malloc(), free(), snprintf().
+ *    - Alternativa considerada: Guardar el ticket en memoria compartida; descartado porque el ticket debe
+ *      sobrevivir entre ejecuciones del cliente.
+ */
+
+#ifndef QUIC_RESUMPTION_H
+#define QUIC_RESUMPTION_H
+
+#include <msquic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define RESUMPTION_TICKET_MAX_LEN 4096
+
+/* Ruta por defecto del ticket: un archivo por broker (host y puerto) en el directorio actual. */
+static inline void BuildResumptionTicketPath(char* destination, size_t capacity, const char* server, uint16_t port) {
+    snprintf(destination, capacity, "quic_ticket_%s_%u.bin", server, (unsigned)port);
+    for (char* cursor = destination; *cursor != '\0'; ++cursor) {
+        if (*cursor == ':' || *cursor == '/' || *cursor == '\\') {
+            *cursor = '_';
+        }
+    }
+}
+
+static inline int SaveResumptionTicket(const char* path, const uint8_t* ticket, uint32_t length) {
+    if (length == 0 || length > RESUMPTION_TICKET_MAX_LEN) {
+        return 0;
+    }
+
+    FILE* file = fopen(path, "wb");
+    if (file == NULL) {
+        return 0;
+    }
+    size_t written = fwrite(ticket, 1, length, file);
+    fclose(file);
+    return written == length;
+}
+
+/*
+ * Carga el ticket guardado y lo asocia a la conexion (antes de ConnectionStart). Devuelve 1 si la conexion
+ * intentara un handshake reanudado; 0 si no hay ticket o msquic lo rechazo (handshake completo normal).
+ */
+static inline int ApplyResumptionTicket(const QUIC_API_TABLE* api, HQUIC connection, const char* path) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        return 0;
+    }
+
+    uint8_t* ticket = (uint8_t*)malloc(RESUMPTION_TICKET_MAX_LEN);
+    if (ticket == NULL) {
+        fclose(file);
+        return 0;
+    }
+
+    size_t length = fread(ticket, 1, RESUMPTION_TICKET_MAX_LEN, file);
+    fclose(file);
+    if (length == 0) {
+        free(ticket);
+        return 0;
+    }
+
+    QUIC_STATUS status = api->SetParam(
+        connection,
+        QUIC_PARAM_CONN_RESUMPTION_TICKET,
+        (uint32_t)length,
+        ticket);
+    free(ticket);
+    return QUIC_SUCCEEDED(status);
+}
+
+#endif /* QUIC_RESUMPTION_H */
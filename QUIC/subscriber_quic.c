@@ -8,7 +8,9 @@
  *    - Por que: Permite establecer conexiones QUIC seguras y recibir datos por streams.
  *    - Funciones usadas: MsQuicOpen(), MsQuic->RegistrationOpen(), MsQuic->ConfigurationOpen(),
  *      MsQuic->ConfigurationLoadCredential(), MsQuic->ConnectionOpen(), MsQuic->ConnectionStart(),
- *      MsQuic->StreamOpen(), MsQuic->StreamStart(), MsQuic->StreamSend().
+ *      MsQuic->StreamOpen(), MsQuic->StreamStart(), MsQuic->StreamSend(), MsQuic->SetParam() (ticket de
+ *      reanudacion para handshakes 0-RTT, ver quic_resumption.h), MsQuic->SetCallbackHandler() (stream de alta
+ *      prioridad que abre el broker).
  *    - Alternativa considerada: Implementar QUIC manualmente; descartado por complejidad y cumplimiento de RFC.
  *
  * 2. stdio.h (libreria estandar)
@@ -23,18 +25,33 @@
  *    - Por que: Construccion del mensaje de suscripcion y buffers de recepcion.
  *    - Funciones usadas: strlen(), strcpy(), strncpy(), memset().
  *
- * 5. windows.h
+ * 5. windows.h (via quic_platform.h; en Linux se emula sobre pthreads)
  *    - Por que: Eventos de sincronizacion necesarios para coordinar el ciclo de vida con callbacks asincronos.
  *    - Funciones usadas: CreateEventA(), WaitForSingleObject(), SetEvent(), CloseHandle(), InterlockedIncrement(),
  *      InterlockedDecrement().
  *    - Alternativa considerada: Esperas activas; descartado por consumo innecesario de CPU.
+ *
+ * 6. ../common/latency_stamp.h
+ *    - Por que: Los eventos con marcas "#<origen>#<ingreso>|mensaje" alimentan dos histogramas en el propio
+ *      proceso (publisher->broker y broker->subscriber); cada 5 s y al terminar se imprimen p50/p99/max.
+ *    - Funciones usadas: LatencyStampNowNs(), LatencyStampParse(), LatencyStatsRecord(), LatencyStatsPrint().
+ *
+ * 7. ../common/message_sink.h
+ *    - Por que: Los eventos van a la salida elegida con --salida (texto agrupado en consola o archivo, registro
+ *      binario o nula) en lugar de un printf por evento. El callback del stream escribe y el hilo principal vacia
+ *      el buffer cada MESSAGE_SINK_FLUSH_MS sin trafico, por eso el sink se protege con un CRITICAL_SECTION.
+ *    - Funciones usadas: MessageSinkOpen(), MessageSinkRecord(), MessageSinkPrintf(), MessageSinkTick(),
+ *      MessageSinkFlush(), MessageSinkClose(), MessageSinkPrintSummary().
  */
 
 #include <msquic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <windows.h>
+#include "quic_platform.h"
+#include "quic_resumption.h"
+#include "../common/latency_stamp.h"
+#include "../common/message_sink.h"
 
 #define MESSAGE_MAX_LEN 512
 
@@ -57,9 +74,13 @@ typedef struct SubscriberContext {
     HANDLE ShutdownEvent;
     volatile LONG OutstandingSends;
     char Topic[MESSAGE_MAX_LEN];
+    uint64_t HandshakeStartUs;
+    int ResumptionAttempted;
+    char TicketPath[260];
+    const char* ReplayFrom;   /* --desde: offset o @hora_ms del registro del broker; NULL = solo en vivo. */
 } SubscriberContext;
 
-static SubscriberContext AppContext = { NULL, NULL, NULL, 0, {0} };
+static SubscriberContext AppContext = { NULL, NULL, NULL, 0, {0}, 0, 0, {0}, NULL };
 
 static int InitializeEvents(void) {
     AppContext.ConnectedEvent = CreateEventA(NULL, TRUE, FALSE, NULL);
@@ -100,7 +121,11 @@ static uint8_t* DuplicateBytes(const char* source, size_t length) {
 
 static QUIC_STATUS SendSubscription(const char* topic) {
     char message[MESSAGE_MAX_LEN];
-    snprintf(message, sizeof(message), "SUBSCRIBER|%s", topic);
+    if (AppContext.ReplayFrom != NULL) {
+        snprintf(message, sizeof(message), "REPLAY|%s|%s\n", topic, AppContext.ReplayFrom);
+    } else {
+        snprintf(message, sizeof(message), "SUBSCRIBER|%s\n", topic);
+    }
 
     size_t length = strlen(message);
     if (length == 0) {
@@ -123,8 +148,15 @@ static QUIC_STATUS SendSubscription(const char* topic) {
     buffer.Buffer = ctx->buffer;
     buffer.Length = ctx->length;
 
+    /*
+     * La suscripcion es idempotente, asi que puede viajar como dato 0-RTT en una conexion reanudada. REPLAY no:
+     * si el 0-RTT se repitiera, el historial llegaria dos veces.
+     */
+    QUIC_SEND_FLAGS flags = AppContext.ResumptionAttempted && AppContext.ReplayFrom == NULL
+        ? QUIC_SEND_FLAG_ALLOW_0_RTT : QUIC_SEND_FLAG_NONE;
+
     InterlockedIncrement(&AppContext.OutstandingSends);
-    QUIC_STATUS status = MsQuic->StreamSend(Stream, &buffer, 1, QUIC_SEND_FLAG_NONE, ctx);
+    QUIC_STATUS status = MsQuic->StreamSend(Stream, &buffer, 1, flags, ctx);
     if (QUIC_FAILED(status)) {
         InterlockedDecrement(&AppContext.OutstandingSends);
         free(ctx->buffer);
@@ -133,26 +165,80 @@ static QUIC_STATUS SendSubscription(const char* topic) {
     return status;
 }
 
-static void PrintReceive(const QUIC_STREAM_EVENT* event) {
-    char message[MESSAGE_MAX_LEN];
-    size_t offset = 0;
-
-    for (uint32_t i = 0; i < event->RECEIVE.BufferCount; ++i) {
-        const QUIC_BUFFER* buffer = &event->RECEIVE.Buffers[i];
-        size_t remaining = MESSAGE_MAX_LEN - 1 - offset;
-        size_t toCopy = buffer->Length < remaining ? buffer->Length : remaining;
-        memcpy(message + offset, buffer->Buffer, toCopy);
-        offset += toCopy;
-        if (toCopy < buffer->Length) {
-            fprintf(stderr, "[SUBSCRIBER] Mensaje entrante truncado.\n");
-            break;
+/* Fragmento de linea pendiente entre eventos RECEIVE (el broker separa los mensajes con '\n'). */
+typedef struct PendingLine {
+    char text[MESSAGE_MAX_LEN];
+    size_t length;
+    int truncated;
+} PendingLine;
+
+/* Uno por stream: el stream de alta prioridad que abre el broker intercala sus eventos con los del principal. */
+static PendingLine MainLine;
+static PendingLine PriorityLine;
+
+/* Latencia por tramo de los eventos con marcas; solo la toca el callback del stream. */
+static LatencyStats Latency;
+
+/* Salida de los eventos: la escribe el callback del stream y la vacia tambien el hilo principal. */
+static MessageSink Output;
+static CRITICAL_SECTION OutputLock;
+
+static void PrintLine(PendingLine* line, uint64_t receivedNs) {
+    line->text[line->length] = '\0';
+    if (line->length > 0 && line->text[line->length - 1] == '\r') {
+        line->text[--line->length] = '\0';
+    }
+    if (line->truncated) {
+        fprintf(stderr, "[SUBSCRIBER] Mensaje entrante truncado.\n");
+    }
+    uint64_t originNs, ingressNs;
+    if (line->length > 0) {
+        MessageSinkRecord(&Output, receivedNs, line->text, line->length);
+    }
+    if (line->length > LATENCY_STAMP_FORWARD_LEN && line->text[LATENCY_STAMP_FORWARD_LEN] == '|' &&
+        LatencyStampParse(line->text, line->length, &originNs, &ingressNs)) {
+        uint64_t totalUs = LatencyStatsRecord(&Latency, originNs, ingressNs, receivedNs);
+        MessageSinkPrintf(&Output, "[SUBSCRIBER] Evento recibido (%s) [+%llu us]: %s\n", AppContext.Topic,
+                          (unsigned long long)totalUs, line->text + LATENCY_STAMP_FORWARD_LEN + 1);
+        if (receivedNs >= Latency.nextReportNs) {
+            MessageSinkFlush(&Output);  /* el resumen no se adelanta a los eventos del buffer */
         }
+        LatencyStatsMaybePrint(&Latency, receivedNs, stdout, "[SUBSCRIBER]");
+    } else if (line->length > 0) {
+        MessageSinkPrintf(&Output, "[SUBSCRIBER] Evento recibido (%s): %s\n", AppContext.Topic, line->text);
     }
+    line->length = 0;
+    line->truncated = 0;
+}
 
-    message[offset] = '\0';
-    if (offset > 0) {
-        printf("[SUBSCRIBER] Evento recibido (%s): %s\n", AppContext.Topic, message);
+/* Un RECEIVE puede traer varios eventos agrupados por el broker o solo parte de uno. */
+static void PrintReceive(const QUIC_STREAM_EVENT* event, PendingLine* line) {
+    uint64_t receivedNs = LatencyStampNowNs();
+    EnterCriticalSection(&OutputLock);
+    for (uint32_t i = 0; i < event->RECEIVE.BufferCount; ++i) {
+        const uint8_t* data = event->RECEIVE.Buffers[i].Buffer;
+        size_t length = event->RECEIVE.Buffers[i].Length;
+
+        while (length > 0) {
+            const uint8_t* newline = (const uint8_t*)memchr(data, '\n', length);
+            size_t chunk = newline != NULL ? (size_t)(newline - data) : length;
+            size_t remaining = MESSAGE_MAX_LEN - 1 - line->length;
+            size_t toCopy = chunk < remaining ? chunk : remaining;
+            memcpy(line->text + line->length, data, toCopy);
+            line->length += toCopy;
+            if (toCopy < chunk) {
+                line->truncated = 1;
+            }
+
+            if (newline == NULL) {
+                break;
+            }
+            PrintLine(line, receivedNs);
+            data += chunk + 1;
+            length -= chunk + 1;
+        }
     }
+    LeaveCriticalSection(&OutputLock);
 }
 
 static
@@ -177,7 +263,7 @@ SubscriberStreamCallback(
     }
 
     case QUIC_STREAM_EVENT_RECEIVE:
-        PrintReceive(event);
+        PrintReceive(event, &MainLine);
         break;
 
     case QUIC_STREAM_EVENT_PEER_SEND_SHUTDOWN:
@@ -198,6 +284,33 @@ SubscriberStreamCallback(
     return QUIC_STATUS_SUCCESS;
 }
 
+/* Stream unidireccional del broker para los eventos de alta prioridad; se cierra junto con la conexion. */
+static
+QUIC_STATUS
+PriorityStreamCallback(
+    HQUIC stream,
+    void* context,
+    QUIC_STREAM_EVENT* event
+    )
+{
+    (void)context;
+
+    switch (event->Type) {
+    case QUIC_STREAM_EVENT_RECEIVE:
+        PrintReceive(event, &PriorityLine);
+        break;
+
+    case QUIC_STREAM_EVENT_SHUTDOWN_COMPLETE:
+        MsQuic->StreamClose(stream);
+        break;
+
+    default:
+        break;
+    }
+
+    return QUIC_STATUS_SUCCESS;
+}
+
 static
 QUIC_STATUS
 SubscriberConnectionCallback(
@@ -210,10 +323,27 @@ SubscriberConnectionCallback(
     (void)context;
 
     switch (event->Type) {
-    case QUIC_CONNECTION_EVENT_CONNECTED:
-        printf("[SUBSCRIBER] Conexion QUIC establecida.\n");
+    case QUIC_CONNECTION_EVENT_CONNECTED: {
+        uint64_t elapsedUs = PlatformNowUs() - AppContext.HandshakeStartUs;
+        printf("[SUBSCRIBER] Conexion QUIC establecida. Handshake %s en %.3f ms.\n",
+               event->CONNECTED.SessionResumed ? "reanudado" : "completo",
+               elapsedUs / 1000.0);
         SetEvent(AppContext.ConnectedEvent);
         break;
+    }
+
+    case QUIC_CONNECTION_EVENT_PEER_STREAM_STARTED:
+        MsQuic->SetCallbackHandler(event->PEER_STREAM_STARTED.Stream, (void*)PriorityStreamCallback, NULL);
+        break;
+
+    case QUIC_CONNECTION_EVENT_RESUMPTION_TICKET_RECEIVED:
+        if (!SaveResumptionTicket(
+                AppContext.TicketPath,
+                event->RESUMPTION_TICKET_RECEIVED.ResumptionTicket,
+                event->RESUMPTION_TICKET_RECEIVED.ResumptionTicketLength)) {
+            fprintf(stderr, "[SUBSCRIBER] No se pudo guardar el ticket de reanudacion en %s\n", AppContext.TicketPath);
+        }
+        break;
 
     case QUIC_CONNECTION_EVENT_SHUTDOWN_INITIATED_BY_TRANSPORT:
         printf("[SUBSCRIBER] Transporte inicio shutdown (0x%llx).\n",
@@ -267,6 +397,9 @@ static int InitializeQuic(void) {
     settings.SendIdleTimeoutMs = 600000;
     settings.IsSet.KeepAliveIntervalMs = TRUE;
     settings.KeepAliveIntervalMs = 15000;
+    /* Permite al broker abrir el stream de alta prioridad (ver broker_quic.c, PRIORIDAD DE EVENTOS). */
+    settings.IsSet.PeerUnidiStreamCount = TRUE;
+    settings.PeerUnidiStreamCount = 1;
 
     status = MsQuic->ConfigurationOpen(
         Registration,
@@ -337,6 +470,9 @@ static int StartConnection(const char* serverName, uint16_t port) {
         return 0;
     }
 
+    AppContext.ResumptionAttempted = ApplyResumptionTicket(MsQuic, Connection, AppContext.TicketPath);
+    AppContext.HandshakeStartUs = PlatformNowUs();
+
     status = MsQuic->ConnectionStart(
         Connection,
         Configuration,
@@ -394,10 +530,30 @@ static int OpenStreamAndSubscribe(const char* topic) {
 }
 
 int main(int argc, char** argv) {
-    if (argc != 4) {
-        fprintf(stderr, "Uso: %s <IP_BROKER> <PUERTO> <TOPIC>\n", argv[0]);
+    const char* ticketPath = NULL;
+    const char* outputSpec = NULL;
+    int validArguments = argc >= 4;
+    for (int i = 4; validArguments && i < argc; i += 2) {
+        if (i + 1 < argc && strcmp(argv[i], "--ticket") == 0) {
+            ticketPath = argv[i + 1];
+        } else if (i + 1 < argc && strcmp(argv[i], "--desde") == 0) {
+            AppContext.ReplayFrom = argv[i + 1];
+        } else if (i + 1 < argc && strcmp(argv[i], "--salida") == 0) {
+            outputSpec = argv[i + 1];
+        } else {
+            validArguments = 0;
+        }
+    }
+    if (!validArguments) {
+        fprintf(stderr, "Uso: %s <IP_BROKER> <PUERTO> <TOPIC> [--ticket <RUTA_TICKET>] [--desde <offset|@hora_ms>]\n"
+                        "       [--salida texto|texto:RUTA|binario:RUTA|nula]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (!MessageSinkOpen(&Output, outputSpec)) {
+        fprintf(stderr, "[SUBSCRIBER] Salida invalida o no se pudo abrir: %s\n", outputSpec);
         return EXIT_FAILURE;
     }
+    InitializeCriticalSection(&OutputLock);
 
     const char* brokerAddress = argv[1];
     int portValue = atoi(argv[2]);
@@ -412,6 +568,13 @@ int main(int argc, char** argv) {
     }
     strcpy(AppContext.Topic, argv[3]);
 
+    if (ticketPath != NULL) {
+        strncpy(AppContext.TicketPath, ticketPath, sizeof(AppContext.TicketPath) - 1);
+        AppContext.TicketPath[sizeof(AppContext.TicketPath) - 1] = '\0';
+    } else {
+        BuildResumptionTicketPath(AppContext.TicketPath, sizeof(AppContext.TicketPath), brokerAddress, (uint16_t)portValue);
+    }
+
     if (!InitializeEvents()) {
         DisposeEvents();
         return EXIT_FAILURE;
@@ -428,12 +591,17 @@ int main(int argc, char** argv) {
         return EXIT_FAILURE;
     }
 
-    DWORD waitResult = WaitForSingleObject(AppContext.ConnectedEvent, 15000);
-    if (waitResult != WAIT_OBJECT_0) {
-        fprintf(stderr, "[SUBSCRIBER] Timeout esperando conexion.\n");
-        CleanupQuic();
-        DisposeEvents();
-        return EXIT_FAILURE;
+    if (AppContext.ResumptionAttempted) {
+        printf("[SUBSCRIBER] Ticket de reanudacion cargado (%s); la suscripcion se envia como 0-RTT.\n",
+               AppContext.TicketPath);
+    } else {
+        DWORD waitResult = WaitForSingleObject(AppContext.ConnectedEvent, 15000);
+        if (waitResult != WAIT_OBJECT_0) {
+            fprintf(stderr, "[SUBSCRIBER] Timeout esperando conexion.\n");
+            CleanupQuic();
+            DisposeEvents();
+            return EXIT_FAILURE;
+        }
     }
 
     if (!OpenStreamAndSubscribe(AppContext.Topic)) {
@@ -442,8 +610,18 @@ int main(int argc, char** argv) {
         return EXIT_FAILURE;
     }
 
+    LatencyStatsInit(&Latency);
     printf("[SUBSCRIBER] Esperando eventos...\n");
-    DWORD shutdownWait = WaitForSingleObject(AppContext.ShutdownEvent, INFINITE);
+    /* Sin eventos nadie vacia la salida: se despierta cada MESSAGE_SINK_FLUSH_MS para hacerlo. */
+    DWORD shutdownWait;
+    while ((shutdownWait = WaitForSingleObject(AppContext.ShutdownEvent, MESSAGE_SINK_FLUSH_MS)) == WAIT_TIMEOUT) {
+        EnterCriticalSection(&OutputLock);
+        MessageSinkTick(&Output, LatencyStampNowNs());
+        LeaveCriticalSection(&OutputLock);
+    }
+    EnterCriticalSection(&OutputLock);
+    MessageSinkFlush(&Output);
+    LeaveCriticalSection(&OutputLock);
     if (shutdownWait == WAIT_OBJECT_0) {
         printf("[SUBSCRIBER] ShutdownEvent recibido, limpiando.\n");
     } else if (shutdownWait == WAIT_FAILED) {
@@ -460,6 +638,10 @@ int main(int argc, char** argv) {
     CleanupQuic();
     DisposeEvents();
 
+    MessageSinkClose(&Output);
+    DeleteCriticalSection(&OutputLock);
+    LatencyStatsPrint(&Latency, stdout, "[SUBSCRIBER]");
+    MessageSinkPrintSummary(&Output, stdout, "[SUBSCRIBER]");
     printf("[SUBSCRIBER] Finalizado.\n");
     return EXIT_SUCCESS;
 }
@@ -3,23 +3,690 @@
 #include <string.h>
 #include <winsock2.h>
 #include <ws2tcpip.h>
+#include "../common/routing.h"  // Topics y subscriptores compartidos con los brokers UDP y QUIC
+#include "../common/event_log.h"
+#include "../common/latency_stamp.h"  // Marca de ingreso junto a la de origen del publisher
+#include "../common/metrics.h"        // Contadores y endpoint de Prometheus (--metricas PUERTO)
+#include "../common/outbound_lanes.h" // Cola de salida por prioridad para los subscribers lentos
 
 #pragma comment(lib, "ws2_32.lib")
 
 #define PORT 8000
 #define MAX_CLIENTS 20
+#define MAX_SUSCRIPCIONES 4096  // Entre todas las conexiones: cada subscriber puede seguir varios topics
 #define BUFFER_SIZE 1024
-#define TOPIC_LEN 64
+#define MENSAJES_RETENIDOS 8   // Ultimos mensajes por topic que recibe un subscriber al conectarse
+#define BUFERES_POR_ENVIO 64
+#define FSYNC_MS_DEFECTO 50       // Intervalo del commit agrupado del registro (--fsync grupo)
+#define MAX_PARES 8               // Brokers vecinos configurados con --par
+#define LARGO_ID_BROKER 32
+#define PAUSA_RECONEXION_MS 2000  // Reintento de los --par que no estan conectados
 
+// Un publisher puede enviar varios mensajes en un solo recv() (por ejemplo en modo --multi); lo que queda
+// despues del ultimo '\n' se guarda en 'pendiente' hasta que llegue el resto.
 typedef struct {
     SOCKET socket;
-    char topic[TOPIC_LEN];
+    char pendiente[BUFFER_SIZE];
+    int longitud;
+} Publisher;
+
+Publisher publishers[MAX_CLIENTS];
+
+// Conexion de un subscriber. Despues de registrarse puede enviar mas lineas por la misma conexion:
+// "SUBSCRIBE|filtro", "UNSUBSCRIBE|filtro" y "REPLAY|topic|desde". Cada filtro es una entrada propia de la
+// tabla de enrutamiento (handle = socket, owner = esta conexion), asi el fan-out sigue recorriendo solo las
+// listas de los filtros que coinciden; 'suscripciones' guarda los indices de esas entradas para darlas de baja.
+// Un enlace con otro broker (federacion) usa la misma estructura con es_par: sus filtros son el interes que
+// anuncio el vecino y viven en la tabla 'federacion' en lugar de 'suscripciones'.
+typedef struct {
+    SOCKET socket;
+    char pendiente[BUFFER_SIZE];
+    int longitud;
+    int32_t *suscripciones;
+    int cantidad;
+    int capacidad;
+    uint64_t ultima_publicacion;  // Si dos filtros de la conexion coinciden, la publicacion se envia una vez
+    int caido;                    // Fallo un envio: se cierra al final de la vuelta del bucle principal
+    OutboundLanes salida;         // Lo que el socket (no bloqueante) todavia no acepto, un carril por prioridad
+    int es_par;                   // Enlace con otro broker, no un subscriber
+    int destino;                  // Indice del --par que abrio el enlace, o -1 si lo abrio el otro broker
+    int conectando;               // connect no bloqueante hacia el --par todavia en curso
+    char par[LARGO_ID_BROKER];    // Id del broker vecino; vacio hasta recibir su "BROKER|id"
+    int reenviando;               // REPLAY en curso: sale del registro antes que la cola y sin bloquear
+    EventLogCursor reenvio;
+    char topic_reenvio[ROUTING_TOPIC_LEN];
+    uint64_t bytes_reenviados;
 } Subscriber;
 
-SOCKET publisher_sockets[MAX_CLIENTS];
 Subscriber subscribers[MAX_CLIENTS];
 
-void iniciar_broker(SOCKET *server_fd) {
+RoutingTable suscripciones;
+RoutingPlan plan_fanout;
+OutboundPolicy politica_salida = OUTBOUND_STRICT;
+uint64_t publicacion_actual = 0;
+int32_t entregas_repetidas = 0;
+
+// Registro persistente de eventos (opcional, --registro DIR).
+EventLog registro;
+int registro_activo = 0;
+
+// Metricas en vivo (opcional, --metricas PUERTO): las registra este hilo y las lee el hilo del endpoint.
+Metrics metricas;
+MetricsServer servidor_metricas;
+int metricas_activas = 0;
+
+// Federacion (--par): cada broker anuncia a sus vecinos los filtros de sus subscribers locales ("INTERES|+|f" y
+// "INTERES|-|f") y les reenvia una publicacion local solo si el interes de alguno coincide. Lo que llega de un
+// vecino se entrega a los subscribers locales y nunca se reenvia a otro vecino (horizonte dividido): cada
+// publicacion hace a lo sumo un salto, asi que no puede dar vueltas aunque los enlaces formen ciclos, y la
+// federacion debe ser una malla completa. Los grupos de consumo se reparten por broker (ver anunciar_interes).
+typedef struct {
+    char filtro[ROUTING_TOPIC_LEN];
+    int conteo;                   // Suscripciones locales con este filtro
+} Interes;
+
+RoutingTable federacion;
+RoutingPlan plan_federacion;
+Interes intereses[MAX_SUSCRIPCIONES];
+int cantidad_intereses = 0;
+char id_broker[LARGO_ID_BROKER];
+struct sockaddr_in pares[MAX_PARES];
+const char *nombres_pares[MAX_PARES];
+char ids_pares[MAX_PARES][LARGO_ID_BROKER];  // Id que respondio cada --par (vacio hasta el primer enlace)
+int par_descartado[MAX_PARES];               // El --par resulto ser este mismo broker: no se reintenta
+int avisado_pares[MAX_PARES];                // Ya se aviso que no responde; no se repite en cada reintento
+int cantidad_pares = 0;
+
+void procesar_datos_publisher(Publisher *publisher, const char *datos, int bytes);
+void procesar_mensaje_publisher(char *linea, int longitud, Subscriber *origen);
+void terminar_reenvio(Subscriber *subscriber);
+
+SOCKET socket_de(RoutingTable *tabla, int32_t indice) {
+    return (SOCKET)(uintptr_t)tabla->entries[indice].handle;
+}
+
+Subscriber *subscriber_de(RoutingTable *tabla, int32_t indice) {
+    return (Subscriber *)tabla->entries[indice].owner;
+}
+
+RoutingTable *tabla_de(Subscriber *subscriber) {
+    return subscriber->es_par ? &federacion : &suscripciones;
+}
+
+void fallo_envio(Subscriber *subscriber, const char *detalle) {
+    fprintf(stderr, "[BROKER] %s (socket %d): %d\n", detalle, (int)subscriber->socket, WSAGetLastError());
+    if (metricas_activas) {
+        MetricsCountSendFailure(&metricas);
+    }
+    subscriber->caido = 1;
+}
+
+// Envia lo pendiente hasta que el socket deje de aceptar datos; el carril lo elige la politica de --prioridad.
+// Un REPLAY en curso sale antes que la cola (salvo el mensaje de la cola que ya salio a medias) directo desde
+// el mapeo del registro; al alcanzar el final del registro el topic pasa a llegar en vivo.
+void enviar_pendientes(Subscriber *subscriber) {
+    const char *datos;
+    uint32_t largo;
+    while (!subscriber->caido) {
+        int desde_registro = subscriber->reenviando && subscriber->salida.current == OUTBOUND_NO_LANE;
+        if (desde_registro) {
+            if (!EventLogCursorPeek(&subscriber->reenvio, &datos, &largo)) {
+                terminar_reenvio(subscriber);
+                continue;
+            }
+        } else if (!OutboundLanesPeek(&subscriber->salida, &datos, &largo)) {
+            return;
+        }
+        int enviados = send(subscriber->socket, datos, (int)largo, 0);
+        if (enviados == SOCKET_ERROR) {
+            if (WSAGetLastError() != WSAEWOULDBLOCK) {
+                fallo_envio(subscriber, "Error al enviar a subscriber");
+            }
+            return;
+        }
+        if (desde_registro) {
+            EventLogCursorAdvance(&subscriber->reenvio, (uint32_t)enviados);
+            subscriber->bytes_reenviados += (uint32_t)enviados;
+        } else {
+            OutboundLanesConsume(&subscriber->salida, (uint32_t)enviados);
+        }
+    }
+}
+
+int salida_pendiente(const Subscriber *subscriber) {
+    return subscriber->reenviando || !OutboundLanesEmpty(&subscriber->salida);
+}
+
+void reanudar_no_bloqueante(Subscriber *subscriber) {
+    u_long no_bloqueante = 1;
+    ioctlsocket(subscriber->socket, FIONBIO, &no_bloqueante);
+}
+
+// Sin nada pendiente se envia directo; lo que el socket no acepta (o todo, si ya hay cola o un REPLAY en curso)
+// se guarda en el carril de la prioridad del mensaje. Un carril lleno descarta el mensaje pero no da de baja
+// al subscriber.
+int encolar_salida(Subscriber *subscriber, EventPriority prioridad, const char *mensaje, uint32_t longitud) {
+    uint32_t enviados = 0;
+    if (!salida_pendiente(subscriber)) {
+        int resultado = send(subscriber->socket, mensaje, (int)longitud, 0);
+        if (resultado == (int)longitud) {
+            return 1;
+        }
+        if (resultado == SOCKET_ERROR && WSAGetLastError() != WSAEWOULDBLOCK) {
+            fallo_envio(subscriber, "Error al enviar a subscriber");
+            return 0;
+        }
+        enviados = resultado == SOCKET_ERROR ? 0 : (uint32_t)resultado;
+    }
+    OutboundLanesPush(&subscriber->salida, prioridad, mensaje, longitud, enviados);
+    return 1;
+}
+
+int entregar_tcp(void *contexto, RoutingTable *tabla, int32_t indice, const char *mensaje, uint32_t longitud) {
+    (void)contexto;
+    Subscriber *subscriber = subscriber_de(tabla, indice);
+    if (subscriber->caido) {
+        return 0;
+    }
+    if (subscriber->ultima_publicacion == publicacion_actual) {
+        entregas_repetidas++;
+        return 1;
+    }
+    subscriber->ultima_publicacion = publicacion_actual;
+    return encolar_salida(subscriber, tabla->deliveryPriority, mensaje, longitud);
+}
+
+// Sin nada pendiente los mensajes retenidos se envian con una sola llamada WSASend (envio con varios buferes)
+// por cada BUFERES_POR_ENVIO mensajes, sin copiarlos a un bufer intermedio. El socket es no bloqueante: lo que
+// no acepta se copia a la cola de salida, empezando por el mensaje que quedo a medias.
+int entregar_lote_tcp(void *contexto, RoutingTable *tabla, int32_t indice, const RoutingSpan *mensajes, int32_t cantidad) {
+    (void)contexto;
+    Subscriber *subscriber = subscriber_de(tabla, indice);
+    if (subscriber->caido) {
+        return 0;
+    }
+    int32_t primero = 0;
+    uint32_t aceptados = 0;
+    if (!salida_pendiente(subscriber)) {
+        WSABUF buferes[BUFERES_POR_ENVIO];
+        while (primero < cantidad) {
+            int32_t lote = cantidad - primero < BUFERES_POR_ENVIO ? cantidad - primero : BUFERES_POR_ENVIO;
+            uint32_t total = 0;
+            for (int32_t i = 0; i < lote; i++) {
+                buferes[i].buf = (char *)mensajes[primero + i].data;
+                buferes[i].len = mensajes[primero + i].length;
+                total += mensajes[primero + i].length;
+            }
+            DWORD enviados = 0;
+            if (WSASend(socket_de(tabla, indice), buferes, (DWORD)lote, &enviados, 0, NULL, NULL) == SOCKET_ERROR) {
+                if (WSAGetLastError() != WSAEWOULDBLOCK) {
+                    fallo_envio(subscriber, "Error al enviar mensajes retenidos");
+                    return 0;
+                }
+                break;
+            }
+            if (enviados < total) {
+                aceptados = (uint32_t)enviados;
+                break;
+            }
+            primero += lote;
+        }
+    }
+    for (int32_t i = primero; i < cantidad; i++) {
+        if (aceptados >= mensajes[i].length) {
+            aceptados -= mensajes[i].length;
+            continue;
+        }
+        OutboundLanesPush(&subscriber->salida, EVENT_PRIORITY_NORMAL, mensajes[i].data, mensajes[i].length, aceptados);
+        aceptados = 0;
+    }
+    return 1;
+}
+
+// Las lineas de control hacia un vecino van por el carril de alta prioridad, delante de las publicaciones.
+void enviar_a_par(Subscriber *par, const char *linea) {
+    encolar_salida(par, EVENT_PRIORITY_HIGH, linea, (uint32_t)strlen(linea));
+}
+
+// El interes se anuncia con el filtro sin "$share/<grupo>/": un grupo de consumo se reparte dentro de cada
+// broker. Si el grupo tiene miembros en varios brokers, cada publicacion llega a un miembro por broker (el
+// vecino recibe el mensaje y lo reparte entre sus propios miembros); para que llegue a uno solo en toda la
+// federacion, los miembros del grupo deben conectarse al mismo broker.
+void anunciar_interes(char signo, const char *filtro) {
+    char linea[BUFFER_SIZE];
+    snprintf(linea, sizeof(linea), "INTERES|%c|%s\n", signo, filtro);
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        if (subscribers[i].socket > 0 && subscribers[i].es_par && subscribers[i].par[0] != '\0' && !subscribers[i].caido) {
+            enviar_a_par(&subscribers[i], linea);
+        }
+    }
+}
+
+// Cuenta las suscripciones locales por filtro; los vecinos solo se enteran cuando un filtro aparece o desaparece.
+void sumar_interes(const char *filtro, int delta) {
+    int i = 0;
+    while (i < cantidad_intereses && strcmp(intereses[i].filtro, filtro) != 0) {
+        i++;
+    }
+    if (i == cantidad_intereses) {
+        if (delta < 0 || cantidad_intereses == MAX_SUSCRIPCIONES) {
+            return;
+        }
+        snprintf(intereses[i].filtro, sizeof(intereses[i].filtro), "%s", filtro);
+        intereses[i].conteo = 0;
+        cantidad_intereses++;
+    }
+    intereses[i].conteo += delta;
+    if (delta > 0 && intereses[i].conteo == 1) {
+        anunciar_interes('+', intereses[i].filtro);
+    } else if (intereses[i].conteo <= 0) {
+        anunciar_interes('-', intereses[i].filtro);
+        intereses[i] = intereses[--cantidad_intereses];
+    }
+}
+
+// Al dar de baja una suscripcion se quita de la lista de su conexion; el socket lo cierra cerrar_subscriber,
+// porque la conexion puede seguir con otros topics o suscribirse a otros mas adelante.
+void liberar_tcp(void *contexto, RoutingTable *tabla, int32_t indice) {
+    (void)contexto;
+    Subscriber *subscriber = subscriber_de(tabla, indice);
+    for (int i = 0; i < subscriber->cantidad; i++) {
+        if (subscriber->suscripciones[i] == indice) {
+            subscriber->suscripciones[i] = subscriber->suscripciones[--subscriber->cantidad];
+            break;
+        }
+    }
+    const char *filtro = RoutingTopicName(tabla, tabla->entries[indice].topicId);
+    if (subscriber->es_par) {
+        printf("[BROKER] El broker %s ya no sigue '%s'\n", subscriber->par, filtro);
+        return;
+    }
+    printf("[BROKER] Socket %d dado de baja de '%s'\n", (int)subscriber->socket, filtro);
+    sumar_interes(filtro, -1);
+}
+
+// Mensajes en la cola de salida: en un grupo de consumo el mensaje va al miembro con menos pendientes.
+uint32_t profundidad_tcp(void *contexto, RoutingTable *tabla, int32_t indice) {
+    (void)contexto;
+    return subscriber_de(tabla, indice)->salida.queued;
+}
+
+const RoutingTransport transporte_tcp = { "tcp", NULL, entregar_tcp, liberar_tcp, NULL, entregar_lote_tcp, profundidad_tcp };
+
+// Suscripcion de la conexion al filtro (o al grupo "$share/<grupo>/<filtro>"), o ROUTING_NO_INDEX si no la tiene.
+int32_t buscar_suscripcion(Subscriber *subscriber, const char *filtro) {
+    RoutingTable *tabla = tabla_de(subscriber);
+    int32_t topic_id, grupo_id;
+    if (!RoutingResolveSubscription(tabla, filtro, 0, &topic_id, &grupo_id)) {
+        return ROUTING_NO_INDEX;
+    }
+    for (int i = 0; i < subscriber->cantidad; i++) {
+        RoutingEntry *entrada = &tabla->entries[subscriber->suscripciones[i]];
+        if (entrada->topicId == topic_id && entrada->groupId == grupo_id) {
+            return subscriber->suscripciones[i];
+        }
+    }
+    return ROUTING_NO_INDEX;
+}
+
+// Suscribe la conexion a un filtro mas. Un filtro que la conexion ya tiene no se duplica. Con
+// enviar_retenidos el subscriber recibe antes del proximo evento los ultimos mensajes de los topics que
+// coinciden con el filtro (los miembros de un grupo de consumo no los reciben). En un enlace con otro broker
+// el filtro es interes del vecino y no se anuncia a los demas.
+int32_t agregar_suscripcion(Subscriber *subscriber, const char *filtro, int enviar_retenidos) {
+    RoutingTable *tabla = tabla_de(subscriber);
+    char normalizado[ROUTING_TOPIC_LEN];
+    if (RoutingNormalizeTopic(normalizado, filtro, strlen(filtro)) == 0) {
+        return ROUTING_NO_INDEX;
+    }
+    int32_t existente = buscar_suscripcion(subscriber, normalizado);
+    if (existente != ROUTING_NO_INDEX) {
+        return existente;
+    }
+
+    if (subscriber->cantidad == subscriber->capacidad) {
+        int capacidad = subscriber->capacidad == 0 ? 4 : subscriber->capacidad * 2;
+        int32_t *ampliado = realloc(subscriber->suscripciones, sizeof(int32_t) * (size_t)capacidad);
+        if (ampliado == NULL) {
+            return ROUTING_NO_INDEX;
+        }
+        subscriber->suscripciones = ampliado;
+        subscriber->capacidad = capacidad;
+    }
+
+    int32_t indice = RoutingSubscribe(tabla, normalizado, (void *)(uintptr_t)subscriber->socket, subscriber);
+    if (indice == ROUTING_NO_INDEX) {
+        return ROUTING_NO_INDEX;
+    }
+    subscriber->suscripciones[subscriber->cantidad++] = indice;
+    if (subscriber->es_par) {
+        printf("[BROKER] El broker %s sigue '%s'\n", subscriber->par, RoutingTopicName(tabla, tabla->entries[indice].topicId));
+        return indice;
+    }
+    sumar_interes(RoutingTopicName(&suscripciones, suscripciones.entries[indice].topicId), 1);
+    const char *grupo = RoutingEntryGroupName(&suscripciones, indice);
+    printf("[BROKER] Socket %d suscrito a '%s'%s%s (%d topics en la conexion)\n", (int)subscriber->socket,
+           RoutingTopicName(&suscripciones, suscripciones.entries[indice].topicId),
+           grupo != NULL ? " en el grupo " : "", grupo != NULL ? grupo : "", subscriber->cantidad);
+
+    if (enviar_retenidos) {
+        int32_t retenidos = RoutingReplayRetained(&suscripciones, indice);
+        if (retenidos > 0) {
+            printf("[BROKER] %d mensajes retenidos enviados al socket %d\n", (int)retenidos, (int)subscriber->socket);
+        }
+    }
+    return indice;
+}
+
+// UNSUBSCRIBE|filtro: da de baja ese filtro de la conexion (liberar_tcp lo quita de su lista).
+int quitar_suscripcion(Subscriber *subscriber, const char *filtro) {
+    int32_t indice = buscar_suscripcion(subscriber, filtro);
+    if (indice == ROUTING_NO_INDEX) {
+        return 0;
+    }
+    RoutingUnsubscribe(tabla_de(subscriber), indice);
+    return 1;
+}
+
+void cerrar_subscriber(Subscriber *subscriber) {
+    while (subscriber->cantidad > 0) {
+        int antes = subscriber->cantidad;
+        RoutingUnsubscribe(tabla_de(subscriber), subscriber->suscripciones[antes - 1]);
+        if (subscriber->cantidad == antes) {
+            subscriber->cantidad--;  // la entrada ya se habia dado de baja
+        }
+    }
+    if (subscriber->reenviando) {
+        EventLogCursorClose(&subscriber->reenvio);
+    }
+    closesocket(subscriber->socket);
+    if (subscriber->es_par) {
+        printf("[BROKER] Enlace con el broker %s cerrado: socket %d\n",
+               subscriber->par[0] != '\0' ? subscriber->par : "(sin identificar)", (int)subscriber->socket);
+    } else {
+        printf("[BROKER] Subscriber desconectado: socket %d\n", (int)subscriber->socket);
+    }
+    if (OutboundLanesDropped(&subscriber->salida) > 0) {
+        printf("[BROKER] Socket %d: %llu mensajes descartados por cola llena (alta %llu, normal %llu, baja %llu)\n",
+               (int)subscriber->socket, (unsigned long long)OutboundLanesDropped(&subscriber->salida),
+               (unsigned long long)subscriber->salida.dropped[EVENT_PRIORITY_HIGH],
+               (unsigned long long)subscriber->salida.dropped[EVENT_PRIORITY_NORMAL],
+               (unsigned long long)subscriber->salida.dropped[EVENT_PRIORITY_LOW]);
+    }
+    OutboundLanesFree(&subscriber->salida);
+    free(subscriber->suscripciones);
+    memset(subscriber, 0, sizeof(*subscriber));
+}
+
+void presentar_enlace(Subscriber *enlace) {
+    char presentacion[BUFFER_SIZE];
+    snprintf(presentacion, sizeof(presentacion), "BROKER|%s\n", id_broker);
+    enviar_a_par(enlace, presentacion);
+}
+
+// Un enlace con otro broker ocupa un lugar de subscriber. Ambos extremos se presentan con "BROKER|id" apenas
+// se abre la conexion; destino es el --par que la abrio (-1 si la abrio el vecino). Con conectando la
+// presentacion espera a que termine el connect (completar_conexion_par).
+Subscriber *abrir_enlace(SOCKET socket, int destino, int conectando) {
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        Subscriber *enlace = &subscribers[i];
+        if (enlace->socket != 0) {
+            continue;
+        }
+        enlace->socket = socket;
+        enlace->es_par = 1;
+        enlace->destino = destino;
+        enlace->conectando = conectando;
+        OutboundLanesInit(&enlace->salida, politica_salida);
+        if (!conectando) {
+            presentar_enlace(enlace);
+        }
+        return enlace;
+    }
+    printf("[BROKER] No se pudo abrir el enlace con otro broker (maximo %d conexiones)\n", MAX_CLIENTS);
+    closesocket(socket);
+    return NULL;
+}
+
+int existe_enlace(const char *id, const Subscriber *excepto) {
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        const Subscriber *enlace = &subscribers[i];
+        if (enlace != excepto && enlace->socket > 0 && enlace->es_par && !enlace->caido && strcmp(enlace->par, id) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Entre dos brokers queda un solo enlace: si ambos se conectaron entre si, se conserva el que abrio el de
+// menor id (los dos extremos llegan a la misma conclusion). Un --par que apunta a este mismo broker se descarta.
+void registrar_par(Subscriber *enlace, const char *id) {
+    if (enlace->par[0] != '\0') {
+        return;
+    }
+    if (id[0] == '\0' || strlen(id) >= LARGO_ID_BROKER || strcmp(id, id_broker) == 0) {
+        printf("[BROKER] Enlace rechazado: id de broker '%s' invalido o igual al propio\n", id);
+        if (enlace->destino >= 0 && strcmp(id, id_broker) == 0) {
+            par_descartado[enlace->destino] = 1;
+        }
+        enlace->caido = 1;
+        return;
+    }
+    if (enlace->destino >= 0) {
+        snprintf(ids_pares[enlace->destino], LARGO_ID_BROKER, "%s", id);
+    }
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        Subscriber *otro = &subscribers[i];
+        if (otro == enlace || otro->socket == 0 || !otro->es_par || otro->caido || strcmp(otro->par, id) != 0) {
+            continue;
+        }
+        int conservar_saliente = strcmp(id_broker, id) < 0;
+        if ((enlace->destino >= 0) == (otro->destino >= 0) || (enlace->destino >= 0) != conservar_saliente) {
+            printf("[BROKER] Ya hay un enlace con el broker %s; se cierra el duplicado\n", id);
+            enlace->caido = 1;
+            return;
+        }
+        printf("[BROKER] Enlace duplicado con el broker %s; se conserva el nuevo\n", id);
+        otro->caido = 1;
+    }
+    snprintf(enlace->par, sizeof(enlace->par), "%s", id);
+    printf("[BROKER] Federado con el broker %s (socket %d)\n", id, (int)enlace->socket);
+
+    char linea[BUFFER_SIZE];
+    for (int i = 0; i < cantidad_intereses; i++) {
+        snprintf(linea, sizeof(linea), "INTERES|+|%s\n", intereses[i].filtro);
+        enviar_a_par(enlace, linea);
+    }
+}
+
+// BROKER|id, INTERES|+|filtro, INTERES|-|filtro y PUBLISHER|topic|hora|mensaje desde otro broker.
+void procesar_linea_par(Subscriber *enlace, char *linea) {
+    if (strncmp(linea, "BROKER|", 7) == 0) {
+        registrar_par(enlace, linea + 7);
+    } else if (enlace->par[0] == '\0') {
+        printf("[BROKER] Enlace sin presentacion, se cierra: %s\n", linea);
+        enlace->caido = 1;
+    } else if (strncmp(linea, "INTERES|+|", 10) == 0) {
+        if (agregar_suscripcion(enlace, linea + 10, 0) == ROUTING_NO_INDEX) {
+            printf("[BROKER] Interes del broker %s rechazado: '%s'\n", enlace->par, linea + 10);
+        }
+    } else if (strncmp(linea, "INTERES|-|", 10) == 0) {
+        quitar_suscripcion(enlace, linea + 10);
+    } else if (strncmp(linea, "PUBLISHER|", 10) == 0) {
+        procesar_mensaje_publisher(linea, (int)strlen(linea), enlace);
+    } else {
+        printf("[BROKER] Comando de broker desconocido: %s\n", linea);
+    }
+}
+
+void avisar_par_caido(int destino) {
+    if (!avisado_pares[destino]) {
+        printf("[BROKER] El broker %s no responde; se reintenta cada %d ms\n", nombres_pares[destino], PAUSA_RECONEXION_MS);
+        avisado_pares[destino] = 1;
+    }
+}
+
+// Conecta los --par que no tienen enlace sin frenar el bucle: el socket es no bloqueante desde antes del
+// connect, y el enlace queda 'conectando' hasta que select lo marque como escribible o con error.
+void conectar_pares(void) {
+    for (int d = 0; d < cantidad_pares; d++) {
+        if (par_descartado[d] || (ids_pares[d][0] != '\0' && existe_enlace(ids_pares[d], NULL))) {
+            continue;
+        }
+        int conectado = 0;
+        for (int i = 0; i < MAX_CLIENTS; i++) {
+            if (subscribers[i].socket > 0 && subscribers[i].es_par && subscribers[i].destino == d) {
+                conectado = 1;
+            }
+        }
+        if (conectado) {
+            continue;
+        }
+
+        SOCKET sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        if (sock == INVALID_SOCKET) {
+            return;
+        }
+        u_long no_bloqueante = 1;
+        ioctlsocket(sock, FIONBIO, &no_bloqueante);
+        int conectando = 0;
+        if (connect(sock, (struct sockaddr *)&pares[d], sizeof(pares[d])) == SOCKET_ERROR) {
+            if (WSAGetLastError() != WSAEWOULDBLOCK) {
+                avisar_par_caido(d);
+                closesocket(sock);
+                continue;
+            }
+            conectando = 1;
+        }
+        Subscriber *enlace = abrir_enlace(sock, d, conectando);
+        if (enlace != NULL && !conectando) {
+            avisado_pares[d] = 0;
+            printf("[BROKER] Conectado al broker %s\n", nombres_pares[d]);
+        }
+    }
+}
+
+// Termino el connect de un --par: SO_ERROR dice si conecto. Si fallo se libera el lugar sin los avisos de
+// cerrar_subscriber, porque el enlace nunca existio.
+void completar_conexion_par(Subscriber *enlace) {
+    int d = enlace->destino;
+    int error = 0;
+    int largo = sizeof(error);
+    if (getsockopt(enlace->socket, SOL_SOCKET, SO_ERROR, (char *)&error, &largo) == SOCKET_ERROR || error != 0) {
+        avisar_par_caido(d);
+        closesocket(enlace->socket);
+        OutboundLanesFree(&enlace->salida);
+        memset(enlace, 0, sizeof(*enlace));
+        return;
+    }
+    enlace->conectando = 0;
+    avisado_pares[d] = 0;
+    printf("[BROKER] Conectado al broker %s\n", nombres_pares[d]);
+    presentar_enlace(enlace);
+}
+
+// REPLAY|<topic>|<desde>: reenvia el registro desde un offset (o @hora en ms) y luego suscribe al topic en vivo.
+// El reenvio avanza a medida que el socket acepta datos (enviar_pendientes), sin frenar a los demas clientes, y
+// el alta ocurre en terminar_reenvio al alcanzar el final del registro.
+void registrar_replay(Subscriber *subscriber, char *solicitud) {
+    char topic[ROUTING_TOPIC_LEN];
+    size_t largo_topic = RoutingNormalizeTopic(topic, solicitud, strlen(solicitud));
+    char *desde = strchr(solicitud, '|');
+    if (desde != NULL) {
+        desde++;
+        desde[strcspn(desde, "\r\n")] = '\0';
+    }
+
+    EventLogStart inicio;
+    if (largo_topic == 0 || strpbrk(topic, "+#") != NULL || !EventLogParseStart(desde, &inicio)) {
+        printf("[BROKER] Solicitud REPLAY invalida: %s\n", solicitud);
+        return;
+    }
+
+    if (subscriber->reenviando) {
+        printf("[BROKER] Socket %d ya tiene un REPLAY en curso; se ignora: %s\n", (int)subscriber->socket, solicitud);
+        return;
+    }
+
+    if (registro_activo && EventLogCursorOpen(&registro, topic, &inicio, &subscriber->reenvio)) {
+        subscriber->reenviando = 1;
+        subscriber->bytes_reenviados = 0;
+        snprintf(subscriber->topic_reenvio, sizeof(subscriber->topic_reenvio), "%s", topic);
+        printf("[BROKER] Reenvio de '%s' desde %s%llu al socket %d\n", topic, inicio.byTime ? "@" : "",
+               (unsigned long long)inicio.value, (int)subscriber->socket);
+        enviar_pendientes(subscriber);
+        return;
+    }
+    if (!registro_activo) {
+        printf("[BROKER] REPLAY sin registro activo (use --registro); se suscribe solo en vivo\n");
+    }
+    if (agregar_suscripcion(subscriber, topic, 0) == ROUTING_NO_INDEX) {
+        printf("[BROKER] No se pudo registrar la suscripcion (maximo %d)\n", MAX_SUSCRIPCIONES);
+    }
+}
+
+// El reenvio alcanzo el final del registro. Cada evento se agrega al registro antes del fan-out y el broker es
+// de un solo hilo, asi que entre el ultimo byte reenviado y el alta no se pierde ni se repite ningun evento.
+void terminar_reenvio(Subscriber *subscriber) {
+    subscriber->reenviando = 0;
+    EventLogCursorClose(&subscriber->reenvio);  // suelta el segmento para la retencion
+    printf("[BROKER] Reenvio de '%s' al socket %d completo: %llu bytes\n", subscriber->topic_reenvio,
+           (int)subscriber->socket, (unsigned long long)subscriber->bytes_reenviados);
+    if (agregar_suscripcion(subscriber, subscriber->topic_reenvio, 0) == ROUTING_NO_INDEX) {
+        printf("[BROKER] No se pudo registrar la suscripcion (maximo %d)\n", MAX_SUSCRIPCIONES);
+    }
+}
+
+void procesar_linea_subscriber(Subscriber *subscriber, char *linea) {
+    if (subscriber->es_par) {
+        procesar_linea_par(subscriber, linea);
+    } else if (strncmp(linea, "SUBSCRIBER|", 11) == 0 || strncmp(linea, "SUBSCRIBE|", 10) == 0) {
+        const char *filtro = linea + (linea[9] == 'R' ? 11 : 10);
+        if (agregar_suscripcion(subscriber, filtro, 1) == ROUTING_NO_INDEX) {
+            printf("[BROKER] Suscripcion rechazada: '%s' (maximo %d, o topic vacio o con comodines invalidos)\n",
+                   filtro, MAX_SUSCRIPCIONES);
+        }
+    } else if (strncmp(linea, "UNSUBSCRIBE|", 12) == 0) {
+        if (!quitar_suscripcion(subscriber, linea + 12)) {
+            printf("[BROKER] Socket %d no estaba suscrito a '%s'\n", (int)subscriber->socket, linea + 12);
+        }
+    } else if (strncmp(linea, "REPLAY|", 7) == 0) {
+        registrar_replay(subscriber, linea + 7);
+    } else {
+        printf("[BROKER] Comando de subscriber desconocido: %s\n", linea);
+    }
+}
+
+// Igual que con los publishers, un recv puede traer varias lineas o solo parte de una.
+void procesar_datos_subscriber(Subscriber *subscriber, const char *datos, int bytes) {
+    while (bytes > 0 && !subscriber->caido) {
+        const char *salto = memchr(datos, '\n', (size_t)bytes);
+        int tramo = salto != NULL ? (int)(salto - datos) : bytes;
+
+        int espacio = BUFFER_SIZE - 1 - subscriber->longitud;
+        int copiar = tramo < espacio ? tramo : espacio;
+        memcpy(subscriber->pendiente + subscriber->longitud, datos, (size_t)copiar);
+        subscriber->longitud += copiar;
+
+        if (salto == NULL) {
+            return;
+        }
+
+        if (subscriber->longitud > 0 && subscriber->pendiente[subscriber->longitud - 1] == '\r') {
+            subscriber->longitud--;
+        }
+        subscriber->pendiente[subscriber->longitud] = '\0';
+        if (subscriber->longitud > 0) {
+            procesar_linea_subscriber(subscriber, subscriber->pendiente);
+        }
+        subscriber->longitud = 0;
+
+        datos += tramo + 1;
+        bytes -= tramo + 1;
+    }
+}
+
+void iniciar_broker(SOCKET *server_fd, int puerto) {
     struct sockaddr_in address;
 
     *server_fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
@@ -34,7 +701,7 @@ void iniciar_broker(SOCKET *server_fd) {
 
     address.sin_family = AF_INET;
     address.sin_addr.s_addr = INADDR_ANY;
-    address.sin_port = htons(PORT);
+    address.sin_port = htons((u_short)puerto);
 
     if (bind(*server_fd, (struct sockaddr *)&address, sizeof(address)) == SOCKET_ERROR) {
         perror("Error en bind");
@@ -50,7 +717,7 @@ void iniciar_broker(SOCKET *server_fd) {
         exit(EXIT_FAILURE);
     }
 
-    printf("[BROKER] Escuchando en puerto %d...\n", PORT);
+    printf("[BROKER] Escuchando en puerto %d...\n", puerto);
 }
 
 void registrar_cliente(SOCKET new_socket) {
@@ -65,41 +732,249 @@ void registrar_cliente(SOCKET new_socket) {
 
     if (strncmp(buffer, "PUBLISHER", 9) == 0) {
         for (int i = 0; i < MAX_CLIENTS; i++) {
-            if (publisher_sockets[i] == 0) {
-                publisher_sockets[i] = new_socket;
+            if (publishers[i].socket == 0) {
+                publishers[i].socket = new_socket;
+                publishers[i].longitud = 0;
                 printf("[BROKER] Publisher conectado: socket %d\n", (int)new_socket);
+
+                // Los mensajes que llegaron junto con la identificacion se procesan de una vez.
+                char *fin_identificacion = memchr(buffer, '\n', (size_t)bytes);
+                if (fin_identificacion != NULL) {
+                    int consumidos = (int)(fin_identificacion - buffer) + 1;
+                    procesar_datos_publisher(&publishers[i], fin_identificacion + 1, bytes - consumidos);
+                }
                 return;
             }
         }
-    } else if (strncmp(buffer, "SUBSCRIBER|", 11) == 0) {
-        char *topic = buffer + 11;
+    } else if (strncmp(buffer, "SUBSCRIBE", 9) == 0 || strncmp(buffer, "REPLAY|", 7) == 0) {
         for (int i = 0; i < MAX_CLIENTS; i++) {
-            if (subscribers[i].socket == 0) {
-                subscribers[i].socket = new_socket;
-                strncpy(subscribers[i].topic, topic, TOPIC_LEN - 1);
-                subscribers[i].topic[TOPIC_LEN - 1] = '\0';
-                printf("[BROKER] Subscriber conectado: socket %d, topic '%s'\n", (int)new_socket, subscribers[i].topic);
-                return;
+            Subscriber *subscriber = &subscribers[i];
+            if (subscriber->socket != 0) {
+                continue;
             }
+            subscriber->socket = new_socket;
+            OutboundLanesInit(&subscriber->salida, politica_salida);
+            printf("[BROKER] Subscriber conectado: socket %d\n", (int)new_socket);
+            // Desde aca un subscriber lento no frena al broker: lo que no entra en el socket (retenidos y
+            // REPLAY incluidos) queda pendiente para la proxima vuelta de select.
+            reanudar_no_bloqueante(subscriber);
+            procesar_datos_subscriber(subscriber, buffer, bytes);
+            // Un cliente anterior puede enviar "SUBSCRIBER|topic" sin '\n'.
+            if (subscriber->cantidad == 0 && !subscriber->reenviando && subscriber->longitud > 0) {
+                subscriber->pendiente[subscriber->longitud] = '\0';
+                subscriber->longitud = 0;
+                procesar_linea_subscriber(subscriber, subscriber->pendiente);
+            }
+            if (subscriber->cantidad == 0 && !subscriber->reenviando) {
+                cerrar_subscriber(subscriber);
+            }
+            return;
+        }
+        printf("[BROKER] No se pudo registrar el subscriber (maximo %d conexiones)\n", MAX_CLIENTS);
+        closesocket(new_socket);
+    } else if (strncmp(buffer, "BROKER|", 7) == 0) {
+        Subscriber *enlace = abrir_enlace(new_socket, -1, 0);
+        if (enlace == NULL) {
+            return;
         }
+        procesar_datos_subscriber(enlace, buffer, bytes);
+        if (enlace->caido) {
+            cerrar_subscriber(enlace);
+            return;
+        }
+        reanudar_no_bloqueante(enlace);
     } else {
         printf("[BROKER] Tipo desconocido: %s\n", buffer);
         closesocket(new_socket);
     }
 }
 
-void reenviar_a_subscribers(const char *topic, const char *mensaje) {
-    for (int i = 0; i < MAX_CLIENTS; i++) {
-        SOCKET fd = subscribers[i].socket;
-        if (fd > 0 && strstr(subscribers[i].topic, topic) != NULL) {
-            if (send(fd, mensaje, (int)strlen(mensaje), 0) == SOCKET_ERROR) {
-                perror("[BROKER] Error al enviar a subscriber");
+// origen es el enlace del broker vecino que reenvio el mensaje, o NULL si lo envio un publisher propio.
+void procesar_mensaje_publisher(char *linea, int longitud, Subscriber *origen) {
+    uint64_t ingreso_ns = LatencyStampNowNs();
+    if (origen != NULL) {
+        printf("[BROKER] Mensaje del broker %s: %s\n", origen->par, linea);
+    } else {
+        printf("[BROKER] Mensaje recibido: %s\n", linea);
+    }
+
+    RoutingPublish publicacion;
+    if (RoutingParsePublish(linea, (size_t)longitud, &publicacion)) {
+        // Con marca de origen la hora se reenvia como "#<origen>#<ingreso>"; una hora comun pasa sin cambios.
+        char marcas[LATENCY_STAMP_FORWARD_LEN + 1];
+        const char *hora = LatencyStampForward(publicacion.timestamp, ingreso_ns, marcas);
+        char mensaje_final[BUFFER_SIZE];
+        int largo = snprintf(mensaje_final, sizeof(mensaje_final), "[%s] %s: %s\n",
+                             hora, publicacion.topic, publicacion.body);
+        if (largo >= (int)sizeof(mensaje_final)) {
+            largo = (int)sizeof(mensaje_final) - 1;
+            mensaje_final[largo - 1] = '\n';
+        }
+        if (registro_activo) {
+            EventLogAppend(&registro, publicacion.topic, mensaje_final, (uint32_t)largo);
+        }
+        publicacion_actual++;
+        // Solo lo publicado aca se reenvia, y solo a los vecinos con interes en el topic (horizonte dividido).
+        if (origen == NULL && federacion.active > 0) {
+            char reenvio[BUFFER_SIZE];
+            int largo_reenvio = snprintf(reenvio, sizeof(reenvio), "PUBLISHER|%s|%s%s|%s\n", publicacion.topic,
+                                         EventPriorityMark(publicacion.priority), publicacion.timestamp, publicacion.body);
+            if (largo_reenvio >= (int)sizeof(reenvio)) {
+                largo_reenvio = (int)sizeof(reenvio) - 1;
+                reenvio[largo_reenvio - 1] = '\n';
             }
+            plan_federacion.priority = publicacion.priority;
+            RoutingPublishTo(&federacion, &plan_federacion, publicacion.topic, reenvio, (uint32_t)largo_reenvio);
         }
+        entregas_repetidas = 0;
+        plan_fanout.priority = publicacion.priority;
+        int32_t entregados = RoutingPublishTo(&suscripciones, &plan_fanout, publicacion.topic, mensaje_final, (uint32_t)largo);
+        if (entregados < 0) {
+            printf("[BROKER] Memoria insuficiente para enrutar un mensaje de '%s'; no se entrego\n", publicacion.topic);
+            entregados = 0;
+        }
+        entregados -= entregas_repetidas;
+
+        if (metricas_activas) {
+            uint64_t origen_ns;
+            MetricsCountPublish(&metricas, publicacion.topic, (uint32_t)longitud, entregados, (uint32_t)largo);
+            if (hora == marcas && LatencyStampDecode(hora, &origen_ns) && ingreso_ns >= origen_ns) {
+                MetricsRecordLatency(&metricas, METRICS_LATENCY_INGRESS, (ingreso_ns - origen_ns) / 1000ULL);
+            }
+            MetricsRecordLatency(&metricas, METRICS_LATENCY_BROKER, (LatencyStampNowNs() - ingreso_ns) / 1000ULL);
+        }
+    }
+}
+
+void procesar_datos_publisher(Publisher *publisher, const char *datos, int bytes) {
+    while (bytes > 0) {
+        const char *salto = memchr(datos, '\n', (size_t)bytes);
+        int tramo = salto != NULL ? (int)(salto - datos) : bytes;
+
+        int espacio = BUFFER_SIZE - 1 - publisher->longitud;
+        int copiar = tramo < espacio ? tramo : espacio;  // una linea mas larga que el buffer se trunca
+        memcpy(publisher->pendiente + publisher->longitud, datos, (size_t)copiar);
+        publisher->longitud += copiar;
+
+        if (salto == NULL) {
+            return;
+        }
+
+        if (publisher->longitud > 0 && publisher->pendiente[publisher->longitud - 1] == '\r') {
+            publisher->longitud--;
+        }
+        publisher->pendiente[publisher->longitud] = '\0';
+        if (publisher->longitud > 0) {
+            procesar_mensaje_publisher(publisher->pendiente, publisher->longitud, NULL);
+        }
+        publisher->longitud = 0;
+
+        datos += tramo + 1;
+        bytes -= tramo + 1;
     }
 }
 
-int main() {
+void mostrar_uso(const char *programa) {
+    fprintf(stderr, "Uso: %s [--puerto N] [--registro DIR] [--fsync no|grupo|siempre] [--fsync-ms N] [--metricas PUERTO]\n"
+                    "          [--prioridad estricta|ponderada] [--id NOMBRE] [--par IP:PUERTO]...\n", programa);
+    fprintf(stderr, "  --puerto N       Puerto de escucha (por defecto %d)\n", PORT);
+    fprintf(stderr, "  --registro DIR   Guarda cada evento en un registro por topic (permite REPLAY|topic|offset)\n");
+    fprintf(stderr, "  --fsync          no: lo escribe el sistema; grupo: un commit cada N ms (defecto); siempre: cada evento\n");
+    fprintf(stderr, "  --fsync-ms N     Intervalo del commit agrupado (por defecto %d ms)\n", FSYNC_MS_DEFECTO);
+    fprintf(stderr, "  --metricas P     Expone metricas de Prometheus en http://127.0.0.1:P/metrics\n");
+    fprintf(stderr, "  --prioridad      Cola de un subscriber lento: estricta (la alta siempre primero, defecto) o\n"
+                    "                   ponderada (8:3:1 entre alta, normal y baja)\n");
+    fprintf(stderr, "  --id NOMBRE      Nombre del broker en la federacion (por defecto tcp-<puerto>)\n");
+    fprintf(stderr, "  --par IP:PUERTO  Otro broker TCP al que reenviar los topics que sus subscribers siguen\n"
+                    "                   (repetible, hasta %d; la federacion debe ser una malla completa)\n", MAX_PARES);
+}
+
+// IP:PUERTO de un --par.
+int leer_par(const char *texto, struct sockaddr_in *direccion) {
+    const char *separador = strrchr(texto, ':');
+    if (separador == NULL || separador == texto || separador - texto >= 64) {
+        return 0;
+    }
+    char ip[64];
+    memcpy(ip, texto, (size_t)(separador - texto));
+    ip[separador - texto] = '\0';
+    int puerto = atoi(separador + 1);
+    memset(direccion, 0, sizeof(*direccion));
+    direccion->sin_family = AF_INET;
+    direccion->sin_addr.s_addr = inet_addr(ip);
+    direccion->sin_port = htons((u_short)puerto);
+    return puerto > 0 && puerto <= 65535 && direccion->sin_addr.s_addr != INADDR_NONE;
+}
+
+int main(int argc, char *argv[]) {
+    const char *directorio_registro = NULL;
+    EventLogSyncPolicy politica = EVENT_LOG_SYNC_GROUP;
+    int fsync_ms = FSYNC_MS_DEFECTO;
+    int puerto_metricas = 0;
+    int puerto = PORT;
+    const char *id = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--puerto") == 0 && i + 1 < argc) {
+            puerto = atoi(argv[++i]);
+            if (puerto <= 0 || puerto > 65535) {
+                mostrar_uso(argv[0]);
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(argv[i], "--id") == 0 && i + 1 < argc) {
+            id = argv[++i];
+            if (id[0] == '\0' || strlen(id) >= LARGO_ID_BROKER || strchr(id, '|') != NULL) {
+                mostrar_uso(argv[0]);
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(argv[i], "--par") == 0 && i + 1 < argc) {
+            i++;
+            if (cantidad_pares == MAX_PARES || !leer_par(argv[i], &pares[cantidad_pares])) {
+                mostrar_uso(argv[0]);
+                return EXIT_FAILURE;
+            }
+            nombres_pares[cantidad_pares++] = argv[i];
+        } else if (strcmp(argv[i], "--registro") == 0 && i + 1 < argc) {
+            directorio_registro = argv[++i];
+        } else if (strcmp(argv[i], "--fsync") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "no") == 0) {
+                politica = EVENT_LOG_SYNC_NONE;
+            } else if (strcmp(argv[i], "grupo") == 0) {
+                politica = EVENT_LOG_SYNC_GROUP;
+            } else if (strcmp(argv[i], "siempre") == 0) {
+                politica = EVENT_LOG_SYNC_ALWAYS;
+            } else {
+                mostrar_uso(argv[0]);
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(argv[i], "--fsync-ms") == 0 && i + 1 < argc) {
+            fsync_ms = atoi(argv[++i]);
+            if (fsync_ms <= 0) {
+                mostrar_uso(argv[0]);
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(argv[i], "--prioridad") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "estricta") == 0) {
+                politica_salida = OUTBOUND_STRICT;
+            } else if (strcmp(argv[i], "ponderada") == 0) {
+                politica_salida = OUTBOUND_WEIGHTED;
+            } else {
+                mostrar_uso(argv[0]);
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(argv[i], "--metricas") == 0 && i + 1 < argc) {
+            puerto_metricas = atoi(argv[++i]);
+            if (puerto_metricas <= 0 || puerto_metricas > 65535) {
+                mostrar_uso(argv[0]);
+                return EXIT_FAILURE;
+            }
+        } else {
+            mostrar_uso(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
     WSADATA wsaData;
     if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
         fprintf(stderr, "Error al iniciar Winsock.\n");
@@ -110,36 +985,104 @@ int main() {
     struct sockaddr_in client_addr;
     int addrlen = sizeof(client_addr);
 
-    memset(publisher_sockets, 0, sizeof(publisher_sockets));
+    memset(publishers, 0, sizeof(publishers));
     memset(subscribers, 0, sizeof(subscribers));
+    RoutingTableInit(&suscripciones, &transporte_tcp, 0, MAX_CLIENTS, MAX_SUSCRIPCIONES);
+    RoutingSetRetainDepth(&suscripciones, MENSAJES_RETENIDOS);
+    RoutingSetGroupPolicy(&suscripciones, ROUTING_GROUP_LEAST_LOADED);
+    RoutingTableInit(&federacion, &transporte_tcp, 0, MAX_CLIENTS, MAX_SUSCRIPCIONES);
+    if (id != NULL) {
+        snprintf(id_broker, sizeof(id_broker), "%s", id);
+    } else {
+        snprintf(id_broker, sizeof(id_broker), "tcp-%d", puerto);
+    }
 
-    iniciar_broker(&server_fd);
+    if (directorio_registro != NULL) {
+        if (!EventLogOpen(&registro, directorio_registro, politica, (uint32_t)fsync_ms)) {
+            WSACleanup();
+            return EXIT_FAILURE;
+        }
+        registro_activo = 1;
+        printf("[BROKER] Registro de eventos en %s\n", directorio_registro);
+    }
+    ULONGLONG proxima_sync = GetTickCount64() + (ULONGLONG)fsync_ms;
+
+    if (puerto_metricas > 0) {
+        if (!MetricsInit(&metricas, "tcp") || !MetricsServerStart(&servidor_metricas, &metricas, (uint16_t)puerto_metricas)) {
+            fprintf(stderr, "[BROKER] No se pudo abrir el puerto de metricas %d\n", puerto_metricas);
+            WSACleanup();
+            return EXIT_FAILURE;
+        }
+        metricas_activas = 1;
+        printf("[BROKER] Metricas en http://127.0.0.1:%d/metrics\n", puerto_metricas);
+    }
+
+    printf("[BROKER] Cola de subscribers lentos: prioridad %s\n", OutboundPolicyName(politica_salida));
+    iniciar_broker(&server_fd, puerto);
+    ULONGLONG proxima_conexion = 0;
+    if (cantidad_pares > 0) {
+        printf("[BROKER] Federacion: broker %s con %d vecinos configurados\n", id_broker, cantidad_pares);
+        conectar_pares();
+        proxima_conexion = GetTickCount64() + PAUSA_RECONEXION_MS;
+    }
 
     while (1) {
-        fd_set read_fds;
+        if (metricas_activas) {
+            MetricsSetSubscribers(&metricas, suscripciones.active);
+        }
+
+        fd_set read_fds, write_fds, except_fds;
         FD_ZERO(&read_fds);
+        FD_ZERO(&write_fds);
+        FD_ZERO(&except_fds);
         FD_SET(server_fd, &read_fds);
         SOCKET max_fd = server_fd;
 
         for (int i = 0; i < MAX_CLIENTS; i++) {
-            if (publisher_sockets[i] > 0) {
-                FD_SET(publisher_sockets[i], &read_fds);
-                if (publisher_sockets[i] > max_fd) max_fd = publisher_sockets[i];
+            if (publishers[i].socket > 0) {
+                FD_SET(publishers[i].socket, &read_fds);
+                if (publishers[i].socket > max_fd) max_fd = publishers[i].socket;
             }
         }
 
         for (int i = 0; i < MAX_CLIENTS; i++) {
-            if (subscribers[i].socket > 0) {
+            if (subscribers[i].socket > 0 && subscribers[i].conectando) {
+                // Winsock avisa un connect exitoso como escribible y uno fallido como excepcion.
+                FD_SET(subscribers[i].socket, &write_fds);
+                FD_SET(subscribers[i].socket, &except_fds);
+            } else if (subscribers[i].socket > 0) {
                 FD_SET(subscribers[i].socket, &read_fds);
+                if (salida_pendiente(&subscribers[i])) {
+                    FD_SET(subscribers[i].socket, &write_fds);
+                }
                 if (subscribers[i].socket > max_fd) max_fd = subscribers[i].socket;
             }
         }
 
-        int activity = select(0, &read_fds, NULL, NULL, NULL);
+        // Con commit agrupado select despierta al menos cada fsync_ms para sincronizar lo acumulado, y con
+        // --par cada PAUSA_RECONEXION_MS para reintentar los vecinos sin enlace.
+        int commit_agrupado = registro_activo && politica == EVENT_LOG_SYNC_GROUP;
+        int espera_ms = commit_agrupado ? fsync_ms : PAUSA_RECONEXION_MS;
+        if (cantidad_pares > 0 && espera_ms > PAUSA_RECONEXION_MS) {
+            espera_ms = PAUSA_RECONEXION_MS;
+        }
+        struct timeval espera = { espera_ms / 1000, (espera_ms % 1000) * 1000 };
+        int activity = select(0, &read_fds, &write_fds, &except_fds, commit_agrupado || cantidad_pares > 0 ? &espera : NULL);
+        if (commit_agrupado && GetTickCount64() >= proxima_sync) {
+            EventLogSync(&registro);
+            proxima_sync = GetTickCount64() + (ULONGLONG)fsync_ms;
+        }
+        if (cantidad_pares > 0 && GetTickCount64() >= proxima_conexion) {
+            conectar_pares();
+            proxima_conexion = GetTickCount64() + PAUSA_RECONEXION_MS;
+        }
         if (activity == SOCKET_ERROR) {
             perror("select");
             continue;
         }
+        if (activity == 0) {
+            continue;
+        }
 
         if (FD_ISSET(server_fd, &read_fds)) {
             SOCKET new_socket = accept(server_fd, (struct sockaddr *)&client_addr, &addrlen);
@@ -149,32 +1092,67 @@ int main() {
         }
 
         for (int i = 0; i < MAX_CLIENTS; i++) {
-            SOCKET fd = publisher_sockets[i];
+            SOCKET fd = publishers[i].socket;
             if (fd > 0 && FD_ISSET(fd, &read_fds)) {
                 char buffer[BUFFER_SIZE];
-                int bytes = recv(fd, buffer, BUFFER_SIZE - 1, 0);
+                int bytes = recv(fd, buffer, BUFFER_SIZE, 0);
                 if (bytes <= 0) {
                     closesocket(fd);
-                    publisher_sockets[i] = 0;
+                    publishers[i].socket = 0;
+                    publishers[i].longitud = 0;
                     printf("[BROKER] Publisher desconectado\n");
                 } else {
-                    buffer[bytes] = '\0';
-                    printf("[BROKER] Mensaje recibido: %s\n", buffer);
-
-                    char *tipo = strtok(buffer, "|");
-                    char *topic = strtok(NULL, "|");
-                    char *hora = strtok(NULL, "|");
-                    char *mensaje = strtok(NULL, "");
-                    if (tipo && topic && hora && mensaje) {
-                        char mensaje_final[BUFFER_SIZE];
-                        snprintf(mensaje_final, sizeof(mensaje_final), "[%s] %s: %s\n", hora, topic, mensaje);
-                        reenviar_a_subscribers(topic, mensaje_final);
-                    }
+                    procesar_datos_publisher(&publishers[i], buffer, bytes);
+                }
+            }
+        }
+
+        // Los subscribers envian SUBSCRIBE / UNSUBSCRIBE / REPLAY por la misma conexion; recv <= 0 es desconexion.
+        // Un socket que vuelve a aceptar datos recibe lo que quedo en su cola, empezando por la alta prioridad.
+        for (int i = 0; i < MAX_CLIENTS; i++) {
+            Subscriber *subscriber = &subscribers[i];
+            if (subscriber->socket > 0 && subscriber->conectando) {
+                if (FD_ISSET(subscriber->socket, &write_fds) || FD_ISSET(subscriber->socket, &except_fds)) {
+                    completar_conexion_par(subscriber);
+                }
+                continue;
+            }
+            if (subscriber->socket > 0 && FD_ISSET(subscriber->socket, &write_fds)) {
+                enviar_pendientes(subscriber);
+            }
+            if (subscriber->socket > 0 && !subscriber->caido && FD_ISSET(subscriber->socket, &read_fds)) {
+                char buffer[BUFFER_SIZE];
+                int bytes = recv(subscriber->socket, buffer, BUFFER_SIZE, 0);
+                if (bytes <= 0) {
+                    subscriber->caido = 1;
+                } else {
+                    procesar_datos_subscriber(subscriber, buffer, bytes);
                 }
             }
+            if (subscriber->socket > 0 && subscriber->caido) {
+                cerrar_subscriber(subscriber);
+            }
+        }
+    }
+
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        if (subscribers[i].socket > 0) {
+            cerrar_subscriber(&subscribers[i]);
         }
     }
 
+    RoutingFreePlan(&plan_fanout);
+    RoutingFreePlan(&plan_federacion);
+    RoutingTableFree(&suscripciones);
+    RoutingTableFree(&federacion);
+    if (registro_activo) {
+        EventLogClose(&registro);
+    }
+    if (metricas_activas) {
+        MetricsServerStop(&servidor_metricas);
+        MetricsFree(&metricas);
+    }
+
     closesocket(server_fd);
     WSACleanup();
     return 0;
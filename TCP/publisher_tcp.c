@@ -3,23 +3,76 @@
 #include <string.h>
 #include <winsock2.h>      // Librería principal de sockets en Windows
 #include <ws2tcpip.h>      // Para inet_pton y funciones de red
-#include <time.h>
 #include <windows.h>       // Para Sleep()
+#include "../common/match_replay.h"  // Modo --multi: varios partidos en una sola conexion
+#include "../common/latency_stamp.h"  // Marca de origen en nanosegundos para medir la latencia
+#include "../common/event_priority.h"  // Marca de prioridad: goles y rojas pasan antes que las jugadas de rutina
 
 #pragma comment(lib, "ws2_32.lib")  // Vincula la librería de Winsock
 
 #define BROKER_IP "127.0.0.1"
 #define BROKER_PORT 8000
 #define BUFFER_SIZE 1024
+#define INTERVALO_MS 2000
+
+// Modo --multi: todos los partidos comparten la conexion; cada linea lleva su topic y termina en '\n',
+// asi el broker separa los mensajes aunque lleguen varios en un mismo recv().
+int publicar_multiples_partidos(SOCKET sock_fd, const char *fuente, uint32_t intervalo_ms) {
+    MatchSchedule partidos;
+    if (LoadMatchSchedule(&partidos, fuente, intervalo_ms) == 0) {
+        fprintf(stderr, "[PUBLISHER] No hay partidos para publicar en '%s'\n", fuente);
+        FreeMatchSchedule(&partidos);
+        return 0;
+    }
+
+    printf("[PUBLISHER] Publicando %d partidos desde '%s' (un evento cada %u ms por partido)\n",
+           partidos.active, fuente, intervalo_ms);
+
+    char buffer_envio[BUFFER_SIZE];
+    char mensaje[900];
+    char hora[LATENCY_STAMP_ORIGIN_LEN + 1];
+    int ok = 1;
+    MatchSource *partido;
+    while (ok && (partido = NextMatch(&partidos)) != NULL) {
+        ReplaySleepUntil(partido->nextDueMs);
+        if (!ReadMatchLine(&partidos, partido, mensaje, sizeof(mensaje))) {
+            printf("[PUBLISHER] Fin del partido '%s' (%u mensajes).\n", partido->topic, partido->sent);
+            continue;
+        }
+
+        LatencyStampOrigin(hora);
+        snprintf(buffer_envio, sizeof(buffer_envio), "PUBLISHER|%s|%s%s|%s\n", partido->topic,
+                 EventPriorityMark(EventPriorityClassify(mensaje)), hora, mensaje);
+        if (send(sock_fd, buffer_envio, (int)strlen(buffer_envio), 0) == SOCKET_ERROR) {
+            perror("Error al enviar mensaje");
+            ok = 0;
+        } else {
+            printf("[PUBLISHER] Mensaje enviado: %s", buffer_envio);
+        }
+    }
+
+    FreeMatchSchedule(&partidos);
+    return ok;
+}
 
 int main(int argc, char *argv[]) {
+    int modo_multi = argc >= 3 && strcmp(argv[1], "--multi") == 0;
     if (argc < 3) {
         fprintf(stderr, "Uso: %s <archivo_mensajes> <partido>\n", argv[0]);
+        fprintf(stderr, "     %s --multi <directorio|manifiesto> [intervalo_ms]\n", argv[0]);
         return EXIT_FAILURE;
     }
 
     const char *archivo = argv[1];
     const char *partido = argv[2];
+    uint32_t intervalo_ms = INTERVALO_MS;
+    if (modo_multi) {
+        archivo = argv[2];
+        partido = "multi";
+        if (argc >= 4) {
+            intervalo_ms = (uint32_t)atoi(argv[3]);
+        }
+    }
 
     WSADATA wsaData;
     if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
@@ -62,6 +115,14 @@ int main(int argc, char *argv[]) {
         return EXIT_FAILURE;
     }
 
+    if (modo_multi) {
+        int ok = publicar_multiples_partidos(sock_fd, archivo, intervalo_ms);
+        printf("[PUBLISHER] Todos los partidos terminaron. Cerrando conexión.\n");
+        closesocket(sock_fd);
+        WSACleanup();
+        return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
     // Abrir archivo de mensajes
     FILE *file = fopen(archivo, "r");
     if (!file) {
@@ -77,16 +138,16 @@ int main(int argc, char *argv[]) {
     while (fgets(mensaje, sizeof(mensaje), file)) {
         mensaje[strcspn(mensaje, "\n")] = '\0';  // eliminar salto de línea
 
-        time_t t = time(NULL);
-        struct tm *tm_info = localtime(&t);
-        char hora[9];  // HH:MM:SS
-        strftime(hora, sizeof(hora), "%H:%M:%S", tm_info);
+        char hora[LATENCY_STAMP_ORIGIN_LEN + 1];  // "#" + nanosegundos en hexadecimal
+        LatencyStampOrigin(hora);
 
         char mensaje_limpio[900];
         strncpy(mensaje_limpio, mensaje, sizeof(mensaje_limpio) - 1);
         mensaje_limpio[sizeof(mensaje_limpio) - 1] = '\0';
 
-        snprintf(buffer_envio, sizeof(buffer_envio), "PUBLISHER|%s|%s|%s\n", partido, hora, mensaje_limpio);
+        // La prioridad va como prefijo de la hora ("!" alta, "~" baja); el broker la quita antes de reenviar.
+        snprintf(buffer_envio, sizeof(buffer_envio), "PUBLISHER|%s|%s%s|%s\n", partido,
+                 EventPriorityMark(EventPriorityClassify(mensaje_limpio)), hora, mensaje_limpio);
 
         // Enviar mensaje
         if (send(sock_fd, buffer_envio, (int)strlen(buffer_envio), 0) == SOCKET_ERROR) {
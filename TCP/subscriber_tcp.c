@@ -3,6 +3,9 @@
 #include <string.h>
 #include <winsock2.h>
 #include <ws2tcpip.h>
+#include <windows.h>  // Hilo que lee las altas y bajas de topics desde la consola
+#include "../common/latency_stamp.h"  // Latencia publisher->broker y broker->subscriber
+#include "../common/message_sink.h"  // Salida agrupada de los mensajes (--salida)
 
 #pragma comment(lib, "ws2_32.lib")  // Enlaza la librería de Winsock
 
@@ -10,13 +13,82 @@
 #define BROKER_PORT 8000
 #define BUFFER_SIZE 1024
 
+// Histogramas por tramo (~70 KB), por eso globales y no en la pila.
+LatencyStats latencias;
+MessageSink salida;
+
+// El broker reenvia "[hora] topic: mensaje\n"; si la hora es "#<origen>#<ingreso>" se registra la latencia
+// de cada tramo y se muestra la total en su lugar.
+// Las lineas van al sink elegido con --salida; antes del resumen periodico de latencia se vacia el sink para
+// que en la consola el resumen no se adelante a los mensajes que todavia estan en el buffer.
+void mostrar_linea(const char *linea, size_t largo, uint64_t recibido_ns) {
+    uint64_t origen_ns, ingreso_ns;
+    MessageSinkRecord(&salida, recibido_ns, linea, largo);
+    if (largo > LATENCY_STAMP_FORWARD_LEN + 1 && linea[0] == '[' && linea[LATENCY_STAMP_FORWARD_LEN + 1] == ']' &&
+        LatencyStampParse(linea + 1, largo - 1, &origen_ns, &ingreso_ns)) {
+        uint64_t total_us = LatencyStatsRecord(&latencias, origen_ns, ingreso_ns, recibido_ns);
+        MessageSinkPrintf(&salida, "[SUBSCRIBER] Mensaje recibido: [+%llu us]%.*s\n", (unsigned long long)total_us,
+                          (int)(largo - LATENCY_STAMP_FORWARD_LEN - 2), linea + LATENCY_STAMP_FORWARD_LEN + 2);
+        if (recibido_ns >= latencias.nextReportNs) {
+            MessageSinkFlush(&salida);
+        }
+        LatencyStatsMaybePrint(&latencias, recibido_ns, stdout, "[SUBSCRIBER]");
+    } else {
+        MessageSinkPrintf(&salida, "[SUBSCRIBER] Mensaje recibido: %.*s\n", (int)largo, linea);
+    }
+}
+
+// Mientras recibe, el subscriber acepta por consola "+topic" (SUBSCRIBE) y "-topic" (UNSUBSCRIBE); el broker
+// agrega o quita ese filtro en la misma conexion. send desde este hilo no interfiere con el recv del principal.
+DWORD WINAPI leer_comandos(LPVOID parametro) {
+    SOCKET sock_fd = *(SOCKET *)parametro;
+    char linea[BUFFER_SIZE];
+    char comando[BUFFER_SIZE + 16];
+    while (fgets(linea, sizeof(linea), stdin) != NULL) {
+        linea[strcspn(linea, "\r\n")] = '\0';
+        if ((linea[0] != '+' && linea[0] != '-') || linea[1] == '\0') {
+            fprintf(stderr, "[SUBSCRIBER] Use +topic para suscribirse o -topic para darse de baja\n");
+            continue;
+        }
+        int largo = snprintf(comando, sizeof(comando), "%s|%s\n", linea[0] == '+' ? "SUBSCRIBE" : "UNSUBSCRIBE", linea + 1);
+        if (send(sock_fd, comando, largo, 0) == SOCKET_ERROR) {
+            break;
+        }
+        fprintf(stderr, "[SUBSCRIBER] %s '%s' enviado\n", linea[0] == '+' ? "Alta de" : "Baja de", linea + 1);
+    }
+    return 0;
+}
+
 int main(int argc, char *argv[]) {
-    if (argc < 2) {
-        fprintf(stderr, "Uso: %s <topic>\n", argv[0]);
+    const char *desde = NULL;
+    const char *tipo_salida = NULL;
+    int cantidad_topics = 1;
+    while (cantidad_topics < argc && strncmp(argv[cantidad_topics], "--", 2) != 0) {
+        cantidad_topics++;
+    }
+    cantidad_topics--;
+    int argumentos_ok = cantidad_topics > 0 && (argc - 1 - cantidad_topics) % 2 == 0;
+    for (int i = 1 + cantidad_topics; argumentos_ok && i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--desde") == 0) {
+            desde = argv[i + 1];
+        } else if (strcmp(argv[i], "--salida") == 0) {
+            tipo_salida = argv[i + 1];
+        } else {
+            argumentos_ok = 0;
+        }
+    }
+    if (!argumentos_ok) {
+        fprintf(stderr, "Uso: %s <topic> [topic ...] [--desde <offset|@hora_ms>] [--salida texto|texto:RUTA|binario:RUTA|nula]\n", argv[0]);
+        fprintf(stderr, "  --desde   Reenvia primero los eventos guardados en el registro del broker\n");
+        fprintf(stderr, "  --salida  Destino de los mensajes recibidos (por defecto texto en la consola)\n");
+        fprintf(stderr, "  Durante la ejecucion: +topic agrega un topic, -topic lo quita\n");
+        return EXIT_FAILURE;
+    }
+    if (!MessageSinkOpen(&salida, tipo_salida)) {
+        fprintf(stderr, "Salida invalida o no se pudo abrir: %s\n", tipo_salida);
         return EXIT_FAILURE;
     }
 
-    const char *topic = argv[1];
     SOCKET sock_fd;
     struct sockaddr_in broker_addr;
     char buffer[BUFFER_SIZE];
@@ -50,28 +122,72 @@ int main(int argc, char *argv[]) {
 
     printf("[SUBSCRIBER] Conectado al broker en %s:%d\n", BROKER_IP, BROKER_PORT);
 
-    // Enviar identificación
-    snprintf(buffer, sizeof(buffer), "SUBSCRIBER|%s\n", topic);
-    if (send(sock_fd, buffer, (int)strlen(buffer), 0) == SOCKET_ERROR) {
-        printf("Error al enviar identificación: %d\n", WSAGetLastError());
-        closesocket(sock_fd);
-        WSACleanup();
-        return EXIT_FAILURE;
+    // Enviar identificación: la primera linea registra la conexion y cada topic extra va como SUBSCRIBE
+    // (con --desde cada topic pide el reenvio del registro antes de los eventos en vivo)
+    for (int i = 0; i < cantidad_topics; i++) {
+        const char *topic = argv[1 + i];
+        if (desde != NULL) {
+            snprintf(buffer, sizeof(buffer), "REPLAY|%s|%s\n", topic, desde);
+        } else {
+            snprintf(buffer, sizeof(buffer), "%s|%s\n", i == 0 ? "SUBSCRIBER" : "SUBSCRIBE", topic);
+        }
+        if (send(sock_fd, buffer, (int)strlen(buffer), 0) == SOCKET_ERROR) {
+            printf("Error al enviar identificación: %d\n", WSAGetLastError());
+            closesocket(sock_fd);
+            WSACleanup();
+            return EXIT_FAILURE;
+        }
+        printf("[SUBSCRIBER] Suscrito al topic '%s'\n", topic);
     }
+    CreateThread(NULL, 0, leer_comandos, &sock_fd, 0, NULL);
 
-    printf("[SUBSCRIBER] Suscrito al topic '%s'\n", topic);
-
-    // Escuchar mensajes del broker
+    // Escuchar mensajes del broker; un recv puede traer varias lineas o solo parte de una.
+    LatencyStatsInit(&latencias);
+    char pendiente[BUFFER_SIZE];
+    size_t pendiente_largo = 0;
     while (1) {
-        int bytes = recv(sock_fd, buffer, BUFFER_SIZE - 1, 0);
+        // select espera a lo sumo MESSAGE_SINK_FLUSH_MS: sin trafico se vacia lo que quedo en el buffer de salida.
+        // El socket sigue siendo bloqueante y sin SO_RCVTIMEO, que al vencer deja la conexion en estado indeterminado.
+        fd_set lectura;
+        FD_ZERO(&lectura);
+        FD_SET(sock_fd, &lectura);
+        struct timeval espera = { 0, MESSAGE_SINK_FLUSH_MS * 1000 };
+        int listos = select(0, &lectura, NULL, NULL, &espera);
+        if (listos == 0) {
+            MessageSinkTick(&salida, LatencyStampNowNs());
+            continue;
+        }
+
+        int bytes = listos == SOCKET_ERROR ? SOCKET_ERROR : recv(sock_fd, buffer, BUFFER_SIZE - 1, 0);
         if (bytes <= 0) {
+            MessageSinkFlush(&salida);
             printf("[SUBSCRIBER] Conexión cerrada por el broker\n");
             break;
         }
 
-        buffer[bytes] = '\0';
-        printf("[SUBSCRIBER] Mensaje recibido: %s\n", buffer);
+        uint64_t recibido_ns = LatencyStampNowNs();
+        const char *datos = buffer;
+        size_t restantes = (size_t)bytes;
+        while (restantes > 0) {
+            const char *salto = memchr(datos, '\n', restantes);
+            size_t tramo = salto != NULL ? (size_t)(salto - datos) : restantes;
+            size_t copiar = tramo < sizeof(pendiente) - pendiente_largo ? tramo : sizeof(pendiente) - pendiente_largo;
+            memcpy(pendiente + pendiente_largo, datos, copiar);  // una linea mas larga que el buffer se trunca
+            pendiente_largo += copiar;
+            if (salto == NULL) {
+                break;
+            }
+            if (pendiente_largo > 0) {
+                mostrar_linea(pendiente, pendiente_largo, recibido_ns);
+            }
+            pendiente_largo = 0;
+            datos += tramo + 1;
+            restantes -= tramo + 1;
+        }
     }
+    LatencyStatsPrint(&latencias, stdout, "[SUBSCRIBER]");
+    MessageSinkClose(&salida);
+    MessageSinkPrintSummary(&salida, stdout, "[SUBSCRIBER]");
 
     closesocket(sock_fd);
     WSACleanup();
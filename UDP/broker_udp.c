@@ -3,24 +3,43 @@
 #include <string.h>
 #include <winsock2.h> // Creacion de sockets nativa de windows
 #include <ws2tcpip.h> // Manejo de direcciones IP en windows
+#include "../common/routing.h" // Topics y subscriptores compartidos con los brokers TCP y QUIC
+#include "../common/latency_stamp.h" // Marca de ingreso junto a la de origen del publisher
+#include "../common/metrics.h" // Contadores y endpoint de Prometheus (--metricas PUERTO)
 #pragma comment(lib, "ws2_32.lib")  
 
 #define MAX_MSG_LEN 512
 #define MAX_SUBS 100
-
-// Estructura que guarda un subscriptor (topic + dirección)
-typedef struct {
-    char topic[50];
-    struct sockaddr_in addr;
-} Subscriber;
-
-Subscriber subscribers[MAX_SUBS];
-int subscriber_count = 0;
+#define MENSAJES_RETENIDOS 8 // Ultimos mensajes por partido que recibe un subscriptor al registrarse
+
+// Cada suscripcion guarda la dirección del subscriptor como estado extra de la tabla de enrutamiento.
+RoutingTable subscribers;
+RoutingPlan plan_fanout;
+
+// Metricas en vivo (opcional): las registra el bucle principal y las lee el hilo del endpoint.
+Metrics metricas;
+MetricsServer servidor_metricas;
+int metricas_activas = 0;
+
+int entregar_udp(void *contexto, RoutingTable *tabla, int32_t indice, const char *mensaje, uint32_t longitud) {
+    SOCKET sockfd = *(SOCKET *)contexto;
+    struct sockaddr_in *addr = (struct sockaddr_in *)RoutingEntryExtra(tabla, indice);
+    // UDP no tiene conexion: un error de sendto no implica que el subscriptor se haya ido.
+    if (sendto(sockfd, mensaje, (int)longitud, 0, (struct sockaddr*)addr, sizeof(*addr)) == SOCKET_ERROR && metricas_activas) {
+        MetricsCountSendFailure(&metricas);
+    }
+    return 1;
+}
 
 int main(int argc, char *argv[]) {
 
-    if (argc != 2) {
-        printf("Uso: %s <PUERTO>\n", argv[0]);
+    int puerto_metricas = 0;
+    if (argc == 4 && strcmp(argv[2], "--metricas") == 0) {
+        puerto_metricas = atoi(argv[3]);
+    }
+    if (argc != 2 && !(argc == 4 && puerto_metricas > 0 && puerto_metricas <= 65535)) {
+        printf("Uso: %s <PUERTO> [--metricas PUERTO_METRICAS]\n", argv[0]);
+        printf("  --metricas   Expone metricas de Prometheus en http://127.0.0.1:PUERTO_METRICAS/metrics\n");
         return 1;
     }
 
@@ -35,6 +54,7 @@ int main(int argc, char *argv[]) {
     SOCKET sockfd;
     struct sockaddr_in broker_addr, client_addr;
     char buffer[MAX_MSG_LEN];
+    char datagrama[MAX_MSG_LEN]; // "#<origen>#<ingreso>|mensaje", acotado a lo que lee el subscriptor
     int addr_len = sizeof(client_addr);
 
     // Crear socket 
@@ -61,42 +81,96 @@ int main(int argc, char *argv[]) {
 
     printf("[BROKER] Escuchando en puerto %d...\n", port);
 
+    // Sin DeliverBatch: cada mensaje retenido viaja en su propio datagrama, como los mensajes en vivo.
+    RoutingTransport transporte_udp = { "udp", &sockfd, entregar_udp, NULL, NULL, NULL, NULL };
+    RoutingTableInit(&subscribers, &transporte_udp, sizeof(struct sockaddr_in), 16, MAX_SUBS);
+    RoutingSetRetainDepth(&subscribers, MENSAJES_RETENIDOS);
+
+    if (puerto_metricas > 0) {
+        if (!MetricsInit(&metricas, "udp") || !MetricsServerStart(&servidor_metricas, &metricas, (uint16_t)puerto_metricas)) {
+            printf("Error al abrir el puerto de metricas %d.\n", puerto_metricas);
+            closesocket(sockfd);
+            WSACleanup();
+            return 1;
+        }
+        metricas_activas = 1;
+        printf("[BROKER] Metricas en http://127.0.0.1:%d/metrics\n", puerto_metricas);
+    }
+
     // Bucle principal de recepción
     while (1) {
         memset(buffer, 0, sizeof(buffer));
-        int n = recvfrom(sockfd, buffer, MAX_MSG_LEN, 0,(struct sockaddr*)&client_addr, &addr_len);
+        int n = recvfrom(sockfd, buffer, MAX_MSG_LEN - 1, 0,(struct sockaddr*)&client_addr, &addr_len);
+        if (n <= 0) {
+            continue;
+        }
         buffer[n] = '\0';
 
         if (strncmp(buffer, "SUBSCRIBER|", 11) == 0) {
             char *topic = buffer + 11;
 
-            if (subscriber_count < MAX_SUBS) {
-                strcpy(subscribers[subscriber_count].topic, topic);
-                subscribers[subscriber_count].addr = client_addr;
-                subscriber_count++;
-                printf("[BROKER] Nuevo subscriptor a 'Partido %s'\n", topic);
+            int32_t indice = RoutingSubscribe(&subscribers, topic, NULL, NULL);
+            if (indice != ROUTING_NO_INDEX) {
+                *(struct sockaddr_in *)RoutingEntryExtra(&subscribers, indice) = client_addr;
+                printf("[BROKER] Nuevo subscriptor a 'Partido %s'\n",
+                       RoutingTopicName(&subscribers, subscribers.entries[indice].topicId));
+                int32_t retenidos = RoutingReplayRetained(&subscribers, indice);
+                if (retenidos > 0) {
+                    printf("[BROKER] %d mensajes retenidos enviados al nuevo subscriptor\n", (int)retenidos);
+                }
+            } else {
+                printf("[BROKER] Suscripcion rechazada: '%s' (tabla llena o topic invalido)\n", topic);
+            }
+            if (metricas_activas) {
+                MetricsSetSubscribers(&metricas, subscribers.active);
             }
 
         }
         else if (strncmp(buffer, "PUBLISHER|", 10) == 0) {
 
-            char *topic = strtok(buffer + 10, "|");
-            char *hora = strtok(NULL, "|");
-            char *mensaje = strtok(NULL, "");
-
-            if (topic && hora && mensaje) {
-                printf("[BROKER] Publicacion recibida del partido '%s': %s|%s\n", topic, hora, mensaje);
+            uint64_t ingreso_ns = LatencyStampNowNs();
+            RoutingPublish publicacion;
+            if (RoutingParsePublish(buffer, (size_t)n, &publicacion)) {
+                printf("[BROKER] Publicacion recibida del partido '%s': %s|%s\n",
+                       publicacion.topic, publicacion.timestamp, publicacion.body);
+
+                // Reenviar a los subscriptores interesados; con marca de origen el datagrama lleva
+                // "#<origen>#<ingreso>|" antes del mensaje para que el subscriptor mida cada tramo.
+                char marcas[LATENCY_STAMP_FORWARD_LEN + 1];
+                const char *hora = LatencyStampForward(publicacion.timestamp, ingreso_ns, marcas);
+                const char *salida = publicacion.body;
+                int largo = (int)strlen(publicacion.body);
+                if (hora == marcas) {
+                    largo = snprintf(datagrama, sizeof(datagrama), "%s|%s", hora, publicacion.body);
+                    if (largo >= (int)sizeof(datagrama)) {
+                        largo = (int)sizeof(datagrama) - 1;
+                    }
+                    salida = datagrama;
+                }
+                int32_t entregados = RoutingPublishTo(&subscribers, &plan_fanout, publicacion.topic, salida, (uint32_t)largo);
+                if (entregados < 0) {
+                    printf("[BROKER] Memoria insuficiente para enrutar un mensaje de '%s'; no se entrego.\n", publicacion.topic);
+                    entregados = 0;
+                }
 
-                // Reenviar a los subscriptores interesados
-                for (int i = 0; i < subscriber_count; i++) {
-                    if (strcmp(subscribers[i].topic, topic) == 0) {
-                        sendto(sockfd, mensaje, strlen(mensaje), 0, (struct sockaddr*)&subscribers[i].addr, sizeof(subscribers[i].addr));
+                if (metricas_activas) {
+                    uint64_t origen_ns;
+                    MetricsCountPublish(&metricas, publicacion.topic, (uint32_t)n, entregados, (uint32_t)largo);
+                    if (hora == marcas && LatencyStampDecode(hora, &origen_ns) && ingreso_ns >= origen_ns) {
+                        MetricsRecordLatency(&metricas, METRICS_LATENCY_INGRESS, (ingreso_ns - origen_ns) / 1000ULL);
                     }
+                    MetricsRecordLatency(&metricas, METRICS_LATENCY_BROKER, (LatencyStampNowNs() - ingreso_ns) / 1000ULL);
                 }
             }
         }
     }
 
+    if (metricas_activas) {
+        MetricsServerStop(&servidor_metricas);
+        MetricsFree(&metricas);
+    }
+    RoutingFreePlan(&plan_fanout);
+    RoutingTableFree(&subscribers);
     closesocket(sockfd);
     WSACleanup();
     return 0;
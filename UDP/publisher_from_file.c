@@ -0,0 +1,195 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <winsock2.h> // Creacion de sockets nativa de windows
+#include <ws2tcpip.h> // Manejo de direcciones IP en windows
+#include "../common/line_feed.h" // Archivo mapeado en memoria, leido por lineas sin copiarlas
+#include "../common/latency_stamp.h" // Marca de origen en nanosegundos para medir la latencia
+#pragma comment(lib, "ws2_32.lib")
+
+#define MAX_MSG_LEN 512 // El broker lee hasta MAX_MSG_LEN - 1 bytes por datagrama
+#define MAX_TOPIC_LEN 64
+#define BUFFER_SOCKET (4 * 1024 * 1024)
+#define INTERVALO_PROGRESO_NS 1000000000ULL
+
+// Publisher para archivos de eventos grandes: lee el archivo mapeado en memoria y cada datagrama se arma con
+// WSASendTo a partir de dos partes, la cabecera "PUBLISHER|topic|#origen|" y la linea tal como esta en el
+// mapeo, asi el mensaje no se copia en el proceso antes de llegar al socket. Sin --verbose solo imprime el
+// progreso una vez por segundo: con archivos de millones de lineas el printf por mensaje pone el limite.
+
+typedef struct opciones_publicacion {
+    uint32_t tasa;          // Mensajes por segundo; 0 = tan rapido como acepte el socket
+    uint32_t repeticiones;  // Veces que se recorre el archivo; 0 = sin fin
+    int verbose;
+} opciones_publicacion;
+
+typedef struct progreso_publicacion {
+    uint64_t inicio_ns;
+    uint64_t ultimo_reporte_ns;
+    uint64_t enviados;
+    uint64_t bytes;
+    uint64_t recortados;
+    uint64_t vacios;
+    uint64_t errores;
+} progreso_publicacion;
+
+// Con tasa fija se espera hasta que le toque al siguiente mensaje; Sleep(1) solo si falta mas de 2 ms,
+// porque su resolucion en Windows ronda el milisegundo o mas.
+void esperar_turno(const opciones_publicacion *opciones, const progreso_publicacion *progreso) {
+    if (opciones->tasa == 0) {
+        return;
+    }
+    uint64_t turno_ns = progreso->inicio_ns + progreso->enviados * 1000000000ULL / opciones->tasa;
+    uint64_t ahora_ns;
+    while ((ahora_ns = LatencyStampNowNs()) < turno_ns) {
+        if (turno_ns - ahora_ns > 2000000ULL) {
+            Sleep(1);
+        }
+    }
+}
+
+void imprimir_progreso(const progreso_publicacion *progreso, uint64_t ahora_ns, const char *etiqueta) {
+    double segundos = (double)(ahora_ns - progreso->inicio_ns) / 1e9;
+    if (segundos <= 0.0) {
+        segundos = 1e-9;
+    }
+    printf("[PUBLISHER] %s %llu mensajes en %.1f s (%.0f msg/s, %.1f MB/s)", etiqueta,
+           (unsigned long long)progreso->enviados, segundos,
+           (double)progreso->enviados / segundos, (double)progreso->bytes / segundos / 1e6);
+    if (progreso->recortados > 0 || progreso->errores > 0) {
+        printf(", %llu recortados, %llu errores de envio",
+               (unsigned long long)progreso->recortados, (unsigned long long)progreso->errores);
+    }
+    printf("\n");
+}
+
+int main(int argc, char *argv[]) {
+
+    opciones_publicacion opciones = { 0, 1, 0 };
+    int argumentos_ok = argc >= 5;
+    for (int i = 5; argumentos_ok && i < argc; i++) {
+        if (strcmp(argv[i], "--tasa") == 0 && i + 1 < argc) {
+            opciones.tasa = (uint32_t)atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--repetir") == 0 && i + 1 < argc) {
+            opciones.repeticiones = (uint32_t)atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--verbose") == 0) {
+            opciones.verbose = 1;
+        } else {
+            argumentos_ok = 0;
+        }
+    }
+    if (!argumentos_ok || strlen(argv[3]) >= MAX_TOPIC_LEN) {
+        printf("Uso: %s <IP_BROKER> <PUERTO> <TOPIC> <ARCHIVO_MENSAJES> [--tasa N] [--repetir N] [--verbose]\n", argv[0]);
+        printf("  --tasa N      Mensajes por segundo (0 = sin pausa, por defecto)\n");
+        printf("  --repetir N   Recorre el archivo N veces (0 = sin fin; por defecto 1)\n");
+        printf("  --verbose     Imprime cada mensaje enviado\n");
+        return 1;
+    }
+
+    char *broker_ip = argv[1];
+    int port = atoi(argv[2]);
+    char *topic = argv[3];
+    char *archivo = argv[4];
+
+    WSADATA wsaData;
+    if (WSAStartup(MAKEWORD(2,2), &wsaData) != 0) {
+        printf("Error al inicializar Winsock.\n");
+        return 1;
+    }
+
+    SOCKET sockfd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (sockfd == INVALID_SOCKET) {
+        printf("Error al crear socket.\n");
+        WSACleanup();
+        return 1;
+    }
+    // Buffer de envio amplio para que las rafagas no se pierdan en el propio socket
+    int buffer_socket = BUFFER_SOCKET;
+    setsockopt(sockfd, SOL_SOCKET, SO_SNDBUF, (const char *)&buffer_socket, sizeof(buffer_socket));
+
+    struct sockaddr_in broker_addr;
+    memset(&broker_addr, 0, sizeof(broker_addr));
+    broker_addr.sin_family = AF_INET;
+    broker_addr.sin_port = htons(port);
+    broker_addr.sin_addr.s_addr = inet_addr(broker_ip);
+
+    LineFeed lineas;
+    if (!LineFeedOpen(&lineas, archivo, 0)) {
+        printf("Error al abrir el archivo %s\n", archivo);
+        closesocket(sockfd);
+        WSACleanup();
+        return 1;
+    }
+
+    printf("[PUBLISHER] Enviando a %s:%d informacion sobre el Partido %s desde %s (%.1f MB)\n",
+           broker_ip, port, topic, archivo, (double)lineas.fileSize / 1e6);
+
+    // La cabecera se arma una vez; en cada mensaje solo se reescribe la marca de origen en su lugar.
+    char cabecera[MAX_MSG_LEN];
+    int largo_prefijo = snprintf(cabecera, sizeof(cabecera), "PUBLISHER|%s|", topic);
+    int largo_cabecera = largo_prefijo + LATENCY_STAMP_ORIGIN_LEN + 1;
+    cabecera[largo_cabecera - 1] = '|';
+    size_t maximo_cuerpo = (size_t)(MAX_MSG_LEN - 1 - largo_cabecera);
+
+    progreso_publicacion progreso;
+    memset(&progreso, 0, sizeof(progreso));
+    progreso.inicio_ns = LatencyStampNowNs();
+    progreso.ultimo_reporte_ns = progreso.inicio_ns;
+
+    for (uint32_t vuelta = 0; opciones.repeticiones == 0 || vuelta < opciones.repeticiones; vuelta++) {
+        LineFeedRewind(&lineas);
+        LineSlice linea;
+        while (LineFeedNext(&lineas, &linea)) {
+            if (linea.length == 0) {
+                progreso.vacios++;
+                continue;
+            }
+            size_t largo_cuerpo = linea.length;
+            if (largo_cuerpo > maximo_cuerpo) {
+                largo_cuerpo = maximo_cuerpo;
+                progreso.recortados++;
+            }
+
+            esperar_turno(&opciones, &progreso);
+            LatencyStampEncode(cabecera + largo_prefijo, LatencyStampNowNs());
+
+            WSABUF partes[2];
+            partes[0].buf = cabecera;
+            partes[0].len = (ULONG)largo_cabecera;
+            partes[1].buf = (char *)linea.text;
+            partes[1].len = (ULONG)largo_cuerpo;
+            DWORD enviados = 0;
+            if (WSASendTo(sockfd, partes, 2, &enviados, 0, (struct sockaddr*)&broker_addr, sizeof(broker_addr), NULL, NULL) == SOCKET_ERROR) {
+                progreso.errores++;
+                continue;
+            }
+            progreso.enviados++;
+            progreso.bytes += enviados;
+
+            if (opciones.verbose) {
+                printf("[PUBLISHER] Mensaje enviado: %.*s%.*s\n", largo_cabecera, cabecera, (int)largo_cuerpo, linea.text);
+            } else if ((progreso.enviados & 1023) == 0) {
+                uint64_t ahora_ns = LatencyStampNowNs();
+                if (ahora_ns - progreso.ultimo_reporte_ns >= INTERVALO_PROGRESO_NS) {
+                    imprimir_progreso(&progreso, ahora_ns, "Progreso:");
+                    progreso.ultimo_reporte_ns = ahora_ns;
+                }
+            }
+        }
+        if (progreso.enviados == 0 && progreso.errores == 0) {
+            break; // Archivo sin lineas: repetirlo no enviaria nada
+        }
+    }
+
+    imprimir_progreso(&progreso, LatencyStampNowNs(), "Fin del archivo:");
+    if (lineas.truncatedLines > 0) {
+        printf("[PUBLISHER] %llu lineas mas largas que la ventana de lectura se cortaron.\n",
+               (unsigned long long)lineas.truncatedLines);
+    }
+
+    LineFeedClose(&lineas);
+    closesocket(sockfd);
+    WSACleanup();
+
+    return 0;
+}
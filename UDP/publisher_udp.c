@@ -3,15 +3,53 @@
 #include <string.h>
 #include <winsock2.h> // Creacion de sockets nativa de windows
 #include <ws2tcpip.h> // Manejo de direcciones IP en windows
-#include <time.h>
+#include "../common/match_replay.h" // Modo --multi: varios partidos desde un solo socket
+#include "../common/latency_stamp.h" // Marca de origen en nanosegundos para medir la latencia
+#include "../common/event_priority.h" // Marca de prioridad de cada evento (goles, rojas, rutina)
 #pragma comment(lib, "ws2_32.lib")
 
 #define MAX_MSG_LEN 512
 
+// Modo --multi: un solo socket envia los eventos de todos los partidos; cada datagrama lleva su topic.
+// Con intervalo 0 (por defecto) los eventos salen sin pausa, como en el modo de un solo archivo.
+int publicar_multiples_partidos(SOCKET sockfd, struct sockaddr_in *broker_addr, const char *fuente, uint32_t intervalo_ms) {
+    MatchSchedule partidos;
+    if (LoadMatchSchedule(&partidos, fuente, intervalo_ms) == 0) {
+        printf("No hay partidos para publicar en %s\n", fuente);
+        FreeMatchSchedule(&partidos);
+        return 0;
+    }
+
+    printf("[PUBLISHER] Publicando %d partidos desde %s (intervalo %u ms por partido)\n", partidos.active, fuente, intervalo_ms);
+
+    char buffer_envio[MAX_MSG_LEN];
+    char mensaje[MAX_MSG_LEN];
+    MatchSource *partido;
+    while ((partido = NextMatch(&partidos)) != NULL) {
+        ReplaySleepUntil(partido->nextDueMs);
+        if (!ReadMatchLine(&partidos, partido, mensaje, sizeof(mensaje))) {
+            printf("[PUBLISHER] Fin del partido %s (%u mensajes).\n", partido->topic, partido->sent);
+            continue;
+        }
+
+        char hora[LATENCY_STAMP_ORIGIN_LEN + 1];
+        LatencyStampOrigin(hora);
+        snprintf(buffer_envio, sizeof(buffer_envio), "PUBLISHER|%s|%s%s|%s", partido->topic,
+                 EventPriorityMark(EventPriorityClassify(mensaje)), hora, mensaje);
+        sendto(sockfd, buffer_envio, strlen(buffer_envio), 0, (struct sockaddr*)broker_addr, sizeof(*broker_addr));
+        printf("[PUBLISHER] Mensaje enviado: %s\n", buffer_envio);
+    }
+
+    FreeMatchSchedule(&partidos);
+    return 1;
+}
+
 int main(int argc, char *argv[]) {
 
-    if (argc != 5) {
+    int modo_multi = argc >= 5 && strcmp(argv[3], "--multi") == 0;
+    if (argc != 5 && !(modo_multi && argc == 6)) {
         printf("Uso: %s <IP_BROKER> <PUERTO> <TOPIC> <ARCHIVO_MENSAJES>\n", argv[0]);
+        printf("     %s <IP_BROKER> <PUERTO> --multi <DIRECTORIO|MANIFIESTO> [INTERVALO_MS]\n", argv[0]);
         return 1;
     }
 
@@ -44,6 +82,14 @@ int main(int argc, char *argv[]) {
     broker_addr.sin_port = htons(port);
     broker_addr.sin_addr.s_addr = inet_addr(broker_ip);
 
+    if (modo_multi) {
+        uint32_t intervalo_ms = argc == 6 ? (uint32_t)atoi(argv[5]) : 0;
+        int ok = publicar_multiples_partidos(sockfd, &broker_addr, archivo, intervalo_ms);
+        closesocket(sockfd);
+        WSACleanup();
+        return ok ? 0 : 1;
+    }
+
     // Abrir archivo de mensajes
     FILE *file = fopen(archivo, "r");
     if (!file) {
@@ -59,11 +105,10 @@ int main(int argc, char *argv[]) {
     while (fgets(mensaje, sizeof(mensaje), file)) {
         mensaje[strcspn(mensaje, "\n")] = '\0';  
 
-        time_t t = time(NULL);
-        struct tm *tm_info = localtime(&t);
-        char hora[10]; 
-        strftime(hora, sizeof(hora), "%H:%M:%S", tm_info);
-        snprintf(buffer_envio, sizeof(buffer_envio), "PUBLISHER|%s|%s|%s", topic, hora, mensaje);
+        char hora[LATENCY_STAMP_ORIGIN_LEN + 1];
+        LatencyStampOrigin(hora);
+        snprintf(buffer_envio, sizeof(buffer_envio), "PUBLISHER|%s|%s%s|%s", topic,
+                 EventPriorityMark(EventPriorityClassify(mensaje)), hora, mensaje);
         sendto(sockfd, buffer_envio, strlen(buffer_envio), 0, (struct sockaddr*)&broker_addr, sizeof(broker_addr));
         printf("[PUBLISHER] Mensaje enviado: %s\n", buffer_envio);
         msg_id++;
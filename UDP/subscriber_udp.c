@@ -3,14 +3,28 @@
 #include <string.h>
 #include <winsock2.h> // Creacion de sockets nativa de windows
 #include <ws2tcpip.h> // Manejo de direcciones IP en windows
+#include "../common/latency_stamp.h" // Latencia publisher->broker y broker->subscriber
+#include "../common/message_sink.h" // Salida agrupada de los mensajes (--salida)
 #pragma comment(lib, "ws2_32.lib")
 
 #define MAX_MSG_LEN 512
 
+// Histogramas por tramo (~70 KB), por eso globales y no en la pila.
+LatencyStats latencias;
+MessageSink salida;
+
 int main(int argc, char *argv[]) {
 
-    if (argc != 4) {
-        printf("Uso: %s <IP_BROKER> <PUERTO> <TOPIC>\n", argv[0]);
+    const char *tipo_salida = NULL;
+    if (argc == 6 && strcmp(argv[4], "--salida") == 0) {
+        tipo_salida = argv[5];
+    } else if (argc != 4) {
+        printf("Uso: %s <IP_BROKER> <PUERTO> <TOPIC> [--salida texto|texto:RUTA|binario:RUTA|nula]\n", argv[0]);
+        printf("  --salida  Destino de los mensajes recibidos (por defecto texto en la consola)\n");
+        return 1;
+    }
+    if (!MessageSinkOpen(&salida, tipo_salida)) {
+        printf("Salida invalida o no se pudo abrir: %s\n", tipo_salida);
         return 1;
     }
 
@@ -49,16 +63,42 @@ int main(int argc, char *argv[]) {
 
     printf("[SUBSCRIBER] Suscrito al partido %s\n", topic);
 
-    // Recibir mensajes del broker
+    // Recibir mensajes del broker; un datagrama "#<origen>#<ingreso>|mensaje" trae las marcas de latencia.
+    LatencyStatsInit(&latencias);
     while (1) {
-        memset(buffer, 0, sizeof(buffer));
-        int n = recvfrom(sockfd, buffer, MAX_MSG_LEN, 0, NULL, NULL);
+        // select espera a lo sumo MESSAGE_SINK_FLUSH_MS sin trafico para vaciar lo que quedo en el buffer de salida;
+        // el socket queda bloqueante y sin SO_RCVTIMEO, igual que en el subscriber TCP.
+        fd_set lectura;
+        FD_ZERO(&lectura);
+        FD_SET(sockfd, &lectura);
+        struct timeval espera = { 0, MESSAGE_SINK_FLUSH_MS * 1000 };
+        int n = 0;
+        if (select(0, &lectura, NULL, NULL, &espera) > 0) {
+            n = recvfrom(sockfd, buffer, MAX_MSG_LEN - 1, 0, NULL, NULL);
+        }
         if (n > 0) {
+            uint64_t recibido_ns = LatencyStampNowNs();
+            uint64_t origen_ns, ingreso_ns;
             buffer[n] = '\0';
-            printf("[SUBSCRIBER] Mensaje recibido: %s\n", buffer);
+            MessageSinkRecord(&salida, recibido_ns, buffer, (size_t)n);
+            if (n > LATENCY_STAMP_FORWARD_LEN && buffer[LATENCY_STAMP_FORWARD_LEN] == '|' &&
+                LatencyStampParse(buffer, (size_t)n, &origen_ns, &ingreso_ns)) {
+                uint64_t total_us = LatencyStatsRecord(&latencias, origen_ns, ingreso_ns, recibido_ns);
+                MessageSinkPrintf(&salida, "[SUBSCRIBER] Mensaje recibido [+%llu us]: %s\n", (unsigned long long)total_us,
+                                  buffer + LATENCY_STAMP_FORWARD_LEN + 1);
+                if (recibido_ns >= latencias.nextReportNs) {
+                    MessageSinkFlush(&salida);  // el resumen no se adelanta a los mensajes del buffer
+                }
+                LatencyStatsMaybePrint(&latencias, recibido_ns, stdout, "[SUBSCRIBER]");
+            } else {
+                MessageSinkPrintf(&salida, "[SUBSCRIBER] Mensaje recibido: %s\n", buffer);
+            }
+        } else {
+            MessageSinkTick(&salida, LatencyStampNowNs());
         }
     }
 
+    MessageSinkClose(&salida);
     closesocket(sockfd);
     WSACleanup();
     return 0;
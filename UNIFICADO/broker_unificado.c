@@ -0,0 +1,1577 @@
+/*
+ * Archivo: broker_unificado.c
+ * Descripcion: Broker unico para el sistema Publish/Subscribe de noticias deportivas que escucha TCP, UDP y QUIC
+ *              a la vez. Con los brokers separados un publisher TCP no llega a un subscriptor QUIC o UDP, porque
+ *              cada programa tiene su propia tabla; aqui todas las suscripciones comparten una sola tabla de
+ *              enrutamiento y un evento se reparte entre los tres transportes dentro del mismo proceso.
+ *
+ * PROTOCOLOS (los mismos de cada broker, asi los clientes existentes funcionan sin cambios):
+ *    TCP  (--tcp, por defecto 8000)   Como broker_tcp: la primera linea identifica la conexion; los subscriptores
+ *                                     envian SUBSCRIBE|filtro y UNSUBSCRIBE|filtro y reciben "[hora] topic: mensaje".
+ *    UDP  (--udp, por defecto 5001)   Como broker_udp: datagramas SUBSCRIBER|topic y PUBLISHER|topic|hora|mensaje;
+ *                                     el subscriptor recibe el mensaje (o "#<origen>#<ingreso>|mensaje").
+ *    QUIC (--quic, por defecto 5000)  Como broker_quic: lineas SUBSCRIBER|topic y PUBLISHER|... por stream; el
+ *                                     subscriptor recibe SUBSCRIBED|topic y luego "hora|mensaje". Solo se activa con
+ *                                     certificado (--pfx o --cert/--key).
+ *    SHM  (por el puerto TCP)         Subscribers en la misma maquina: la primera linea (o una posterior) de una
+ *                                     conexion TCP es SHM|filtro y el broker responde
+ *                                     "SHM|filtro|<segmento>|<retenidos>"; los mensajes se leen de ese segmento.
+ *    Un puerto 0 desactiva ese transporte.
+ *
+ * TABLA COMPARTIDA:
+ *    Todas las suscripciones son entradas de una RoutingTable (../common/routing.h) con un unico RoutingTransport
+ *    que despacha segun el transporte de la entrada (RouteExtra). El fan-out de un evento resuelve una sola vez
+ *    los filtros que coinciden, sin importar por donde llego el publisher ni por donde escucha cada subscriptor;
+ *    los mensajes retenidos y los grupos de consumo "$share/<grupo>/<filtro>" mezclan transportes.
+ *
+ * UNA COPIA POR EVENTO:
+ *    Cada evento se arma una sola vez como sobre "topic|hora|mensaje\n" (SharedEvent, con contador de
+ *    referencias). QUIC envia el sufijo "hora|mensaje\n" apuntando al sobre: cada StreamSend toma una referencia
+ *    y la suelta en SEND_COMPLETE. UDP envia el mensaje (con las marcas de latencia si las hay) desde el mismo
+ *    buffer. Solo TCP usa otro formato: la linea "[hora] topic: mensaje\n" se arma una vez por evento y la
+ *    comparten todas las conexiones TCP; una conexion lenta la copia a su cola de salida.
+ *
+ * MEMORIA COMPARTIDA:
+ *    Cada filtro pedido por SHM| tiene un canal: un anillo de un escritor y muchos lectores
+ *    (../common/shm_ring.h) y una sola entrada en la tabla, sin importar cuantos procesos lo lean. El fan-out
+ *    copia el sobre del evento una vez en el anillo; cada subscriber local lo mapea y lee a su ritmo, y si se
+ *    atrasa mas de --shm-ranuras mensajes los pierde (y los cuenta) en lugar de frenar al broker. La conexion
+ *    TCP solo lleva el control: al cerrarse se suelta el canal, y el ultimo lector elimina el segmento. Los
+ *    grupos "$share/..." no se ofrecen por SHM porque todos los lectores de un anillo ven todos los mensajes.
+ *
+ * HILOS:
+ *    El hilo principal atiende TCP y UDP con select(); msquic llama a sus callbacks desde sus propios hilos.
+ *    RoutesLock serializa la tabla y las conexiones TCP. Los sockets TCP de los subscriptores son no bloqueantes y
+ *    lo que no aceptan va a una cola por prioridad (../common/outbound_lanes.h), asi un callback de msquic nunca
+ *    queda esperando a un subscriptor TCP lento. Si un callback deja datos encolados (o una conexion caida)
+ *    despierta al hilo principal con un datagrama a un socket local, para que select vigile ese socket.
+ *
+ * Quedan solo en los brokers separados: el registro persistente y REPLAY, las metricas, la federacion TCP y el
+ * envio agrupado, los workers y el stream de prioridad de QUIC.
+ *
+ * LIBRERIAS UTILIZADAS Y JUSTIFICACION:
+ *
+ * 1. msquic.h
+ *    - Por que: Listener QUIC en el mismo proceso que los sockets TCP y UDP.
+ *    - Funciones usadas: MsQuicOpen2(), MsQuicClose(), MsQuic->RegistrationOpen(), MsQuic->ConfigurationOpen(),
+ *      MsQuic->ConfigurationLoadCredential(), MsQuic->ListenerOpen(), MsQuic->ListenerStart(),
+ *      MsQuic->SetCallbackHandler(), MsQuic->ConnectionSetConfiguration(), MsQuic->StreamSend().
+ *    - Alternativa considerada: Reenviar entre los tres brokers por sockets locales; descartado porque cada evento
+ *      cruzaria procesos y se copiaria una vez por broker.
+ *
+ * 2. winsock2.h / ws2tcpip.h
+ *    - Por que: Sockets TCP y UDP y select() del hilo principal.
+ *    - Funciones usadas: socket(), bind(), listen(), accept(), recv(), send(), recvfrom(), sendto(), select(),
+ *      ioctlsocket(), getsockname(), closesocket().
+ *
+ * 3. windows.h (via ../QUIC/quic_platform.h)
+ *    - Por que: CRITICAL_SECTION para compartir la tabla entre el hilo principal y los callbacks de msquic, e
+ *      InterlockedIncrement()/InterlockedDecrement() para las referencias de cada evento.
+ *    - Alternativa considerada: Un hilo dedicado que reciba los eventos QUIC por una cola; descartado porque
+ *      agregaria un salto mas a cada evento QUIC.
+ *
+ * 4. stdio.h / stdlib.h / string.h (libreria estandar)
+ *    - Por que: Diagnostico, memoria de los eventos y separacion de las lineas.
+ *    - Funciones usadas: printf(), fprintf(), snprintf(), malloc(), calloc(), free(), atoi(), memcpy(), memchr(),
+ *      strcmp(), strncmp(), strlen().
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <msquic.h>
+#include "../QUIC/quic_platform.h"
+#include "../common/routing.h"
+#include "../common/latency_stamp.h"
+#include "../common/outbound_lanes.h"
+#include "../common/shm_ring.h"
+
+#pragma comment(lib, "ws2_32.lib")
+
+#define DEFAULT_TCP_PORT 8000
+#define DEFAULT_UDP_PORT 5001
+#define DEFAULT_QUIC_PORT 5000
+#define MAX_TCP_CLIENTS 20            /* Por tipo, como broker_tcp; select de Windows vigila hasta 64 sockets. */
+#define TCP_LINE_LEN 1024
+#define DATAGRAM_MAX_LEN 512
+#define QUIC_MESSAGE_MAX_LEN 512
+#define INITIAL_ROUTE_CAPACITY 256
+#define DEFAULT_MAX_SUBSCRIPTIONS 131072
+#define DEFAULT_RETAINED_MESSAGES 8
+#define PEER_BIDI_STREAMS 256
+#define MAX_SHM_CHANNELS 32           /* Bits de TcpSubscriber.shmChannels. */
+#define NO_INDEX ROUTING_NO_INDEX
+
+typedef enum TransportKind {
+    TRANSPORT_TCP = 0,
+    TRANSPORT_UDP,
+    TRANSPORT_QUIC,
+    TRANSPORT_SHM
+} TransportKind;
+
+static const char* const TransportNames[] = { "TCP", "UDP", "QUIC", "SHM" };
+
+/*
+ * Estado extra de cada entrada de la tabla: el transporte y, en UDP, la direccion del subscriptor. En la
+ * RoutingEntry, handle es el socket TCP o el stream QUIC y owner la conexion (TcpSubscriber o QuicClient), el
+ * ShmChannel en SHM, o NULL en UDP, que no tiene conexion.
+ */
+typedef struct RouteExtra {
+    uint8_t kind;
+    struct sockaddr_in udpAddress;
+} RouteExtra;
+
+/* Sobre "topic|hora|mensaje\n" de un evento; se libera cuando el ultimo envio QUIC que lo referencia termina. */
+typedef struct SharedEvent {
+    volatile LONG references;
+    uint32_t length;
+    char data[];
+} SharedEvent;
+
+typedef struct TcpPublisher {
+    SOCKET socket;
+    char pending[TCP_LINE_LEN];
+    int length;
+} TcpPublisher;
+
+/* Una conexion puede seguir varios filtros; subscriptions guarda los indices de sus entradas. */
+typedef struct TcpSubscriber {
+    SOCKET socket;
+    char pending[TCP_LINE_LEN];
+    int length;
+    int32_t* subscriptions;
+    int count;
+    int capacity;
+    uint64_t lastPublication;     /* Un evento que coincide con varios filtros se envia una sola vez. */
+    int failed;                   /* El hilo principal la cierra en la proxima vuelta. */
+    uint32_t shmChannels;         /* Canales SHM que lee el proceso de esta conexion (bit i = ShmChannels[i]). */
+    OutboundLanes output;
+} TcpSubscriber;
+
+/* Anillo compartido de un filtro; readers cuenta las conexiones de control que lo usan (0 = libre). */
+typedef struct ShmChannel {
+    ShmRing ring;
+    int32_t routeIndex;
+    int readers;
+} ShmChannel;
+
+typedef struct QuicClient {
+    HQUIC connection;
+    int32_t subscriberIndex;
+    volatile LONG pendingSends;   /* Envios sin SEND_COMPLETE; lo usa el reparto por carga de los grupos. */
+} QuicClient;
+
+/* receiveBuffer solo se reserva mientras hay un fragmento de mensaje sin '\n' pendiente. */
+typedef struct QuicStream {
+    QuicClient* client;
+    char* receiveBuffer;
+    uint16_t receiveLength;
+    uint8_t truncated;
+} QuicStream;
+
+/* msquic conserva el QUIC_BUFFER hasta SEND_COMPLETE. Apunta al sobre compartido (event) o a una copia propia. */
+typedef struct QuicSend {
+    QUIC_BUFFER buffer;
+    SharedEvent* event;
+    uint8_t* owned;
+    QuicClient* queuedFor;
+} QuicSend;
+
+typedef struct BrokerOptions {
+    int tcpPort;
+    int udpPort;
+    int quicPort;
+    const char* pfxPath;
+    const char* pfxPassword;
+    const char* certFile;
+    const char* keyFile;
+    int maxSubscriptions;
+    int retainedMessages;
+    RoutingGroupPolicy groupPolicy;
+    OutboundPolicy lanePolicy;
+    int shmSlots;
+    int verbose;
+} BrokerOptions;
+
+static const QUIC_API_TABLE* MsQuic = NULL;
+static HQUIC Registration = NULL;
+static HQUIC Configuration = NULL;
+static HQUIC Listener = NULL;
+static const char* const DEFAULT_ALPN = "sports-pubsub";
+
+/* Tabla compartida por los tres transportes; todo acceso va con RoutesLock tomado. */
+static RoutingTable Routes;
+static RoutingPlan FanoutPlan;
+static CRITICAL_SECTION RoutesLock;
+
+static TcpPublisher TcpPublishers[MAX_TCP_CLIENTS];
+static TcpSubscriber TcpSubscribers[MAX_TCP_CLIENTS];
+static OutboundPolicy LanePolicy = OUTBOUND_STRICT;
+static SOCKET UdpSocket = INVALID_SOCKET;
+static SOCKET WakeSocket = INVALID_SOCKET;
+static struct sockaddr_in WakeAddress;
+static int WakePending = 0;
+static int MainThreadInside = 0;  /* El hilo principal tiene RoutesLock: no hace falta despertarlo. */
+static ShmChannel ShmChannels[MAX_SHM_CHANNELS];
+static uint32_t ShmSlots = SHM_RING_DEFAULT_SLOTS;
+static uint32_t ShmGeneration = 0;
+static int TcpPort = DEFAULT_TCP_PORT;
+static int Verbose = 0;
+
+/* Evento que RoutingPublishTo esta entregando y su linea TCP, armada con el primer subscriptor TCP. */
+static uint64_t PublicationNumber = 0;
+static SharedEvent* CurrentEvent = NULL;
+static char TcpLine[TCP_LINE_LEN];
+static uint32_t TcpLineLength = 0;
+static int32_t RepeatedDeliveries = 0;
+
+/* ---------------------------------------------------------------------------------------------------------
+ * Sobre de cada evento y formato de cada transporte
+ * --------------------------------------------------------------------------------------------------------- */
+
+static void ReleaseEvent(SharedEvent* event) {
+    if (event != NULL && InterlockedDecrement(&event->references) == 0) {
+        free(event);
+    }
+}
+
+/* Separa "topic|hora|mensaje\n" (el topic y la hora no contienen '|'). */
+static int EnvelopeSplit(const char* envelope, uint32_t length, uint32_t* topicLength, uint32_t* timestampLength) {
+    const char* topicEnd = (const char*)memchr(envelope, '|', length);
+    if (topicEnd == NULL) {
+        return 0;
+    }
+    const char* timestamp = topicEnd + 1;
+    const char* timestampEnd = (const char*)memchr(timestamp, '|', length - (uint32_t)(timestamp - envelope));
+    if (timestampEnd == NULL) {
+        return 0;
+    }
+    *topicLength = (uint32_t)(topicEnd - envelope);
+    *timestampLength = (uint32_t)(timestampEnd - timestamp);
+    return 1;
+}
+
+/* Linea de broker_tcp, "[hora] topic: mensaje\n"; devuelve 0 si el sobre es invalido. */
+static uint32_t FormatTcpLine(char* line, size_t size, const char* envelope, uint32_t length) {
+    uint32_t topicLength, timestampLength;
+    if (!EnvelopeSplit(envelope, length, &topicLength, &timestampLength)) {
+        return 0;
+    }
+    const char* timestamp = envelope + topicLength + 1;
+    const char* body = timestamp + timestampLength + 1;
+    int written = snprintf(line, size, "[%.*s] %.*s: %.*s", (int)timestampLength, timestamp, (int)topicLength,
+                           envelope, (int)(envelope + length - body), body);
+    if (written >= (int)size) {
+        written = (int)size - 1;
+        line[written - 1] = '\n';
+    }
+    return (uint32_t)written;
+}
+
+/* Datagrama de broker_udp dentro del sobre: el mensaje, o "#<origen>#<ingreso>|mensaje" con marcas, sin '\n'. */
+static int UdpSlice(const char* envelope, uint32_t length, const char** data, uint32_t* size) {
+    uint32_t topicLength, timestampLength;
+    if (!EnvelopeSplit(envelope, length, &topicLength, &timestampLength)) {
+        return 0;
+    }
+    const char* timestamp = envelope + topicLength + 1;
+    int stamped = timestampLength == LATENCY_STAMP_FORWARD_LEN && timestamp[0] == '#';
+    *data = stamped ? timestamp : timestamp + timestampLength + 1;
+    *size = (uint32_t)(envelope + length - 1 - *data);
+    if (*size > DATAGRAM_MAX_LEN - 1) {
+        *size = DATAGRAM_MAX_LEN - 1;  /* lo que lee subscriber_udp */
+    }
+    return 1;
+}
+
+/* ---------------------------------------------------------------------------------------------------------
+ * TCP (las funciones se llaman con RoutesLock tomado, desde el hilo principal o desde un callback de msquic)
+ * --------------------------------------------------------------------------------------------------------- */
+
+static void WakeMainLoop(void) {
+    if (!MainThreadInside && !WakePending && WakeSocket != INVALID_SOCKET) {
+        WakePending = 1;
+        sendto(WakeSocket, "w", 1, 0, (struct sockaddr*)&WakeAddress, sizeof(WakeAddress));
+    }
+}
+
+static void TcpFail(TcpSubscriber* subscriber, const char* detail) {
+    fprintf(stderr, "[BROKER] %s (socket %d): %d\n", detail, (int)subscriber->socket, WSAGetLastError());
+    subscriber->failed = 1;
+    WakeMainLoop();
+}
+
+/* Envia lo encolado hasta que el socket deje de aceptar datos; el carril lo elige la politica de --prioridad. */
+static void FlushTcpOutput(TcpSubscriber* subscriber) {
+    const char* data;
+    uint32_t length;
+    while (!subscriber->failed && OutboundLanesPeek(&subscriber->output, &data, &length)) {
+        int sent = send(subscriber->socket, data, (int)length, 0);
+        if (sent == SOCKET_ERROR) {
+            if (WSAGetLastError() != WSAEWOULDBLOCK) {
+                TcpFail(subscriber, "Error al enviar a subscriber TCP");
+            }
+            return;
+        }
+        OutboundLanesConsume(&subscriber->output, (uint32_t)sent);
+    }
+}
+
+/* Con la cola vacia se envia directo; lo que el socket no acepta va al carril de la prioridad del evento. */
+static int TcpEnqueue(TcpSubscriber* subscriber, EventPriority priority, const char* line, uint32_t length) {
+    uint32_t sent = 0;
+    if (OutboundLanesEmpty(&subscriber->output)) {
+        int result = send(subscriber->socket, line, (int)length, 0);
+        if (result == (int)length) {
+            return 1;
+        }
+        if (result == SOCKET_ERROR && WSAGetLastError() != WSAEWOULDBLOCK) {
+            TcpFail(subscriber, "Error al enviar a subscriber TCP");
+            return 0;
+        }
+        sent = result == SOCKET_ERROR ? 0 : (uint32_t)result;
+    }
+    OutboundLanesPush(&subscriber->output, priority, line, length, sent);
+    WakeMainLoop();  /* select debe vigilar la escritura de este socket */
+    return 1;
+}
+
+static int TcpDeliver(RoutingTable* table, int32_t index, const char* message, uint32_t length) {
+    TcpSubscriber* subscriber = (TcpSubscriber*)table->entries[index].owner;
+    if (subscriber->failed) {
+        return 0;
+    }
+    if (CurrentEvent == NULL || message != CurrentEvent->data) {
+        char line[TCP_LINE_LEN];
+        uint32_t lineLength = FormatTcpLine(line, sizeof(line), message, length);
+        return lineLength == 0 || TcpEnqueue(subscriber, table->deliveryPriority, line, lineLength);
+    }
+    if (subscriber->lastPublication == PublicationNumber) {
+        RepeatedDeliveries++;
+        return 1;
+    }
+    subscriber->lastPublication = PublicationNumber;
+    if (TcpLineLength == 0) {
+        TcpLineLength = FormatTcpLine(TcpLine, sizeof(TcpLine), message, length);
+    }
+    return TcpLineLength == 0 || TcpEnqueue(subscriber, table->deliveryPriority, TcpLine, TcpLineLength);
+}
+
+/* ---------------------------------------------------------------------------------------------------------
+ * QUIC: envios
+ * --------------------------------------------------------------------------------------------------------- */
+
+static void FreeQuicSend(QuicSend* send) {
+    if (send->queuedFor != NULL) {
+        InterlockedDecrement(&send->queuedFor->pendingSends);
+    }
+    ReleaseEvent(send->event);
+    free(send->owned);
+    free(send);
+}
+
+/* Con event el buffer apunta al sobre (toma una referencia); sin el, se copia. */
+static int QuicSendSlice(HQUIC stream, QuicClient* client, SharedEvent* event, const char* data, uint32_t length) {
+    QuicSend* send = (QuicSend*)calloc(1, sizeof(QuicSend));
+    if (send == NULL) {
+        return 0;
+    }
+    if (event != NULL) {
+        InterlockedIncrement(&event->references);
+        send->event = event;
+    } else {
+        send->owned = (uint8_t*)malloc(length);
+        if (send->owned == NULL) {
+            free(send);
+            return 0;
+        }
+        memcpy(send->owned, data, length);
+        data = (const char*)send->owned;
+    }
+    if (client != NULL) {
+        InterlockedIncrement(&client->pendingSends);
+        send->queuedFor = client;
+    }
+    send->buffer.Buffer = (uint8_t*)data;
+    send->buffer.Length = length;
+    if (QUIC_FAILED(MsQuic->StreamSend(stream, &send->buffer, 1, QUIC_SEND_FLAG_NONE, send))) {
+        FreeQuicSend(send);
+        return 0;
+    }
+    return 1;
+}
+
+static int QuicSendText(HQUIC stream, const char* text) {
+    return QuicSendSlice(stream, NULL, NULL, text, (uint32_t)strlen(text));
+}
+
+static int QuicDeliver(RoutingTable* table, int32_t index, const char* message, uint32_t length) {
+    RoutingEntry* entry = &table->entries[index];
+    uint32_t topicLength, timestampLength;
+    if (!EnvelopeSplit(message, length, &topicLength, &timestampLength)) {
+        return 1;
+    }
+    SharedEvent* event = CurrentEvent != NULL && message == CurrentEvent->data ? CurrentEvent : NULL;
+    if (!QuicSendSlice((HQUIC)entry->handle, (QuicClient*)entry->owner, event, message + topicLength + 1,
+                       length - topicLength - 1)) {
+        fprintf(stderr, "[BROKER] Error enviando a subscriptor QUIC (%s). Se eliminaran sus datos.\n",
+                RoutingTopicName(table, entry->topicId));
+        return 0;
+    }
+    return 1;
+}
+
+/* Mensajes retenidos a un subscriptor QUIC: el anillo puede sobrescribirse, asi que van copiados en un solo envio. */
+static int QuicDeliverRetained(RoutingTable* table, int32_t index, const RoutingSpan* spans, int32_t count) {
+    RoutingEntry* entry = &table->entries[index];
+    char* joined = (char*)malloc((size_t)count * QUIC_MESSAGE_MAX_LEN);
+    if (joined == NULL) {
+        return 0;
+    }
+    uint32_t total = 0;
+    for (int32_t i = 0; i < count; ++i) {
+        uint32_t topicLength, timestampLength;
+        if (EnvelopeSplit(spans[i].data, spans[i].length, &topicLength, &timestampLength)) {
+            uint32_t length = spans[i].length - topicLength - 1;
+            if (length > QUIC_MESSAGE_MAX_LEN) {
+                length = QUIC_MESSAGE_MAX_LEN;
+            }
+            memcpy(joined + total, spans[i].data + topicLength + 1, length);
+            total += length;
+        }
+    }
+    int sent = total == 0 || QuicSendSlice((HQUIC)entry->handle, NULL, NULL, joined, total);
+    free(joined);
+    return sent;
+}
+
+/* ---------------------------------------------------------------------------------------------------------
+ * Transporte unificado del nucleo de enrutamiento (los callbacks se llaman con RoutesLock tomado)
+ * --------------------------------------------------------------------------------------------------------- */
+
+static RouteExtra* ExtraOf(RoutingTable* table, int32_t index) {
+    return (RouteExtra*)RoutingEntryExtra(table, index);
+}
+
+static int UnifiedDeliver(void* context, RoutingTable* table, int32_t index, const char* message, uint32_t length) {
+    (void)context;
+    RouteExtra* extra = ExtraOf(table, index);
+    switch (extra->kind) {
+    case TRANSPORT_TCP:
+        return TcpDeliver(table, index, message, length);
+    case TRANSPORT_UDP: {
+        /* UDP no tiene conexion: un error de sendto no implica que el subscriptor se haya ido. */
+        const char* data;
+        uint32_t size;
+        if (UdpSlice(message, length, &data, &size)) {
+            sendto(UdpSocket, data, (int)size, 0, (struct sockaddr*)&extra->udpAddress, sizeof(extra->udpAddress));
+        }
+        return 1;
+    }
+    case TRANSPORT_SHM:
+        /* El sobre entra tal cual al anillo: una copia por evento para todos los lectores del canal. */
+        ShmRingWrite(&((ShmChannel*)table->entries[index].owner)->ring, message, length);
+        return 1;
+    default:
+        return QuicDeliver(table, index, message, length);
+    }
+}
+
+static int UnifiedDeliverBatch(void* context, RoutingTable* table, int32_t index, const RoutingSpan* spans, int32_t count) {
+    if (ExtraOf(table, index)->kind == TRANSPORT_QUIC) {
+        return QuicDeliverRetained(table, index, spans, count);
+    }
+    for (int32_t i = 0; i < count; ++i) {
+        if (!UnifiedDeliver(context, table, index, spans[i].data, spans[i].length)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void UnifiedRelease(void* context, RoutingTable* table, int32_t index) {
+    (void)context;
+    RoutingEntry* entry = &table->entries[index];
+    uint8_t kind = ExtraOf(table, index)->kind;
+    if (kind == TRANSPORT_TCP) {
+        TcpSubscriber* subscriber = (TcpSubscriber*)entry->owner;
+        for (int i = 0; i < subscriber->count; ++i) {
+            if (subscriber->subscriptions[i] == index) {
+                subscriber->subscriptions[i] = subscriber->subscriptions[--subscriber->count];
+                break;
+            }
+        }
+        printf("[BROKER] Socket TCP %d dado de baja de '%s'\n", (int)subscriber->socket,
+               RoutingTopicName(table, entry->topicId));
+    } else if (kind == TRANSPORT_QUIC && entry->owner != NULL) {
+        ((QuicClient*)entry->owner)->subscriberIndex = NO_INDEX;
+    }
+}
+
+/* Envios pendientes de cada subscriptor para el reparto por carga de los grupos; UDP y SHM no tienen cola. */
+static uint32_t UnifiedQueueDepth(void* context, RoutingTable* table, int32_t index) {
+    (void)context;
+    RoutingEntry* entry = &table->entries[index];
+    switch (ExtraOf(table, index)->kind) {
+    case TRANSPORT_TCP:
+        return ((TcpSubscriber*)entry->owner)->output.queued;
+    case TRANSPORT_QUIC:
+        return entry->owner != NULL ? (uint32_t)((QuicClient*)entry->owner)->pendingSends : 0;
+    default:
+        return 0;
+    }
+}
+
+static const RoutingTransport UnifiedTransport = {
+    "unificado", NULL, UnifiedDeliver, UnifiedRelease, NULL, UnifiedDeliverBatch, UnifiedQueueDepth
+};
+
+/*
+ * Debe llamarse con RoutesLock tomado. line es "PUBLISHER|topic|hora|mensaje" sin '\n' y con espacio para un
+ * '\0' en line[length]. El sobre se arma una vez y lo comparten los tres transportes.
+ */
+static void PublishEvent(char* line, size_t length, TransportKind source) {
+    uint64_t ingressNs = LatencyStampNowNs();
+    RoutingPublish publish;
+    if (!RoutingParsePublish(line, length, &publish)) {
+        fprintf(stderr, "[BROKER] Mensaje de publisher %s malformado: %s\n", TransportNames[source], line);
+        return;
+    }
+
+    char stamps[LATENCY_STAMP_FORWARD_LEN + 1];
+    const char* timestamp = LatencyStampForward(publish.timestamp, ingressNs, stamps);
+    size_t topicLength = strlen(publish.topic);
+    size_t timestampLength = strlen(timestamp);
+    size_t bodyLength = strlen(publish.body);
+    size_t envelopeLength = topicLength + timestampLength + bodyLength + 3;
+    SharedEvent* event = (SharedEvent*)malloc(offsetof(SharedEvent, data) + envelopeLength);
+    if (event == NULL) {
+        fprintf(stderr, "[BROKER] Sin memoria para el evento de '%s'.\n", publish.topic);
+        return;
+    }
+    event->references = 1;  /* la del broker, hasta terminar el fan-out */
+    event->length = (uint32_t)envelopeLength;
+    char* cursor = event->data;
+    memcpy(cursor, publish.topic, topicLength);
+    cursor += topicLength;
+    *cursor++ = '|';
+    memcpy(cursor, timestamp, timestampLength);
+    cursor += timestampLength;
+    *cursor++ = '|';
+    memcpy(cursor, publish.body, bodyLength);
+    cursor[bodyLength] = '\n';
+
+    PublicationNumber++;
+    CurrentEvent = event;
+    TcpLineLength = 0;
+    RepeatedDeliveries = 0;
+    FanoutPlan.priority = publish.priority;
+    int32_t delivered = RoutingPublishTo(&Routes, &FanoutPlan, publish.topic, event->data, event->length);
+    if (delivered < 0) {
+        fprintf(stderr, "[BROKER] Memoria insuficiente para enrutar un evento de '%s'; no se entrego.\n", publish.topic);
+        delivered = 0;
+    }
+    delivered -= RepeatedDeliveries;
+    CurrentEvent = NULL;
+    ReleaseEvent(event);
+
+    if (Verbose) {
+        printf("[BROKER] Evento %s en '%s' (prioridad %s) entregado a %d subscriptores\n", TransportNames[source],
+               publish.topic, EventPriorityName(publish.priority), (int)delivered);
+    }
+}
+
+/* ---------------------------------------------------------------------------------------------------------
+ * TCP: conexiones (hilo principal, con RoutesLock tomado)
+ * --------------------------------------------------------------------------------------------------------- */
+
+/* Suscripcion de la conexion al filtro (o al grupo "$share/<grupo>/<filtro>"), o NO_INDEX si no la tiene. */
+static int32_t TcpFindSubscription(TcpSubscriber* subscriber, const char* filter) {
+    int32_t topicId, groupId;
+    if (!RoutingResolveSubscription(&Routes, filter, 0, &topicId, &groupId)) {
+        return NO_INDEX;
+    }
+    for (int i = 0; i < subscriber->count; ++i) {
+        RoutingEntry* entry = &Routes.entries[subscriber->subscriptions[i]];
+        if (entry->topicId == topicId && entry->groupId == groupId) {
+            return subscriber->subscriptions[i];
+        }
+    }
+    return NO_INDEX;
+}
+
+static int32_t TcpAddSubscription(TcpSubscriber* subscriber, const char* filter) {
+    char normalized[ROUTING_TOPIC_LEN];
+    if (RoutingNormalizeTopic(normalized, filter, strlen(filter)) == 0) {
+        return NO_INDEX;
+    }
+    int32_t existing = TcpFindSubscription(subscriber, normalized);
+    if (existing != NO_INDEX) {
+        return existing;
+    }
+    if (subscriber->count == subscriber->capacity) {
+        int capacity = subscriber->capacity == 0 ? 4 : subscriber->capacity * 2;
+        int32_t* grown = (int32_t*)realloc(subscriber->subscriptions, sizeof(int32_t) * (size_t)capacity);
+        if (grown == NULL) {
+            return NO_INDEX;
+        }
+        subscriber->subscriptions = grown;
+        subscriber->capacity = capacity;
+    }
+
+    int32_t index = RoutingSubscribe(&Routes, normalized, (void*)(uintptr_t)subscriber->socket, subscriber);
+    if (index == NO_INDEX) {
+        return NO_INDEX;
+    }
+    ExtraOf(&Routes, index)->kind = TRANSPORT_TCP;
+    subscriber->subscriptions[subscriber->count++] = index;
+    const char* group = RoutingEntryGroupName(&Routes, index);
+    printf("[BROKER] Socket TCP %d suscrito a '%s'%s%s (%d subscriptores en total)\n", (int)subscriber->socket,
+           RoutingTopicName(&Routes, Routes.entries[index].topicId), group != NULL ? " en el grupo " : "",
+           group != NULL ? group : "", (int)Routes.active);
+    RoutingReplayRetained(&Routes, index);
+    return index;
+}
+
+/* Canal SHM del filtro ya normalizado, o -1 si nadie lo pidio. */
+static int FindShmChannel(const char* filter) {
+    int32_t topicId, groupId;
+    if (!RoutingResolveSubscription(&Routes, filter, 0, &topicId, &groupId)) {
+        return -1;
+    }
+    for (int i = 0; i < MAX_SHM_CHANNELS; ++i) {
+        ShmChannel* channel = &ShmChannels[i];
+        if (channel->readers > 0 && Routes.entries[channel->routeIndex].topicId == topicId) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/* El primer lector de un filtro crea el anillo y su entrada en la tabla, que recibe los mensajes retenidos. */
+static int OpenShmChannel(TcpSubscriber* subscriber, const char* filter, char* normalized) {
+    if (ShmSlots == 0 || RoutingNormalizeTopic(normalized, filter, strlen(filter)) == 0 ||
+        strncmp(normalized, "$share/", 7) == 0) {
+        return -1;
+    }
+    int slot = FindShmChannel(normalized);
+    if (slot < 0) {
+        for (int i = 0; i < MAX_SHM_CHANNELS && slot < 0; ++i) {
+            slot = ShmChannels[i].readers == 0 ? i : -1;
+        }
+        if (slot < 0) {
+            return -1;
+        }
+        ShmChannel* channel = &ShmChannels[slot];
+        char name[SHM_RING_NAME_LEN];
+        ShmRingFormatName(name, sizeof(name), TcpPort, slot, ++ShmGeneration);
+        if (!ShmRingCreate(&channel->ring, name, ShmSlots, SHM_RING_SLOT_BYTES)) {
+            fprintf(stderr, "[BROKER] No se pudo crear el segmento compartido %s.\n", name);
+            return -1;
+        }
+        channel->routeIndex = RoutingSubscribe(&Routes, normalized, NULL, channel);
+        if (channel->routeIndex == NO_INDEX) {
+            ShmRingClose(&channel->ring);
+            return -1;
+        }
+        ExtraOf(&Routes, channel->routeIndex)->kind = TRANSPORT_SHM;
+        RoutingReplayRetained(&Routes, channel->routeIndex);
+        printf("[BROKER] Canal SHM '%s' en %s (%u ranuras de %u bytes)\n", normalized, name,
+               channel->ring.header->slotCount, SHM_RING_SLOT_BYTES);
+    }
+    if ((subscriber->shmChannels & (1u << slot)) == 0) {
+        subscriber->shmChannels |= 1u << slot;
+        ShmChannels[slot].readers++;
+    }
+    return slot;
+}
+
+/* Al irse el ultimo lector se da de baja la entrada y se elimina el segmento. */
+static void ReleaseShmChannel(TcpSubscriber* subscriber, int slot) {
+    ShmChannel* channel = &ShmChannels[slot];
+    subscriber->shmChannels &= ~(1u << slot);
+    if (--channel->readers > 0) {
+        return;
+    }
+    printf("[BROKER] Canal SHM '%s' cerrado\n", RoutingTopicName(&Routes, Routes.entries[channel->routeIndex].topicId));
+    RoutingUnsubscribe(&Routes, channel->routeIndex);
+    ShmRingClose(&channel->ring);
+    channel->routeIndex = NO_INDEX;
+}
+
+static void ProcessShmRequest(TcpSubscriber* subscriber, const char* filter) {
+    char normalized[ROUTING_TOPIC_LEN];
+    char reply[TCP_LINE_LEN];
+    int slot = OpenShmChannel(subscriber, filter, normalized);
+    if (slot < 0) {
+        printf("[BROKER] Canal SHM rechazado: '%s'\n", filter);
+        snprintf(reply, sizeof(reply), "ERROR|%s\n", filter);
+    } else {
+        snprintf(reply, sizeof(reply), "SHM|%s|%s|%u\n", normalized, ShmChannels[slot].ring.name, Routes.retainDepth);
+    }
+    TcpEnqueue(subscriber, EVENT_PRIORITY_HIGH, reply, (uint32_t)strlen(reply));
+}
+
+static void CloseTcpSubscriber(TcpSubscriber* subscriber) {
+    while (subscriber->count > 0) {
+        int before = subscriber->count;
+        RoutingUnsubscribe(&Routes, subscriber->subscriptions[before - 1]);
+        if (subscriber->count == before) {
+            subscriber->count--;  /* la entrada ya se habia dado de baja */
+        }
+    }
+    for (int i = 0; i < MAX_SHM_CHANNELS; ++i) {
+        if (subscriber->shmChannels & (1u << i)) {
+            ReleaseShmChannel(subscriber, i);
+        }
+    }
+    closesocket(subscriber->socket);
+    printf("[BROKER] Subscriber TCP desconectado: socket %d\n", (int)subscriber->socket);
+    if (OutboundLanesDropped(&subscriber->output) > 0) {
+        printf("[BROKER] Socket %d: %llu mensajes descartados por cola llena\n", (int)subscriber->socket,
+               (unsigned long long)OutboundLanesDropped(&subscriber->output));
+    }
+    OutboundLanesFree(&subscriber->output);
+    free(subscriber->subscriptions);
+    memset(subscriber, 0, sizeof(*subscriber));
+}
+
+static void ProcessTcpSubscriberLine(TcpSubscriber* subscriber, char* line) {
+    if (strncmp(line, "SUBSCRIBER|", 11) == 0 || strncmp(line, "SUBSCRIBE|", 10) == 0) {
+        const char* filter = line + (line[9] == 'R' ? 11 : 10);
+        if (TcpAddSubscription(subscriber, filter) == NO_INDEX) {
+            printf("[BROKER] Suscripcion TCP rechazada: '%s'\n", filter);
+        }
+    } else if (strncmp(line, "SHM|", 4) == 0) {
+        ProcessShmRequest(subscriber, line + 4);
+    } else if (strncmp(line, "UNSUBSCRIBE|", 12) == 0) {
+        int32_t index = TcpFindSubscription(subscriber, line + 12);
+        char normalized[ROUTING_TOPIC_LEN];
+        int slot = RoutingNormalizeTopic(normalized, line + 12, strlen(line + 12)) > 0 ? FindShmChannel(normalized) : -1;
+        if (index != NO_INDEX) {
+            RoutingUnsubscribe(&Routes, index);
+        } else if (slot >= 0 && (subscriber->shmChannels & (1u << slot))) {
+            ReleaseShmChannel(subscriber, slot);
+        }
+    } else if (strncmp(line, "REPLAY|", 7) == 0) {
+        printf("[BROKER] REPLAY no disponible en el broker unificado (use broker_tcp --registro): %s\n", line);
+    } else {
+        printf("[BROKER] Comando de subscriber desconocido: %s\n", line);
+    }
+}
+
+/* Un recv puede traer varias lineas o solo parte de una; lo que queda sin '\n' espera en pending. */
+static int AppendLine(char* pending, int* pendingLength, const char** data, int* bytes, int* complete) {
+    const char* newline = (const char*)memchr(*data, '\n', (size_t)*bytes);
+    int chunk = newline != NULL ? (int)(newline - *data) : *bytes;
+    int space = TCP_LINE_LEN - 1 - *pendingLength;
+    int toCopy = chunk < space ? chunk : space;  /* una linea mas larga que el buffer se trunca */
+    memcpy(pending + *pendingLength, *data, (size_t)toCopy);
+    *pendingLength += toCopy;
+    *complete = newline != NULL;
+    if (newline == NULL) {
+        *bytes = 0;
+        return 0;
+    }
+    if (*pendingLength > 0 && pending[*pendingLength - 1] == '\r') {
+        (*pendingLength)--;
+    }
+    pending[*pendingLength] = '\0';
+    *data += chunk + 1;
+    *bytes -= chunk + 1;
+    return *pendingLength;
+}
+
+static void ProcessTcpPublisherData(TcpPublisher* publisher, const char* data, int bytes) {
+    while (bytes > 0) {
+        int complete;
+        int length = AppendLine(publisher->pending, &publisher->length, &data, &bytes, &complete);
+        if (complete) {
+            if (length > 0) {
+                PublishEvent(publisher->pending, (size_t)length, TRANSPORT_TCP);
+            }
+            publisher->length = 0;
+        }
+    }
+}
+
+static void ProcessTcpSubscriberData(TcpSubscriber* subscriber, const char* data, int bytes) {
+    while (bytes > 0 && !subscriber->failed) {
+        int complete;
+        int length = AppendLine(subscriber->pending, &subscriber->length, &data, &bytes, &complete);
+        if (complete) {
+            if (length > 0) {
+                ProcessTcpSubscriberLine(subscriber, subscriber->pending);
+            }
+            subscriber->length = 0;
+        }
+    }
+}
+
+/* La primera lectura (hecha sin RoutesLock) identifica la conexion, como en broker_tcp. */
+static void RegisterTcpClient(SOCKET socket, const char* buffer, int bytes) {
+    if (strncmp(buffer, "PUBLISHER", 9) == 0) {
+        for (int i = 0; i < MAX_TCP_CLIENTS; ++i) {
+            TcpPublisher* publisher = &TcpPublishers[i];
+            if (publisher->socket != 0) {
+                continue;
+            }
+            publisher->socket = socket;
+            publisher->length = 0;
+            printf("[BROKER] Publisher TCP conectado: socket %d\n", (int)socket);
+            const char* identified = (const char*)memchr(buffer, '\n', (size_t)bytes);
+            if (identified != NULL) {
+                ProcessTcpPublisherData(publisher, identified + 1, bytes - (int)(identified - buffer) - 1);
+            }
+            return;
+        }
+    } else if (strncmp(buffer, "SUBSCRIBE", 9) == 0 || strncmp(buffer, "SHM|", 4) == 0) {
+        for (int i = 0; i < MAX_TCP_CLIENTS; ++i) {
+            TcpSubscriber* subscriber = &TcpSubscribers[i];
+            if (subscriber->socket != 0) {
+                continue;
+            }
+            subscriber->socket = socket;
+            /* No bloqueante antes de reenviar retenidos o responder SHM|: se hace con RoutesLock tomado. */
+            u_long nonBlocking = 1;
+            ioctlsocket(socket, FIONBIO, &nonBlocking);
+            OutboundLanesInit(&subscriber->output, LanePolicy);
+            printf("[BROKER] Subscriber TCP conectado: socket %d\n", (int)socket);
+            ProcessTcpSubscriberData(subscriber, buffer, bytes);
+            /* Un cliente anterior puede enviar "SUBSCRIBER|topic" sin '\n'. */
+            if (subscriber->count == 0 && subscriber->shmChannels == 0 && subscriber->length > 0) {
+                subscriber->pending[subscriber->length] = '\0';
+                subscriber->length = 0;
+                ProcessTcpSubscriberLine(subscriber, subscriber->pending);
+            }
+            if (subscriber->count == 0 && subscriber->shmChannels == 0) {
+                CloseTcpSubscriber(subscriber);
+                return;
+            }
+            return;
+        }
+    } else {
+        printf("[BROKER] Tipo de cliente TCP desconocido: %s\n", buffer);
+        closesocket(socket);
+        return;
+    }
+    printf("[BROKER] No se pudo registrar el cliente TCP (maximo %d conexiones)\n", MAX_TCP_CLIENTS);
+    closesocket(socket);
+}
+
+/* ---------------------------------------------------------------------------------------------------------
+ * UDP (hilo principal, con RoutesLock tomado)
+ * --------------------------------------------------------------------------------------------------------- */
+
+static void ProcessDatagram(char* buffer, int length, const struct sockaddr_in* from) {
+    if (strncmp(buffer, "SUBSCRIBER|", 11) == 0) {
+        int32_t index = RoutingSubscribe(&Routes, buffer + 11, NULL, NULL);
+        if (index == NO_INDEX) {
+            printf("[BROKER] Suscripcion UDP rechazada: '%s' (tabla llena o topic invalido)\n", buffer + 11);
+            return;
+        }
+        RouteExtra* extra = ExtraOf(&Routes, index);
+        extra->kind = TRANSPORT_UDP;
+        extra->udpAddress = *from;
+        printf("[BROKER] Nuevo subscriptor UDP a '%s' (%d subscriptores en total)\n",
+               RoutingTopicName(&Routes, Routes.entries[index].topicId), (int)Routes.active);
+        RoutingReplayRetained(&Routes, index);
+    } else if (strncmp(buffer, "PUBLISHER|", 10) == 0) {
+        PublishEvent(buffer, (size_t)length, TRANSPORT_UDP);
+    }
+}
+
+/* ---------------------------------------------------------------------------------------------------------
+ * QUIC: callbacks de msquic (toman RoutesLock para tocar la tabla)
+ * --------------------------------------------------------------------------------------------------------- */
+
+/* Cada conexion QUIC sigue un solo topic, como en broker_quic; SUBSCRIBER| de nuevo cambia el topic. */
+static void QuicSubscribe(QuicClient* client, HQUIC stream, const char* topic) {
+    char topicName[ROUTING_TOPIC_LEN];
+    if (RoutingNormalizeTopic(topicName, topic, strlen(topic)) == 0) {
+        fprintf(stderr, "[BROKER] Solicitud de suscripcion QUIC sin topic.\n");
+        return;
+    }
+
+    /* Alta, confirmacion y retenidos bajo el mismo lock: ningun evento en vivo se intercala. */
+    EnterCriticalSection(&RoutesLock);
+    int32_t index = client->subscriberIndex;
+    int isNew = 0;
+    if (index != NO_INDEX) {
+        int changed = RoutingChangeTopic(&Routes, index, topicName);
+        if (changed < 0) {
+            index = NO_INDEX;
+        } else {
+            Routes.entries[index].handle = stream;
+            isNew = changed > 0;
+        }
+    } else {
+        index = RoutingSubscribe(&Routes, topicName, stream, client);
+        if (index != NO_INDEX) {
+            ExtraOf(&Routes, index)->kind = TRANSPORT_QUIC;
+            client->subscriberIndex = index;
+            isNew = 1;
+        }
+    }
+    char ack[QUIC_MESSAGE_MAX_LEN];
+    snprintf(ack, sizeof(ack), "%s|%s\n", index != NO_INDEX ? "SUBSCRIBED" : "ERROR", topicName);
+    (void)QuicSendText(stream, ack);
+    if (index != NO_INDEX && isNew) {
+        RoutingReplayRetained(&Routes, index);
+        printf("[BROKER] Subscriptor QUIC a '%s' (%d subscriptores en total)\n", topicName, (int)Routes.active);
+    }
+    LeaveCriticalSection(&RoutesLock);
+}
+
+static void QuicUnsubscribe(QuicClient* client, HQUIC stream) {
+    EnterCriticalSection(&RoutesLock);
+    int32_t index = client->subscriberIndex;
+    if (index != NO_INDEX && (stream == NULL || Routes.entries[index].handle == stream)) {
+        RoutingUnsubscribe(&Routes, index);
+    }
+    LeaveCriticalSection(&RoutesLock);
+}
+
+static void DispatchQuicMessage(HQUIC stream, QuicStream* ctx, const char* data, size_t length, int truncated) {
+    char message[QUIC_MESSAGE_MAX_LEN];
+    if (length > QUIC_MESSAGE_MAX_LEN - 1) {
+        length = QUIC_MESSAGE_MAX_LEN - 1;
+        truncated = 1;
+    }
+    memcpy(message, data, length);
+    message[length] = '\0';
+    if (length > 0 && message[length - 1] == '\r') {
+        message[--length] = '\0';
+    }
+    if (truncated) {
+        fprintf(stderr, "[BROKER] Mensaje QUIC truncado (excede %d bytes).\n", QUIC_MESSAGE_MAX_LEN);
+    }
+    if (length == 0) {
+        return;
+    }
+
+    if (strncmp(message, "SUBSCRIBER|", 11) == 0) {
+        QuicSubscribe(ctx->client, stream, message + 11);
+    } else if (strncmp(message, "PUBLISHER|", 10) == 0) {
+        EnterCriticalSection(&RoutesLock);
+        PublishEvent(message, length, TRANSPORT_QUIC);
+        LeaveCriticalSection(&RoutesLock);
+    } else if (strncmp(message, "REPLAY|", 7) == 0) {
+        char topicName[ROUTING_TOPIC_LEN];
+        char error[QUIC_MESSAGE_MAX_LEN];
+        RoutingNormalizeTopic(topicName, message + 7, length - 7);
+        snprintf(error, sizeof(error), "ERROR|%s\n", topicName);
+        (void)QuicSendText(stream, error);
+        fprintf(stderr, "[BROKER] REPLAY no disponible en el broker unificado (use broker_quic --registro).\n");
+    } else {
+        fprintf(stderr, "[BROKER] Mensaje QUIC desconocido: %s\n", message);
+    }
+}
+
+/* Acumula un fragmento sin '\n'; el buffer se reserva aqui y se libera al completar el mensaje. */
+static void AppendQuicPending(QuicStream* ctx, const char* data, size_t length) {
+    if (ctx->receiveBuffer == NULL) {
+        ctx->receiveBuffer = (char*)malloc(QUIC_MESSAGE_MAX_LEN);
+        if (ctx->receiveBuffer == NULL) {
+            ctx->truncated = 1;
+            return;
+        }
+    }
+    size_t remaining = QUIC_MESSAGE_MAX_LEN - 1 - ctx->receiveLength;
+    size_t toCopy = length < remaining ? length : remaining;
+    memcpy(ctx->receiveBuffer + ctx->receiveLength, data, toCopy);
+    ctx->receiveLength = (uint16_t)(ctx->receiveLength + toCopy);
+    if (toCopy < length) {
+        ctx->truncated = 1;
+    }
+}
+
+static void DispatchQuicPending(HQUIC stream, QuicStream* ctx) {
+    if (ctx->receiveBuffer != NULL) {
+        DispatchQuicMessage(stream, ctx, ctx->receiveBuffer, ctx->receiveLength, ctx->truncated);
+    }
+    free(ctx->receiveBuffer);
+    ctx->receiveBuffer = NULL;
+    ctx->receiveLength = 0;
+    ctx->truncated = 0;
+}
+
+/* Un RECEIVE puede traer varios mensajes o solo parte de uno; los completos se despachan desde el buffer de msquic. */
+static void HandleQuicReceive(HQUIC stream, QuicStream* ctx, const QUIC_STREAM_EVENT* event) {
+    for (uint32_t i = 0; i < event->RECEIVE.BufferCount; ++i) {
+        const char* cursor = (const char*)event->RECEIVE.Buffers[i].Buffer;
+        size_t available = event->RECEIVE.Buffers[i].Length;
+        while (available > 0) {
+            const char* newline = (const char*)memchr(cursor, '\n', available);
+            size_t chunk = newline != NULL ? (size_t)(newline - cursor) : available;
+            if (newline != NULL && ctx->receiveLength == 0 && !ctx->truncated) {
+                DispatchQuicMessage(stream, ctx, cursor, chunk, 0);
+            } else {
+                AppendQuicPending(ctx, cursor, chunk);
+                if (newline != NULL) {
+                    DispatchQuicPending(stream, ctx);
+                }
+            }
+            if (newline == NULL) {
+                break;
+            }
+            cursor = newline + 1;
+            available -= chunk + 1;
+        }
+    }
+}
+
+static
+QUIC_STATUS
+QuicStreamCallback(
+    HQUIC stream,
+    void* context,
+    QUIC_STREAM_EVENT* event
+    )
+{
+    QuicStream* ctx = (QuicStream*)context;
+
+    switch (event->Type) {
+    case QUIC_STREAM_EVENT_RECEIVE:
+        HandleQuicReceive(stream, ctx, event);
+        break;
+    case QUIC_STREAM_EVENT_SEND_COMPLETE:
+        FreeQuicSend((QuicSend*)event->SEND_COMPLETE.ClientContext);
+        break;
+    case QUIC_STREAM_EVENT_PEER_SEND_SHUTDOWN:
+        /* Un cliente que no termina su ultimo mensaje en '\n' lo entrega al cerrar su lado del stream. */
+        if (ctx->receiveLength > 0 || ctx->truncated) {
+            DispatchQuicPending(stream, ctx);
+        }
+        break;
+    case QUIC_STREAM_EVENT_SHUTDOWN_COMPLETE:
+        QuicUnsubscribe(ctx->client, stream);
+        MsQuic->StreamClose(stream);
+        free(ctx->receiveBuffer);
+        free(ctx);
+        break;
+    default:
+        break;
+    }
+    return QUIC_STATUS_SUCCESS;
+}
+
+static
+QUIC_STATUS
+QuicConnectionCallback(
+    HQUIC connection,
+    void* context,
+    QUIC_CONNECTION_EVENT* event
+    )
+{
+    QuicClient* client = (QuicClient*)context;
+
+    switch (event->Type) {
+    case QUIC_CONNECTION_EVENT_CONNECTED:
+        MsQuic->ConnectionSendResumptionTicket(connection, QUIC_SEND_RESUMPTION_FLAG_NONE, 0, NULL);
+        break;
+    case QUIC_CONNECTION_EVENT_PEER_STREAM_STARTED: {
+        QuicStream* ctx = (QuicStream*)calloc(1, sizeof(QuicStream));
+        if (ctx == NULL) {
+            MsQuic->StreamShutdown(
+                event->PEER_STREAM_STARTED.Stream,
+                QUIC_STREAM_SHUTDOWN_FLAG_ABORT_RECEIVE | QUIC_STREAM_SHUTDOWN_FLAG_ABORT_SEND,
+                QUIC_STATUS_OUT_OF_MEMORY);
+            break;
+        }
+        ctx->client = client;
+        MsQuic->SetCallbackHandler(event->PEER_STREAM_STARTED.Stream, (void*)QuicStreamCallback, ctx);
+        break;
+    }
+    case QUIC_CONNECTION_EVENT_SHUTDOWN_COMPLETE:
+        QuicUnsubscribe(client, NULL);
+        MsQuic->ConnectionClose(connection);
+        free(client);
+        break;
+    default:
+        break;
+    }
+    return QUIC_STATUS_SUCCESS;
+}
+
+static
+QUIC_STATUS
+QuicListenerCallback(
+    HQUIC listener,
+    void* context,
+    QUIC_LISTENER_EVENT* event
+    )
+{
+    (void)listener;
+    (void)context;
+
+    if (event->Type == QUIC_LISTENER_EVENT_NEW_CONNECTION) {
+        QuicClient* client = (QuicClient*)calloc(1, sizeof(QuicClient));
+        if (client == NULL) {
+            return QUIC_STATUS_OUT_OF_MEMORY;
+        }
+        client->connection = event->NEW_CONNECTION.Connection;
+        client->subscriberIndex = NO_INDEX;
+        MsQuic->SetCallbackHandler(event->NEW_CONNECTION.Connection, (void*)QuicConnectionCallback, client);
+        QUIC_STATUS status = MsQuic->ConnectionSetConfiguration(event->NEW_CONNECTION.Connection, Configuration);
+        if (QUIC_FAILED(status)) {
+            MsQuic->ConnectionClose(event->NEW_CONNECTION.Connection);
+            free(client);
+            return status;
+        }
+    }
+    return QUIC_STATUS_SUCCESS;
+}
+
+static int ReadFileToBuffer(const char* path, uint8_t** buffer, uint32_t* length) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        fprintf(stderr, "[BROKER] No se pudo abrir el archivo: %s\n", path);
+        return 0;
+    }
+    fseek(file, 0, SEEK_END);
+    long fileSize = ftell(file);
+    rewind(file);
+    uint8_t* data = fileSize > 0 ? (uint8_t*)malloc((size_t)fileSize) : NULL;
+    if (data == NULL || fread(data, 1, (size_t)fileSize, file) != (size_t)fileSize) {
+        fprintf(stderr, "[BROKER] No se pudo leer %s.\n", path);
+        free(data);
+        fclose(file);
+        return 0;
+    }
+    fclose(file);
+    *buffer = data;
+    *length = (uint32_t)fileSize;
+    return 1;
+}
+
+/* El PFX se entrega a msquic como PKCS#12 en ambas plataformas (broker_quic lo importa con CryptoAPI en Windows). */
+static QUIC_STATUS LoadCredential(const BrokerOptions* options) {
+    QUIC_CREDENTIAL_CONFIG credConfig;
+    memset(&credConfig, 0, sizeof(credConfig));
+    credConfig.Flags = QUIC_CREDENTIAL_FLAG_NONE;
+
+    if (options->certFile != NULL) {
+        QUIC_CERTIFICATE_FILE certFile;
+        certFile.CertificateFile = options->certFile;
+        certFile.PrivateKeyFile = options->keyFile;
+        credConfig.Type = QUIC_CREDENTIAL_TYPE_CERTIFICATE_FILE;
+        credConfig.CertificateFile = &certFile;
+        return MsQuic->ConfigurationLoadCredential(Configuration, &credConfig);
+    }
+
+    uint8_t* pfxBuffer = NULL;
+    uint32_t pfxLength = 0;
+    if (!ReadFileToBuffer(options->pfxPath, &pfxBuffer, &pfxLength)) {
+        return QUIC_STATUS_INVALID_PARAMETER;
+    }
+    QUIC_CERTIFICATE_PKCS12 pkcs12;
+    pkcs12.Asn1Blob = pfxBuffer;
+    pkcs12.Asn1BlobLength = pfxLength;
+    pkcs12.PrivateKeyPassword = options->pfxPassword;
+    credConfig.Type = QUIC_CREDENTIAL_TYPE_CERTIFICATE_PKCS12;
+    credConfig.CertificatePkcs12 = &pkcs12;
+    QUIC_STATUS status = MsQuic->ConfigurationLoadCredential(Configuration, &credConfig);
+    free(pfxBuffer);
+    return status;
+}
+
+static void StopQuic(void) {
+    if (Listener != NULL) {
+        MsQuic->ListenerClose(Listener);
+        Listener = NULL;
+    }
+    if (Configuration != NULL) {
+        MsQuic->ConfigurationClose(Configuration);
+        Configuration = NULL;
+    }
+    if (Registration != NULL) {
+        MsQuic->RegistrationClose(Registration);
+        Registration = NULL;
+    }
+    if (MsQuic != NULL) {
+        MsQuicClose(MsQuic);
+        MsQuic = NULL;
+    }
+}
+
+static int StartQuic(const BrokerOptions* options) {
+    QUIC_STATUS status = MsQuicOpen2(&MsQuic);
+    if (QUIC_FAILED(status)) {
+        fprintf(stderr, "[BROKER] MsQuicOpen fracaso (%u).\n", status);
+        MsQuic = NULL;
+        return 0;
+    }
+    QUIC_REGISTRATION_CONFIG regConfig = { "BrokerUnificado", QUIC_EXECUTION_PROFILE_LOW_LATENCY };
+    status = MsQuic->RegistrationOpen(&regConfig, &Registration);
+    if (QUIC_FAILED(status)) {
+        fprintf(stderr, "[BROKER] RegistrationOpen fracaso (%u).\n", status);
+        StopQuic();
+        return 0;
+    }
+
+    QUIC_BUFFER alpn;
+    alpn.Buffer = (uint8_t*)DEFAULT_ALPN;
+    alpn.Length = (uint32_t)strlen(DEFAULT_ALPN);
+
+    QUIC_SETTINGS settings;
+    memset(&settings, 0, sizeof(settings));
+    settings.IsSet.IdleTimeoutMs = TRUE;
+    settings.IdleTimeoutMs = 600000;
+    settings.IsSet.KeepAliveIntervalMs = TRUE;
+    settings.KeepAliveIntervalMs = 15000;
+    settings.IsSet.ServerResumptionLevel = TRUE;
+    settings.ServerResumptionLevel = QUIC_SERVER_RESUME_AND_ZERORTT;
+    settings.IsSet.PeerBidiStreamCount = TRUE;
+    settings.PeerBidiStreamCount = PEER_BIDI_STREAMS;
+    status = MsQuic->ConfigurationOpen(Registration, &alpn, 1, &settings, sizeof(settings), NULL, &Configuration);
+    if (QUIC_FAILED(status)) {
+        fprintf(stderr, "[BROKER] ConfigurationOpen fracaso (%u).\n", status);
+        StopQuic();
+        return 0;
+    }
+    status = LoadCredential(options);
+    if (QUIC_FAILED(status)) {
+        fprintf(stderr, "[BROKER] ConfigurationLoadCredential fracaso (%u).\n", status);
+        StopQuic();
+        return 0;
+    }
+    status = MsQuic->ListenerOpen(Registration, QuicListenerCallback, NULL, &Listener);
+    if (QUIC_FAILED(status)) {
+        fprintf(stderr, "[BROKER] ListenerOpen fracaso (%u).\n", status);
+        StopQuic();
+        return 0;
+    }
+    QUIC_ADDR address;
+    memset(&address, 0, sizeof(address));
+    address.Ipv4.sin_family = AF_INET;
+    address.Ipv4.sin_port = htons((uint16_t)options->quicPort);
+    address.Ipv4.sin_addr.s_addr = htonl(INADDR_ANY);
+    status = MsQuic->ListenerStart(Listener, &alpn, 1, &address);
+    if (QUIC_FAILED(status)) {
+        fprintf(stderr, "[BROKER] ListenerStart fracaso (%u).\n", status);
+        StopQuic();
+        return 0;
+    }
+    return 1;
+}
+
+/* ---------------------------------------------------------------------------------------------------------
+ * Sockets del hilo principal
+ * --------------------------------------------------------------------------------------------------------- */
+
+static SOCKET OpenSocket(int type, uint32_t address, int port) {
+    SOCKET sock = socket(AF_INET, type, type == SOCK_STREAM ? IPPROTO_TCP : IPPROTO_UDP);
+    if (sock == INVALID_SOCKET) {
+        return INVALID_SOCKET;
+    }
+    int reuse = 1;
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, (const char*)&reuse, sizeof(reuse));
+    struct sockaddr_in local;
+    memset(&local, 0, sizeof(local));
+    local.sin_family = AF_INET;
+    local.sin_addr.s_addr = address;
+    local.sin_port = htons((u_short)port);
+    if (bind(sock, (struct sockaddr*)&local, sizeof(local)) == SOCKET_ERROR ||
+        (type == SOCK_STREAM && listen(sock, MAX_TCP_CLIENTS) == SOCKET_ERROR)) {
+        closesocket(sock);
+        return INVALID_SOCKET;
+    }
+    return sock;
+}
+
+/* Socket UDP local, no bloqueante, al que los callbacks de msquic envian un byte para cortar el select. */
+static int OpenWakeSocket(void) {
+    WakeSocket = OpenSocket(SOCK_DGRAM, htonl(INADDR_LOOPBACK), 0);
+    int length = sizeof(WakeAddress);
+    if (WakeSocket == INVALID_SOCKET || getsockname(WakeSocket, (struct sockaddr*)&WakeAddress, &length) == SOCKET_ERROR) {
+        return 0;
+    }
+    u_long nonBlocking = 1;
+    ioctlsocket(WakeSocket, FIONBIO, &nonBlocking);
+    return 1;
+}
+
+static void PrintUsage(const char* program) {
+    fprintf(stderr, "Uso: %s [--tcp PUERTO] [--udp PUERTO] [--quic PUERTO] [--pfx ARCHIVO CLAVE | --cert CRT --key KEY]\n"
+                    "          [--retener N] [--max-subscriptores N] [--grupos carga|turno] [--prioridad estricta|ponderada]\n"
+                    "          [--shm-ranuras N] [--verbose]\n", program);
+    fprintf(stderr, "  --tcp / --udp / --quic   Puerto de cada transporte (por defecto %d, %d y %d; 0 lo desactiva)\n",
+            DEFAULT_TCP_PORT, DEFAULT_UDP_PORT, DEFAULT_QUIC_PORT);
+    fprintf(stderr, "  --pfx / --cert --key     Certificado del listener QUIC; sin el, QUIC queda desactivado\n");
+    fprintf(stderr, "  --retener N              Mensajes retenidos por topic (por defecto %d; 0 = no)\n", DEFAULT_RETAINED_MESSAGES);
+    fprintf(stderr, "  --max-subscriptores N    Suscripciones entre los tres transportes (por defecto %d)\n", DEFAULT_MAX_SUBSCRIPTIONS);
+    fprintf(stderr, "  --grupos carga|turno     Reparto en grupos $share/<grupo>/<filtro> (por defecto carga)\n");
+    fprintf(stderr, "  --prioridad              Cola de un subscriber TCP lento: estricta (defecto) o ponderada (8:3:1)\n");
+    fprintf(stderr, "  --shm-ranuras N          Mensajes de cada anillo SHM, potencia de dos (por defecto %u; 0 desactiva SHM)\n",
+            SHM_RING_DEFAULT_SLOTS);
+    fprintf(stderr, "  --verbose                Imprime cada evento enrutado\n");
+    fprintf(stderr, "Ejemplo: %s --tcp 8000 --udp 5001 --quic 5000 --pfx ..\\QUIC\\broker_dev.pfx PfxStrongPassword\n", program);
+}
+
+static int ParsePort(const char* text, int* port) {
+    *port = atoi(text);
+    return *port >= 0 && *port <= 65535;
+}
+
+static int ParseArguments(int argc, char** argv, BrokerOptions* options) {
+    memset(options, 0, sizeof(*options));
+    options->tcpPort = DEFAULT_TCP_PORT;
+    options->udpPort = DEFAULT_UDP_PORT;
+    options->quicPort = DEFAULT_QUIC_PORT;
+    options->maxSubscriptions = DEFAULT_MAX_SUBSCRIPTIONS;
+    options->retainedMessages = DEFAULT_RETAINED_MESSAGES;
+    options->groupPolicy = ROUTING_GROUP_LEAST_LOADED;
+    options->lanePolicy = OUTBOUND_STRICT;
+    options->shmSlots = SHM_RING_DEFAULT_SLOTS;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--tcp") == 0 && i + 1 < argc) {
+            if (!ParsePort(argv[++i], &options->tcpPort)) {
+                return 0;
+            }
+        } else if (strcmp(argv[i], "--udp") == 0 && i + 1 < argc) {
+            if (!ParsePort(argv[++i], &options->udpPort)) {
+                return 0;
+            }
+        } else if (strcmp(argv[i], "--quic") == 0 && i + 1 < argc) {
+            if (!ParsePort(argv[++i], &options->quicPort)) {
+                return 0;
+            }
+        } else if (strcmp(argv[i], "--pfx") == 0 && i + 2 < argc) {
+            options->pfxPath = argv[++i];
+            options->pfxPassword = argv[++i];
+        } else if (strcmp(argv[i], "--cert") == 0 && i + 1 < argc) {
+            options->certFile = argv[++i];
+        } else if (strcmp(argv[i], "--key") == 0 && i + 1 < argc) {
+            options->keyFile = argv[++i];
+        } else if (strcmp(argv[i], "--retener") == 0 && i + 1 < argc) {
+            options->retainedMessages = atoi(argv[++i]);
+            if (options->retainedMessages < 0 || options->retainedMessages > 1024) {
+                return 0;
+            }
+        } else if (strcmp(argv[i], "--max-subscriptores") == 0 && i + 1 < argc) {
+            options->maxSubscriptions = atoi(argv[++i]);
+            if (options->maxSubscriptions <= 0) {
+                return 0;
+            }
+        } else if (strcmp(argv[i], "--grupos") == 0 && i + 1 < argc) {
+            const char* policy = argv[++i];
+            if (strcmp(policy, "carga") == 0) {
+                options->groupPolicy = ROUTING_GROUP_LEAST_LOADED;
+            } else if (strcmp(policy, "turno") == 0) {
+                options->groupPolicy = ROUTING_GROUP_ROUND_ROBIN;
+            } else {
+                return 0;
+            }
+        } else if (strcmp(argv[i], "--prioridad") == 0 && i + 1 < argc) {
+            const char* policy = argv[++i];
+            if (strcmp(policy, "estricta") == 0) {
+                options->lanePolicy = OUTBOUND_STRICT;
+            } else if (strcmp(policy, "ponderada") == 0) {
+                options->lanePolicy = OUTBOUND_WEIGHTED;
+            } else {
+                return 0;
+            }
+        } else if (strcmp(argv[i], "--shm-ranuras") == 0 && i + 1 < argc) {
+            options->shmSlots = atoi(argv[++i]);
+            if (options->shmSlots < 0 || options->shmSlots > (1 << 20)) {
+                return 0;
+            }
+        } else if (strcmp(argv[i], "--verbose") == 0) {
+            options->verbose = 1;
+        } else {
+            return 0;
+        }
+    }
+    if ((options->certFile == NULL) != (options->keyFile == NULL) || (options->certFile != NULL && options->pfxPath != NULL)) {
+        fprintf(stderr, "[BROKER] --cert y --key van juntos y no se combinan con --pfx.\n");
+        return 0;
+    }
+    if (options->tcpPort == 0 && options->udpPort == 0 && options->quicPort == 0) {
+        fprintf(stderr, "[BROKER] Todos los transportes estan desactivados.\n");
+        return 0;
+    }
+    return 1;
+}
+
+int main(int argc, char** argv) {
+    BrokerOptions options;
+    if (!ParseArguments(argc, argv, &options)) {
+        PrintUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    Verbose = options.verbose;
+    LanePolicy = options.lanePolicy;
+    TcpPort = options.tcpPort;
+    ShmSlots = options.tcpPort > 0 ? (uint32_t)options.shmSlots : 0;  /* el control de SHM va por TCP */
+
+    WSADATA wsaData;
+    if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
+        fprintf(stderr, "Error al iniciar Winsock.\n");
+        return EXIT_FAILURE;
+    }
+
+    InitializeCriticalSection(&RoutesLock);
+    RoutingTableInit(&Routes, &UnifiedTransport, sizeof(RouteExtra), INITIAL_ROUTE_CAPACITY, options.maxSubscriptions);
+    RoutingSetRetainDepth(&Routes, (uint32_t)options.retainedMessages);
+    RoutingSetGroupPolicy(&Routes, options.groupPolicy);
+
+    SOCKET tcpListener = INVALID_SOCKET;
+    if (options.tcpPort > 0 && (tcpListener = OpenSocket(SOCK_STREAM, INADDR_ANY, options.tcpPort)) == INVALID_SOCKET) {
+        fprintf(stderr, "[BROKER] No se pudo escuchar TCP en el puerto %d.\n", options.tcpPort);
+        return EXIT_FAILURE;
+    }
+    if (options.udpPort > 0 && (UdpSocket = OpenSocket(SOCK_DGRAM, INADDR_ANY, options.udpPort)) == INVALID_SOCKET) {
+        fprintf(stderr, "[BROKER] No se pudo escuchar UDP en el puerto %d.\n", options.udpPort);
+        return EXIT_FAILURE;
+    }
+    if (!OpenWakeSocket()) {
+        fprintf(stderr, "[BROKER] No se pudo abrir el socket local de aviso.\n");
+        return EXIT_FAILURE;
+    }
+    int quicEnabled = options.quicPort > 0 && (options.pfxPath != NULL || options.certFile != NULL);
+    if (options.quicPort > 0 && !quicEnabled) {
+        printf("[BROKER] QUIC desactivado: falta el certificado (--pfx o --cert/--key).\n");
+    }
+    if (quicEnabled && !StartQuic(&options)) {
+        return EXIT_FAILURE;
+    }
+
+    printf("[BROKER] Broker unificado: TCP %d, UDP %d, QUIC %d (0 = desactivado), una tabla para todos.\n",
+           options.tcpPort, UdpSocket != INVALID_SOCKET ? options.udpPort : 0, quicEnabled ? options.quicPort : 0);
+    if (ShmSlots > 0) {
+        printf("[BROKER] Subscribers locales por memoria compartida: SHM|filtro por TCP, anillos de %u ranuras.\n", ShmSlots);
+    }
+    printf("[BROKER] Estado por suscripcion: RoutingEntry %zu + RouteExtra %zu bytes, maximo %d suscripciones.\n",
+           sizeof(RoutingEntry), sizeof(RouteExtra), options.maxSubscriptions);
+
+    while (1) {
+        fd_set readSet, writeSet;
+        FD_ZERO(&readSet);
+        FD_ZERO(&writeSet);
+        FD_SET(WakeSocket, &readSet);
+        if (tcpListener != INVALID_SOCKET) {
+            FD_SET(tcpListener, &readSet);
+        }
+        if (UdpSocket != INVALID_SOCKET) {
+            FD_SET(UdpSocket, &readSet);
+        }
+
+        EnterCriticalSection(&RoutesLock);
+        for (int i = 0; i < MAX_TCP_CLIENTS; ++i) {
+            if (TcpPublishers[i].socket > 0) {
+                FD_SET(TcpPublishers[i].socket, &readSet);
+            }
+            if (TcpSubscribers[i].socket > 0) {
+                FD_SET(TcpSubscribers[i].socket, &readSet);
+                if (!OutboundLanesEmpty(&TcpSubscribers[i].output)) {
+                    FD_SET(TcpSubscribers[i].socket, &writeSet);
+                }
+            }
+        }
+        WakePending = 0;
+        LeaveCriticalSection(&RoutesLock);
+
+        if (select(0, &readSet, &writeSet, NULL, NULL) == SOCKET_ERROR) {
+            perror("select");
+            continue;
+        }
+
+        if (FD_ISSET(WakeSocket, &readSet)) {
+            char discard[16];
+            while (recv(WakeSocket, discard, sizeof(discard), 0) > 0) {
+            }
+        }
+
+        /* La primera lectura de una conexion nueva se hace sin RoutesLock: msquic sigue enrutando mientras tanto. */
+        SOCKET accepted = INVALID_SOCKET;
+        char first[TCP_LINE_LEN];
+        int firstBytes = 0;
+        if (tcpListener != INVALID_SOCKET && FD_ISSET(tcpListener, &readSet)) {
+            accepted = accept(tcpListener, NULL, NULL);
+            if (accepted != INVALID_SOCKET) {
+                firstBytes = recv(accepted, first, TCP_LINE_LEN - 1, 0);
+                if (firstBytes <= 0) {
+                    closesocket(accepted);
+                    accepted = INVALID_SOCKET;
+                } else {
+                    first[firstBytes] = '\0';
+                }
+            }
+        }
+
+        EnterCriticalSection(&RoutesLock);
+        MainThreadInside = 1;
+
+        if (accepted != INVALID_SOCKET) {
+            RegisterTcpClient(accepted, first, firstBytes);
+        }
+
+        if (UdpSocket != INVALID_SOCKET && FD_ISSET(UdpSocket, &readSet)) {
+            char datagram[DATAGRAM_MAX_LEN];
+            struct sockaddr_in from;
+            int fromLength = sizeof(from);
+            int bytes = recvfrom(UdpSocket, datagram, DATAGRAM_MAX_LEN - 1, 0, (struct sockaddr*)&from, &fromLength);
+            if (bytes > 0) {
+                datagram[bytes] = '\0';
+                ProcessDatagram(datagram, bytes, &from);
+            }
+        }
+
+        for (int i = 0; i < MAX_TCP_CLIENTS; ++i) {
+            SOCKET fd = TcpPublishers[i].socket;
+            if (fd > 0 && FD_ISSET(fd, &readSet)) {
+                char buffer[TCP_LINE_LEN];
+                int bytes = recv(fd, buffer, TCP_LINE_LEN, 0);
+                if (bytes <= 0) {
+                    closesocket(fd);
+                    memset(&TcpPublishers[i], 0, sizeof(TcpPublishers[i]));
+                    printf("[BROKER] Publisher TCP desconectado\n");
+                } else {
+                    ProcessTcpPublisherData(&TcpPublishers[i], buffer, bytes);
+                }
+            }
+        }
+
+        for (int i = 0; i < MAX_TCP_CLIENTS; ++i) {
+            TcpSubscriber* subscriber = &TcpSubscribers[i];
+            if (subscriber->socket > 0 && FD_ISSET(subscriber->socket, &writeSet)) {
+                FlushTcpOutput(subscriber);
+            }
+            if (subscriber->socket > 0 && !subscriber->failed && FD_ISSET(subscriber->socket, &readSet)) {
+                char buffer[TCP_LINE_LEN];
+                int bytes = recv(subscriber->socket, buffer, TCP_LINE_LEN, 0);
+                if (bytes <= 0) {
+                    subscriber->failed = 1;
+                } else {
+                    ProcessTcpSubscriberData(subscriber, buffer, bytes);
+                }
+            }
+            if (subscriber->socket > 0 && subscriber->failed) {
+                CloseTcpSubscriber(subscriber);
+            }
+        }
+
+        MainThreadInside = 0;
+        LeaveCriticalSection(&RoutesLock);
+    }
+
+    if (quicEnabled) {
+        MsQuic->ListenerStop(Listener);
+        StopQuic();
+    }
+    for (int i = 0; i < MAX_TCP_CLIENTS; ++i) {
+        if (TcpSubscribers[i].socket > 0) {
+            CloseTcpSubscriber(&TcpSubscribers[i]);  /* suelta tambien sus canales SHM */
+        }
+    }
+    RoutingFreePlan(&FanoutPlan);
+    RoutingTableFree(&Routes);
+    DeleteCriticalSection(&RoutesLock);
+    closesocket(WakeSocket);
+    WSACleanup();
+    return EXIT_SUCCESS;
+}
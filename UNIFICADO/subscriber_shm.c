@@ -0,0 +1,274 @@
+/*
+ * Archivo: subscriber_shm.c
+ * Descripcion: Subscriber para procesos en la misma maquina que broker_unificado. Pide cada topic por la conexion
+ *              TCP de control (SHM|topic), mapea el anillo en memoria compartida que le indica el broker y lee los
+ *              mensajes directamente de ahi, sin sockets de loopback en el camino de los datos.
+ *
+ * PROTOCOLO:
+ *    Envia "SHM|topic\n" por cada topic y espera "SHM|topic|<segmento>|<retenidos>\n" (o "ERROR|topic\n"). Cada
+ *    mensaje del anillo es el sobre "topic|hora|mensaje\n" del broker y se muestra como "[hora] topic: mensaje",
+ *    igual que subscriber_tcp. La conexion queda abierta: al cerrarla el broker suelta el canal.
+ *
+ * ESPERA:
+ *    Con los anillos vacios el hilo consulta SHM_IDLE_SPINS veces seguidas, luego cede el procesador y, si sigue
+ *    sin trafico, duerme 1 ms por vuelta. Un lector que se atrasa mas que el tamano del anillo pierde mensajes;
+ *    se informan al llegar el siguiente y al terminar.
+ *
+ * LIBRERIAS UTILIZADAS Y JUSTIFICACION:
+ *
+ * 1. winsock2.h / ws2tcpip.h
+ *    - Por que: Conexion TCP de control con el broker.
+ *    - Funciones usadas: socket(), connect(), send(), recv(), select(), closesocket().
+ *
+ * 2. windows.h (via ../common/shm_ring.h)
+ *    - Por que: Mapear los segmentos de memoria compartida y Sleep() entre consultas.
+ *    - Funciones usadas: OpenFileMappingA(), MapViewOfFile(), UnmapViewOfFile(), Sleep().
+ *
+ * 3. stdio.h / stdlib.h / string.h (libreria estandar)
+ *    - Por que: Argumentos, respuesta del broker y salida de los mensajes.
+ *    - Funciones usadas: printf(), fprintf(), snprintf(), atoi(), strncmp(), strchr(), memchr().
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include "../common/shm_ring.h"
+#include "../common/latency_stamp.h"
+#include "../common/message_sink.h"
+
+#pragma comment(lib, "ws2_32.lib")
+
+#define BROKER_IP "127.0.0.1"
+#define BROKER_PORT 8000
+#define CONTROL_LINE_LEN 1024
+#define MAX_CHANNELS 32
+#define SHM_IDLE_SPINS 2000
+#define SHM_IDLE_YIELDS 100
+
+typedef struct ShmSubscription {
+    char topic[128];
+    ShmRing ring;
+    ShmRingReader reader;
+    uint64_t reportedLost;
+    uint64_t reportedTruncated;
+} ShmSubscription;
+
+static ShmSubscription Channels[MAX_CHANNELS];
+static int ChannelCount = 0;
+static LatencyStats Latencies;   /* ~70 KB: global y no en la pila */
+static MessageSink Output;
+
+/* Una linea de la conexion de control; devuelve 0 si el broker la cerro. */
+static int ReadControlLine(SOCKET socket, char* line, size_t size) {
+    size_t length = 0;
+    char c;
+    while (recv(socket, &c, 1, 0) == 1) {
+        if (c == '\n') {
+            line[length > 0 && line[length - 1] == '\r' ? length - 1 : length] = '\0';
+            return 1;
+        }
+        if (length < size - 1) {
+            line[length++] = c;
+        }
+    }
+    return 0;
+}
+
+/* Pide el canal del topic y mapea su anillo. */
+static int OpenChannel(SOCKET control, const char* topic) {
+    char line[CONTROL_LINE_LEN];
+    snprintf(line, sizeof(line), "SHM|%s\n", topic);
+    if (send(control, line, (int)strlen(line), 0) == SOCKET_ERROR || !ReadControlLine(control, line, sizeof(line))) {
+        fprintf(stderr, "[SUBSCRIBER] El broker no respondio a SHM|%s\n", topic);
+        return 0;
+    }
+    /* SHM|filtro|segmento|retenidos */
+    char* filter = line + 4;
+    char* segment = strncmp(line, "SHM|", 4) == 0 ? strchr(filter, '|') : NULL;
+    char* retained = segment != NULL ? strchr(segment + 1, '|') : NULL;
+    if (retained == NULL) {
+        fprintf(stderr, "[SUBSCRIBER] Canal rechazado por el broker: %s\n", line);
+        return 0;
+    }
+    *segment++ = '\0';
+    *retained++ = '\0';
+
+    ShmSubscription* channel = &Channels[ChannelCount];
+    if (!ShmRingOpen(&channel->ring, segment)) {
+        fprintf(stderr, "[SUBSCRIBER] No se pudo mapear %s (el broker debe correr en esta maquina)\n", segment);
+        return 0;
+    }
+    snprintf(channel->topic, sizeof(channel->topic), "%s", filter);
+    ShmRingReaderInit(&channel->ring, &channel->reader, (uint32_t)atoi(retained));
+    ChannelCount++;
+    printf("[SUBSCRIBER] Suscrito a '%s' por memoria compartida (%s, %u ranuras)\n", filter, segment,
+           channel->ring.header->slotCount);
+    return 1;
+}
+
+/* Muestra el sobre "topic|hora|mensaje" como "[hora] topic: mensaje", con la latencia si la hora trae marcas. */
+static void ShowMessage(const char* envelope, uint32_t length, uint64_t receivedNs) {
+    if (length > 0 && envelope[length - 1] == '\n') {
+        length--;
+    }
+    const char* topicEnd = (const char*)memchr(envelope, '|', length);
+    const char* timestamp = topicEnd != NULL ? topicEnd + 1 : NULL;
+    const char* timestampEnd = timestamp != NULL ? (const char*)memchr(timestamp, '|', length - (uint32_t)(timestamp - envelope)) : NULL;
+    if (timestampEnd == NULL) {
+        MessageSinkPrintf(&Output, "[SUBSCRIBER] Mensaje recibido: %.*s\n", (int)length, envelope);
+        return;
+    }
+    int topicLength = (int)(topicEnd - envelope);
+    int timestampLength = (int)(timestampEnd - timestamp);
+    const char* body = timestampEnd + 1;
+    int bodyLength = (int)(envelope + length - body);
+
+    char line[CONTROL_LINE_LEN];
+    int lineLength = snprintf(line, sizeof(line), "[%.*s] %.*s: %.*s", timestampLength, timestamp, topicLength, envelope,
+                              bodyLength, body);
+    MessageSinkRecord(&Output, receivedNs, line, lineLength < (int)sizeof(line) ? (size_t)lineLength : sizeof(line) - 1);
+
+    uint64_t originNs, ingressNs;
+    if (timestampLength == LATENCY_STAMP_FORWARD_LEN && LatencyStampParse(timestamp, (size_t)timestampLength, &originNs, &ingressNs)) {
+        uint64_t totalUs = LatencyStatsRecord(&Latencies, originNs, ingressNs, receivedNs);
+        MessageSinkPrintf(&Output, "[SUBSCRIBER] Mensaje recibido: [+%llu us] %.*s: %.*s\n", (unsigned long long)totalUs,
+                          topicLength, envelope, bodyLength, body);
+        if (receivedNs >= Latencies.nextReportNs) {
+            MessageSinkFlush(&Output);
+        }
+        LatencyStatsMaybePrint(&Latencies, receivedNs, stdout, "[SUBSCRIBER]");
+    } else {
+        MessageSinkPrintf(&Output, "[SUBSCRIBER] Mensaje recibido: %.*s\n", lineLength, line);
+    }
+}
+
+/* El broker cerro la conexion de control (o se cayo). */
+static int ControlClosed(SOCKET control) {
+    fd_set readSet;
+    FD_ZERO(&readSet);
+    FD_SET(control, &readSet);
+    struct timeval timeout = { 0, 0 };
+    char discard[64];
+    return select(0, &readSet, NULL, NULL, &timeout) > 0 && recv(control, discard, sizeof(discard), 0) <= 0;
+}
+
+int main(int argc, char** argv) {
+    const char* outputKind = NULL;
+    int port = BROKER_PORT;
+    int topicCount = 1;
+    while (topicCount < argc && strncmp(argv[topicCount], "--", 2) != 0) {
+        topicCount++;
+    }
+    topicCount--;
+    int argumentsOk = topicCount > 0 && topicCount <= MAX_CHANNELS && (argc - 1 - topicCount) % 2 == 0;
+    for (int i = 1 + topicCount; argumentsOk && i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--puerto") == 0) {
+            port = atoi(argv[i + 1]);
+            argumentsOk = port > 0 && port <= 65535;
+        } else if (strcmp(argv[i], "--salida") == 0) {
+            outputKind = argv[i + 1];
+        } else {
+            argumentsOk = 0;
+        }
+    }
+    if (!argumentsOk) {
+        fprintf(stderr, "Uso: %s <topic> [topic ...] [--puerto N] [--salida texto|texto:RUTA|binario:RUTA|nula]\n", argv[0]);
+        fprintf(stderr, "  --puerto  Puerto TCP de broker_unificado en esta maquina (por defecto %d)\n", BROKER_PORT);
+        fprintf(stderr, "  --salida  Destino de los mensajes recibidos (por defecto texto en la consola)\n");
+        return EXIT_FAILURE;
+    }
+    if (!MessageSinkOpen(&Output, outputKind)) {
+        fprintf(stderr, "Salida invalida o no se pudo abrir: %s\n", outputKind);
+        return EXIT_FAILURE;
+    }
+
+    WSADATA wsaData;
+    if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
+        printf("Error al inicializar Winsock\n");
+        return EXIT_FAILURE;
+    }
+    SOCKET control = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    struct sockaddr_in broker;
+    memset(&broker, 0, sizeof(broker));
+    broker.sin_family = AF_INET;
+    broker.sin_port = htons((u_short)port);
+    broker.sin_addr.s_addr = inet_addr(BROKER_IP);
+    if (control == INVALID_SOCKET || connect(control, (struct sockaddr*)&broker, sizeof(broker)) == SOCKET_ERROR) {
+        printf("Error al conectar con el broker: %d\n", WSAGetLastError());
+        WSACleanup();
+        return EXIT_FAILURE;
+    }
+    printf("[SUBSCRIBER] Conectado al broker en %s:%d\n", BROKER_IP, port);
+
+    for (int i = 0; i < topicCount; ++i) {
+        OpenChannel(control, argv[1 + i]);
+    }
+    if (ChannelCount == 0) {
+        closesocket(control);
+        WSACleanup();
+        return EXIT_FAILURE;
+    }
+
+    LatencyStatsInit(&Latencies);
+    char message[SHM_RING_SLOT_BYTES];
+    uint32_t idle = 0;
+    int running = 1;
+    while (running) {
+        int received = 0;
+        for (int i = 0; i < ChannelCount; ++i) {
+            ShmSubscription* channel = &Channels[i];
+            uint32_t length;
+            /* Se leen pocos mensajes por canal y vuelta para que un topic con mucho trafico no tape a los demas. */
+            for (int burst = 0; burst < 64 && ShmRingRead(&channel->ring, &channel->reader, message, sizeof(message), &length); ++burst) {
+                ShowMessage(message, length, LatencyStampNowNs());
+                received = 1;
+            }
+            if (channel->reader.lost != channel->reportedLost) {
+                MessageSinkPrintf(&Output, "[SUBSCRIBER] Se perdieron %llu mensajes de '%s' (lector atrasado)\n",
+                                  (unsigned long long)(channel->reader.lost - channel->reportedLost), channel->topic);
+                channel->reportedLost = channel->reader.lost;
+            }
+            if (channel->reader.truncated != channel->reportedTruncated) {
+                MessageSinkPrintf(&Output, "[SUBSCRIBER] %llu mensajes de '%s' llegaron truncados (no entraban en la ranura)\n",
+                                  (unsigned long long)(channel->reader.truncated - channel->reportedTruncated), channel->topic);
+                channel->reportedTruncated = channel->reader.truncated;
+            }
+        }
+        if (received) {
+            idle = 0;
+            continue;
+        }
+
+        /* Sin mensajes: primero se sigue consultando, despues se cede el procesador y al final se duerme. */
+        idle++;
+        if (idle < SHM_IDLE_SPINS) {
+            continue;
+        }
+        MessageSinkTick(&Output, LatencyStampNowNs());
+        for (int i = 0; i < ChannelCount; ++i) {
+            if (ShmRingClosed(&Channels[i].ring)) {
+                running = 0;
+            }
+        }
+        if (ControlClosed(control)) {
+            running = 0;
+        }
+        Sleep(idle < SHM_IDLE_SPINS + SHM_IDLE_YIELDS ? 0 : 1);
+    }
+    MessageSinkFlush(&Output);
+    printf("[SUBSCRIBER] Conexion cerrada por el broker\n");
+
+    for (int i = 0; i < ChannelCount; ++i) {
+        printf("[SUBSCRIBER] '%s': %llu mensajes perdidos por atraso, %llu truncados\n", Channels[i].topic,
+               (unsigned long long)Channels[i].reader.lost, (unsigned long long)Channels[i].reader.truncated);
+        ShmRingClose(&Channels[i].ring);
+    }
+    LatencyStatsPrint(&Latencies, stdout, "[SUBSCRIBER]");
+    MessageSinkClose(&Output);
+    MessageSinkPrintSummary(&Output, stdout, "[SUBSCRIBER]");
+    closesocket(control);
+    WSACleanup();
+    return EXIT_SUCCESS;
+}
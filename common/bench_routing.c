@@ -0,0 +1,273 @@
+/*
+ * Archivo: bench_routing.c
+ * Descripcion: Micro-benchmarks del nucleo de enrutamiento (routing.h) que comparten los brokers TCP, UDP y QUIC.
+ *
+ * No abre sockets: el transporte de prueba solo cuenta entregas y bytes, asi que el resultado mide el costo propio
+ * del broker (separar el mensaje, ubicar el topic, recorrer los subscriptores) sin el ruido de la red. Casos:
+ *    - parse:    RoutingParsePublish sobre una linea "PUBLISHER|topic|hora|mensaje".
+ *    - lookup:   busqueda de un topic entre N topics internados.
+ *    - churn:    alta y baja de una suscripcion con la tabla ya poblada.
+ *    - fan-out:  publicacion a un topic con S subscriptores, repartidos entre varios topics.
+ *    - lineal:   el mismo fan-out con el recorrido que usaban antes los brokers (arreglo plano + strcmp por
+ *                subscriptor), como referencia.
+ *    - comodines: topics futbol/ligaL/partidoP/goles con filtros exactos, '+' y '#'; se mide la publicacion con
+ *                las coincidencias guardadas y el recorrido del trie sin ellas.
+ *
+ * Uso: bench_routing [ESCALA]   (ESCALA multiplica las iteraciones; por defecto 1)
+ *
+ * LIBRERIAS UTILIZADAS Y JUSTIFICACION:
+ *
+ * 1. stdio.h / stdlib.h / string.h (libreria estandar)
+ *    - Por que: Salida de resultados y armado de topics de prueba.
+ *    - Funciones usadas: printf(), snprintf(), atoi(), malloc(), free(), strcmp().
+ *
+ * 2. windows.h (Windows) / time.h (Linux)
+ *    - Por que: Reloj monotonico de alta resolucion.
+ *    - Funciones usadas: QueryPerformanceCounter(), QueryPerformanceFrequency(); clock_gettime().
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+#include "routing.h"
+
+#define BENCH_TOPICS 64
+#define BENCH_MAX_SUBSCRIBERS (1 << 20)
+
+typedef struct BenchSink {
+    uint64_t deliveries;
+    uint64_t bytes;
+} BenchSink;
+
+/* Evita que el compilador descarte el resultado de los casos sin efectos visibles. */
+static volatile uint64_t BenchGuard;
+
+static uint64_t BenchNowNs(void) {
+#ifdef _WIN32
+    LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (uint64_t)(counter.QuadPart / frequency.QuadPart) * 1000000000ULL +
+           (uint64_t)(counter.QuadPart % frequency.QuadPart) * 1000000000ULL / (uint64_t)frequency.QuadPart;
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+#endif
+}
+
+static int BenchDeliver(void* context, RoutingTable* table, int32_t index, const char* message, uint32_t length) {
+    (void)table;
+    (void)index;
+    BenchSink* sink = (BenchSink*)context;
+    sink->deliveries++;
+    sink->bytes += length + (uint8_t)message[0];
+    return 1;
+}
+
+static void BenchTopicName(char* destination, size_t capacity, int topic) {
+    snprintf(destination, capacity, "Partido%d", topic);
+}
+
+static void PrintResult(const char* name, uint64_t operations, uint64_t elapsedNs) {
+    double perOperation = operations > 0 ? (double)elapsedNs / (double)operations : 0.0;
+    double perSecond = elapsedNs > 0 ? (double)operations * 1e9 / (double)elapsedNs : 0.0;
+    printf("%-34s %12.1f ns/op %14.0f op/s\n", name, perOperation, perSecond);
+}
+
+static void BenchParse(int scale) {
+    const char* sample = "PUBLISHER|Partido17|21:04:55|Gol de Equipo A, minuto 73";
+    size_t length = strlen(sample);
+    char line[128];
+    RoutingPublish publish;
+
+    uint64_t iterations = 2000000ULL * (uint64_t)scale;
+    uint64_t checksum = 0;
+    uint64_t start = BenchNowNs();
+    for (uint64_t i = 0; i < iterations; ++i) {
+        memcpy(line, sample, length + 1);
+        if (RoutingParsePublish(line, length, &publish)) {
+            checksum += (uint8_t)publish.body[0];
+        }
+    }
+    PrintResult("parse PUBLISHER|topic|hora|msg", iterations, BenchNowNs() - start);
+    BenchGuard += checksum;
+}
+
+static void BenchLookup(RoutingTransport* transport, int scale) {
+    RoutingTable table;
+    RoutingTableInit(&table, transport, 0, 16, 16);
+
+    enum { TOPIC_COUNT = 4096 };
+    static char names[TOPIC_COUNT][ROUTING_TOPIC_LEN];
+    for (int i = 0; i < TOPIC_COUNT; ++i) {
+        BenchTopicName(names[i], sizeof(names[i]), i);
+        RoutingInternTopic(&table, names[i]);
+    }
+
+    uint64_t iterations = 4000000ULL * (uint64_t)scale;
+    uint64_t checksum = 0;
+    uint64_t start = BenchNowNs();
+    for (uint64_t i = 0; i < iterations; ++i) {
+        checksum += (uint64_t)RoutingFindTopic(&table, names[(i * 2654435761u) & (TOPIC_COUNT - 1)]);
+    }
+    PrintResult("lookup (4096 topics)", iterations, BenchNowNs() - start);
+    BenchGuard += checksum;
+    RoutingTableFree(&table);
+}
+
+static void BenchChurn(RoutingTransport* transport, int scale) {
+    RoutingTable table;
+    RoutingTableInit(&table, transport, 0, 1024, BENCH_MAX_SUBSCRIBERS);
+
+    char topic[ROUTING_TOPIC_LEN];
+    for (int i = 0; i < 100000; ++i) {
+        BenchTopicName(topic, sizeof(topic), i % BENCH_TOPICS);
+        RoutingSubscribe(&table, topic, NULL, NULL);
+    }
+
+    uint64_t iterations = 2000000ULL * (uint64_t)scale;
+    uint64_t start = BenchNowNs();
+    for (uint64_t i = 0; i < iterations; ++i) {
+        int32_t index = RoutingSubscribe(&table, "Partido7", NULL, NULL);
+        RoutingUnsubscribe(&table, index);
+    }
+    PrintResult("alta + baja (100k subscriptores)", iterations, BenchNowNs() - start);
+    RoutingTableFree(&table);
+}
+
+/* Recorrido de los brokers anteriores: arreglo plano de topics y comparacion por subscriptor. */
+static uint64_t LinearFanout(char (*topics)[ROUTING_TOPIC_LEN], int count, const char* topic, BenchSink* sink,
+                             const char* message, uint32_t length) {
+    uint64_t delivered = 0;
+    for (int i = 0; i < count; ++i) {
+        if (strcmp(topics[i], topic) == 0) {
+            BenchDeliver(sink, NULL, i, message, length);
+            delivered++;
+        }
+    }
+    return delivered;
+}
+
+static void BenchFanout(RoutingTransport* transport, BenchSink* sink, int subscribersPerTopic, int scale) {
+    int total = subscribersPerTopic * BENCH_TOPICS;
+    RoutingTable table;
+    RoutingTableInit(&table, transport, 0, 1024, BENCH_MAX_SUBSCRIBERS);
+    RoutingPlan plan;
+    memset(&plan, 0, sizeof(plan));
+
+    char (*flat)[ROUTING_TOPIC_LEN] = (char (*)[ROUTING_TOPIC_LEN])malloc((size_t)total * ROUTING_TOPIC_LEN);
+    if (flat == NULL) {
+        fprintf(stderr, "Sin memoria para %d subscriptores.\n", total);
+        return;
+    }
+
+    /* Topics intercalados, como llegan los subscriptores reales. */
+    for (int i = 0; i < total; ++i) {
+        BenchTopicName(flat[i], ROUTING_TOPIC_LEN, i % BENCH_TOPICS);
+        RoutingSubscribe(&table, flat[i], NULL, NULL);
+    }
+
+    const char* message = "[21:04:55] Partido7: Gol de Equipo A, minuto 73\n";
+    uint32_t length = (uint32_t)strlen(message);
+    uint64_t publishes = (uint64_t)(4000000 / subscribersPerTopic + 1) * (uint64_t)scale;
+
+    char name[64];
+    sink->deliveries = 0;
+    uint64_t start = BenchNowNs();
+    for (uint64_t i = 0; i < publishes; ++i) {
+        RoutingPublishTo(&table, &plan, "Partido7", message, length);
+    }
+    uint64_t elapsed = BenchNowNs() - start;
+    snprintf(name, sizeof(name), "fan-out %d subs/topic (entregas)", subscribersPerTopic);
+    PrintResult(name, sink->deliveries, elapsed);
+
+    /* El recorrido lineal es O(total); con tablas grandes se limita el numero de publicaciones. */
+    uint64_t linearPublishes = publishes / BENCH_TOPICS + 1;
+    sink->deliveries = 0;
+    start = BenchNowNs();
+    for (uint64_t i = 0; i < linearPublishes; ++i) {
+        LinearFanout(flat, total, "Partido7", sink, message, length);
+    }
+    elapsed = BenchNowNs() - start;
+    snprintf(name, sizeof(name), "lineal  %d subs/topic (entregas)", subscribersPerTopic);
+    PrintResult(name, sink->deliveries, elapsed);
+
+    free(flat);
+    RoutingFreePlan(&plan);
+    RoutingTableFree(&table);
+}
+
+static void BenchWildcards(RoutingTransport* transport, BenchSink* sink, int scale) {
+    RoutingTable table;
+    RoutingTableInit(&table, transport, 0, 1024, BENCH_MAX_SUBSCRIBERS);
+    RoutingPlan plan;
+    memset(&plan, 0, sizeof(plan));
+
+    /* 16 ligas x 32 partidos: un filtro exacto por partido, uno '+' por liga y dos '#'. */
+    char filter[ROUTING_TOPIC_LEN];
+    for (int league = 0; league < 16; ++league) {
+        for (int match = 0; match < 32; ++match) {
+            snprintf(filter, sizeof(filter), "futbol/liga%d/partido%d/goles", league, match);
+            RoutingSubscribe(&table, filter, NULL, NULL);
+        }
+        snprintf(filter, sizeof(filter), "futbol/liga%d/+/goles", league);
+        RoutingSubscribe(&table, filter, NULL, NULL);
+    }
+    RoutingSubscribe(&table, "futbol/#", NULL, NULL);
+    RoutingSubscribe(&table, "+/+/partido7/#", NULL, NULL);
+
+    const char* topic = "futbol/liga3/partido7/goles";
+    const char* message = "[21:04:55] Gol de Equipo A, minuto 73\n";
+    uint32_t length = (uint32_t)strlen(message);
+    uint64_t iterations = 2000000ULL * (uint64_t)scale;
+
+    sink->deliveries = 0;
+    uint64_t start = BenchNowNs();
+    for (uint64_t i = 0; i < iterations; ++i) {
+        RoutingPublishTo(&table, &plan, topic, message, length);
+    }
+    PrintResult("comodines, coincidencias guardadas", iterations, BenchNowNs() - start);
+
+    /* Cambiar la generacion obliga a recorrer el trie en cada publicacion. */
+    start = BenchNowNs();
+    for (uint64_t i = 0; i < iterations; ++i) {
+        table.filterGeneration++;
+        RoutingPublishTo(&table, &plan, topic, message, length);
+    }
+    PrintResult("comodines, recorrido del trie", iterations, BenchNowNs() - start);
+    printf("%-34s %12.1f por publicacion\n", "  entregas", (double)sink->deliveries / (double)(iterations * 2));
+
+    RoutingFreePlan(&plan);
+    RoutingTableFree(&table);
+}
+
+int main(int argc, char** argv) {
+    int scale = argc > 1 ? atoi(argv[1]) : 1;
+    if (scale <= 0) {
+        fprintf(stderr, "Uso: %s [ESCALA]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    BenchSink sink;
+    memset(&sink, 0, sizeof(sink));
+    RoutingTransport transport = { "bench", &sink, BenchDeliver, NULL, NULL, NULL, NULL };
+
+    printf("Nucleo de enrutamiento: RoutingEntry %zu bytes, %d topics en los casos de fan-out.\n",
+           sizeof(RoutingEntry), BENCH_TOPICS);
+    BenchParse(scale);
+    BenchLookup(&transport, scale);
+    BenchChurn(&transport, scale);
+    int sizes[] = { 1, 16, 256, 4096 };
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+        BenchFanout(&transport, &sink, sizes[i], scale);
+    }
+    BenchWildcards(&transport, &sink, scale);
+    return BenchGuard == 42 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,1014 @@
+/*
+ * Archivo: event_log.h
+ * Descripcion: Registro persistente de eventos por topic (solo se agrega al final), mapeado en memoria, con
+ *              reenvio desde un offset o una hora. Lo usan los brokers TCP y QUIC (opcion --registro).
+ *
+ * FORMATO EN DISCO:
+ *    <directorio>/<topic codificado>/<offset base de 20 digitos>.log   Segmento de datos
+ *    <directorio>/<topic codificado>/<offset base de 20 digitos>.idx   Indice disperso del segmento
+ *
+ *    Cada registro es el mensaje tal como el broker lo envia a sus subscriptores (una linea terminada en '\n'),
+ *    asi un tramo del segmento se puede enviar al socket sin transformarlo (send o StreamSend apuntando al
+ *    mapeo; EventLogCursor lo reparte en varios envios si el socket no acepta todo). El offset de un registro
+ *    es su numero de orden dentro del topic, empezando en 0.
+ *    Los segmentos se crean con su tamano final (relleno de ceros) y se mapean completos; el primer byte 0 marca
+ *    el final de lo escrito. Cuando un registro no cabe se abre un segmento nuevo con base = siguiente offset.
+ *    El indice guarda (offset, posicion, hora de llegada) cada EVENT_LOG_INDEX_BYTES bytes: para ubicar un offset
+ *    se busca en el indice y se cuentan lineas desde esa posicion. Una hora se resuelve con la granularidad del
+ *    indice (el reenvio empieza en la ultima entrada con hora <= la pedida, puede incluir algunos eventos previos).
+ *    Los topics se codifican para el sistema de archivos: todo lo que no sea [A-Za-z0-9_.-] pasa a %XX.
+ *
+ * RECUPERACION:
+ *    Al abrir un segmento se carga su indice, se descartan las entradas posteriores al final real y se recorre
+ *    desde la ultima entrada valida hasta el primer byte 0. Un registro a medio escribir (sin '\n') se borra.
+ *
+ * POLITICA DE SINCRONIZACION (EventLogSyncPolicy):
+ *    - EVENT_LOG_SYNC_NONE: el sistema operativo escribe las paginas cuando quiere. Lo mas rapido.
+ *    - EVENT_LOG_SYNC_GROUP: commit agrupado. Agregar es solo un memcpy al mapeo; cada syncIntervalMs el broker
+ *      llama a EventLogSync (o a EventLogCollectDirty + EventLogSyncRanges fuera de su lock) y un solo
+ *      msync/FlushViewOfFile por segmento hace durables todos los eventos acumulados.
+ *    - EVENT_LOG_SYNC_ALWAYS: cada evento se sincroniza antes de volver. Durable pero lento: el publish espera al disco.
+ *
+ * RETENCION:
+ *    Cada topic conserva a lo sumo maxSegments segmentos (EVENT_LOG_MAX_SEGMENTS por defecto): al abrir uno nuevo
+ *    el mas viejo sale del topic y se desmapea y se borra del disco (.log e .idx). Tambien al cargar un topic con
+ *    mas segmentos de una ejecucion anterior. El registro acepta hasta maxTopics topics (EVENT_LOG_MAX_TOPICS);
+ *    los eventos de topics nuevos por encima del limite no se registran.
+ *    Un segmento que todavia se esta leyendo (tramo entregado a msquic, cursor de reenvio o tramo capturado por
+ *    EventLogCollectDirty) tiene pins > 0: al retirarlo queda en la lista retired, mapeado, y se borra en la
+ *    primera pasada (EventLogSweepRetired, al abrir un segmento o al capturar tramos) despues del ultimo
+ *    EventLogUnpin. Asi un puntero obtenido en EventLogReplay sigue siendo valido mientras tenga su pin.
+ *
+ * Las funciones no toman locks: el broker serializa el acceso igual que con routing.h. La excepcion es
+ * EventLogUnpin, que es atomico y se puede llamar desde cualquier hilo (por ejemplo en SEND_COMPLETE).
+ *
+ * LIBRERIAS UTILIZADAS Y JUSTIFICACION:
+ *
+ * 1. stdio.h / stdlib.h / string.h (libreria estandar)
+ *    - Por que: Archivos de indice, tablas dinamicas y armado de rutas.
+ *    - Funciones usadas: fopen(), fread(), fwrite(), fflush(), fclose(), malloc(), calloc(), realloc(), free(),
+ *      qsort(), snprintf(), memchr(), memcpy(), memmove(), memset(), strtoull(), remove().
+ *
+ * 2. stdatomic.h (libreria estandar C11)
+ *    - Por que: Contador de pins de cada segmento; msquic lo descuenta desde sus hilos sin el lock del broker.
+ *    - Funciones usadas: atomic_init(), atomic_fetch_add_explicit(), atomic_fetch_sub_explicit(), atomic_load_explicit().
+ *
+ * 3. windows.h (Windows) / sys/mman.h, fcntl.h, unistd.h, dirent.h, sys/stat.h, errno.h, time.h (Linux)
+ *    - Por que: Mapear los segmentos en memoria, sincronizarlos con el disco y listar el directorio de un topic.
+ *    - Funciones usadas: CreateFileA(), GetFileSizeEx(), CreateFileMappingA(), MapViewOfFile(),
+ *      FlushViewOfFile(), FlushFileBuffers(), UnmapViewOfFile(), CreateDirectoryA(), FindFirstFileA(),
+ *      GetSystemTimeAsFileTime(); open(), ftruncate(), mmap(), msync(), munmap(), mkdir(), opendir(), clock_gettime().
+ *    - Alternativa considerada: fwrite() + fflush() a un archivo por topic; descartado porque cada evento pagaria
+ *      una llamada al sistema en el camino del publish y el reenvio tendria que copiar a un buffer de usuario.
+ */
+
+#ifndef EVENT_LOG_H
+#define EVENT_LOG_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#define EVENT_LOG_TOPIC_LEN 64
+#define EVENT_LOG_PATH_LEN 512
+#define EVENT_LOG_SEGMENT_BYTES (16u * 1024u * 1024u)
+#define EVENT_LOG_INDEX_BYTES 4096u
+#define EVENT_LOG_NO_INDEX (-1)
+#define EVENT_LOG_MAX_SEGMENTS 8u    /* Por topic: 128 MB de historial con el tamano de segmento por defecto */
+#define EVENT_LOG_MAX_TOPICS 1024u
+
+typedef enum EventLogSyncPolicy {
+    EVENT_LOG_SYNC_NONE = 0,
+    EVENT_LOG_SYNC_GROUP,
+    EVENT_LOG_SYNC_ALWAYS
+} EventLogSyncPolicy;
+
+typedef struct EventLogIndexEntry {
+    uint64_t offset;
+    uint64_t timestampMs;
+    uint32_t position;
+    uint32_t reserved;
+} EventLogIndexEntry;
+
+struct EventLogTopic;
+
+typedef struct EventLogSegment {
+    uint64_t baseOffset;
+    uint64_t nextOffset;
+    uint32_t size;
+    uint32_t capacity;
+    uint32_t syncedSize;
+    uint32_t lastIndexed;
+    char* data;
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#else
+    int file;
+#endif
+    FILE* indexFile;
+    EventLogIndexEntry* index;
+    int32_t indexCount;
+    int32_t indexCapacity;
+    const struct EventLogTopic* owner;         /* Para armar la ruta al borrarlo */
+    atomic_int pins;                           /* Lectores que todavia apuntan al mapeo */
+    struct EventLogSegment* nextRetired;       /* Lista de segmentos retirados con pins pendientes */
+} EventLogSegment;
+
+/* Los segmentos se guardan por puntero para que su direccion no cambie al crecer el arreglo. */
+typedef struct EventLogTopic {
+    char name[EVENT_LOG_TOPIC_LEN];
+    char path[EVENT_LOG_PATH_LEN];
+    uint32_t hash;
+    EventLogSegment** segments;
+    int32_t segmentCount;
+    int32_t segmentCapacity;
+    int32_t firstDirty;
+} EventLogTopic;
+
+typedef struct EventLog {
+    char directory[EVENT_LOG_PATH_LEN];
+    EventLogSyncPolicy policy;
+    uint32_t syncIntervalMs;
+    uint32_t segmentBytes;
+    EventLogTopic** topics;
+    int32_t topicCount;
+    int32_t topicCapacity;
+    int32_t* slots;
+    uint32_t slotMask;
+    uint32_t maxSegments;
+    uint32_t maxTopics;
+    int topicLimitReported;
+    EventLogSegment* retired;
+    uint64_t appended;
+    uint64_t syncs;
+    uint64_t retiredSegments;
+} EventLog;
+
+/* Tramo pendiente de sincronizar, capturado con el lock del broker y sincronizado fuera de el. */
+typedef struct EventLogDirtyRange {
+    EventLogSegment* segment;
+    uint32_t start;
+    uint32_t end;
+} EventLogDirtyRange;
+
+/* Punto de partida de un reenvio: un offset o una hora (milisegundos desde 1970). */
+typedef struct EventLogStart {
+    uint8_t byTime;
+    uint64_t value;
+} EventLogStart;
+
+/*
+ * Recibe cada tramo contiguo de un reenvio; devuelve 0 si el envio fallo. Si el tramo se sigue usando despues de
+ * volver (un envio asincronico) el sink toma un pin con EventLogPin y lo suelta con EventLogUnpin.
+ */
+typedef int (*EventLogSink)(void* context, EventLogSegment* segment, uint32_t position, uint32_t length);
+
+static inline uint64_t EventLogNowMs(void) {
+#ifdef _WIN32
+    FILETIME now;
+    GetSystemTimeAsFileTime(&now);
+    uint64_t ticks = ((uint64_t)now.dwHighDateTime << 32) | now.dwLowDateTime;
+    return ticks / 10000ULL - 11644473600000ULL;
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return (uint64_t)now.tv_sec * 1000ULL + (uint64_t)now.tv_nsec / 1000000ULL;
+#endif
+}
+
+static inline int EventLogMakeDirectory(const char* path) {
+#ifdef _WIN32
+    return CreateDirectoryA(path, NULL) || GetLastError() == ERROR_ALREADY_EXISTS;
+#else
+    return mkdir(path, 0755) == 0 || errno == EEXIST;
+#endif
+}
+
+static inline uint32_t EventLogHash(const char* topic) {
+    uint32_t hash = 2166136261u;
+    for (const unsigned char* cursor = (const unsigned char*)topic; *cursor != '\0'; ++cursor) {
+        hash ^= *cursor;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/* Nombre de directorio para el topic: "futbol/liga 1" -> "futbol%2Fliga%201". */
+static inline void EventLogEncodeTopic(char* destination, size_t capacity, const char* topic) {
+    static const char hex[] = "0123456789ABCDEF";
+    size_t used = 0;
+    for (const unsigned char* cursor = (const unsigned char*)topic; *cursor != '\0' && used + 4 <= capacity; ++cursor) {
+        unsigned char c = *cursor;
+        int plain = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+                    c == '_' || c == '-' || (c == '.' && cursor != (const unsigned char*)topic);
+        if (plain) {
+            destination[used++] = (char)c;
+        } else {
+            destination[used++] = '%';
+            destination[used++] = hex[c >> 4];
+            destination[used++] = hex[c & 0x0F];
+        }
+    }
+    destination[used] = '\0';
+}
+
+/* Acepta "" (desde el principio), "<offset>" o "@<milisegundos desde 1970>". */
+static inline int EventLogParseStart(const char* text, EventLogStart* start) {
+    start->byTime = 0;
+    start->value = 0;
+    if (text == NULL || *text == '\0') {
+        return 1;
+    }
+    if (*text == '@') {
+        start->byTime = 1;
+        text++;
+    }
+    if (*text < '0' || *text > '9') {
+        return 0;
+    }
+    char* end = NULL;
+    start->value = strtoull(text, &end, 10);
+    return *end == '\0' || *end == '\r' || *end == '\n';
+}
+
+/* ---------------------------------------------------------------------------------------------------------
+ * Segmentos
+ * --------------------------------------------------------------------------------------------------------- */
+
+static inline int EventLogAddIndexEntry(EventLogSegment* segment, uint64_t offset, uint32_t position, uint64_t timestampMs, int persist) {
+    if (segment->indexCount == segment->indexCapacity) {
+        int32_t capacity = segment->indexCapacity == 0 ? 64 : segment->indexCapacity * 2;
+        EventLogIndexEntry* grown = (EventLogIndexEntry*)realloc(segment->index, sizeof(EventLogIndexEntry) * (size_t)capacity);
+        if (grown == NULL) {
+            return 0;
+        }
+        segment->index = grown;
+        segment->indexCapacity = capacity;
+    }
+
+    EventLogIndexEntry* entry = &segment->index[segment->indexCount++];
+    entry->offset = offset;
+    entry->timestampMs = timestampMs;
+    entry->position = position;
+    entry->reserved = 0;
+    segment->lastIndexed = position;
+    if (persist && segment->indexFile != NULL) {
+        fwrite(entry, sizeof(*entry), 1, segment->indexFile);
+    }
+    return 1;
+}
+
+static inline void EventLogSegmentPath(char* path, size_t capacity, const EventLogTopic* topic, uint64_t baseOffset, const char* extension) {
+    snprintf(path, capacity, "%s/%020llu.%s", topic->path, (unsigned long long)baseOffset, extension);
+}
+
+static inline void EventLogPin(EventLogSegment* segment) {
+    atomic_fetch_add_explicit(&segment->pins, 1, memory_order_relaxed);
+}
+
+static inline void EventLogUnpin(EventLogSegment* segment) {
+    atomic_fetch_sub_explicit(&segment->pins, 1, memory_order_release);
+}
+
+static inline void EventLogUnmapSegment(EventLogSegment* segment) {
+#ifdef _WIN32
+    if (segment->data != NULL) {
+        UnmapViewOfFile(segment->data);
+    }
+    if (segment->mapping != NULL) {
+        CloseHandle(segment->mapping);
+    }
+    if (segment->file != INVALID_HANDLE_VALUE) {
+        CloseHandle(segment->file);
+    }
+#else
+    if (segment->data != NULL) {
+        munmap(segment->data, segment->capacity);
+    }
+    if (segment->file >= 0) {
+        close(segment->file);
+    }
+#endif
+    if (segment->indexFile != NULL) {
+        fclose(segment->indexFile);
+    }
+    free(segment->index);
+    free(segment);
+}
+
+/* Crea el archivo (o abre el existente) con el tamano del segmento y lo mapea completo. */
+static inline int EventLogMapSegment(EventLogSegment* segment, const char* path, uint32_t capacity) {
+    segment->capacity = capacity;
+#ifdef _WIN32
+    segment->file = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, OPEN_ALWAYS,
+                                FILE_ATTRIBUTE_NORMAL, NULL);
+    if (segment->file == INVALID_HANDLE_VALUE) {
+        return 0;
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(segment->file, &size)) {
+        return 0;
+    }
+    if (size.QuadPart > 0) {
+        segment->capacity = (uint32_t)size.QuadPart;
+    }
+    segment->mapping = CreateFileMappingA(segment->file, NULL, PAGE_READWRITE, 0, segment->capacity, NULL);
+    if (segment->mapping == NULL) {
+        return 0;
+    }
+    segment->data = (char*)MapViewOfFile(segment->mapping, FILE_MAP_WRITE, 0, 0, segment->capacity);
+    return segment->data != NULL;
+#else
+    segment->file = open(path, O_RDWR | O_CREAT, 0644);
+    if (segment->file < 0) {
+        return 0;
+    }
+    struct stat info;
+    if (fstat(segment->file, &info) != 0) {
+        return 0;
+    }
+    if (info.st_size > 0) {
+        segment->capacity = (uint32_t)info.st_size;
+    } else if (ftruncate(segment->file, (off_t)capacity) != 0) {
+        return 0;
+    }
+    void* data = mmap(NULL, segment->capacity, PROT_READ | PROT_WRITE, MAP_SHARED, segment->file, 0);
+    if (data == MAP_FAILED) {
+        return 0;
+    }
+    segment->data = (char*)data;
+    return 1;
+#endif
+}
+
+/*
+ * Abre un segmento: carga su indice, descarta las entradas que apuntan mas alla de lo escrito y recorre desde la
+ * ultima entrada valida hasta el final para contar los registros y completar el indice.
+ */
+static inline EventLogSegment* EventLogOpenSegment(EventLog* log, EventLogTopic* topic, uint64_t baseOffset) {
+    EventLogSegment* segment = (EventLogSegment*)calloc(1, sizeof(EventLogSegment));
+    if (segment == NULL) {
+        return NULL;
+    }
+#ifdef _WIN32
+    segment->file = INVALID_HANDLE_VALUE;
+#else
+    segment->file = -1;
+#endif
+    segment->baseOffset = baseOffset;
+    segment->owner = topic;
+    atomic_init(&segment->pins, 0);
+
+    char path[EVENT_LOG_PATH_LEN + 32];
+    EventLogSegmentPath(path, sizeof(path), topic, baseOffset, "log");
+    if (!EventLogMapSegment(segment, path, log->segmentBytes)) {
+        fprintf(stderr, "[REGISTRO] No se pudo mapear %s\n", path);
+        EventLogUnmapSegment(segment);
+        return NULL;
+    }
+
+    EventLogSegmentPath(path, sizeof(path), topic, baseOffset, "idx");
+    FILE* indexFile = fopen(path, "rb");
+    if (indexFile != NULL) {
+        EventLogIndexEntry entry;
+        while (fread(&entry, sizeof(entry), 1, indexFile) == 1) {
+            if (entry.position >= segment->capacity || (entry.position > 0 && segment->data[entry.position - 1] != '\n') ||
+                segment->data[entry.position] == '\0') {
+                break;
+            }
+            EventLogAddIndexEntry(segment, entry.offset, entry.position, entry.timestampMs, 0);
+        }
+        fclose(indexFile);
+    }
+
+    uint64_t offset = baseOffset;
+    uint32_t position = 0;
+    uint64_t timestampMs = 0;
+    if (segment->indexCount > 0) {
+        offset = segment->index[segment->indexCount - 1].offset;
+        position = segment->index[segment->indexCount - 1].position;
+        timestampMs = segment->index[segment->indexCount - 1].timestampMs;
+    }
+    uint32_t end = position;
+    while (position < segment->capacity && segment->data[position] != '\0') {
+        const char* newline = (const char*)memchr(segment->data + position, '\n', segment->capacity - position);
+        if (newline == NULL) {
+            break;
+        }
+        uint32_t next = (uint32_t)(newline - segment->data) + 1;
+        if (memchr(segment->data + position, '\0', next - position) != NULL) {
+            break;
+        }
+        if (position - segment->lastIndexed >= EVENT_LOG_INDEX_BYTES || segment->indexCount == 0) {
+            EventLogAddIndexEntry(segment, offset, position, timestampMs, 0);
+        }
+        offset++;
+        position = next;
+        end = next;
+    }
+    /* Lo que sigue al ultimo '\n' es un registro incompleto (caida a mitad de escritura). */
+    if (end < segment->capacity) {
+        uint32_t tail = end;
+        while (tail < segment->capacity && segment->data[tail] != '\0') {
+            segment->data[tail++] = '\0';
+        }
+    }
+    segment->size = end;
+    segment->syncedSize = end;
+    segment->nextOffset = offset;
+
+    /* El indice se reescribe con las entradas validas y luego solo se agrega al final. */
+    segment->indexFile = fopen(path, "wb");
+    if (segment->indexFile != NULL && segment->indexCount > 0) {
+        fwrite(segment->index, sizeof(EventLogIndexEntry), (size_t)segment->indexCount, segment->indexFile);
+        fflush(segment->indexFile);
+    }
+    return segment;
+}
+
+static inline int EventLogAppendSegment(EventLogTopic* topic, EventLogSegment* segment) {
+    if (topic->segmentCount == topic->segmentCapacity) {
+        int32_t capacity = topic->segmentCapacity == 0 ? 4 : topic->segmentCapacity * 2;
+        EventLogSegment** grown = (EventLogSegment**)realloc(topic->segments, sizeof(EventLogSegment*) * (size_t)capacity);
+        if (grown == NULL) {
+            return 0;
+        }
+        topic->segments = grown;
+        topic->segmentCapacity = capacity;
+    }
+    topic->segments[topic->segmentCount++] = segment;
+    return 1;
+}
+
+/* Desmapea el segmento y borra sus archivos. */
+static inline void EventLogDeleteSegment(EventLogSegment* segment) {
+    char dataPath[EVENT_LOG_PATH_LEN + 32];
+    char indexPath[EVENT_LOG_PATH_LEN + 32];
+    EventLogSegmentPath(dataPath, sizeof(dataPath), segment->owner, segment->baseOffset, "log");
+    EventLogSegmentPath(indexPath, sizeof(indexPath), segment->owner, segment->baseOffset, "idx");
+    EventLogUnmapSegment(segment);
+    remove(indexPath);
+    if (remove(dataPath) != 0) {
+        fprintf(stderr, "[REGISTRO] No se pudo borrar el segmento %s\n", dataPath);
+    }
+}
+
+/* Borra los segmentos retirados que ya nadie lee. */
+static inline void EventLogSweepRetired(EventLog* log) {
+    EventLogSegment** link = &log->retired;
+    while (*link != NULL) {
+        EventLogSegment* segment = *link;
+        if (atomic_load_explicit(&segment->pins, memory_order_acquire) == 0) {
+            *link = segment->nextRetired;
+            EventLogDeleteSegment(segment);
+        } else {
+            link = &segment->nextRetired;
+        }
+    }
+}
+
+/* Saca del topic los segmentos mas viejos que exceden maxSegments; el ultimo (el que recibe eventos) nunca sale. */
+static inline void EventLogEnforceRetention(EventLog* log, EventLogTopic* topic) {
+    while (topic->segmentCount > (int32_t)log->maxSegments && topic->segmentCount > 1) {
+        EventLogSegment* oldest = topic->segments[0];
+        topic->segmentCount--;
+        memmove(topic->segments, topic->segments + 1, sizeof(EventLogSegment*) * (size_t)topic->segmentCount);
+        if (topic->firstDirty > 0) {
+            topic->firstDirty--;
+        }
+        oldest->nextRetired = log->retired;
+        log->retired = oldest;
+        log->retiredSegments++;
+    }
+    EventLogSweepRetired(log);
+}
+
+static inline int EventLogCompareOffsets(const void* left, const void* right) {
+    uint64_t a = *(const uint64_t*)left;
+    uint64_t b = *(const uint64_t*)right;
+    return a < b ? -1 : (a > b ? 1 : 0);
+}
+
+static inline int EventLogAddBaseOffset(uint64_t** offsets, int32_t* count, int32_t* capacity, const char* name) {
+    size_t length = strlen(name);
+    if (length != 24 || strcmp(name + 20, ".log") != 0) {
+        return 1;
+    }
+    if (*count == *capacity) {
+        int32_t grownCapacity = *capacity == 0 ? 8 : *capacity * 2;
+        uint64_t* grown = (uint64_t*)realloc(*offsets, sizeof(uint64_t) * (size_t)grownCapacity);
+        if (grown == NULL) {
+            return 0;
+        }
+        *offsets = grown;
+        *capacity = grownCapacity;
+    }
+    (*offsets)[(*count)++] = strtoull(name, NULL, 10);
+    return 1;
+}
+
+/* Abre los segmentos existentes del topic en orden de offset; si no hay ninguno crea el primero. */
+static inline int EventLogLoadTopic(EventLog* log, EventLogTopic* topic) {
+    if (!EventLogMakeDirectory(topic->path)) {
+        fprintf(stderr, "[REGISTRO] No se pudo crear el directorio %s\n", topic->path);
+        return 0;
+    }
+
+    uint64_t* offsets = NULL;
+    int32_t count = 0;
+    int32_t capacity = 0;
+    int ok = 1;
+#ifdef _WIN32
+    char pattern[EVENT_LOG_PATH_LEN + 8];
+    snprintf(pattern, sizeof(pattern), "%s\\*.log", topic->path);
+    WIN32_FIND_DATAA data;
+    HANDLE search = FindFirstFileA(pattern, &data);
+    if (search != INVALID_HANDLE_VALUE) {
+        do {
+            ok = EventLogAddBaseOffset(&offsets, &count, &capacity, data.cFileName);
+        } while (ok && FindNextFileA(search, &data));
+        FindClose(search);
+    }
+#else
+    DIR* directory = opendir(topic->path);
+    if (directory != NULL) {
+        struct dirent* entry;
+        while (ok && (entry = readdir(directory)) != NULL) {
+            ok = EventLogAddBaseOffset(&offsets, &count, &capacity, entry->d_name);
+        }
+        closedir(directory);
+    }
+#endif
+    if (!ok) {
+        free(offsets);
+        return 0;
+    }
+    if (count > 1) {
+        qsort(offsets, (size_t)count, sizeof(uint64_t), EventLogCompareOffsets);
+    }
+
+    if (count == 0) {
+        EventLogSegment* first = EventLogOpenSegment(log, topic, 0);
+        ok = first != NULL && EventLogAppendSegment(topic, first);
+    }
+    for (int32_t i = 0; ok && i < count; ++i) {
+        EventLogSegment* segment = EventLogOpenSegment(log, topic, offsets[i]);
+        ok = segment != NULL && EventLogAppendSegment(topic, segment);
+    }
+    free(offsets);
+    topic->firstDirty = topic->segmentCount - 1;
+    if (ok) {
+        EventLogEnforceRetention(log, topic);
+    }
+    return ok;
+}
+
+/* ---------------------------------------------------------------------------------------------------------
+ * Registro
+ * --------------------------------------------------------------------------------------------------------- */
+
+static inline int EventLogOpen(EventLog* log, const char* directory, EventLogSyncPolicy policy, uint32_t syncIntervalMs) {
+    memset(log, 0, sizeof(*log));
+    snprintf(log->directory, sizeof(log->directory), "%s", directory);
+    log->policy = policy;
+    log->syncIntervalMs = syncIntervalMs;
+    log->segmentBytes = EVENT_LOG_SEGMENT_BYTES;
+    log->maxSegments = EVENT_LOG_MAX_SEGMENTS;
+    log->maxTopics = EVENT_LOG_MAX_TOPICS;
+    if (!EventLogMakeDirectory(log->directory)) {
+        fprintf(stderr, "[REGISTRO] No se pudo crear el directorio %s\n", log->directory);
+        return 0;
+    }
+    return 1;
+}
+
+static inline int EventLogResizeSlots(EventLog* log, uint32_t slotCount) {
+    int32_t* slots = (int32_t*)malloc(sizeof(int32_t) * slotCount);
+    if (slots == NULL) {
+        return 0;
+    }
+    for (uint32_t i = 0; i < slotCount; ++i) {
+        slots[i] = EVENT_LOG_NO_INDEX;
+    }
+    uint32_t mask = slotCount - 1;
+    for (int32_t id = 0; id < log->topicCount; ++id) {
+        uint32_t slot = log->topics[id]->hash & mask;
+        while (slots[slot] != EVENT_LOG_NO_INDEX) {
+            slot = (slot + 1) & mask;
+        }
+        slots[slot] = id;
+    }
+    free(log->slots);
+    log->slots = slots;
+    log->slotMask = mask;
+    return 1;
+}
+
+/* Ubica el registro del topic; con create lo abre (o lo crea en disco) si todavia no estaba cargado. */
+static inline EventLogTopic* EventLogFindTopic(EventLog* log, const char* name, int create) {
+    uint32_t hash = EventLogHash(name);
+    if (log->slots != NULL) {
+        for (uint32_t slot = hash & log->slotMask; log->slots[slot] != EVENT_LOG_NO_INDEX; slot = (slot + 1) & log->slotMask) {
+            EventLogTopic* topic = log->topics[log->slots[slot]];
+            if (topic->hash == hash && strcmp(topic->name, name) == 0) {
+                return topic;
+            }
+        }
+    }
+    if (!create || strlen(name) >= EVENT_LOG_TOPIC_LEN) {
+        return NULL;
+    }
+    if ((uint32_t)log->topicCount >= log->maxTopics) {
+        if (!log->topicLimitReported) {
+            fprintf(stderr, "[REGISTRO] Limite de %u topics alcanzado; los topics nuevos (como '%s') no se registran\n",
+                    log->maxTopics, name);
+            log->topicLimitReported = 1;
+        }
+        return NULL;
+    }
+
+    if ((uint32_t)(log->topicCount + 1) * 2 > (log->slots == NULL ? 0 : log->slotMask + 1)) {
+        if (!EventLogResizeSlots(log, log->slots == NULL ? 64 : (log->slotMask + 1) * 2)) {
+            return NULL;
+        }
+    }
+    if (log->topicCount == log->topicCapacity) {
+        int32_t capacity = log->topicCapacity == 0 ? 16 : log->topicCapacity * 2;
+        EventLogTopic** grown = (EventLogTopic**)realloc(log->topics, sizeof(EventLogTopic*) * (size_t)capacity);
+        if (grown == NULL) {
+            return NULL;
+        }
+        log->topics = grown;
+        log->topicCapacity = capacity;
+    }
+
+    EventLogTopic* topic = (EventLogTopic*)calloc(1, sizeof(EventLogTopic));
+    if (topic == NULL) {
+        return NULL;
+    }
+    memcpy(topic->name, name, strlen(name) + 1);
+    topic->hash = hash;
+    char encoded[3 * EVENT_LOG_TOPIC_LEN + 1];
+    EventLogEncodeTopic(encoded, sizeof(encoded), name);
+    snprintf(topic->path, sizeof(topic->path), "%s/%s", log->directory, encoded);
+    if (!EventLogLoadTopic(log, topic)) {
+        for (int32_t i = 0; i < topic->segmentCount; ++i) {
+            EventLogUnmapSegment(topic->segments[i]);
+        }
+        free(topic->segments);
+        free(topic);
+        return NULL;
+    }
+
+    int32_t id = log->topicCount++;
+    log->topics[id] = topic;
+    uint32_t slot = hash & log->slotMask;
+    while (log->slots[slot] != EVENT_LOG_NO_INDEX) {
+        slot = (slot + 1) & log->slotMask;
+    }
+    log->slots[slot] = id;
+    return topic;
+}
+
+static inline void EventLogSyncRange(EventLogSegment* segment, uint32_t start, uint32_t end) {
+    if (end <= start) {
+        return;
+    }
+#ifdef _WIN32
+    FlushViewOfFile(segment->data + start, end - start);
+    FlushFileBuffers(segment->file);
+#else
+    uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+    uintptr_t first = ((uintptr_t)(segment->data + start)) & ~(page - 1);
+    msync((void*)first, (size_t)((uintptr_t)(segment->data + end) - first), MS_SYNC);
+#endif
+}
+
+/*
+ * Agrega un registro (una linea terminada en '\n', sin bytes 0) al final del topic y devuelve su offset, o -1 si
+ * no se pudo. Con EVENT_LOG_SYNC_ALWAYS vuelve despues de sincronizarlo.
+ */
+static inline int64_t EventLogAppend(EventLog* log, const char* topicName, const char* record, uint32_t length) {
+    if (length == 0 || record[length - 1] != '\n' || memchr(record, '\0', length) != NULL) {
+        return -1;
+    }
+    EventLogTopic* topic = EventLogFindTopic(log, topicName, 1);
+    if (topic == NULL) {
+        return -1;
+    }
+
+    EventLogSegment* segment = topic->segments[topic->segmentCount - 1];
+    if (length > segment->capacity - segment->size) {
+        if (length > log->segmentBytes) {
+            return -1;
+        }
+        EventLogSegment* next = EventLogOpenSegment(log, topic, segment->nextOffset);
+        if (next == NULL || !EventLogAppendSegment(topic, next)) {
+            if (next != NULL) {
+                EventLogUnmapSegment(next);
+            }
+            return -1;
+        }
+        if (segment->indexFile != NULL) {
+            fflush(segment->indexFile);
+        }
+        segment = next;
+        EventLogEnforceRetention(log, topic);
+    }
+
+    uint32_t position = segment->size;
+    if (segment->indexCount == 0 || position - segment->lastIndexed >= EVENT_LOG_INDEX_BYTES) {
+        EventLogAddIndexEntry(segment, segment->nextOffset, position, EventLogNowMs(), 1);
+    }
+    memcpy(segment->data + position, record, length);
+    segment->size += length;
+    uint64_t offset = segment->nextOffset++;
+    log->appended++;
+
+    if (log->policy == EVENT_LOG_SYNC_ALWAYS) {
+        EventLogSyncRange(segment, segment->syncedSize, segment->size);
+        segment->syncedSize = segment->size;
+        topic->firstDirty = topic->segmentCount - 1;
+        log->syncs++;
+    }
+    return (int64_t)offset;
+}
+
+/*
+ * Primera fase del commit agrupado (con el lock del broker tomado): copia en ranges los tramos escritos desde la
+ * ultima sincronizacion y los marca como sincronizados. Devuelve cuantos tramos copio; si hay mas que capacity,
+ * los restantes quedan para la proxima llamada. Cada tramo tiene un pin hasta EventLogSyncRanges.
+ */
+static inline int32_t EventLogCollectDirty(EventLog* log, EventLogDirtyRange* ranges, int32_t capacity) {
+    EventLogSweepRetired(log);
+    int32_t count = 0;
+    for (int32_t id = 0; id < log->topicCount && count < capacity; ++id) {
+        EventLogTopic* topic = log->topics[id];
+        for (int32_t i = topic->firstDirty; i < topic->segmentCount && count < capacity; ++i) {
+            EventLogSegment* segment = topic->segments[i];
+            if (segment->size > segment->syncedSize) {
+                ranges[count].segment = segment;
+                ranges[count].start = segment->syncedSize;
+                ranges[count].end = segment->size;
+                EventLogPin(segment);
+                count++;
+                segment->syncedSize = segment->size;
+            }
+            if (segment->indexFile != NULL) {
+                fflush(segment->indexFile);
+            }
+            topic->firstDirty = i;
+        }
+    }
+    return count;
+}
+
+/* Segunda fase (sin lock): los pins mantienen los segmentos mapeados, asi que se puede sincronizar mientras otros agregan. */
+static inline void EventLogSyncRanges(const EventLogDirtyRange* ranges, int32_t count) {
+    for (int32_t i = 0; i < count; ++i) {
+        EventLogSyncRange(ranges[i].segment, ranges[i].start, ranges[i].end);
+        EventLogUnpin(ranges[i].segment);
+    }
+}
+
+/* Commit agrupado en un solo paso, para brokers de un hilo. Devuelve cuantos tramos sincronizo. */
+static inline int32_t EventLogSync(EventLog* log) {
+    EventLogDirtyRange ranges[64];
+    int32_t total = 0;
+    int32_t count;
+    while ((count = EventLogCollectDirty(log, ranges, 64)) > 0) {
+        EventLogSyncRanges(ranges, count);
+        total += count;
+    }
+    if (total > 0) {
+        log->syncs++;
+    }
+    return total;
+}
+
+/* Posicion del registro offset dentro del segmento: busca en el indice y cuenta lineas desde ahi. */
+static inline uint32_t EventLogLocate(const EventLogSegment* segment, uint64_t offset) {
+    int32_t low = 0;
+    int32_t high = segment->indexCount - 1;
+    int32_t best = -1;
+    while (low <= high) {
+        int32_t middle = low + (high - low) / 2;
+        if (segment->index[middle].offset <= offset) {
+            best = middle;
+            low = middle + 1;
+        } else {
+            high = middle - 1;
+        }
+    }
+    if (best < 0) {
+        return 0;
+    }
+
+    uint64_t current = segment->index[best].offset;
+    uint32_t position = segment->index[best].position;
+    while (current < offset && position < segment->size) {
+        const char* newline = (const char*)memchr(segment->data + position, '\n', segment->size - position);
+        if (newline == NULL) {
+            return segment->size;
+        }
+        position = (uint32_t)(newline - segment->data) + 1;
+        current++;
+    }
+    return position;
+}
+
+/* Convierte una hora en el offset de la ultima entrada de indice con hora <= la pedida. */
+static inline uint64_t EventLogOffsetForTime(const EventLogTopic* topic, uint64_t timestampMs) {
+    uint64_t offset = topic->segments[0]->baseOffset;
+    for (int32_t i = 0; i < topic->segmentCount; ++i) {
+        const EventLogSegment* segment = topic->segments[i];
+        for (int32_t j = 0; j < segment->indexCount; ++j) {
+            if (segment->index[j].timestampMs > timestampMs) {
+                return offset;
+            }
+            offset = segment->index[j].offset;
+        }
+    }
+    return offset;
+}
+
+/* Registro del topic para un reenvio, o NULL si no tiene eventos (tampoco de una ejecucion anterior). */
+static inline EventLogTopic* EventLogReplayTopic(EventLog* log, const char* topicName) {
+    EventLogTopic* topic = EventLogFindTopic(log, topicName, 0);
+    if (topic == NULL) {
+        /* Puede tener eventos de una ejecucion anterior que todavia no se cargaron. */
+        char encoded[3 * EVENT_LOG_TOPIC_LEN + 1];
+        char path[EVENT_LOG_PATH_LEN];
+        EventLogEncodeTopic(encoded, sizeof(encoded), topicName);
+        snprintf(path, sizeof(path), "%s/%s", log->directory, encoded);
+#ifdef _WIN32
+        DWORD attributes = GetFileAttributesA(path);
+        int exists = attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+#else
+        struct stat info;
+        int exists = stat(path, &info) == 0 && S_ISDIR(info.st_mode);
+#endif
+        if (!exists) {
+            return NULL;
+        }
+        topic = EventLogFindTopic(log, topicName, 1);
+    }
+    return topic;
+}
+
+/*
+ * Entrega a sink los registros del topic desde start hasta el final actual, un tramo contiguo por segmento.
+ * Devuelve los bytes entregados, 0 si el topic no tiene eventos y -1 si el sink fallo.
+ */
+static inline int64_t EventLogReplay(EventLog* log, const char* topicName, const EventLogStart* start, EventLogSink sink, void* context) {
+    EventLogTopic* topic = EventLogReplayTopic(log, topicName);
+    if (topic == NULL) {
+        return 0;
+    }
+
+    uint64_t offset = start->byTime ? EventLogOffsetForTime(topic, start->value) : start->value;
+    int64_t sent = 0;
+    for (int32_t i = 0; i < topic->segmentCount; ++i) {
+        EventLogSegment* segment = topic->segments[i];
+        if (segment->nextOffset <= offset || segment->size == 0) {
+            continue;
+        }
+        uint32_t position = offset > segment->baseOffset ? EventLogLocate(segment, offset) : 0;
+        if (position >= segment->size) {
+            continue;
+        }
+        if (!sink(context, segment, position, segment->size - position)) {
+            return -1;
+        }
+        sent += segment->size - position;
+    }
+    return sent;
+}
+
+/*
+ * Reenvio por partes, para un broker que no puede bloquearse esperando al socket: el cursor recuerda el segmento
+ * (con un pin, asi la retencion no lo borra mientras se envia) y la posicion del proximo byte. El final se vuelve
+ * a leer en cada consulta: lo que se agrega durante el reenvio tambien sale. Si el cursor se atrasa mas que la
+ * retencion, al terminar su segmento sigue por el mas viejo que quede.
+ */
+typedef struct EventLogCursor {
+    EventLogTopic* topic;
+    EventLogSegment* segment;
+    uint32_t position;
+} EventLogCursor;
+
+/* Ubica el cursor en start. Devuelve 0 si el topic no tiene registro (no hay nada que reenviar). */
+static inline int EventLogCursorOpen(EventLog* log, const char* topicName, const EventLogStart* start, EventLogCursor* cursor) {
+    memset(cursor, 0, sizeof(*cursor));
+    EventLogTopic* topic = EventLogReplayTopic(log, topicName);
+    if (topic == NULL) {
+        return 0;
+    }
+    cursor->topic = topic;
+
+    uint64_t offset = start->byTime ? EventLogOffsetForTime(topic, start->value) : start->value;
+    for (int32_t i = 0; i < topic->segmentCount; ++i) {
+        EventLogSegment* segment = topic->segments[i];
+        if (segment->nextOffset > offset && segment->size > 0) {
+            cursor->segment = segment;
+            cursor->position = offset > segment->baseOffset ? EventLogLocate(segment, offset) : 0;
+            EventLogPin(segment);
+            return 1;
+        }
+    }
+    /* El offset esta mas alla de lo escrito: el cursor espera al final del ultimo segmento. */
+    cursor->segment = topic->segments[topic->segmentCount - 1];
+    cursor->position = cursor->segment->size;
+    EventLogPin(cursor->segment);
+    return 1;
+}
+
+/* Tramo contiguo que falta enviar; devuelve 0 si el cursor llego al final actual del topic. */
+static inline int EventLogCursorPeek(EventLogCursor* cursor, const char** data, uint32_t* length) {
+    if (cursor->topic == NULL) {
+        return 0;
+    }
+    for (;;) {
+        EventLogSegment* segment = cursor->segment;
+        if (cursor->position < segment->size) {
+            *data = segment->data + cursor->position;
+            *length = segment->size - cursor->position;
+            return 1;
+        }
+        /* El segmento puede haber salido del topic: se busca el siguiente por offset, no por posicion. */
+        EventLogSegment* next = NULL;
+        for (int32_t i = 0; i < cursor->topic->segmentCount && next == NULL; ++i) {
+            if (cursor->topic->segments[i]->baseOffset > segment->baseOffset) {
+                next = cursor->topic->segments[i];
+            }
+        }
+        if (next == NULL) {
+            return 0;
+        }
+        EventLogPin(next);
+        EventLogUnpin(segment);
+        cursor->segment = next;
+        cursor->position = 0;
+    }
+}
+
+static inline void EventLogCursorAdvance(EventLogCursor* cursor, uint32_t bytes) {
+    cursor->position += bytes;
+}
+
+/* Suelta el pin del cursor; el segmento se borra en la proxima pasada si ya habia sido retirado. */
+static inline void EventLogCursorClose(EventLogCursor* cursor) {
+    if (cursor->segment != NULL) {
+        EventLogUnpin(cursor->segment);
+    }
+    memset(cursor, 0, sizeof(*cursor));
+}
+
+/* Siguiente offset del topic (cantidad de eventos registrados), o 0 si no tiene registro cargado. */
+static inline uint64_t EventLogNextOffset(EventLog* log, const char* topicName) {
+    EventLogTopic* topic = EventLogFindTopic(log, topicName, 0);
+    return topic == NULL ? 0 : topic->segments[topic->segmentCount - 1]->nextOffset;
+}
+
+/*
+ * Sincroniza lo pendiente (salvo con EVENT_LOG_SYNC_NONE) y libera los mapeos. Se llama cuando ya nadie lee el
+ * registro, asi que los segmentos retirados se borran aunque les quede algun pin.
+ */
+static inline void EventLogClose(EventLog* log) {
+    if (log->policy != EVENT_LOG_SYNC_NONE) {
+        EventLogSync(log);
+    }
+    while (log->retired != NULL) {
+        EventLogSegment* segment = log->retired;
+        log->retired = segment->nextRetired;
+        EventLogDeleteSegment(segment);
+    }
+    for (int32_t id = 0; id < log->topicCount; ++id) {
+        EventLogTopic* topic = log->topics[id];
+        for (int32_t i = 0; i < topic->segmentCount; ++i) {
+            EventLogUnmapSegment(topic->segments[i]);
+        }
+        free(topic->segments);
+        free(topic);
+    }
+    free(log->topics);
+    free(log->slots);
+    memset(log, 0, sizeof(*log));
+}
+
+#endif /* EVENT_LOG_H */
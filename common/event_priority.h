@@ -0,0 +1,88 @@
+/*
+ * Archivo: event_priority.h
+ * Descripcion: Prioridad de los eventos de un partido, compartida por publishers y brokers. Un gol o una tarjeta
+ *              roja no debe esperar detras de una fila de "Disparo desviado" hacia un subscriber lento.
+ *
+ * PROTOCOLO:
+ *    La prioridad viaja como primer caracter del campo hora: "PUBLISHER|topic|!hora|mensaje" es alta y
+ *    "PUBLISHER|topic|~hora|mensaje" es baja; sin marca es normal, asi los publishers anteriores siguen igual. El
+ *    broker quita la marca al separar el mensaje (RoutingParsePublish), de modo que los subscribers reciben la
+ *    hora de siempre (y la marca de latencia "#<origen>" sigue al comienzo del campo).
+ *
+ * CLASIFICACION:
+ *    Los publishers marcan cada linea con EventPriorityClassify: goles, tarjetas rojas, penales, inicio y final
+ *    del partido van en alta; las jugadas de rutina que no cambian el partido (disparos o remates desviados,
+ *    saques de banda o de arco) van en baja; el resto, normal.
+ *
+ * LIBRERIAS UTILIZADAS Y JUSTIFICACION:
+ *
+ * 1. string.h (libreria estandar)
+ *    - Por que: Buscar las palabras clave del evento.
+ *    - Funciones usadas: strstr().
+ */
+
+#ifndef EVENT_PRIORITY_H
+#define EVENT_PRIORITY_H
+
+#include <string.h>
+
+#define EVENT_PRIORITY_LEVELS 3
+#define EVENT_PRIORITY_MARK_HIGH '!'
+#define EVENT_PRIORITY_MARK_LOW '~'
+
+/* Menor valor, mayor prioridad: sirve directamente como indice de carril. */
+typedef enum EventPriority {
+    EVENT_PRIORITY_HIGH = 0,
+    EVENT_PRIORITY_NORMAL = 1,
+    EVENT_PRIORITY_LOW = 2
+} EventPriority;
+
+static inline const char* EventPriorityName(EventPriority priority) {
+    switch (priority) {
+    case EVENT_PRIORITY_HIGH: return "alta";
+    case EVENT_PRIORITY_LOW: return "baja";
+    default: return "normal";
+    }
+}
+
+/* Prefijo del campo hora para la prioridad ("" para normal). */
+static inline const char* EventPriorityMark(EventPriority priority) {
+    switch (priority) {
+    case EVENT_PRIORITY_HIGH: return "!";
+    case EVENT_PRIORITY_LOW: return "~";
+    default: return "";
+    }
+}
+
+/* Lee la marca al comienzo del campo hora y la saltea; sin marca devuelve EVENT_PRIORITY_NORMAL. */
+static inline EventPriority EventPriorityStrip(const char** timestamp) {
+    if ((*timestamp)[0] == EVENT_PRIORITY_MARK_HIGH) {
+        (*timestamp)++;
+        return EVENT_PRIORITY_HIGH;
+    }
+    if ((*timestamp)[0] == EVENT_PRIORITY_MARK_LOW) {
+        (*timestamp)++;
+        return EVENT_PRIORITY_LOW;
+    }
+    return EVENT_PRIORITY_NORMAL;
+}
+
+static inline EventPriority EventPriorityClassify(const char* body) {
+    static const char* const high[] = {
+        "Gol", "gol", "Tarjeta roja", "Penal", "Inicio del partido", "Comienza el partido", "Final del partido"
+    };
+    static const char* const low[] = { "desviado", "Saque de banda", "Saque de arco" };
+    for (size_t i = 0; i < sizeof(high) / sizeof(high[0]); ++i) {
+        if (strstr(body, high[i]) != NULL) {
+            return EVENT_PRIORITY_HIGH;
+        }
+    }
+    for (size_t i = 0; i < sizeof(low) / sizeof(low[0]); ++i) {
+        if (strstr(body, low[i]) != NULL) {
+            return EVENT_PRIORITY_LOW;
+        }
+    }
+    return EVENT_PRIORITY_NORMAL;
+}
+
+#endif /* EVENT_PRIORITY_H */
@@ -0,0 +1,123 @@
+/*
+ * Archivo: latency_histogram.h
+ * Descripcion: Histograma de latencias con precision relativa fija (estilo HDR), para las herramientas de
+ *              medicion (BENCH/bench_pubsub.c) y los subscriptores que reportan latencias.
+ *
+ * Los valores (microsegundos) se agrupan en cubetas de potencias de dos; cada cubeta se divide en
+ * LATENCY_SUB_BUCKETS / 2 sub-cubetas lineales, asi el error relativo de cualquier valor es menor a
+ * 2 / LATENCY_SUB_BUCKETS (menos de 0.8%) desde 1 us hasta ~12 dias. Registrar es O(1) sin memoria dinamica y
+ * los percentiles se calculan recorriendo 4352 contadores. Dos histogramas se combinan sumando contadores, por
+ * eso cada hilo puede llevar el suyo sin locks y se juntan al final.
+ *
+ * LIBRERIAS UTILIZADAS Y JUSTIFICACION:
+ *
+ * 1. stdint.h / string.h (libreria estandar)
+ *    - Por que: Contadores de 64 bits y puesta a cero del histograma.
+ *    - Funciones usadas: memset().
+ *    - Alternativa considerada: Guardar todas las muestras y ordenarlas (como loadclient_quic.c con los
+ *      handshakes); descartado porque una corrida de millones de mensajes necesitaria cientos de MB y los
+ *      percentiles altos (p99.9) requieren muchas muestras.
+ */
+
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <stdint.h>
+#include <string.h>
+
+#define LATENCY_SUB_BUCKET_BITS 8
+#define LATENCY_SUB_BUCKETS (1u << LATENCY_SUB_BUCKET_BITS)
+#define LATENCY_HALF_BITS (LATENCY_SUB_BUCKET_BITS - 1)
+#define LATENCY_HALF_BUCKETS (1u << LATENCY_HALF_BITS)
+#define LATENCY_MAX_BUCKET 32
+#define LATENCY_COUNTS ((LATENCY_MAX_BUCKET + 2) << LATENCY_HALF_BITS)
+#define LATENCY_MAX_VALUE ((1ULL << (LATENCY_MAX_BUCKET + LATENCY_SUB_BUCKET_BITS)) - 1)
+
+typedef struct LatencyHistogram {
+    uint64_t counts[LATENCY_COUNTS];
+    uint64_t total;
+    uint64_t min;
+    uint64_t max;
+    uint64_t sum;
+} LatencyHistogram;
+
+static inline void LatencyHistogramInit(LatencyHistogram* histogram) {
+    memset(histogram, 0, sizeof(*histogram));
+    histogram->min = UINT64_MAX;
+}
+
+static inline uint32_t LatencyIndex(uint64_t value) {
+    int log2 = 63 - __builtin_clzll(value | (LATENCY_SUB_BUCKETS - 1));
+    int bucket = log2 - LATENCY_HALF_BITS;
+    uint32_t subBucket = (uint32_t)(value >> bucket);
+    return ((uint32_t)(bucket + 1) << LATENCY_HALF_BITS) + subBucket - LATENCY_HALF_BUCKETS;
+}
+
+/* Mayor valor que cae en la misma sub-cubeta que index (convencion HDR para reportar percentiles). */
+static inline uint64_t LatencyHighestEquivalent(uint32_t index) {
+    int bucket = (int)(index >> LATENCY_HALF_BITS) - 1;
+    uint64_t subBucket = (index & (LATENCY_HALF_BUCKETS - 1)) + LATENCY_HALF_BUCKETS;
+    if (bucket < 0) {
+        subBucket -= LATENCY_HALF_BUCKETS;
+        bucket = 0;
+    }
+    return (subBucket << bucket) + (1ULL << bucket) - 1;
+}
+
+static inline void LatencyHistogramRecord(LatencyHistogram* histogram, uint64_t value) {
+    if (value > LATENCY_MAX_VALUE) {
+        value = LATENCY_MAX_VALUE;
+    }
+    histogram->counts[LatencyIndex(value)]++;
+    histogram->total++;
+    histogram->sum += value;
+    if (value < histogram->min) {
+        histogram->min = value;
+    }
+    if (value > histogram->max) {
+        histogram->max = value;
+    }
+}
+
+static inline void LatencyHistogramMerge(LatencyHistogram* target, const LatencyHistogram* source) {
+    if (source->total == 0) {
+        return;
+    }
+    for (uint32_t i = 0; i < LATENCY_COUNTS; ++i) {
+        target->counts[i] += source->counts[i];
+    }
+    target->total += source->total;
+    target->sum += source->sum;
+    if (source->min < target->min) {
+        target->min = source->min;
+    }
+    if (source->max > target->max) {
+        target->max = source->max;
+    }
+}
+
+/* Valor bajo el cual queda el percentile% de las muestras (0 si el histograma esta vacio). */
+static inline uint64_t LatencyHistogramPercentile(const LatencyHistogram* histogram, double percentile) {
+    if (histogram->total == 0) {
+        return 0;
+    }
+    uint64_t target = (uint64_t)(percentile / 100.0 * (double)histogram->total + 0.5);
+    if (target == 0) {
+        target = 1;
+    }
+    uint64_t seen = 0;
+    for (uint32_t i = 0; i < LATENCY_COUNTS; ++i) {
+        seen += histogram->counts[i];
+        if (seen >= target) {
+            uint64_t value = LatencyHighestEquivalent(i);
+            return value < histogram->max ? value : histogram->max;
+        }
+    }
+    return histogram->max;
+}
+
+static inline double LatencyHistogramMean(const LatencyHistogram* histogram) {
+    return histogram->total == 0 ? 0.0 : (double)histogram->sum / (double)histogram->total;
+}
+
+#endif /* LATENCY_HISTOGRAM_H */
@@ -0,0 +1,186 @@
+/*
+ * Archivo: latency_stamp.h
+ * Descripcion: Marcas de tiempo de alta resolucion en el protocolo publisher -> broker -> subscriber y
+ *              estadisticas de latencia por tramo que cada subscriber lleva en su propio proceso.
+ *
+ * FORMATO:
+ *    El publisher pone en el campo de hora de "PUBLISHER|topic|hora|mensaje" su marca de origen "#<origen>" en
+ *    lugar de "HH:MM:SS". El broker registra su marca de ingreso al recibir el mensaje y reenvia la hora como
+ *    "#<origen>#<ingreso>". Ambas marcas son nanosegundos de reloj monotonico escritos como 16 digitos
+ *    hexadecimales: el ancho fijo permite codificar y decodificar sin strftime/localtime ni sscanf, y a
+ *    diferencia de 8 bytes crudos nunca contiene '|' ni '\n', que separan campos y mensajes en los tres
+ *    transportes. Una hora que no empieza con '#' (por ejemplo de un publisher anterior) se reenvia sin cambios.
+ *
+ *    Donde queda la hora en lo que recibe el subscriber:
+ *      TCP:  "[#<origen>#<ingreso>] topic: mensaje\n"
+ *      QUIC: "#<origen>#<ingreso>|mensaje\n"
+ *      UDP:  "#<origen>#<ingreso>|mensaje" (sin marca el broker UDP reenvia solo el mensaje, como antes)
+ *
+ * RELOJ:
+ *    QueryPerformanceCounter / CLOCK_MONOTONIC, comun a todos los procesos de una misma maquina. Si publisher,
+ *    broker y subscriber corren en maquinas distintas las diferencias no significan nada; una latencia negativa
+ *    no se registra y se cuenta como "desfasada". Los mensajes retenidos o reenviados desde el registro del
+ *    broker traen su marca original, asi que su latencia incluye el tiempo que pasaron guardados.
+ *
+ * LIBRERIAS UTILIZADAS Y JUSTIFICACION:
+ *
+ * 1. windows.h (Windows) / time.h (Linux)
+ *    - Por que: Reloj monotonico con resolucion de nanosegundos (o la del contador de rendimiento).
+ *    - Funciones usadas: QueryPerformanceFrequency(), QueryPerformanceCounter(), clock_gettime().
+ *    - Alternativa considerada: time()/localtime()/strftime() como antes; descartado porque la resolucion de
+ *      un segundo no alcanza para medir al broker y localtime se pagaba en cada linea.
+ *
+ * 2. stdio.h (libreria estandar)
+ *    - Por que: Resumen periodico de percentiles en consola.
+ *    - Funciones usadas: fprintf().
+ */
+
+#ifndef LATENCY_STAMP_H
+#define LATENCY_STAMP_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "latency_histogram.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#define LATENCY_STAMP_DIGITS 16
+#define LATENCY_STAMP_ORIGIN_LEN (1 + LATENCY_STAMP_DIGITS)
+#define LATENCY_STAMP_FORWARD_LEN (2 * LATENCY_STAMP_ORIGIN_LEN)
+#define LATENCY_STAMP_MARK '#'
+#define LATENCY_REPORT_INTERVAL_NS 5000000000ULL
+
+static inline uint64_t LatencyStampNowNs(void) {
+#ifdef _WIN32
+    static LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+    if (frequency.QuadPart == 0) {
+        QueryPerformanceFrequency(&frequency);
+    }
+    QueryPerformanceCounter(&counter);
+    return (uint64_t)(counter.QuadPart / frequency.QuadPart) * 1000000000ULL +
+           (uint64_t)(counter.QuadPart % frequency.QuadPart) * 1000000000ULL / (uint64_t)frequency.QuadPart;
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+#endif
+}
+
+/* Escribe "#" y 16 digitos hexadecimales (sin '\0'). */
+static inline void LatencyStampEncode(char* destination, uint64_t value) {
+    static const char digits[] = "0123456789abcdef";
+    destination[0] = LATENCY_STAMP_MARK;
+    for (int i = LATENCY_STAMP_DIGITS; i >= 1; --i) {
+        destination[i] = digits[value & 0xF];
+        value >>= 4;
+    }
+}
+
+/* Lee una marca escrita por LatencyStampEncode; devuelve 0 si no lo es. */
+static inline int LatencyStampDecode(const char* source, uint64_t* value) {
+    if (source[0] != LATENCY_STAMP_MARK) {
+        return 0;
+    }
+    uint64_t result = 0;
+    for (int i = 1; i <= LATENCY_STAMP_DIGITS; ++i) {
+        char c = source[i];
+        uint64_t digit;
+        if (c >= '0' && c <= '9') {
+            digit = (uint64_t)(c - '0');
+        } else if (c >= 'a' && c <= 'f') {
+            digit = (uint64_t)(c - 'a' + 10);
+        } else {
+            return 0;
+        }
+        result = (result << 4) | digit;
+    }
+    *value = result;
+    return 1;
+}
+
+/* Hora del publisher: marca de origen terminada en '\0' (destination con al menos LATENCY_STAMP_ORIGIN_LEN + 1). */
+static inline void LatencyStampOrigin(char* destination) {
+    LatencyStampEncode(destination, LatencyStampNowNs());
+    destination[LATENCY_STAMP_ORIGIN_LEN] = '\0';
+}
+
+/*
+ * Hora que reenvia el broker: si timestamp es una marca de origen escribe "#<origen>#<ingreso>" en destination
+ * (al menos LATENCY_STAMP_FORWARD_LEN + 1) y devuelve destination; si no, devuelve timestamp sin cambios.
+ */
+static inline const char* LatencyStampForward(const char* timestamp, uint64_t ingressNs, char* destination) {
+    uint64_t origin;
+    if (strlen(timestamp) != LATENCY_STAMP_ORIGIN_LEN || !LatencyStampDecode(timestamp, &origin)) {
+        return timestamp;
+    }
+    memcpy(destination, timestamp, LATENCY_STAMP_ORIGIN_LEN);
+    LatencyStampEncode(destination + LATENCY_STAMP_ORIGIN_LEN, ingressNs);
+    destination[LATENCY_STAMP_FORWARD_LEN] = '\0';
+    return destination;
+}
+
+/* Lee "#<origen>#<ingreso>" al comienzo de text; devuelve 0 si el mensaje no trae marcas. */
+static inline int LatencyStampParse(const char* text, size_t length, uint64_t* originNs, uint64_t* ingressNs) {
+    return length >= LATENCY_STAMP_FORWARD_LEN &&
+           LatencyStampDecode(text, originNs) &&
+           LatencyStampDecode(text + LATENCY_STAMP_ORIGIN_LEN, ingressNs);
+}
+
+/* Histogramas por tramo del subscriber (microsegundos); ~70 KB, conviene que sea estatico. */
+typedef struct LatencyStats {
+    LatencyHistogram toBroker;
+    LatencyHistogram toSubscriber;
+    uint64_t skewed;
+    uint64_t nextReportNs;
+} LatencyStats;
+
+static inline void LatencyStatsInit(LatencyStats* stats) {
+    LatencyHistogramInit(&stats->toBroker);
+    LatencyHistogramInit(&stats->toSubscriber);
+    stats->skewed = 0;
+    stats->nextReportNs = LatencyStampNowNs() + LATENCY_REPORT_INTERVAL_NS;
+}
+
+/* Registra un mensaje recibido en receivedNs; devuelve la latencia total en microsegundos. */
+static inline uint64_t LatencyStatsRecord(LatencyStats* stats, uint64_t originNs, uint64_t ingressNs, uint64_t receivedNs) {
+    if (ingressNs < originNs || receivedNs < ingressNs) {
+        stats->skewed++;
+        return 0;
+    }
+    LatencyHistogramRecord(&stats->toBroker, (ingressNs - originNs) / 1000ULL);
+    LatencyHistogramRecord(&stats->toSubscriber, (receivedNs - ingressNs) / 1000ULL);
+    return (receivedNs - originNs) / 1000ULL;
+}
+
+static inline void LatencyStatsPrint(const LatencyStats* stats, FILE* output, const char* prefix) {
+    const LatencyHistogram* toBroker = &stats->toBroker;
+    const LatencyHistogram* toSubscriber = &stats->toSubscriber;
+    if (toBroker->total == 0 && stats->skewed == 0) {
+        return;
+    }
+    fprintf(output,
+            "%s Latencia (%llu eventos, %llu desfasados): publisher->broker p50 %llu us, p99 %llu us, max %llu us | "
+            "broker->subscriber p50 %llu us, p99 %llu us, max %llu us\n",
+            prefix, (unsigned long long)toBroker->total, (unsigned long long)stats->skewed,
+            (unsigned long long)LatencyHistogramPercentile(toBroker, 50.0),
+            (unsigned long long)LatencyHistogramPercentile(toBroker, 99.0), (unsigned long long)toBroker->max,
+            (unsigned long long)LatencyHistogramPercentile(toSubscriber, 50.0),
+            (unsigned long long)LatencyHistogramPercentile(toSubscriber, 99.0), (unsigned long long)toSubscriber->max);
+}
+
+/* Imprime el resumen cada LATENCY_REPORT_INTERVAL_NS (acumulado desde el inicio). */
+static inline void LatencyStatsMaybePrint(LatencyStats* stats, uint64_t nowNs, FILE* output, const char* prefix) {
+    if (nowNs < stats->nextReportNs) {
+        return;
+    }
+    stats->nextReportNs = nowNs + LATENCY_REPORT_INTERVAL_NS;
+    LatencyStatsPrint(stats, output, prefix);
+}
+
+#endif /* LATENCY_STAMP_H */
@@ -0,0 +1,297 @@
+/*
+ * Archivo: line_feed.h
+ * Descripcion: Lectura de archivos de eventos por lineas sobre el archivo mapeado en memoria, para publishers que
+ *              reproducen archivos grandes (UDP/publisher_from_file.c).
+ *
+ * MAPEO POR VENTANAS:
+ *    El archivo no se mapea completo: se mapea una ventana (64 MB por defecto) y cuando la linea actual la
+ *    cruza se vuelve a mapear desde el comienzo de esa linea. Asi un archivo de varios GB se recorre con un
+ *    ejecutable de 32 bits y la memoria ocupada no depende del tamano del archivo. Una linea que no entra en una
+ *    ventana se entrega cortada y el resto se descarta hasta el siguiente '\n' (se cuenta en truncatedLines).
+ *
+ * LINEAS SIN COPIA:
+ *    LineFeedNext devuelve un puntero dentro del mapeo y la longitud de la linea, sin el '\n' ni el '\r' final y
+ *    sin '\0'. El puntero vale hasta la siguiente llamada (un cambio de ventana desmapea la anterior), tiempo de
+ *    sobra para pasarlo directo a send/sendto sin copiarlo a un buffer intermedio.
+ *
+ * BUSQUEDA DEL SALTO DE LINEA:
+ *    Con SSE2 (x64, o x86 compilado con -msse2) se comparan 32 bytes por iteracion contra '\n' y la mascara
+ *    indica la posicion; el resto, y los compiladores sin SSE2, usan memchr.
+ *
+ * LIBRERIAS UTILIZADAS Y JUSTIFICACION:
+ *
+ * 1. windows.h (Windows) / sys/mman.h, sys/stat.h, fcntl.h, unistd.h (Linux)
+ *    - Por que: Mapear ventanas del archivo en memoria de solo lectura.
+ *    - Funciones usadas: CreateFileA(), GetFileSizeEx(), CreateFileMappingA(), MapViewOfFile(), UnmapViewOfFile(),
+ *      CloseHandle(), GetSystemInfo(); open(), fstat(), mmap(), madvise(), munmap(), close(), sysconf().
+ *    - Alternativa considerada: fgets() con buffers de 512 o 1024 bytes como los publishers; descartado porque
+ *      copia cada linea dos veces (del cache del sistema al FILE y del FILE al buffer) y corta en silencio las
+ *      lineas largas.
+ *
+ * 2. emmintrin.h (intrinsecos SSE2) / string.h (libreria estandar)
+ *    - Por que: Buscar el '\n' de varios bytes a la vez.
+ *    - Funciones usadas: _mm_set1_epi8(), _mm_loadu_si128(), _mm_cmpeq_epi8(), _mm_movemask_epi8(), memchr().
+ */
+
+#ifndef LINE_FEED_H
+#define LINE_FEED_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define LINE_FEED_SSE2 1
+#endif
+
+#if defined(_MSC_VER) && defined(LINE_FEED_SSE2)
+#include <intrin.h>
+#endif
+
+#define LINE_FEED_DEFAULT_WINDOW (64u * 1024u * 1024u)
+
+typedef struct LineSlice {
+    const char* text;
+    size_t length;
+} LineSlice;
+
+typedef struct LineFeed {
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#else
+    int file;
+#endif
+    uint64_t fileSize;
+    uint64_t viewOffset;       /* Posicion en el archivo del primer byte de la ventana. */
+    const char* view;
+    size_t viewLength;
+    size_t windowBytes;
+    size_t granularity;        /* Las ventanas empiezan en multiplos de este valor. */
+    uint64_t position;         /* Proximo byte sin leer. */
+    int skipPending;           /* La ultima linea salio cortada: descartar hasta el proximo '\n'. */
+    uint64_t lines;
+    uint64_t truncatedLines;
+    uint64_t remaps;
+} LineFeed;
+
+#ifdef LINE_FEED_SSE2
+static inline uint32_t LineFeedLowestBit(uint32_t mask) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return (uint32_t)index;
+#else
+    return (uint32_t)__builtin_ctz(mask);
+#endif
+}
+#endif
+
+/* Primer '\n' en [cursor, end) o NULL; nunca lee fuera del rango. */
+static inline const char* LineFeedFindNewline(const char* cursor, const char* end) {
+#ifdef LINE_FEED_SSE2
+    const __m128i newline = _mm_set1_epi8('\n');
+    while (end - cursor >= 32) {
+        __m128i low = _mm_loadu_si128((const __m128i*)cursor);
+        __m128i high = _mm_loadu_si128((const __m128i*)(cursor + 16));
+        uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(low, newline)) |
+                        ((uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(high, newline)) << 16);
+        if (mask != 0) {
+            return cursor + LineFeedLowestBit(mask);
+        }
+        cursor += 32;
+    }
+#endif
+    return (const char*)memchr(cursor, '\n', (size_t)(end - cursor));
+}
+
+static inline void LineFeedUnmap(LineFeed* feed) {
+    if (feed->view != NULL) {
+#ifdef _WIN32
+        UnmapViewOfFile((LPCVOID)feed->view);
+#else
+        munmap((void*)feed->view, feed->viewLength);
+#endif
+        feed->view = NULL;
+        feed->viewLength = 0;
+    }
+}
+
+/* Mapea la ventana que contiene offset (alineada hacia abajo a la granularidad). */
+static inline int LineFeedMapAt(LineFeed* feed, uint64_t offset) {
+    uint64_t base = offset - offset % feed->granularity;
+    uint64_t remaining = feed->fileSize - base;
+    size_t length = remaining < feed->windowBytes ? (size_t)remaining : feed->windowBytes;
+
+    LineFeedUnmap(feed);
+#ifdef _WIN32
+    void* view = MapViewOfFile(feed->mapping, FILE_MAP_READ, (DWORD)(base >> 32), (DWORD)(base & 0xFFFFFFFFu), length);
+    if (view == NULL) {
+        return 0;
+    }
+#else
+    void* view = mmap(NULL, length, PROT_READ, MAP_PRIVATE, feed->file, (off_t)base);
+    if (view == MAP_FAILED) {
+        return 0;
+    }
+    madvise(view, length, MADV_SEQUENTIAL);
+#endif
+    feed->view = (const char*)view;
+    feed->viewLength = length;
+    feed->viewOffset = base;
+    feed->remaps++;
+    return 1;
+}
+
+/* windowBytes 0 usa LINE_FEED_DEFAULT_WINDOW. Devuelve 0 si el archivo no se puede abrir o mapear. */
+static inline int LineFeedOpen(LineFeed* feed, const char* path, size_t windowBytes) {
+    memset(feed, 0, sizeof(*feed));
+#ifdef _WIN32
+    SYSTEM_INFO system;
+    GetSystemInfo(&system);
+    feed->granularity = system.dwAllocationGranularity;
+    feed->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (feed->file == INVALID_HANDLE_VALUE) {
+        return 0;
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(feed->file, &size)) {
+        CloseHandle(feed->file);
+        return 0;
+    }
+    feed->fileSize = (uint64_t)size.QuadPart;
+    /* CreateFileMapping no acepta archivos vacios: sin mapeo LineFeedNext simplemente no devuelve lineas. */
+    if (feed->fileSize > 0) {
+        feed->mapping = CreateFileMappingA(feed->file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (feed->mapping == NULL) {
+            CloseHandle(feed->file);
+            return 0;
+        }
+    }
+#else
+    feed->granularity = (size_t)sysconf(_SC_PAGESIZE);
+    feed->file = open(path, O_RDONLY);
+    if (feed->file < 0) {
+        return 0;
+    }
+    struct stat info;
+    if (fstat(feed->file, &info) != 0) {
+        close(feed->file);
+        return 0;
+    }
+    feed->fileSize = (uint64_t)info.st_size;
+#endif
+
+    if (windowBytes == 0) {
+        windowBytes = LINE_FEED_DEFAULT_WINDOW;
+    }
+    /* Al menos dos unidades de granularidad: remapear desde el comienzo de una linea siempre avanza. */
+    windowBytes = (windowBytes + feed->granularity - 1) / feed->granularity * feed->granularity;
+    if (windowBytes < 2 * feed->granularity) {
+        windowBytes = 2 * feed->granularity;
+    }
+    feed->windowBytes = windowBytes;
+    return 1;
+}
+
+/* Vuelve al comienzo del archivo (para reproducirlo otra vez); la ventana actual se reutiliza si sirve. */
+static inline void LineFeedRewind(LineFeed* feed) {
+    feed->position = 0;
+    feed->skipPending = 0;
+}
+
+/*
+ * Siguiente linea en line (sin '\n' ni '\r' final). Devuelve 0 al final del archivo o si falla un mapeo.
+ * line->text apunta al mapeo y vale hasta la proxima llamada.
+ */
+static inline int LineFeedNext(LineFeed* feed, LineSlice* line) {
+    while (feed->position < feed->fileSize) {
+        if (feed->view == NULL || feed->position < feed->viewOffset ||
+            feed->position >= feed->viewOffset + feed->viewLength) {
+            if (!LineFeedMapAt(feed, feed->position)) {
+                return 0;
+            }
+        }
+
+        const char* start = feed->view + (size_t)(feed->position - feed->viewOffset);
+        const char* end = feed->view + feed->viewLength;
+        const char* newline = LineFeedFindNewline(start, end);
+        int viewReachesEnd = feed->viewOffset + feed->viewLength >= feed->fileSize;
+
+        if (newline == NULL && !viewReachesEnd && !feed->skipPending) {
+            /* La linea cruza el borde: remapear desde su comienzo si eso corre la ventana. */
+            uint64_t base = feed->position - feed->position % feed->granularity;
+            if (base != feed->viewOffset) {
+                if (!LineFeedMapAt(feed, feed->position)) {
+                    return 0;
+                }
+                start = feed->view + (size_t)(feed->position - feed->viewOffset);
+                end = feed->view + feed->viewLength;
+                newline = LineFeedFindNewline(start, end);
+                viewReachesEnd = feed->viewOffset + feed->viewLength >= feed->fileSize;
+            }
+        }
+
+        if (feed->skipPending) {
+            /* Resto de una linea cortada: se descarta hasta su '\n'. */
+            if (newline == NULL) {
+                feed->position = feed->viewOffset + feed->viewLength;
+                continue;
+            }
+            feed->position += (uint64_t)(newline - start) + 1;
+            feed->skipPending = 0;
+            continue;
+        }
+
+        size_t length;
+        if (newline != NULL) {
+            length = (size_t)(newline - start);
+            feed->position += (uint64_t)length + 1;
+        } else {
+            /* Ultima linea sin '\n', o linea mas larga que la ventana. */
+            length = (size_t)(end - start);
+            feed->position += (uint64_t)length;
+            if (!viewReachesEnd) {
+                feed->skipPending = 1;
+                feed->truncatedLines++;
+            }
+        }
+
+        if (length > 0 && start[length - 1] == '\r') {
+            length--;
+        }
+        line->text = start;
+        line->length = length;
+        feed->lines++;
+        return 1;
+    }
+    return 0;
+}
+
+static inline void LineFeedClose(LineFeed* feed) {
+    LineFeedUnmap(feed);
+#ifdef _WIN32
+    if (feed->mapping != NULL) {
+        CloseHandle(feed->mapping);
+    }
+    CloseHandle(feed->file);
+#else
+    close(feed->file);
+#endif
+    memset(feed, 0, sizeof(*feed));
+#ifndef _WIN32
+    feed->file = -1;
+#endif
+}
+
+#endif /* LINE_FEED_H */
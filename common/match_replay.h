@@ -0,0 +1,287 @@
+/*
+ * Archivo: match_replay.h
+ * Descripcion: Planificador para reproducir varios archivos de partido a la vez desde un solo proceso publisher
+ *              (modo --multi de publisher_tcp.c, publisher_udp.c y publisher_quic.c).
+ *
+ * En lugar de un hilo por archivo se usa un unico bucle de eventos con temporizador: cada partido guarda la hora
+ * de su proximo evento y el bucle atiende siempre el partido con la hora mas cercana, durmiendo solo cuando
+ * ninguno esta vencido. Los partidos arrancan escalonados dentro del primer intervalo para no enviar todos sus
+ * eventos en rafaga.
+ *
+ * Fuentes aceptadas:
+ *    - Directorio: cada archivo .txt es un partido y su topic es el nombre del archivo sin extension
+ *      (Partido1.txt -> Partido1).
+ *    - Manifiesto: archivo de texto con una linea "<topic> <ruta_archivo>" por partido; las lineas vacias o que
+ *      empiezan con '#' se ignoran y las rutas relativas se resuelven desde el directorio del manifiesto.
+ *
+ * LIBRERIAS UTILIZADAS Y JUSTIFICACION:
+ *
+ * 1. stdio.h / stdlib.h / string.h (libreria estandar)
+ *    - Por que: Lectura de los archivos de partido y del manifiesto.
+ *    - Funciones usadas: fopen(), fgets(), fclose(), calloc(), realloc(), free(), qsort(), snprintf(), strcspn().
+ *
+ * 2. windows.h (Windows) / dirent.h, time.h, unistd.h (Linux)
+ *    - Por que: Listar el directorio de partidos, reloj monotonico en milisegundos y espera hasta el proximo evento.
+ *    - Funciones usadas: FindFirstFileA(), FindNextFileA(), FindClose(), GetFileAttributesA(), GetTickCount64(),
+ *      Sleep(); opendir(), readdir(), closedir(), stat(), clock_gettime(), usleep().
+ *    - Alternativa considerada: Un hilo por partido con Sleep(); descartado porque con decenas de partidos el costo
+ *      de hilos y el orden de los envios quedan fuera de control.
+ */
+
+#ifndef MATCH_REPLAY_H
+#define MATCH_REPLAY_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#define MATCH_TOPIC_LEN 64
+#define MATCH_PATH_LEN 260
+
+typedef struct MatchSource {
+    char topic[MATCH_TOPIC_LEN];
+    char path[MATCH_PATH_LEN];
+    FILE* file;
+    uint64_t nextDueMs;
+    uint32_t sent;
+    int finished;
+    void* transport;   /* Dato propio del publisher (por ejemplo, el stream QUIC del partido). */
+} MatchSource;
+
+typedef struct MatchSchedule {
+    MatchSource* sources;
+    int count;
+    int capacity;
+    int active;
+    uint32_t intervalMs;
+} MatchSchedule;
+
+static inline uint64_t ReplayNowMs(void) {
+#ifdef _WIN32
+    return (uint64_t)GetTickCount64();
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000ULL + (uint64_t)now.tv_nsec / 1000000ULL;
+#endif
+}
+
+static inline void ReplaySleepUntil(uint64_t dueMs) {
+    uint64_t now = ReplayNowMs();
+    if (dueMs <= now) {
+        return;
+    }
+#ifdef _WIN32
+    Sleep((DWORD)(dueMs - now));
+#else
+    usleep((useconds_t)((dueMs - now) * 1000ULL));
+#endif
+}
+
+static inline int AddMatchSource(MatchSchedule* schedule, const char* topic, const char* path) {
+    if (schedule->count == schedule->capacity) {
+        int capacity = schedule->capacity == 0 ? 16 : schedule->capacity * 2;
+        MatchSource* grown = (MatchSource*)realloc(schedule->sources, sizeof(MatchSource) * (size_t)capacity);
+        if (grown == NULL) {
+            return 0;
+        }
+        schedule->sources = grown;
+        schedule->capacity = capacity;
+    }
+
+    MatchSource* source = &schedule->sources[schedule->count];
+    memset(source, 0, sizeof(*source));
+    snprintf(source->topic, sizeof(source->topic), "%s", topic);
+    snprintf(source->path, sizeof(source->path), "%s", path);
+    schedule->count++;
+    return 1;
+}
+
+static inline int CompareMatchSources(const void* left, const void* right) {
+    return strcmp(((const MatchSource*)left)->topic, ((const MatchSource*)right)->topic);
+}
+
+static inline int IsDirectoryPath(const char* path) {
+#ifdef _WIN32
+    DWORD attributes = GetFileAttributesA(path);
+    return attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+#else
+    struct stat info;
+    return stat(path, &info) == 0 && S_ISDIR(info.st_mode);
+#endif
+}
+
+/* Agrega como partido un archivo "<nombre>.txt" encontrado en el directorio. */
+static inline int AddMatchFromDirectoryEntry(MatchSchedule* schedule, const char* directory, const char* name) {
+    size_t length = strlen(name);
+    if (length <= 4 || strcmp(name + length - 4, ".txt") != 0) {
+        return 1;
+    }
+
+    char topic[MATCH_TOPIC_LEN];
+    snprintf(topic, sizeof(topic), "%.*s", (int)(length - 4), name);
+    char path[MATCH_PATH_LEN];
+    snprintf(path, sizeof(path), "%s/%s", directory, name);
+    return AddMatchSource(schedule, topic, path);
+}
+
+static inline int LoadMatchDirectory(MatchSchedule* schedule, const char* directory) {
+#ifdef _WIN32
+    char pattern[MATCH_PATH_LEN];
+    snprintf(pattern, sizeof(pattern), "%s\\*.txt", directory);
+    WIN32_FIND_DATAA data;
+    HANDLE search = FindFirstFileA(pattern, &data);
+    if (search == INVALID_HANDLE_VALUE) {
+        return 1;
+    }
+    int ok = 1;
+    do {
+        if ((data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0) {
+            ok = AddMatchFromDirectoryEntry(schedule, directory, data.cFileName);
+        }
+    } while (ok && FindNextFileA(search, &data));
+    FindClose(search);
+    return ok;
+#else
+    DIR* handle = opendir(directory);
+    if (handle == NULL) {
+        return 0;
+    }
+    int ok = 1;
+    struct dirent* entry;
+    while (ok && (entry = readdir(handle)) != NULL) {
+        ok = AddMatchFromDirectoryEntry(schedule, directory, entry->d_name);
+    }
+    closedir(handle);
+    return ok;
+#endif
+}
+
+static inline int LoadMatchManifest(MatchSchedule* schedule, const char* manifestPath) {
+    FILE* manifest = fopen(manifestPath, "r");
+    if (manifest == NULL) {
+        return 0;
+    }
+
+    /* Directorio del manifiesto, para resolver rutas relativas. */
+    char base[MATCH_PATH_LEN];
+    snprintf(base, sizeof(base), "%s", manifestPath);
+    char* separator = strrchr(base, '/');
+    char* backslash = strrchr(base, '\\');
+    if (backslash != NULL && (separator == NULL || backslash > separator)) {
+        separator = backslash;
+    }
+    if (separator != NULL) {
+        *separator = '\0';
+    } else {
+        base[0] = '\0';
+    }
+
+    int ok = 1;
+    char line[2 * MATCH_PATH_LEN];
+    while (ok && fgets(line, sizeof(line), manifest) != NULL) {
+        line[strcspn(line, "\r\n")] = '\0';
+        char topic[MATCH_TOPIC_LEN];
+        char file[MATCH_PATH_LEN];
+        if (line[0] == '#' || sscanf(line, "%63s %259s", topic, file) != 2) {
+            continue;
+        }
+
+        int absolute = file[0] == '/' || file[0] == '\\' || (file[0] != '\0' && file[1] == ':');
+        char path[MATCH_PATH_LEN];
+        if (absolute || base[0] == '\0') {
+            snprintf(path, sizeof(path), "%s", file);
+        } else {
+            snprintf(path, sizeof(path), "%s/%s", base, file);
+        }
+        ok = AddMatchSource(schedule, topic, path);
+    }
+
+    fclose(manifest);
+    return ok;
+}
+
+/*
+ * Carga los partidos de un directorio o manifiesto y abre sus archivos. Devuelve la cantidad de partidos
+ * abiertos (0 si no hay ninguno). intervalMs es la pausa entre dos eventos de un mismo partido.
+ */
+static inline int LoadMatchSchedule(MatchSchedule* schedule, const char* source, uint32_t intervalMs) {
+    memset(schedule, 0, sizeof(*schedule));
+    schedule->intervalMs = intervalMs;
+
+    int ok = IsDirectoryPath(source) ? LoadMatchDirectory(schedule, source) : LoadMatchManifest(schedule, source);
+    if (!ok) {
+        fprintf(stderr, "[PUBLISHER] No se pudo leer la lista de partidos: %s\n", source);
+        return 0;
+    }
+    qsort(schedule->sources, (size_t)schedule->count, sizeof(MatchSource), CompareMatchSources);
+
+    uint64_t startMs = ReplayNowMs();
+    for (int i = 0; i < schedule->count; ++i) {
+        MatchSource* match = &schedule->sources[i];
+        match->file = fopen(match->path, "r");
+        if (match->file == NULL) {
+            fprintf(stderr, "[PUBLISHER] No se pudo abrir %s (partido %s).\n", match->path, match->topic);
+            match->finished = 1;
+            continue;
+        }
+        match->nextDueMs = startMs + (uint64_t)intervalMs * (uint64_t)i / (uint64_t)schedule->count;
+        schedule->active++;
+    }
+    return schedule->active;
+}
+
+/* Partido con el evento mas proximo (puede no estar vencido todavia); NULL cuando todos terminaron. */
+static inline MatchSource* NextMatch(MatchSchedule* schedule) {
+    MatchSource* next = NULL;
+    for (int i = 0; i < schedule->count; ++i) {
+        MatchSource* match = &schedule->sources[i];
+        if (!match->finished && (next == NULL || match->nextDueMs < next->nextDueMs)) {
+            next = match;
+        }
+    }
+    return next;
+}
+
+/*
+ * Lee el siguiente evento (linea no vacia, sin salto de linea) del partido y programa el proximo. Devuelve 0 y
+ * marca el partido como terminado al llegar al final del archivo.
+ */
+static inline int ReadMatchLine(MatchSchedule* schedule, MatchSource* match, char* line, size_t capacity) {
+    while (fgets(line, (int)capacity, match->file) != NULL) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] != '\0') {
+            match->nextDueMs += schedule->intervalMs;
+            match->sent++;
+            return 1;
+        }
+    }
+
+    fclose(match->file);
+    match->file = NULL;
+    match->finished = 1;
+    schedule->active--;
+    return 0;
+}
+
+static inline void FreeMatchSchedule(MatchSchedule* schedule) {
+    for (int i = 0; i < schedule->count; ++i) {
+        if (schedule->sources[i].file != NULL) {
+            fclose(schedule->sources[i].file);
+        }
+    }
+    free(schedule->sources);
+    memset(schedule, 0, sizeof(*schedule));
+}
+
+#endif /* MATCH_REPLAY_H */
@@ -0,0 +1,232 @@
+/*
+ * Archivo: message_sink.h
+ * Descripcion: Salidas de los subscribers (opcion --salida de subscriber_tcp.c, subscriber_udp.c y
+ *              subscriber_quic.c) con escrituras agrupadas, para que a tasas altas el limite sea la red y no la
+ *              consola.
+ *
+ * TIPOS DE SALIDA (--salida):
+ *    texto          Las mismas lineas de siempre en la consola, acumuladas en un buffer de 1 MB (por defecto).
+ *    texto:RUTA     Igual, pero agregadas al final del archivo RUTA.
+ *    binario:RUTA   Registro de solo agregado con el mensaje tal como lo entrego el broker: el archivo empieza con
+ *                   "SUBSINK1" y cada registro es longitud (uint32) + hora de recepcion en ns (uint64) + mensaje,
+ *                   enteros en little-endian. Sirve para reprocesar una corrida sin el costo del texto.
+ *    nula           Solo cuenta mensajes y bytes; para medir al broker sin costo de salida.
+ *
+ * AGRUPACION:
+ *    Los mensajes se acumulan en el buffer y se escriben con un solo fwrite cuando el buffer se llena o cuando
+ *    pasaron MESSAGE_SINK_FLUSH_NS desde el ultimo vaciado (lastFlushNs), no desde el ultimo mensaje: con un
+ *    goteo constante ningun mensaje espera mas de ese intervalo. Sin trafico nadie llama a MessageSinkRecord, asi
+ *    que el subscriber llama a MessageSinkTick cuando su espera (select o evento) vence sin datos.
+ *    El sink no tiene lock: si lo usan dos hilos, el llamador lo protege.
+ *
+ * LIBRERIAS UTILIZADAS Y JUSTIFICACION:
+ *
+ * 1. stdio.h / stdarg.h (libreria estandar)
+ *    - Por que: Escritura agrupada en consola o archivo y formato de las lineas de texto.
+ *    - Funciones usadas: fopen(), fwrite(), fflush(), fclose(), ftell(), fseek(), vsnprintf(), vfprintf().
+ *    - Alternativa considerada: printf() por mensaje con setvbuf() grande sobre stdout; descartado porque no
+ *      permite vaciar por tiempo (una linea podria quedar horas en el buffer) y no cubre la salida binaria.
+ *
+ * 2. stdlib.h / string.h (libreria estandar)
+ *    - Por que: Buffer de escritura y separacion de "tipo:ruta".
+ *    - Funciones usadas: malloc(), free(), memcpy(), strncmp(), strcmp().
+ */
+
+#ifndef MESSAGE_SINK_H
+#define MESSAGE_SINK_H
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "latency_stamp.h"
+
+#define MESSAGE_SINK_BUFFER (1024u * 1024u)
+#define MESSAGE_SINK_FLUSH_NS 100000000ULL
+#define MESSAGE_SINK_FLUSH_MS 100
+#define MESSAGE_SINK_MAGIC "SUBSINK1"
+#define MESSAGE_SINK_RECORD_HEADER 12
+
+typedef enum MessageSinkKind {
+    MESSAGE_SINK_TEXT,
+    MESSAGE_SINK_BINARY,
+    MESSAGE_SINK_NULL
+} MessageSinkKind;
+
+typedef struct MessageSink {
+    MessageSinkKind kind;
+    FILE* output;
+    int ownsOutput;
+    char* buffer;
+    size_t used;
+    size_t capacity;
+    uint64_t lastFlushNs;
+    uint64_t messages;
+    uint64_t bytes;       /* Bytes de mensajes recibidos (sin formato ni cabeceras de registro). */
+    uint64_t writes;
+    uint64_t writeErrors;
+} MessageSink;
+
+static inline const char* MessageSinkKindName(MessageSinkKind kind) {
+    switch (kind) {
+    case MESSAGE_SINK_TEXT: return "texto";
+    case MESSAGE_SINK_BINARY: return "binario";
+    default: return "nula";
+    }
+}
+
+/* spec: "texto", "texto:RUTA", "binario:RUTA" o "nula" (NULL equivale a "texto"). Devuelve 0 si es invalida. */
+static inline int MessageSinkOpen(MessageSink* sink, const char* spec) {
+    memset(sink, 0, sizeof(*sink));
+    sink->output = stdout;
+    sink->lastFlushNs = LatencyStampNowNs();
+    const char* path = NULL;
+
+    if (spec == NULL || strcmp(spec, "texto") == 0) {
+        sink->kind = MESSAGE_SINK_TEXT;
+    } else if (strncmp(spec, "texto:", 6) == 0 && spec[6] != '\0') {
+        sink->kind = MESSAGE_SINK_TEXT;
+        path = spec + 6;
+    } else if (strncmp(spec, "binario:", 8) == 0 && spec[8] != '\0') {
+        sink->kind = MESSAGE_SINK_BINARY;
+        path = spec + 8;
+    } else if (strcmp(spec, "nula") == 0) {
+        sink->kind = MESSAGE_SINK_NULL;
+        return 1;
+    } else {
+        return 0;
+    }
+
+    if (path != NULL) {
+        sink->output = fopen(path, sink->kind == MESSAGE_SINK_BINARY ? "ab" : "a");
+        if (sink->output == NULL) {
+            return 0;
+        }
+        sink->ownsOutput = 1;
+        /* El archivo binario lleva la firma una sola vez, al crearse. */
+        fseek(sink->output, 0, SEEK_END);
+        if (sink->kind == MESSAGE_SINK_BINARY && ftell(sink->output) == 0) {
+            fwrite(MESSAGE_SINK_MAGIC, 1, 8, sink->output);
+        }
+    }
+
+    sink->capacity = MESSAGE_SINK_BUFFER;
+    sink->buffer = (char*)malloc(sink->capacity);
+    if (sink->buffer == NULL) {
+        if (sink->ownsOutput) {
+            fclose(sink->output);
+        }
+        return 0;
+    }
+    return 1;
+}
+
+static inline int MessageSinkIsText(const MessageSink* sink) {
+    return sink->kind == MESSAGE_SINK_TEXT;
+}
+
+static inline void MessageSinkFlush(MessageSink* sink) {
+    if (sink->used > 0) {
+        if (fwrite(sink->buffer, 1, sink->used, sink->output) != sink->used) {
+            sink->writeErrors++;
+        }
+        fflush(sink->output);
+        sink->used = 0;
+        sink->writes++;
+    }
+    sink->lastFlushNs = LatencyStampNowNs();
+}
+
+/* Vacia el buffer si paso el intervalo desde el ultimo vaciado; tambien se llama cuando la espera vence sin datos. */
+static inline void MessageSinkTick(MessageSink* sink, uint64_t nowNs) {
+    if (sink->used > 0 && nowNs - sink->lastFlushNs >= MESSAGE_SINK_FLUSH_NS) {
+        MessageSinkFlush(sink);
+    }
+}
+
+/* Deja al menos length bytes libres en el buffer; devuelve 0 si no entran ni vacio. */
+static inline int MessageSinkReserve(MessageSink* sink, size_t length) {
+    if (sink->capacity - sink->used < length) {
+        MessageSinkFlush(sink);
+    }
+    return sink->capacity - sink->used >= length;
+}
+
+/*
+ * Cuenta un mensaje recibido en receivedNs; la salida binaria ademas lo agrega como registro.
+ * En la salida de texto el llamador escribe la linea con MessageSinkPrintf.
+ */
+static inline void MessageSinkRecord(MessageSink* sink, uint64_t receivedNs, const char* data, size_t length) {
+    sink->messages++;
+    sink->bytes += length;
+    if (sink->kind == MESSAGE_SINK_BINARY) {
+        unsigned char header[MESSAGE_SINK_RECORD_HEADER];
+        for (int i = 0; i < 4; ++i) {
+            header[i] = (unsigned char)((uint32_t)length >> (8 * i));
+        }
+        for (int i = 0; i < 8; ++i) {
+            header[4 + i] = (unsigned char)(receivedNs >> (8 * i));
+        }
+        if (MessageSinkReserve(sink, MESSAGE_SINK_RECORD_HEADER + length)) {
+            memcpy(sink->buffer + sink->used, header, MESSAGE_SINK_RECORD_HEADER);
+            memcpy(sink->buffer + sink->used + MESSAGE_SINK_RECORD_HEADER, data, length);
+            sink->used += MESSAGE_SINK_RECORD_HEADER + length;
+        } else if (fwrite(header, 1, MESSAGE_SINK_RECORD_HEADER, sink->output) != MESSAGE_SINK_RECORD_HEADER ||
+                   fwrite(data, 1, length, sink->output) != length) {
+            sink->writeErrors++;
+        }
+    }
+    MessageSinkTick(sink, receivedNs);
+}
+
+/* Agrega texto con formato a la salida de texto; en las demas no hace nada. */
+static inline void MessageSinkPrintf(MessageSink* sink, const char* format, ...) {
+    if (sink->kind != MESSAGE_SINK_TEXT) {
+        return;
+    }
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        size_t available = sink->capacity - sink->used;
+        va_list arguments;
+        va_start(arguments, format);
+        int written = vsnprintf(sink->buffer + sink->used, available, format, arguments);
+        va_end(arguments);
+        if (written < 0) {
+            return;
+        }
+        if ((size_t)written < available) {
+            sink->used += (size_t)written;
+            return;
+        }
+        MessageSinkFlush(sink);
+    }
+    /* Mas largo que el buffer completo: se escribe directo. */
+    va_list arguments;
+    va_start(arguments, format);
+    vfprintf(sink->output, format, arguments);
+    va_end(arguments);
+    sink->writes++;
+}
+
+static inline void MessageSinkPrintSummary(const MessageSink* sink, FILE* output, const char* prefix) {
+    fprintf(output, "%s Salida %s: %llu mensajes, %llu bytes, %llu escrituras", prefix,
+            MessageSinkKindName(sink->kind), (unsigned long long)sink->messages,
+            (unsigned long long)sink->bytes, (unsigned long long)sink->writes);
+    if (sink->writeErrors > 0) {
+        fprintf(output, ", %llu errores de escritura", (unsigned long long)sink->writeErrors);
+    }
+    fprintf(output, "\n");
+}
+
+static inline void MessageSinkClose(MessageSink* sink) {
+    MessageSinkFlush(sink);
+    if (sink->ownsOutput) {
+        fclose(sink->output);
+    }
+    free(sink->buffer);
+    sink->buffer = NULL;
+    sink->output = NULL;
+    sink->ownsOutput = 0;
+}
+
+#endif /* MESSAGE_SINK_H */
@@ -0,0 +1,566 @@
+/*
+ * Archivo: metrics.h
+ * Descripcion: Metricas en vivo de los brokers TCP, UDP y QUIC: contadores por hilo sin locks, agregados a
+ *              pedido y expuestos en formato de texto de Prometheus por un socket local (--metricas PUERTO).
+ *
+ * CONTADORES POR HILO:
+ *    Cada hilo que registra algo (el unico hilo de los brokers TCP y UDP; en QUIC los hilos de msquic, los
+ *    workers y el de descarga) obtiene la primera vez su propio MetricsShard y lo guarda en una variable
+ *    thread-local. Solo su dueno escribe en el: un incremento es una carga y un almacenamiento relajados, sin
+ *    instrucciones con lock ni lineas de cache compartidas. El hilo del socket de metricas suma todos los shards
+ *    al responder; nunca toma locks ni detiene a los hilos que registran, a cambio de que un scrape pueda ver un
+ *    evento a medio contar (se corrige en el siguiente). Si se agotan los METRICS_MAX_SHARDS, los hilos restantes
+ *    comparten un shard de reserva con sumas atomicas y sin histogramas.
+ *
+ * QUE SE MIDE:
+ *    - Por topic publicado: mensajes y bytes de entrada (publishers) y de salida (entregas a subscriptores).
+ *      Los nombres se internan en una tabla propia sin locks (CAS sobre el estado de cada ranura); pasados
+ *      METRICS_MAX_TOPICS topics distintos, el resto se suma en topic="_otros".
+ *    - Fallos de envio hacia subscriptores.
+ *    - Subscriptores activos y profundidad de la cola de salida (gauges que el broker actualiza donde ya tiene el
+ *      valor, o que calcula el callback refresh al responder).
+ *    - Latencias en microsegundos (../common/latency_histogram.h): publisher->broker cuando el mensaje trae marca
+ *      de origen (../common/latency_stamp.h) y tiempo dentro del broker (ingreso hasta fin del fan-out).
+ *
+ * ENDPOINT:
+ *    Escucha solo en 127.0.0.1. Cualquier "GET /metrics" (o "GET /") recibe una respuesta HTTP/1.0 con el texto
+ *    de Prometheus y se cierra la conexion; otra ruta recibe 404. Ejemplo: curl http://127.0.0.1:9100/metrics
+ *
+ * Las metricas de un proceso son una sola instancia (el shard del hilo es una unica variable thread-local).
+ *
+ * LIBRERIAS UTILIZADAS Y JUSTIFICACION:
+ *
+ * 1. stdatomic.h (libreria estandar C11)
+ *    - Por que: Lecturas y escrituras relajadas de los contadores y CAS para publicar shards y topics.
+ *    - Funciones usadas: atomic_load_explicit(), atomic_store_explicit(), atomic_fetch_add_explicit(),
+ *      atomic_compare_exchange_strong().
+ *    - Alternativa considerada: Un CRITICAL_SECTION por broker; descartado porque el scrape competiria con el
+ *      fan-out y un contador compartido rebota su linea de cache entre los hilos de msquic.
+ *
+ * 2. winsock2.h (Windows) / sys/socket.h, arpa/inet.h (Linux)
+ *    - Por que: Socket TCP local del endpoint.
+ *    - Funciones usadas: socket(), setsockopt(), bind(), listen(), accept(), recv(), send(), shutdown(),
+ *      closesocket()/close().
+ *
+ * 3. windows.h (Windows) / pthread.h (Linux)
+ *    - Por que: Hilo del endpoint, asi los brokers de un solo hilo no atienden scrapes en su bucle.
+ *    - Funciones usadas: CreateThread(), WaitForSingleObject(), CloseHandle(), pthread_create(), pthread_join().
+ *
+ * 4. stdio.h / stdarg.h / stdlib.h (libreria estandar)
+ *    - Por que: Armado del texto de la respuesta en un buffer que crece.
+ *    - Funciones usadas: vsnprintf(), malloc(), calloc(), realloc(), free().
+ */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "latency_histogram.h"
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <windows.h>
+typedef SOCKET MetricsSocket;
+#define METRICS_INVALID_SOCKET INVALID_SOCKET
+#define MetricsCloseSocket closesocket
+#define METRICS_SHUT_BOTH SD_BOTH
+#else
+#include <pthread.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+typedef int MetricsSocket;
+#define METRICS_INVALID_SOCKET (-1)
+#define MetricsCloseSocket close
+#define METRICS_SHUT_BOTH SHUT_RDWR
+#endif
+
+#if defined(_MSC_VER)
+#define METRICS_THREAD_LOCAL __declspec(thread)
+#else
+#define METRICS_THREAD_LOCAL _Thread_local
+#endif
+
+#define METRICS_MAX_SHARDS 64
+#define METRICS_MAX_TOPICS 256
+#define METRICS_OTHER_TOPIC METRICS_MAX_TOPICS
+#define METRICS_TOPIC_SLOTS (METRICS_MAX_TOPICS + 1)
+#define METRICS_TOPIC_LEN 64
+#define METRICS_REQUEST_LEN 1024
+#define METRICS_RECEIVE_TIMEOUT_MS 1000
+
+enum {
+    METRICS_SLOT_EMPTY = 0,
+    METRICS_SLOT_WRITING,
+    METRICS_SLOT_READY
+};
+
+typedef enum MetricsLatency {
+    METRICS_LATENCY_INGRESS = 0,   /* marca de origen del publisher -> ingreso al broker */
+    METRICS_LATENCY_BROKER,        /* ingreso al broker -> fin del fan-out */
+    METRICS_LATENCY_KINDS
+} MetricsLatency;
+
+typedef struct MetricsTopicCounters {
+    atomic_uint_fast64_t messagesIn;
+    atomic_uint_fast64_t bytesIn;
+    atomic_uint_fast64_t messagesOut;
+    atomic_uint_fast64_t bytesOut;
+} MetricsTopicCounters;
+
+/* Suma de los shards al responder un scrape. */
+typedef struct MetricsTopicTotals {
+    uint64_t messagesIn;
+    uint64_t bytesIn;
+    uint64_t messagesOut;
+    uint64_t bytesOut;
+} MetricsTopicTotals;
+
+typedef struct MetricsShard {
+    MetricsTopicCounters topics[METRICS_TOPIC_SLOTS];
+    atomic_uint_fast64_t sendFailures;
+    int shared;
+    LatencyHistogram latency[METRICS_LATENCY_KINDS];
+} MetricsShard;
+
+typedef struct MetricsTopicName {
+    atomic_int state;
+    uint32_t hash;
+    char name[METRICS_TOPIC_LEN];
+} MetricsTopicName;
+
+typedef struct Metrics Metrics;
+
+/* Llamado por el hilo del endpoint antes de armar cada respuesta (por ejemplo, para medir colas). */
+typedef void (*MetricsRefresh)(void* context, Metrics* metrics);
+
+struct Metrics {
+    const char* transport;
+    _Atomic(MetricsShard*) shards[METRICS_MAX_SHARDS];
+    atomic_int shardCount;
+    MetricsShard* reserve;
+    MetricsTopicName topicNames[METRICS_MAX_TOPICS];
+    atomic_int_fast64_t subscribers;
+    atomic_int_fast64_t queueDepth;
+    MetricsRefresh refresh;
+    void* refreshContext;
+};
+
+typedef struct MetricsServer {
+    Metrics* metrics;
+    MetricsSocket listener;
+    atomic_int running;
+    int started;
+#ifdef _WIN32
+    HANDLE thread;
+#else
+    pthread_t thread;
+#endif
+} MetricsServer;
+
+static METRICS_THREAD_LOCAL MetricsShard* MetricsCurrentShard = NULL;
+
+static inline int MetricsInit(Metrics* metrics, const char* transport) {
+    memset(metrics, 0, sizeof(*metrics));
+    metrics->transport = transport;
+    metrics->reserve = (MetricsShard*)calloc(1, sizeof(MetricsShard));
+    if (metrics->reserve == NULL) {
+        return 0;
+    }
+    metrics->reserve->shared = 1;
+    return 1;
+}
+
+static inline void MetricsFree(Metrics* metrics) {
+    for (int i = 0; i < METRICS_MAX_SHARDS; ++i) {
+        free(atomic_load(&metrics->shards[i]));
+    }
+    free(metrics->reserve);
+    memset(metrics, 0, sizeof(*metrics));
+}
+
+/* Shard del hilo actual; la primera llamada de cada hilo lo reserva (o usa el de reserva si no quedan). */
+static inline MetricsShard* MetricsShardOf(Metrics* metrics) {
+    if (MetricsCurrentShard != NULL) {
+        return MetricsCurrentShard;
+    }
+    int slot = atomic_fetch_add(&metrics->shardCount, 1);
+    MetricsShard* shard = slot < METRICS_MAX_SHARDS ? (MetricsShard*)calloc(1, sizeof(MetricsShard)) : NULL;
+    if (shard == NULL) {
+        shard = metrics->reserve;
+    } else {
+        for (int i = 0; i < METRICS_LATENCY_KINDS; ++i) {
+            LatencyHistogramInit(&shard->latency[i]);
+        }
+        atomic_store_explicit(&metrics->shards[slot], shard, memory_order_release);
+    }
+    MetricsCurrentShard = shard;
+    return shard;
+}
+
+static inline void MetricsAdd(const MetricsShard* shard, atomic_uint_fast64_t* counter, uint64_t value) {
+    if (shard->shared) {
+        atomic_fetch_add_explicit(counter, value, memory_order_relaxed);
+    } else {
+        atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + value, memory_order_relaxed);
+    }
+}
+
+/* Ranura del topic (lo interna si es nuevo); METRICS_OTHER_TOPIC si la tabla esta llena. */
+static inline int MetricsTopicSlot(Metrics* metrics, const char* topic) {
+    uint32_t hash = 2166136261u;
+    size_t length = 0;
+    for (const unsigned char* cursor = (const unsigned char*)topic; *cursor != '\0'; ++cursor, ++length) {
+        hash ^= *cursor;
+        hash *= 16777619u;
+    }
+    if (length >= METRICS_TOPIC_LEN) {
+        length = METRICS_TOPIC_LEN - 1;
+    }
+
+    for (uint32_t probe = 0; probe < METRICS_MAX_TOPICS; ++probe) {
+        MetricsTopicName* slot = &metrics->topicNames[(hash + probe) % METRICS_MAX_TOPICS];
+        int state = atomic_load_explicit(&slot->state, memory_order_acquire);
+        if (state == METRICS_SLOT_EMPTY) {
+            int expected = METRICS_SLOT_EMPTY;
+            if (atomic_compare_exchange_strong(&slot->state, &expected, METRICS_SLOT_WRITING)) {
+                slot->hash = hash;
+                memcpy(slot->name, topic, length);
+                slot->name[length] = '\0';
+                atomic_store_explicit(&slot->state, METRICS_SLOT_READY, memory_order_release);
+                return (int)((hash + probe) % METRICS_MAX_TOPICS);
+            }
+            state = expected;
+        }
+        /* Otro hilo esta escribiendo el nombre: se espera (son unos pocos bytes). */
+        while (state == METRICS_SLOT_WRITING) {
+            state = atomic_load_explicit(&slot->state, memory_order_acquire);
+        }
+        if (slot->hash == hash && strncmp(slot->name, topic, length) == 0 && slot->name[length] == '\0') {
+            return (int)((hash + probe) % METRICS_MAX_TOPICS);
+        }
+    }
+    return METRICS_OTHER_TOPIC;
+}
+
+/* Un mensaje de publisher: bytesIn recibidos y deliveries entregas de bytesOut cada una. */
+static inline void MetricsCountPublish(Metrics* metrics, const char* topic, uint32_t bytesIn, int32_t deliveries, uint32_t bytesOut) {
+    MetricsShard* shard = MetricsShardOf(metrics);
+    MetricsTopicCounters* counters = &shard->topics[MetricsTopicSlot(metrics, topic)];
+    MetricsAdd(shard, &counters->messagesIn, 1);
+    MetricsAdd(shard, &counters->bytesIn, bytesIn);
+    if (deliveries > 0) {
+        MetricsAdd(shard, &counters->messagesOut, (uint64_t)deliveries);
+        MetricsAdd(shard, &counters->bytesOut, (uint64_t)deliveries * bytesOut);
+    }
+}
+
+static inline void MetricsCountSendFailure(Metrics* metrics) {
+    MetricsShard* shard = MetricsShardOf(metrics);
+    MetricsAdd(shard, &shard->sendFailures, 1);
+}
+
+static inline void MetricsRecordLatency(Metrics* metrics, MetricsLatency kind, uint64_t microseconds) {
+    MetricsShard* shard = MetricsShardOf(metrics);
+    if (!shard->shared) {
+        LatencyHistogramRecord(&shard->latency[kind], microseconds);
+    }
+}
+
+static inline void MetricsSetSubscribers(Metrics* metrics, int64_t count) {
+    atomic_store_explicit(&metrics->subscribers, count, memory_order_relaxed);
+}
+
+static inline void MetricsSetQueueDepth(Metrics* metrics, int64_t depth) {
+    atomic_store_explicit(&metrics->queueDepth, depth, memory_order_relaxed);
+}
+
+/* ---------------------------------------------------------------------------------------------------------
+ * Exposicion en formato de texto de Prometheus
+ * --------------------------------------------------------------------------------------------------------- */
+
+typedef struct MetricsText {
+    char* data;
+    size_t length;
+    size_t capacity;
+    int failed;
+} MetricsText;
+
+static inline void MetricsAppend(MetricsText* text, const char* format, ...) {
+    if (text->failed) {
+        return;
+    }
+    for (;;) {
+        size_t available = text->capacity - text->length;
+        va_list arguments;
+        va_start(arguments, format);
+        int written = available > 0 ? vsnprintf(text->data + text->length, available, format, arguments) : -1;
+        va_end(arguments);
+        if (written >= 0 && (size_t)written < available) {
+            text->length += (size_t)written;
+            return;
+        }
+        size_t capacity = text->capacity == 0 ? 4096 : text->capacity * 2;
+        while (written >= 0 && capacity - text->length <= (size_t)written) {
+            capacity *= 2;
+        }
+        char* grown = (char*)realloc(text->data, capacity);
+        if (grown == NULL) {
+            text->failed = 1;
+            return;
+        }
+        text->data = grown;
+        text->capacity = capacity;
+    }
+}
+
+/* Valor de etiqueta con '\\', '"' y saltos de linea escapados. */
+static inline void MetricsAppendLabel(MetricsText* text, const char* value) {
+    char escaped[METRICS_TOPIC_LEN * 2];
+    size_t length = 0;
+    for (const char* cursor = value; *cursor != '\0' && length < sizeof(escaped) - 2; ++cursor) {
+        if (*cursor == '\\' || *cursor == '"') {
+            escaped[length++] = '\\';
+            escaped[length++] = *cursor;
+        } else if (*cursor == '\n') {
+            escaped[length++] = '\\';
+            escaped[length++] = 'n';
+        } else {
+            escaped[length++] = *cursor;
+        }
+    }
+    escaped[length] = '\0';
+    MetricsAppend(text, "%s", escaped);
+}
+
+static inline void MetricsAppendTopicCounter(MetricsText* text, const Metrics* metrics, const MetricsTopicTotals* totals,
+                                             size_t offset, const char* name, const char* help) {
+    MetricsAppend(text, "# HELP %s %s\n# TYPE %s counter\n", name, help, name);
+    for (int i = 0; i < METRICS_TOPIC_SLOTS; ++i) {
+        uint64_t value = *(const uint64_t*)((const char*)&totals[i] + offset);
+        if (i < METRICS_MAX_TOPICS && atomic_load_explicit(&metrics->topicNames[i].state, memory_order_acquire) != METRICS_SLOT_READY) {
+            continue;
+        }
+        if (i == METRICS_OTHER_TOPIC && value == 0) {
+            continue;
+        }
+        MetricsAppend(text, "%s{transporte=\"%s\",topic=\"", name, metrics->transport);
+        MetricsAppendLabel(text, i == METRICS_OTHER_TOPIC ? "_otros" : metrics->topicNames[i].name);
+        MetricsAppend(text, "\"} %llu\n", (unsigned long long)value);
+    }
+}
+
+static inline void MetricsAppendSummary(MetricsText* text, const Metrics* metrics, const LatencyHistogram* histogram,
+                                        const char* name, const char* help) {
+    static const double quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+    MetricsAppend(text, "# HELP %s %s\n# TYPE %s summary\n", name, help, name);
+    for (size_t i = 0; i < sizeof(quantiles) / sizeof(quantiles[0]); ++i) {
+        MetricsAppend(text, "%s{transporte=\"%s\",quantile=\"%g\"} %llu\n", name, metrics->transport, quantiles[i],
+                      (unsigned long long)LatencyHistogramPercentile(histogram, quantiles[i] * 100.0));
+    }
+    MetricsAppend(text, "%s_sum{transporte=\"%s\"} %llu\n", name, metrics->transport, (unsigned long long)histogram->sum);
+    MetricsAppend(text, "%s_count{transporte=\"%s\"} %llu\n", name, metrics->transport, (unsigned long long)histogram->total);
+}
+
+/* Suma los shards y arma el texto; el llamador libera text->data. Devuelve 0 si falto memoria. */
+static inline int MetricsRender(Metrics* metrics, MetricsText* text) {
+    memset(text, 0, sizeof(*text));
+    MetricsTopicTotals* totals = (MetricsTopicTotals*)calloc(METRICS_TOPIC_SLOTS, sizeof(MetricsTopicTotals));
+    LatencyHistogram* latency = (LatencyHistogram*)malloc(sizeof(LatencyHistogram) * METRICS_LATENCY_KINDS);
+    if (totals == NULL || latency == NULL) {
+        free(totals);
+        free(latency);
+        return 0;
+    }
+    for (int k = 0; k < METRICS_LATENCY_KINDS; ++k) {
+        LatencyHistogramInit(&latency[k]);
+    }
+
+    uint64_t sendFailures = 0;
+    int shardCount = 0;
+    for (int s = 0; s <= METRICS_MAX_SHARDS; ++s) {
+        const MetricsShard* shard = s < METRICS_MAX_SHARDS
+            ? atomic_load_explicit(&metrics->shards[s], memory_order_acquire)
+            : metrics->reserve;
+        if (shard == NULL) {
+            continue;
+        }
+        shardCount += s < METRICS_MAX_SHARDS;
+        for (int i = 0; i < METRICS_TOPIC_SLOTS; ++i) {
+            totals[i].messagesIn += atomic_load_explicit(&shard->topics[i].messagesIn, memory_order_relaxed);
+            totals[i].bytesIn += atomic_load_explicit(&shard->topics[i].bytesIn, memory_order_relaxed);
+            totals[i].messagesOut += atomic_load_explicit(&shard->topics[i].messagesOut, memory_order_relaxed);
+            totals[i].bytesOut += atomic_load_explicit(&shard->topics[i].bytesOut, memory_order_relaxed);
+        }
+        sendFailures += atomic_load_explicit(&shard->sendFailures, memory_order_relaxed);
+        for (int k = 0; k < METRICS_LATENCY_KINDS; ++k) {
+            LatencyHistogramMerge(&latency[k], &shard->latency[k]);
+        }
+    }
+
+    MetricsAppendTopicCounter(text, metrics, totals, offsetof(MetricsTopicTotals, messagesIn),
+                              "broker_mensajes_entrada_total", "Mensajes recibidos de publishers por topic.");
+    MetricsAppendTopicCounter(text, metrics, totals, offsetof(MetricsTopicTotals, bytesIn),
+                              "broker_bytes_entrada_total", "Bytes recibidos de publishers por topic.");
+    MetricsAppendTopicCounter(text, metrics, totals, offsetof(MetricsTopicTotals, messagesOut),
+                              "broker_mensajes_salida_total", "Entregas a subscriptores por topic publicado.");
+    MetricsAppendTopicCounter(text, metrics, totals, offsetof(MetricsTopicTotals, bytesOut),
+                              "broker_bytes_salida_total", "Bytes entregados a subscriptores por topic publicado.");
+    MetricsAppend(text, "# HELP broker_fallos_envio_total Envios a subscriptores que fallaron.\n"
+                        "# TYPE broker_fallos_envio_total counter\nbroker_fallos_envio_total{transporte=\"%s\"} %llu\n",
+                  metrics->transport, (unsigned long long)sendFailures);
+    MetricsAppend(text, "# HELP broker_subscriptores Suscripciones activas.\n"
+                        "# TYPE broker_subscriptores gauge\nbroker_subscriptores{transporte=\"%s\"} %lld\n",
+                  metrics->transport, (long long)atomic_load_explicit(&metrics->subscribers, memory_order_relaxed));
+    MetricsAppend(text, "# HELP broker_cola_salida Mensajes esperando el fan-out.\n"
+                        "# TYPE broker_cola_salida gauge\nbroker_cola_salida{transporte=\"%s\"} %lld\n",
+                  metrics->transport, (long long)atomic_load_explicit(&metrics->queueDepth, memory_order_relaxed));
+    MetricsAppend(text, "# HELP broker_hilos_con_metricas Hilos que registraron metricas.\n"
+                        "# TYPE broker_hilos_con_metricas gauge\nbroker_hilos_con_metricas{transporte=\"%s\"} %d\n",
+                  metrics->transport, shardCount);
+    MetricsAppendSummary(text, metrics, &latency[METRICS_LATENCY_INGRESS], "broker_latencia_ingreso_us",
+                         "Microsegundos desde la marca de origen del publisher hasta el ingreso al broker.");
+    MetricsAppendSummary(text, metrics, &latency[METRICS_LATENCY_BROKER], "broker_latencia_fanout_us",
+                         "Microsegundos desde el ingreso al broker hasta el fin del fan-out.");
+
+    free(totals);
+    free(latency);
+    return !text->failed;
+}
+
+/* ---------------------------------------------------------------------------------------------------------
+ * Socket local de metricas
+ * --------------------------------------------------------------------------------------------------------- */
+
+static inline void MetricsSendAll(MetricsSocket client, const char* data, size_t length) {
+    while (length > 0) {
+        int sent = (int)send(client, data, (int)length, 0);
+        if (sent <= 0) {
+            return;
+        }
+        data += sent;
+        length -= (size_t)sent;
+    }
+}
+
+static inline void MetricsServe(MetricsServer* server, MetricsSocket client) {
+#ifdef _WIN32
+    DWORD timeout = METRICS_RECEIVE_TIMEOUT_MS;
+    setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout));
+#else
+    struct timeval timeout = { METRICS_RECEIVE_TIMEOUT_MS / 1000, (METRICS_RECEIVE_TIMEOUT_MS % 1000) * 1000 };
+    setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+#endif
+    char request[METRICS_REQUEST_LEN];
+    int received = (int)recv(client, request, sizeof(request) - 1, 0);
+    if (received <= 0) {
+        return;
+    }
+    request[received] = '\0';
+
+    if (strncmp(request, "GET /metrics", 12) != 0 && strncmp(request, "GET / ", 6) != 0) {
+        static const char notFound[] = "HTTP/1.0 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+        MetricsSendAll(client, notFound, sizeof(notFound) - 1);
+        return;
+    }
+
+    if (server->metrics->refresh != NULL) {
+        server->metrics->refresh(server->metrics->refreshContext, server->metrics);
+    }
+    MetricsText text;
+    if (!MetricsRender(server->metrics, &text)) {
+        static const char unavailable[] = "HTTP/1.0 503 Service Unavailable\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+        MetricsSendAll(client, unavailable, sizeof(unavailable) - 1);
+        free(text.data);
+        return;
+    }
+    char header[160];
+    int headerLength = snprintf(header, sizeof(header),
+                                "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %zu\r\n"
+                                "Connection: close\r\n\r\n", text.length);
+    MetricsSendAll(client, header, (size_t)headerLength);
+    MetricsSendAll(client, text.data, text.length);
+    free(text.data);
+}
+
+#ifdef _WIN32
+static DWORD WINAPI MetricsServerThread(LPVOID argument) {
+#else
+static void* MetricsServerThread(void* argument) {
+#endif
+    MetricsServer* server = (MetricsServer*)argument;
+    while (atomic_load(&server->running)) {
+        MetricsSocket client = accept(server->listener, NULL, NULL);
+        if (client == METRICS_INVALID_SOCKET) {
+            continue;
+        }
+        MetricsServe(server, client);
+        shutdown(client, METRICS_SHUT_BOTH);
+        MetricsCloseSocket(client);
+    }
+    return 0;
+}
+
+/* Escucha en 127.0.0.1:port y atiende los scrapes en un hilo propio. En Windows requiere WSAStartup previo. */
+static inline int MetricsServerStart(MetricsServer* server, Metrics* metrics, uint16_t port) {
+    memset(server, 0, sizeof(*server));
+    server->metrics = metrics;
+    server->listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (server->listener == METRICS_INVALID_SOCKET) {
+        return 0;
+    }
+    int reuse = 1;
+    setsockopt(server->listener, SOL_SOCKET, SO_REUSEADDR, (const char*)&reuse, sizeof(reuse));
+
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(server->listener, (struct sockaddr*)&address, sizeof(address)) != 0 || listen(server->listener, 8) != 0) {
+        MetricsCloseSocket(server->listener);
+        server->listener = METRICS_INVALID_SOCKET;
+        return 0;
+    }
+
+    atomic_store(&server->running, 1);
+#ifdef _WIN32
+    server->thread = CreateThread(NULL, 0, MetricsServerThread, server, 0, NULL);
+    server->started = server->thread != NULL;
+#else
+    server->started = pthread_create(&server->thread, NULL, MetricsServerThread, server) == 0;
+#endif
+    if (!server->started) {
+        MetricsCloseSocket(server->listener);
+        server->listener = METRICS_INVALID_SOCKET;
+    }
+    return server->started;
+}
+
+/* Cerrar el socket de escucha despierta al accept bloqueado; despues se espera al hilo. */
+static inline void MetricsServerStop(MetricsServer* server) {
+    if (!server->started) {
+        return;
+    }
+    atomic_store(&server->running, 0);
+    shutdown(server->listener, METRICS_SHUT_BOTH);
+    MetricsCloseSocket(server->listener);
+#ifdef _WIN32
+    WaitForSingleObject(server->thread, INFINITE);
+    CloseHandle(server->thread);
+#else
+    pthread_join(server->thread, NULL);
+#endif
+    server->started = 0;
+    server->listener = METRICS_INVALID_SOCKET;
+}
+
+#endif /* METRICS_H */
@@ -0,0 +1,200 @@
+/*
+ * Archivo: outbound_lanes.h
+ * Descripcion: Cola de salida por subscriber con un carril por prioridad (../common/event_priority.h). Cuando el
+ *              socket de un subscriber lento no acepta mas datos, el broker guarda ahi lo que falta enviar y, al
+ *              liberarse el socket, elige primero los eventos de alta prioridad: un gol no queda detras de cien
+ *              saques de banda.
+ *
+ * PLANIFICACION:
+ *    OUTBOUND_STRICT     Siempre el carril de mayor prioridad que tenga mensajes (la baja puede esperar sin
+ *                        limite mientras haya alta o normal).
+ *    OUTBOUND_WEIGHTED   Cada carril recibe creditos en proporcion OUTBOUND_WEIGHTS (8:3:1); se atiende el de
+ *                        mayor prioridad que tenga mensajes y creditos, y cuando ninguno los tiene se recargan.
+ *                        La alta sigue pasando primero, pero la baja avanza aunque la alta no se vacie nunca.
+ *
+ * FORMATO:
+ *    Cada carril es un buffer contiguo con registros [longitud uint32][mensaje]. El mensaje que se esta enviando
+ *    queda fijado (current/currentSent) hasta que sale completo: un envio parcial nunca se intercala con otro
+ *    mensaje, que cortaria la linea en el subscriber. Si un carril supera OUTBOUND_LANE_LIMIT bytes el mensaje
+ *    nuevo se descarta y se cuenta en dropped[], asi un subscriber detenido no agota la memoria del broker.
+ *
+ * LIBRERIAS UTILIZADAS Y JUSTIFICACION:
+ *
+ * 1. stdlib.h / string.h (libreria estandar)
+ *    - Por que: Buffers de los carriles que crecen a demanda y se compactan al consumirse.
+ *    - Funciones usadas: realloc(), free(), memcpy(), memmove(), memset().
+ *    - Alternativa considerada: Lista enlazada con un malloc por mensaje; descartada porque con miles de mensajes
+ *      encolados por subscriber el costo de reservar y liberar cada nodo supera al de copiar las lineas.
+ */
+
+#ifndef OUTBOUND_LANES_H
+#define OUTBOUND_LANES_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "event_priority.h"
+
+#define OUTBOUND_LANE_LIMIT (256u * 1024u)
+#define OUTBOUND_RECORD_HEADER 4
+#define OUTBOUND_NO_LANE (-1)
+
+static const uint32_t OUTBOUND_WEIGHTS[EVENT_PRIORITY_LEVELS] = { 8, 3, 1 };
+
+typedef enum OutboundPolicy {
+    OUTBOUND_STRICT,
+    OUTBOUND_WEIGHTED
+} OutboundPolicy;
+
+typedef struct OutboundLane {
+    char* data;
+    size_t head;        /* Primer registro pendiente. */
+    size_t used;        /* Fin del ultimo registro. */
+    size_t capacity;
+    uint32_t messages;
+} OutboundLane;
+
+typedef struct OutboundLanes {
+    OutboundLane lanes[EVENT_PRIORITY_LEVELS];
+    OutboundPolicy policy;
+    uint32_t credits[EVENT_PRIORITY_LEVELS];
+    int current;              /* Carril del mensaje en curso, o OUTBOUND_NO_LANE. */
+    uint32_t currentSent;     /* Bytes del mensaje en curso que ya salieron. */
+    uint32_t queued;          /* Mensajes en todos los carriles. */
+    uint64_t dropped[EVENT_PRIORITY_LEVELS];
+} OutboundLanes;
+
+static inline const char* OutboundPolicyName(OutboundPolicy policy) {
+    return policy == OUTBOUND_WEIGHTED ? "ponderada" : "estricta";
+}
+
+static inline void OutboundLanesInit(OutboundLanes* lanes, OutboundPolicy policy) {
+    memset(lanes, 0, sizeof(*lanes));
+    lanes->policy = policy;
+    lanes->current = OUTBOUND_NO_LANE;
+    memcpy(lanes->credits, OUTBOUND_WEIGHTS, sizeof(lanes->credits));
+}
+
+static inline int OutboundLanesEmpty(const OutboundLanes* lanes) {
+    return lanes->queued == 0;
+}
+
+static inline uint64_t OutboundLanesDropped(const OutboundLanes* lanes) {
+    uint64_t total = 0;
+    for (int i = 0; i < EVENT_PRIORITY_LEVELS; ++i) {
+        total += lanes->dropped[i];
+    }
+    return total;
+}
+
+/*
+ * Encola un mensaje en el carril de su prioridad. sent > 0 indica que el socket ya acepto esa parte: solo vale
+ * con las colas vacias y el mensaje queda como el que esta en curso. Devuelve 0 si se descarto.
+ */
+static inline int OutboundLanesPush(OutboundLanes* lanes, EventPriority priority, const char* data, uint32_t length, uint32_t sent) {
+    OutboundLane* lane = &lanes->lanes[priority];
+    size_t record = OUTBOUND_RECORD_HEADER + (size_t)length;
+    if (lane->used - lane->head + record > OUTBOUND_LANE_LIMIT) {
+        lanes->dropped[priority]++;
+        return 0;
+    }
+    if (lane->used + record > lane->capacity) {
+        /* Primero se recupera lo ya consumido; solo si no alcanza se agranda el buffer. */
+        if (lane->head > 0) {
+            memmove(lane->data, lane->data + lane->head, lane->used - lane->head);
+            lane->used -= lane->head;
+            lane->head = 0;
+        }
+        if (lane->used + record > lane->capacity) {
+            size_t capacity = lane->capacity == 0 ? 4096 : lane->capacity * 2;
+            while (capacity < lane->used + record) {
+                capacity *= 2;
+            }
+            char* grown = (char*)realloc(lane->data, capacity);
+            if (grown == NULL) {
+                lanes->dropped[priority]++;
+                return 0;
+            }
+            lane->data = grown;
+            lane->capacity = capacity;
+        }
+    }
+    memcpy(lane->data + lane->used, &length, OUTBOUND_RECORD_HEADER);
+    memcpy(lane->data + lane->used + OUTBOUND_RECORD_HEADER, data, length);
+    lane->used += record;
+    lane->messages++;
+    lanes->queued++;
+    if (sent > 0 && lanes->current == OUTBOUND_NO_LANE && lane->messages == 1) {
+        lanes->current = (int)priority;
+        lanes->currentSent = sent;
+    }
+    return 1;
+}
+
+static inline int OutboundLanesSelect(OutboundLanes* lanes) {
+    if (lanes->policy == OUTBOUND_STRICT) {
+        for (int i = 0; i < EVENT_PRIORITY_LEVELS; ++i) {
+            if (lanes->lanes[i].messages > 0) {
+                return i;
+            }
+        }
+        return OUTBOUND_NO_LANE;
+    }
+    for (int round = 0; round < 2; ++round) {
+        for (int i = 0; i < EVENT_PRIORITY_LEVELS; ++i) {
+            if (lanes->lanes[i].messages > 0 && lanes->credits[i] > 0) {
+                lanes->credits[i]--;
+                return i;
+            }
+        }
+        memcpy(lanes->credits, OUTBOUND_WEIGHTS, sizeof(lanes->credits));
+    }
+    return OUTBOUND_NO_LANE;
+}
+
+/* Lo que falta enviar del mensaje en curso (eligiendo el proximo si no hay uno). Devuelve 0 si no queda nada. */
+static inline int OutboundLanesPeek(OutboundLanes* lanes, const char** data, uint32_t* length) {
+    if (lanes->current == OUTBOUND_NO_LANE) {
+        lanes->current = OutboundLanesSelect(lanes);
+        lanes->currentSent = 0;
+        if (lanes->current == OUTBOUND_NO_LANE) {
+            return 0;
+        }
+    }
+    const OutboundLane* lane = &lanes->lanes[lanes->current];
+    uint32_t total;
+    memcpy(&total, lane->data + lane->head, OUTBOUND_RECORD_HEADER);
+    *data = lane->data + lane->head + OUTBOUND_RECORD_HEADER + lanes->currentSent;
+    *length = total - lanes->currentSent;
+    return 1;
+}
+
+/* Marca como enviados bytes del mensaje en curso; al completarlo lo quita de su carril. */
+static inline void OutboundLanesConsume(OutboundLanes* lanes, uint32_t bytes) {
+    OutboundLane* lane = &lanes->lanes[lanes->current];
+    uint32_t total;
+    memcpy(&total, lane->data + lane->head, OUTBOUND_RECORD_HEADER);
+    lanes->currentSent += bytes;
+    if (lanes->currentSent < total) {
+        return;
+    }
+    lane->head += OUTBOUND_RECORD_HEADER + (size_t)total;
+    lane->messages--;
+    lanes->queued--;
+    if (lane->messages == 0) {
+        lane->head = 0;
+        lane->used = 0;
+    }
+    lanes->current = OUTBOUND_NO_LANE;
+    lanes->currentSent = 0;
+}
+
+static inline void OutboundLanesFree(OutboundLanes* lanes) {
+    for (int i = 0; i < EVENT_PRIORITY_LEVELS; ++i) {
+        free(lanes->lanes[i].data);
+    }
+    OutboundPolicy policy = lanes->policy;
+    OutboundLanesInit(lanes, policy);
+}
+
+#endif /* OUTBOUND_LANES_H */
@@ -0,0 +1,379 @@
+/*
+ * Archivo: pcap_stream.h
+ * Descripcion: Lectura en flujo de capturas pcap y decodificacion de segmentos TCP / datagramas UDP, compartida
+ *              por las herramientas de BENCH que trabajan con las capturas de ArchivosWireshark
+ *              (replay_pcap.c reproduce los publishers, analyze_pcap.c mide al broker).
+ *
+ * LECTURA EN FLUJO:
+ *    La captura se lee paquete por paquete con fread (formato pcap clasico, cualquier orden de bytes, marcas en
+ *    micro o nanosegundos); en memoria solo queda el paquete actual, asi que el tamano de la captura no importa.
+ *    pcapng no esta soportado: se convierte con "editcap -F pcap entrada salida". Enlaces soportados: loopback
+ *    de Npcap/BSD (los .pcap del repositorio), Ethernet (con VLAN), IP crudo y Linux cooked (SLL/SLL2); IPv4 e
+ *    IPv6 sin cabeceras de extension. Los fragmentos IP y los paquetes cortados por el snaplen se descartan.
+ *
+ * ORDEN TCP:
+ *    PcapTcpAccept recibe cada segmento de un sentido de una conexion y devuelve solo los bytes nuevos en orden:
+ *    descarta retransmisiones (las capturas de loopback de Npcap suelen traer cada segmento dos veces) y recorta
+ *    solapes. Un segmento posterior a un hueco se acepta igual y se avisa, para que el llamador descarte la linea
+ *    que quedo incompleta. Los segmentos fuera de orden cuentan como huecos; no se guardan para reordenarlos.
+ *
+ * LIBRERIAS UTILIZADAS Y JUSTIFICACION:
+ *
+ * 1. stdio.h (libreria estandar)
+ *    - Por que: Lectura secuencial de la captura.
+ *    - Funciones usadas: fopen(), fread(), fseek(), fclose(), fprintf().
+ *    - Alternativa considerada: libpcap/Npcap (pcap_open_offline); descartado porque agrega una dependencia
+ *      que cada maquina tendria que instalar solo para leer un formato de cabeceras fijas, y mapear el archivo
+ *      completo ata la memoria al tamano de la captura.
+ *
+ * 2. stdlib.h / string.h (libreria estandar)
+ *    - Por que: Buffer del paquete actual y copia de cabeceras.
+ *    - Funciones usadas: malloc(), free(), memcpy(), memset(), memcmp().
+ */
+
+#ifndef PCAP_STREAM_H
+#define PCAP_STREAM_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PCAP_MAGIC_US 0xa1b2c3d4u
+#define PCAP_MAGIC_NS 0xa1b23c4du
+#define PCAPNG_MAGIC 0x0a0d0d0au
+#define PCAP_MAX_PACKET 262144u
+
+#define PCAP_LINK_NULL 0
+#define PCAP_LINK_ETHERNET 1
+#define PCAP_LINK_RAW_BSD 12
+#define PCAP_LINK_RAW 101
+#define PCAP_LINK_LOOP 108
+#define PCAP_LINK_LINUX_SLL 113
+#define PCAP_LINK_LINUX_SLL2 276
+
+#define PCAP_PROTOCOL_TCP 6
+#define PCAP_PROTOCOL_UDP 17
+#define PCAP_TCP_FIN 0x01
+#define PCAP_TCP_SYN 0x02
+#define PCAP_TCP_RST 0x04
+
+typedef struct PcapReader {
+    FILE* file;
+    int swapped;
+    int nanoseconds;
+    uint32_t linkType;
+    uint8_t* packet;
+    uint32_t capacity;
+    uint64_t skippedPackets;
+} PcapReader;
+
+/* Un sentido de una conversacion: direcciones (IPv4 en los primeros 4 bytes), puertos y protocolo. */
+typedef struct PcapFlowKey {
+    uint8_t source[16];
+    uint8_t destination[16];
+    uint16_t sourcePort;
+    uint16_t destinationPort;
+    uint8_t protocol;
+} PcapFlowKey;
+
+/* Lo que interesa de un paquete: el segmento TCP o el datagrama UDP y su flujo. */
+typedef struct PcapPacket {
+    uint64_t timeUs;
+    PcapFlowKey key;
+    uint32_t sequence;
+    uint8_t tcpFlags;
+    const uint8_t* payload;
+    uint32_t payloadLength;
+} PcapPacket;
+
+typedef struct PcapTcpStream {
+    int sequenceKnown;
+    uint32_t nextSequence;
+} PcapTcpStream;
+
+typedef enum PcapTcpResult {
+    PCAP_TCP_IN_ORDER = 0,
+    PCAP_TCP_RETRANSMISSION,
+    PCAP_TCP_GAP
+} PcapTcpResult;
+
+static inline uint32_t PcapSwap32(uint32_t value) {
+    return (value >> 24) | ((value >> 8) & 0xFF00u) | ((value << 8) & 0xFF0000u) | (value << 24);
+}
+
+static inline uint32_t PcapHeader32(const PcapReader* reader, const uint8_t* data) {
+    uint32_t value;
+    memcpy(&value, data, sizeof(value));
+    return reader->swapped ? PcapSwap32(value) : value;
+}
+
+static inline uint16_t PcapBig16(const uint8_t* data) {
+    return (uint16_t)((data[0] << 8) | data[1]);
+}
+
+static inline uint32_t PcapBig32(const uint8_t* data) {
+    return ((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) | ((uint32_t)data[2] << 8) | data[3];
+}
+
+static inline int PcapLinkSupported(uint32_t linkType) {
+    return linkType == PCAP_LINK_NULL || linkType == PCAP_LINK_LOOP || linkType == PCAP_LINK_RAW ||
+           linkType == PCAP_LINK_RAW_BSD || linkType == PCAP_LINK_LINUX_SLL || linkType == PCAP_LINK_LINUX_SLL2 ||
+           linkType == PCAP_LINK_ETHERNET;
+}
+
+/* Abre la captura y valida la cabecera global; los errores se informan por stderr con el prefijo dado. */
+static inline int PcapOpen(PcapReader* reader, const char* path, const char* prefix) {
+    uint8_t header[24];
+    memset(reader, 0, sizeof(*reader));
+    reader->file = fopen(path, "rb");
+    if (reader->file == NULL) {
+        fprintf(stderr, "%s No se pudo abrir %s\n", prefix, path);
+        return 0;
+    }
+    if (fread(header, 1, sizeof(header), reader->file) != sizeof(header)) {
+        fprintf(stderr, "%s %s no tiene cabecera pcap completa\n", prefix, path);
+        fclose(reader->file);
+        return 0;
+    }
+
+    uint32_t magic;
+    memcpy(&magic, header, sizeof(magic));
+    if (PcapSwap32(magic) == PCAP_MAGIC_US || PcapSwap32(magic) == PCAP_MAGIC_NS) {
+        reader->swapped = 1;
+        magic = PcapSwap32(magic);
+    } else if (magic != PCAP_MAGIC_US && magic != PCAP_MAGIC_NS) {
+        if (magic == PCAPNG_MAGIC) {
+            fprintf(stderr, "%s %s es pcapng; conviertalo con: editcap -F pcap <entrada> <salida>\n", prefix, path);
+        } else {
+            fprintf(stderr, "%s %s no es una captura pcap\n", prefix, path);
+        }
+        fclose(reader->file);
+        return 0;
+    }
+    reader->nanoseconds = magic == PCAP_MAGIC_NS;
+    reader->linkType = PcapHeader32(reader, header + 20) & 0xFFFF;
+    if (!PcapLinkSupported(reader->linkType)) {
+        fprintf(stderr, "%s Tipo de enlace %u no soportado\n", prefix, (unsigned)reader->linkType);
+        fclose(reader->file);
+        return 0;
+    }
+
+    uint32_t snapLength = PcapHeader32(reader, header + 16);
+    reader->capacity = snapLength == 0 || snapLength > PCAP_MAX_PACKET ? PCAP_MAX_PACKET : snapLength;
+    if (reader->capacity < 65535) {
+        reader->capacity = 65535;
+    }
+    reader->packet = (uint8_t*)malloc(reader->capacity);
+    if (reader->packet == NULL) {
+        fprintf(stderr, "%s Sin memoria para el buffer de paquetes\n", prefix);
+        fclose(reader->file);
+        return 0;
+    }
+    return 1;
+}
+
+static inline void PcapClose(PcapReader* reader) {
+    if (reader->file != NULL) {
+        fclose(reader->file);
+    }
+    free(reader->packet);
+    memset(reader, 0, sizeof(*reader));
+}
+
+/* Lee el siguiente paquete en reader->packet. Devuelve 1, 0 al final del archivo o -1 si esta truncado. */
+static inline int PcapNext(PcapReader* reader, uint64_t* timeUs, uint32_t* length) {
+    for (;;) {
+        uint8_t header[16];
+        size_t read = fread(header, 1, sizeof(header), reader->file);
+        if (read == 0) {
+            return 0;
+        }
+        if (read != sizeof(header)) {
+            return -1;
+        }
+        uint32_t seconds = PcapHeader32(reader, header);
+        uint32_t fraction = PcapHeader32(reader, header + 4);
+        uint32_t captured = PcapHeader32(reader, header + 8);
+        *timeUs = (uint64_t)seconds * 1000000ULL + (reader->nanoseconds ? fraction / 1000u : fraction);
+
+        if (captured > reader->capacity) {
+            /* Mas grande que el snaplen declarado: no puede ser un mensaje del protocolo. */
+            if (fseek(reader->file, (long)captured, SEEK_CUR) != 0) {
+                return -1;
+            }
+            reader->skippedPackets++;
+            continue;
+        }
+        if (fread(reader->packet, 1, captured, reader->file) != captured) {
+            return -1;
+        }
+        *length = captured;
+        return 1;
+    }
+}
+
+/* Ubica la cabecera IP segun el tipo de enlace. Devuelve el desplazamiento o -1. */
+static inline int PcapLinkOffset(uint32_t linkType, const uint8_t* data, uint32_t length) {
+    switch (linkType) {
+    case PCAP_LINK_NULL:
+    case PCAP_LINK_LOOP:
+        /* Familia de 4 bytes en el orden de la maquina que capturo; la version IP alcanza para decidir. */
+        return length > 4 ? 4 : -1;
+    case PCAP_LINK_RAW:
+    case PCAP_LINK_RAW_BSD:
+        return 0;
+    case PCAP_LINK_LINUX_SLL:
+        return length > 16 ? 16 : -1;
+    case PCAP_LINK_LINUX_SLL2:
+        return length > 20 ? 20 : -1;
+    case PCAP_LINK_ETHERNET: {
+        uint32_t offset = 12;
+        while (offset + 2 <= length) {
+            uint16_t etherType = PcapBig16(data + offset);
+            if (etherType == 0x8100 || etherType == 0x88A8) {
+                offset += 4;
+                continue;
+            }
+            return etherType == 0x0800 || etherType == 0x86DD ? (int)offset + 2 : -1;
+        }
+        return -1;
+    }
+    default:
+        return -1;
+    }
+}
+
+/* Decodifica el paquete actual del lector; devuelve 0 si no es un segmento TCP o datagrama UDP completo. */
+static inline int PcapDecode(const PcapReader* reader, uint64_t timeUs, uint32_t length, PcapPacket* packet) {
+    const uint8_t* data = reader->packet;
+    int offset = PcapLinkOffset(reader->linkType, data, length);
+    if (offset < 0 || (uint32_t)offset >= length) {
+        return 0;
+    }
+    const uint8_t* ip = data + offset;
+    uint32_t remaining = length - (uint32_t)offset;
+
+    PcapFlowKey* key = &packet->key;
+    memset(key, 0, sizeof(*key));
+    const uint8_t* transport;
+    uint32_t transportLength;
+    int version = ip[0] >> 4;
+    if (version == 4) {
+        if (remaining < 20) {
+            return 0;
+        }
+        uint32_t headerLength = (uint32_t)(ip[0] & 0x0F) * 4;
+        uint32_t totalLength = PcapBig16(ip + 2);
+        if (headerLength < 20 || totalLength < headerLength || totalLength > remaining ||
+            (PcapBig16(ip + 6) & 0x3FFF) != 0) {
+            return 0;
+        }
+        key->protocol = ip[9];
+        memcpy(key->source, ip + 12, 4);
+        memcpy(key->destination, ip + 16, 4);
+        transport = ip + headerLength;
+        transportLength = totalLength - headerLength;
+    } else if (version == 6) {
+        if (remaining < 40) {
+            return 0;
+        }
+        uint32_t payloadLength = PcapBig16(ip + 4);
+        if (payloadLength > remaining - 40) {
+            return 0;
+        }
+        key->protocol = ip[6];
+        memcpy(key->source, ip + 8, 16);
+        memcpy(key->destination, ip + 24, 16);
+        transport = ip + 40;
+        transportLength = payloadLength;
+    } else {
+        return 0;
+    }
+
+    if (key->protocol == PCAP_PROTOCOL_TCP) {
+        if (transportLength < 20) {
+            return 0;
+        }
+        uint32_t headerLength = (uint32_t)(transport[12] >> 4) * 4;
+        if (headerLength < 20 || headerLength > transportLength) {
+            return 0;
+        }
+        packet->sequence = PcapBig32(transport + 4);
+        packet->tcpFlags = transport[13];
+        packet->payload = transport + headerLength;
+        packet->payloadLength = transportLength - headerLength;
+    } else if (key->protocol == PCAP_PROTOCOL_UDP) {
+        if (transportLength < 8) {
+            return 0;
+        }
+        uint32_t udpLength = PcapBig16(transport + 4);
+        if (udpLength < 8 || udpLength > transportLength) {
+            return 0;
+        }
+        packet->sequence = 0;
+        packet->tcpFlags = 0;
+        packet->payload = transport + 8;
+        packet->payloadLength = udpLength - 8;
+    } else {
+        return 0;
+    }
+    key->sourcePort = PcapBig16(transport);
+    key->destinationPort = PcapBig16(transport + 2);
+    packet->timeUs = timeUs;
+    return 1;
+}
+
+static inline uint32_t PcapFlowHash(const PcapFlowKey* key) {
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < 16; ++i) {
+        hash = (hash ^ key->source[i] ^ ((uint32_t)key->destination[i] << 8)) * 16777619u;
+    }
+    return (hash ^ key->sourcePort ^ ((uint32_t)key->destinationPort << 16) ^ key->protocol) * 16777619u;
+}
+
+static inline int PcapFlowEquals(const PcapFlowKey* left, const PcapFlowKey* right) {
+    return left->protocol == right->protocol && left->sourcePort == right->sourcePort &&
+           left->destinationPort == right->destinationPort &&
+           memcmp(left->source, right->source, sizeof(left->source)) == 0 &&
+           memcmp(left->destination, right->destination, sizeof(left->destination)) == 0;
+}
+
+/*
+ * Deja en *data / *length solo los bytes nuevos del segmento. Un SYN reinicia el sentido (conexion nueva con el
+ * mismo puerto de origen). Devuelve PCAP_TCP_GAP si faltan bytes antes del segmento.
+ */
+static inline PcapTcpResult PcapTcpAccept(PcapTcpStream* stream, const PcapPacket* packet, const uint8_t** data,
+                                          uint32_t* length) {
+    uint32_t sequence = packet->sequence;
+    *data = packet->payload;
+    *length = packet->payloadLength;
+    if (packet->tcpFlags & PCAP_TCP_SYN) {
+        stream->sequenceKnown = 1;
+        stream->nextSequence = ++sequence;
+    } else if (!stream->sequenceKnown) {
+        /* La captura empezo con la conexion abierta. */
+        stream->sequenceKnown = 1;
+        stream->nextSequence = sequence;
+    }
+    if (*length == 0) {
+        return PCAP_TCP_IN_ORDER;
+    }
+
+    PcapTcpResult result = PCAP_TCP_IN_ORDER;
+    int32_t difference = (int32_t)(sequence - stream->nextSequence);
+    if (difference < 0 && (uint32_t)(-difference) >= *length) {
+        *length = 0;
+        return PCAP_TCP_RETRANSMISSION;
+    }
+    if (difference < 0) {
+        *data += (uint32_t)(-difference);
+        *length -= (uint32_t)(-difference);
+    } else if (difference > 0) {
+        result = PCAP_TCP_GAP;
+    }
+    stream->nextSequence = sequence + (uint32_t)(*data - packet->payload) + *length;
+    return result;
+}
+
+#endif /* PCAP_STREAM_H */
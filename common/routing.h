@@ -0,0 +1,1200 @@
+/*
+ * Archivo: routing.h
+ * Descripcion: Nucleo de enrutamiento comun a los brokers TCP, UDP y QUIC: topics internados, registro de
+ *              subscriptores y planificador de fan-out. Cada broker se conecta a traves de un RoutingTransport
+ *              (entregar un mensaje a un subscriptor y, opcionalmente, liberar su estado propio).
+ *
+ * Semantica unica: un mensaje llega a los subscriptores cuyo filtro coincide con el topic del publisher. El
+ * topic se normaliza al registrarlo y al publicar (se corta en el primer '\r', '\n' o '|' y a
+ * ROUTING_TOPIC_LEN - 1 bytes), de modo que "SUBSCRIBER|1\n" y "PUBLISHER|1|..." coinciden en los tres transportes.
+ *
+ * TOPICS JERARQUICOS:
+ *    Los niveles se separan con '/' (futbol/liga/partido1/goles). En un filtro de suscripcion '+' reemplaza
+ *    exactamente un nivel y '#', solo como ultimo nivel, reemplaza cero o mas niveles (futbol/# tambien recibe
+ *    "futbol"). Un topic plano como "1" es un topic de un solo nivel, asi que los filtros exactos se comportan
+ *    igual que antes. Un publisher no puede publicar en un topic con comodines.
+ *
+ * ESTRUCTURAS:
+ *    - Topics: cada nombre se guarda una sola vez (RoutingTopic) y se ubica con una tabla hash de direccionamiento
+ *      abierto (FNV-1a, factor de carga maximo 1/2). Los topics no se liberan; un topic publicado solo se interna
+ *      si algun subscriptor lo recibe (o si guarda retenidos), asi los topics sin interesados no hacen crecer la
+ *      tabla ni la cache de coincidencias.
+ *    - Subscriptores: tabla empaquetada de RoutingEntry que crece duplicando hasta maxSubscribers. Las entradas
+ *      de un topic forman una lista doblemente enlazada por indice, asi el alta y la baja son O(1) y el fan-out
+ *      recorre solo los subscriptores del topic. Las entradas libres se reutilizan (lista libre).
+ *    - Estado propio del transporte: extraSize bytes por entrada en un arreglo paralelo (RoutingEntryExtra), por
+ *      ejemplo la direccion UDP o el mensaje retenido del envio agrupado QUIC.
+ *    - Trie de filtros: cada filtro con suscripciones se inserta nivel por nivel en un trie; el topic de una
+ *      publicacion recorre el trie en O(profundidad) siguiendo el hijo exacto y el hijo '+' y juntando los filtros
+ *      '#' de cada nodo visitado.
+ *    - Cache de coincidencias: cada topic publicado guarda la lista de filtros que coinciden con el. La lista se
+ *      recalcula solo cuando aparece un filtro nuevo (filterGeneration), asi el caso normal no recorre el trie.
+ *    - Plan de fan-out (RoutingPlan): copia los indices de los subscriptores de los filtros coincidentes a un
+ *      arreglo contiguo y reutilizable; la entrega recorre ese arreglo y puede dar de baja subscriptores sin
+ *      invalidar el recorrido.
+ *    - Mensajes retenidos: con retainDepth > 0 cada topic publicado guarda sus ultimos N mensajes (ya formateados
+ *      por el broker) en un anillo de tamano fijo. RoutingReplayRetained los entrega a un subscriptor recien
+ *      registrado en un solo envio agrupado (DeliverBatch), para que vea el estado del partido sin esperar el
+ *      proximo evento y sin que los publishers tengan que reenviarlo.
+ *    - Prioridad: RoutingParsePublish separa la marca de prioridad del campo hora (../common/event_priority.h) y
+ *      el broker la copia al plan; durante RoutingDeliverPlan queda en table->deliveryPriority para que el
+ *      transporte elija el carril o stream de salida.
+ *    - Grupos de consumo: una suscripcion "$share/<grupo>/<filtro>" entra al grupo <grupo> de ese filtro en lugar
+ *      de la lista comun. Cada mensaje que coincide con el filtro llega a un solo miembro del grupo, asi varios
+ *      subscriptores se reparten el flujo de un topic. El plan guarda el grupo (RoutingGroupRecipient) y el miembro
+ *      se elige al entregar: por turno (ROUTING_GROUP_ROUND_ROBIN) o el de menor cola de salida segun
+ *      QueueDepth del transporte (ROUTING_GROUP_LEAST_LOADED, empates por turno). Si la entrega al elegido falla
+ *      se lo da de baja y se elige otro, asi el mensaje no se pierde mientras quede algun miembro. Los grupos no
+ *      se liberan (como los topics) y no reciben mensajes retenidos: el estado reciente ya lo tiene quien consume.
+ *
+ * Las funciones no toman locks: el broker serializa el acceso (el TCP y el UDP son de un solo hilo; el QUIC llama
+ * con SubscribersLock tomado).
+ *
+ * LIBRERIAS UTILIZADAS Y JUSTIFICACION:
+ *
+ * 1. stdint.h / stdlib.h / string.h (libreria estandar)
+ *    - Por que: Tablas dinamicas y comparacion de topics.
+ *    - Funciones usadas: malloc(), calloc(), realloc(), free(), memcpy(), memchr(), memset(), strcmp(), strlen().
+ *    - Alternativa considerada: Un arreglo fijo por broker (como antes); descartado porque cada broker tenia su
+ *      propio limite y su propia comparacion de topics (strstr, strcmp).
+ */
+
+#ifndef ROUTING_H
+#define ROUTING_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "event_priority.h"
+
+#define ROUTING_TOPIC_LEN 64
+#define ROUTING_NO_INDEX (-1)
+#define ROUTING_INITIAL_TOPIC_SLOTS 256
+#define ROUTING_MAX_LEVELS 16
+#define ROUTING_SHARE_PREFIX "$share/"
+#define ROUTING_SHARE_PREFIX_LEN 7
+
+typedef struct RoutingTable RoutingTable;
+
+/* Mensaje referenciado sin copiar (por ejemplo, dentro del anillo de retenidos). */
+typedef struct RoutingSpan {
+    const char* data;
+    uint32_t length;
+} RoutingSpan;
+
+/*
+ * Interfaz del transporte. Deliver (y DeliverBatch) devuelven 0 si el envio fallo: la suscripcion se da de baja
+ * (y se llama a Release). Release, Grow y DeliverBatch son opcionales; Grow avisa la nueva capacidad de la tabla
+ * para que el broker amplie sus propios arreglos indexados por subscriptor. DeliverBatch entrega varios mensajes
+ * en un solo envio; los spans solo son validos durante la llamada. Sin DeliverBatch se llama a Deliver por mensaje.
+ * QueueDepth (opcional) devuelve cuantos envios tiene pendientes el subscriptor; lo usa el reparto por carga de
+ * los grupos de consumo.
+ */
+typedef struct RoutingTransport {
+    const char* name;
+    void* context;
+    int (*Deliver)(void* context, RoutingTable* table, int32_t index, const char* message, uint32_t length);
+    void (*Release)(void* context, RoutingTable* table, int32_t index);
+    int (*Grow)(void* context, int32_t capacity);
+    int (*DeliverBatch)(void* context, RoutingTable* table, int32_t index, const RoutingSpan* spans, int32_t count);
+    uint32_t (*QueueDepth)(void* context, RoutingTable* table, int32_t index);
+} RoutingTransport;
+
+typedef enum RoutingGroupPolicy {
+    ROUTING_GROUP_ROUND_ROBIN,
+    ROUTING_GROUP_LEAST_LOADED
+} RoutingGroupPolicy;
+
+/* Casilla del anillo de retenidos; el buffer se reutiliza mientras el mensaje quepa. */
+typedef struct RoutingRetainedSlot {
+    char* data;
+    uint32_t length;
+    uint32_t capacity;
+} RoutingRetainedSlot;
+
+typedef struct RoutingRetained {
+    uint32_t next;
+    uint32_t count;
+    RoutingRetainedSlot slots[1];
+} RoutingRetained;
+
+typedef struct RoutingEntry {
+    void* handle;       /* Destino propio del transporte: socket, stream QUIC, etc. */
+    void* owner;        /* Conexion duena de la suscripcion (opcional). */
+    int32_t topicId;
+    int32_t groupId;    /* Grupo de consumo o ROUTING_NO_INDEX; los miembros se enlazan en la lista del grupo. */
+    int32_t nextInTopic;
+    int32_t prevInTopic;
+    uint8_t inUse;
+} RoutingEntry;
+
+/*
+ * Topic internado. Sirve como filtro (tiene suscripciones, isFilter) y como topic publicado (matches guarda los
+ * ids de los filtros que coinciden, valido mientras matchGeneration == filterGeneration de la tabla).
+ */
+typedef struct RoutingTopic {
+    char* name;
+    uint32_t hash;
+    int32_t firstSubscriber;
+    uint32_t subscriberCount;
+    int32_t* matches;
+    int32_t matchCount;
+    uint32_t matchGeneration;
+    uint8_t isFilter;
+    RoutingRetained* retained;
+    int32_t firstGroup;
+} RoutingTopic;
+
+/* Grupo de consumo de un filtro; los grupos del mismo filtro forman una lista enlazada por indice. */
+typedef struct RoutingGroup {
+    char* name;
+    int32_t filterId;
+    int32_t firstMember;
+    uint32_t memberCount;
+    int32_t lastPicked;     /* Ultimo miembro elegido; el turno sigue por el siguiente de la lista. */
+    int32_t nextInFilter;
+} RoutingGroup;
+
+/* Nodo del trie de filtros; los hijos de un nodo forman una lista enlazada por indice. */
+typedef struct RoutingTrieNode {
+    char* level;
+    int32_t firstChild;
+    int32_t nextSibling;
+    int32_t filterId;       /* Filtro que termina en este nodo. */
+    int32_t multiFilterId;  /* Filtro "<ruta hasta este nodo>/#". */
+} RoutingTrieNode;
+
+struct RoutingTable {
+    const RoutingTransport* transport;
+    RoutingEntry* entries;
+    uint8_t* extra;
+    size_t extraSize;
+    int32_t capacity;
+    int32_t highWater;
+    int32_t active;
+    int32_t freeHead;
+    int32_t initialCapacity;
+    int32_t maxSubscribers;
+    RoutingTopic* topics;
+    int32_t topicCount;
+    int32_t topicCapacity;
+    int32_t* topicSlots;
+    uint32_t topicSlotMask;
+    RoutingTrieNode* trie;
+    int32_t trieCount;
+    int32_t trieCapacity;
+    uint32_t filterGeneration;
+    int32_t* scratch;
+    int32_t scratchCount;
+    int32_t scratchCapacity;
+    uint32_t retainDepth;
+    RoutingSpan* spans;
+    int32_t spanCapacity;
+    RoutingGroup* groups;
+    int32_t groupCount;
+    int32_t groupCapacity;
+    RoutingGroupPolicy groupPolicy;
+    EventPriority deliveryPriority;   /* Prioridad del mensaje que RoutingDeliverPlan esta entregando. */
+};
+
+/* Destinatarios de un fan-out: indices de subscriptores o grupos codificados con RoutingGroupRecipient. */
+typedef struct RoutingPlan {
+    int32_t* recipients;
+    int32_t count;
+    int32_t capacity;
+    int32_t topicId;
+    EventPriority priority;   /* La fija el broker antes de entregar; RoutingPlanFanout no la toca. */
+} RoutingPlan;
+
+/* Mensaje "PUBLISHER|topic|hora|mensaje" separado en su lugar; timestamp ya no lleva la marca de prioridad. */
+typedef struct RoutingPublish {
+    char topic[ROUTING_TOPIC_LEN];
+    const char* timestamp;
+    const char* body;
+    EventPriority priority;
+} RoutingPublish;
+
+static inline uint32_t RoutingHashTopic(const char* topic) {
+    uint32_t hash = 2166136261u;
+    for (const unsigned char* cursor = (const unsigned char*)topic; *cursor != '\0'; ++cursor) {
+        hash ^= *cursor;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/* Copia el topic hasta el primer '\r', '\n' o '|' y lo trunca a ROUTING_TOPIC_LEN - 1 bytes. */
+static inline size_t RoutingNormalizeTopic(char* destination, const char* source, size_t sourceLength) {
+    size_t length = 0;
+    while (length < sourceLength && length < ROUTING_TOPIC_LEN - 1) {
+        char c = source[length];
+        if (c == '\0' || c == '\r' || c == '\n' || c == '|') {
+            break;
+        }
+        destination[length++] = c;
+    }
+    destination[length] = '\0';
+    return length;
+}
+
+/*
+ * Separa "PUBLISHER|topic|hora|mensaje" (sin '\n' final). Modifica la linea, que debe tener espacio para un
+ * '\0' en line[length]: hora y mensaje quedan terminados dentro de ella. Devuelve 0 si falta algun campo o el
+ * topic esta vacio.
+ */
+static inline int RoutingParsePublish(char* line, size_t length, RoutingPublish* out) {
+    if (length < 10 || memcmp(line, "PUBLISHER|", 10) != 0) {
+        return 0;
+    }
+    char* topic = line + 10;
+    char* end = line + length;
+    char* topicEnd = (char*)memchr(topic, '|', (size_t)(end - topic));
+    if (topicEnd == NULL) {
+        return 0;
+    }
+    char* timestamp = topicEnd + 1;
+    char* timestampEnd = (char*)memchr(timestamp, '|', (size_t)(end - timestamp));
+    if (timestampEnd == NULL) {
+        return 0;
+    }
+    *timestampEnd = '\0';
+    *end = '\0';
+
+    if (RoutingNormalizeTopic(out->topic, topic, (size_t)(topicEnd - topic)) == 0) {
+        return 0;
+    }
+    out->timestamp = timestamp;
+    out->priority = EventPriorityStrip(&out->timestamp);
+    out->body = timestampEnd + 1;
+    return 1;
+}
+
+static inline int RoutingTableInit(
+    RoutingTable* table,
+    const RoutingTransport* transport,
+    size_t extraSize,
+    int32_t initialCapacity,
+    int32_t maxSubscribers)
+{
+    memset(table, 0, sizeof(*table));
+    table->transport = transport;
+    table->extraSize = extraSize;
+    table->freeHead = ROUTING_NO_INDEX;
+    table->initialCapacity = initialCapacity > 0 ? initialCapacity : 16;
+    table->maxSubscribers = maxSubscribers;
+    return 1;
+}
+
+/* Cantidad de mensajes retenidos por topic (0 = sin retenidos). Debe fijarse antes de publicar. */
+static inline void RoutingSetRetainDepth(RoutingTable* table, uint32_t depth) {
+    table->retainDepth = depth;
+}
+
+/* Reparto dentro de los grupos de consumo (por defecto ROUTING_GROUP_ROUND_ROBIN). */
+static inline void RoutingSetGroupPolicy(RoutingTable* table, RoutingGroupPolicy policy) {
+    table->groupPolicy = policy;
+}
+
+/* Los grupos van en el plan como indices negativos, distintos de ROUTING_NO_INDEX. */
+static inline int32_t RoutingGroupRecipient(int32_t groupId) {
+    return -2 - groupId;
+}
+
+static inline void* RoutingEntryExtra(RoutingTable* table, int32_t index) {
+    return table->extra + (size_t)index * table->extraSize;
+}
+
+static inline const char* RoutingTopicName(const RoutingTable* table, int32_t topicId) {
+    return table->topics[topicId].name;
+}
+
+static inline int32_t RoutingFindTopicHashed(const RoutingTable* table, const char* name, uint32_t hash) {
+    if (table->topicSlots == NULL) {
+        return ROUTING_NO_INDEX;
+    }
+    for (uint32_t slot = hash & table->topicSlotMask;; slot = (slot + 1) & table->topicSlotMask) {
+        int32_t id = table->topicSlots[slot];
+        if (id == ROUTING_NO_INDEX) {
+            return ROUTING_NO_INDEX;
+        }
+        if (table->topics[id].hash == hash && strcmp(table->topics[id].name, name) == 0) {
+            return id;
+        }
+    }
+}
+
+static inline int32_t RoutingFindTopic(const RoutingTable* table, const char* name) {
+    return RoutingFindTopicHashed(table, name, RoutingHashTopic(name));
+}
+
+static inline int RoutingResizeTopicSlots(RoutingTable* table, uint32_t slotCount) {
+    int32_t* slots = (int32_t*)malloc(sizeof(int32_t) * slotCount);
+    if (slots == NULL) {
+        return 0;
+    }
+    for (uint32_t i = 0; i < slotCount; ++i) {
+        slots[i] = ROUTING_NO_INDEX;
+    }
+
+    uint32_t mask = slotCount - 1;
+    for (int32_t id = 0; id < table->topicCount; ++id) {
+        uint32_t slot = table->topics[id].hash & mask;
+        while (slots[slot] != ROUTING_NO_INDEX) {
+            slot = (slot + 1) & mask;
+        }
+        slots[slot] = id;
+    }
+
+    free(table->topicSlots);
+    table->topicSlots = slots;
+    table->topicSlotMask = mask;
+    return 1;
+}
+
+/* Devuelve el id del topic (ya normalizado), creandolo si no existe; ROUTING_NO_INDEX si no hay memoria. */
+static inline int32_t RoutingInternTopic(RoutingTable* table, const char* name) {
+    uint32_t hash = RoutingHashTopic(name);
+    int32_t id = RoutingFindTopicHashed(table, name, hash);
+    if (id != ROUTING_NO_INDEX) {
+        return id;
+    }
+
+    if (table->topicSlots == NULL || (uint32_t)(table->topicCount + 1) * 2 > table->topicSlotMask + 1) {
+        uint32_t slotCount = table->topicSlots == NULL ? ROUTING_INITIAL_TOPIC_SLOTS : (table->topicSlotMask + 1) * 2;
+        if (!RoutingResizeTopicSlots(table, slotCount)) {
+            return ROUTING_NO_INDEX;
+        }
+    }
+    if (table->topicCount == table->topicCapacity) {
+        int32_t capacity = table->topicCapacity == 0 ? ROUTING_INITIAL_TOPIC_SLOTS / 2 : table->topicCapacity * 2;
+        RoutingTopic* grown = (RoutingTopic*)realloc(table->topics, sizeof(RoutingTopic) * (size_t)capacity);
+        if (grown == NULL) {
+            return ROUTING_NO_INDEX;
+        }
+        table->topics = grown;
+        table->topicCapacity = capacity;
+    }
+
+    size_t length = strlen(name);
+    char* copy = (char*)malloc(length + 1);
+    if (copy == NULL) {
+        return ROUTING_NO_INDEX;
+    }
+    memcpy(copy, name, length + 1);
+
+    id = table->topicCount++;
+    table->topics[id].name = copy;
+    table->topics[id].hash = hash;
+    table->topics[id].firstSubscriber = ROUTING_NO_INDEX;
+    table->topics[id].subscriberCount = 0;
+    table->topics[id].matches = NULL;
+    table->topics[id].matchCount = 0;
+    table->topics[id].matchGeneration = 0;
+    table->topics[id].isFilter = 0;
+    table->topics[id].retained = NULL;
+    table->topics[id].firstGroup = ROUTING_NO_INDEX;
+
+    uint32_t slot = hash & table->topicSlotMask;
+    while (table->topicSlots[slot] != ROUTING_NO_INDEX) {
+        slot = (slot + 1) & table->topicSlotMask;
+    }
+    table->topicSlots[slot] = id;
+    return id;
+}
+
+/*
+ * Separa un topic en niveles (punteros dentro de copy, que se modifica). Devuelve la cantidad de niveles o 0 si
+ * hay demasiados. Con isFilter valida los comodines: '+' y '#' ocupan un nivel completo y '#' va al final; sin
+ * isFilter rechaza cualquier comodin.
+ */
+static inline int RoutingSplitLevels(char* copy, char** levels, int isFilter) {
+    int count = 0;
+    char* cursor = copy;
+    for (;;) {
+        if (count == ROUTING_MAX_LEVELS) {
+            return 0;
+        }
+        levels[count++] = cursor;
+        char* slash = strchr(cursor, '/');
+        if (slash != NULL) {
+            *slash = '\0';
+        }
+        int wildcard = strchr(levels[count - 1], '+') != NULL || strchr(levels[count - 1], '#') != NULL;
+        if (wildcard) {
+            int whole = strcmp(levels[count - 1], "+") == 0 || strcmp(levels[count - 1], "#") == 0;
+            if (!isFilter || !whole || (strcmp(levels[count - 1], "#") == 0 && slash != NULL)) {
+                return 0;
+            }
+        }
+        if (slash == NULL) {
+            return count;
+        }
+        cursor = slash + 1;
+    }
+}
+
+static inline int32_t RoutingTrieNewNode(RoutingTable* table, const char* level) {
+    if (table->trieCount == table->trieCapacity) {
+        int32_t capacity = table->trieCapacity == 0 ? 64 : table->trieCapacity * 2;
+        RoutingTrieNode* grown = (RoutingTrieNode*)realloc(table->trie, sizeof(RoutingTrieNode) * (size_t)capacity);
+        if (grown == NULL) {
+            return ROUTING_NO_INDEX;
+        }
+        table->trie = grown;
+        table->trieCapacity = capacity;
+    }
+
+    size_t length = strlen(level);
+    char* copy = (char*)malloc(length + 1);
+    if (copy == NULL) {
+        return ROUTING_NO_INDEX;
+    }
+    memcpy(copy, level, length + 1);
+
+    int32_t id = table->trieCount++;
+    RoutingTrieNode* node = &table->trie[id];
+    node->level = copy;
+    node->firstChild = ROUTING_NO_INDEX;
+    node->nextSibling = ROUTING_NO_INDEX;
+    node->filterId = ROUTING_NO_INDEX;
+    node->multiFilterId = ROUTING_NO_INDEX;
+    return id;
+}
+
+static inline int32_t RoutingTrieChild(RoutingTable* table, int32_t parent, const char* level, int create) {
+    for (int32_t child = table->trie[parent].firstChild; child != ROUTING_NO_INDEX; child = table->trie[child].nextSibling) {
+        if (strcmp(table->trie[child].level, level) == 0) {
+            return child;
+        }
+    }
+    if (!create) {
+        return ROUTING_NO_INDEX;
+    }
+    int32_t child = RoutingTrieNewNode(table, level);
+    if (child != ROUTING_NO_INDEX) {
+        table->trie[child].nextSibling = table->trie[parent].firstChild;
+        table->trie[parent].firstChild = child;
+    }
+    return child;
+}
+
+/* Inserta el topic topicId como filtro en el trie. Los filtros nuevos invalidan las coincidencias guardadas. */
+static inline int RoutingTrieInsert(RoutingTable* table, int32_t topicId) {
+    if (table->topics[topicId].isFilter) {
+        return 1;
+    }
+
+    char copy[ROUTING_TOPIC_LEN];
+    char* levels[ROUTING_MAX_LEVELS];
+    memcpy(copy, table->topics[topicId].name, strlen(table->topics[topicId].name) + 1);
+    int count = RoutingSplitLevels(copy, levels, 1);
+    if (count == 0) {
+        return 0;
+    }
+    if (table->trie == NULL && RoutingTrieNewNode(table, "") == ROUTING_NO_INDEX) {
+        return 0;
+    }
+
+    int32_t node = 0;
+    int multi = strcmp(levels[count - 1], "#") == 0;
+    for (int i = 0; i < count - multi; ++i) {
+        node = RoutingTrieChild(table, node, levels[i], 1);
+        if (node == ROUTING_NO_INDEX) {
+            return 0;
+        }
+    }
+    if (multi) {
+        table->trie[node].multiFilterId = topicId;
+    } else {
+        table->trie[node].filterId = topicId;
+    }
+    table->topics[topicId].isFilter = 1;
+    table->filterGeneration++;
+    return 1;
+}
+
+/* Agrega un filtro coincidente a table->scratch; devuelve 0 si no hay memoria. */
+static inline int RoutingScratchPush(RoutingTable* table, int32_t topicId) {
+    if (topicId == ROUTING_NO_INDEX) {
+        return 1;
+    }
+    if (table->scratchCount == table->scratchCapacity) {
+        int32_t capacity = table->scratchCapacity == 0 ? 16 : table->scratchCapacity * 2;
+        int32_t* grown = (int32_t*)realloc(table->scratch, sizeof(int32_t) * (size_t)capacity);
+        if (grown == NULL) {
+            return 0;
+        }
+        table->scratch = grown;
+        table->scratchCapacity = capacity;
+    }
+    table->scratch[table->scratchCount++] = topicId;
+    return 1;
+}
+
+static inline int RoutingTrieMatch(RoutingTable* table, int32_t node, char** levels, int count, int depth) {
+    RoutingTrieNode* current = &table->trie[node];
+    if (!RoutingScratchPush(table, current->multiFilterId)) {
+        return 0;
+    }
+    if (depth == count) {
+        return RoutingScratchPush(table, current->filterId);
+    }
+    for (int32_t child = current->firstChild; child != ROUTING_NO_INDEX; child = table->trie[child].nextSibling) {
+        const char* level = table->trie[child].level;
+        if ((level[0] == '+' && level[1] == '\0') || strcmp(level, levels[depth]) == 0) {
+            if (!RoutingTrieMatch(table, child, levels, count, depth + 1)) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+/* Deja en table->scratch los filtros que coinciden con el topic (sin internarlo); devuelve 0 si no hay memoria. */
+static inline int RoutingCollectMatches(RoutingTable* table, const char* name) {
+    char copy[ROUTING_TOPIC_LEN];
+    char* levels[ROUTING_MAX_LEVELS];
+    size_t length = strlen(name);
+    table->scratchCount = 0;
+    if (length >= sizeof(copy)) {
+        return 1;
+    }
+    memcpy(copy, name, length + 1);
+    int count = RoutingSplitLevels(copy, levels, 0);
+    if (count > 0 && table->trie != NULL) {
+        return RoutingTrieMatch(table, 0, levels, count, 0);
+    }
+    return 1;
+}
+
+/* Guarda en el topic la lista que dejo RoutingCollectMatches. */
+static inline int RoutingStoreMatches(RoutingTable* table, int32_t topicId) {
+    RoutingTopic* topic = &table->topics[topicId];
+    int32_t* matches = (int32_t*)realloc(topic->matches, sizeof(int32_t) * (size_t)(table->scratchCount + 1));
+    if (matches == NULL) {
+        return 0;
+    }
+    memcpy(matches, table->scratch, sizeof(int32_t) * (size_t)table->scratchCount);
+    topic->matches = matches;
+    topic->matchCount = table->scratchCount;
+    topic->matchGeneration = table->filterGeneration;
+    return 1;
+}
+
+/*
+ * Filtros que coinciden con el topic publicado topicId. Usa la lista guardada si sigue vigente; si no, recorre el
+ * trie y la guarda. Incluye filtros que hoy no tienen subscriptores: como los filtros no se eliminan del trie, la
+ * lista solo envejece cuando aparece un filtro nuevo. Devuelve 0 si no hay memoria.
+ */
+static inline int RoutingRefreshMatches(RoutingTable* table, int32_t topicId) {
+    RoutingTopic* topic = &table->topics[topicId];
+    if (topic->matches != NULL && topic->matchGeneration == table->filterGeneration) {
+        return 1;
+    }
+    return RoutingCollectMatches(table, topic->name) && RoutingStoreMatches(table, topicId);
+}
+
+/* Destinatarios que tendria la lista de filtros: subscriptores comunes y un lugar por grupo con miembros. */
+static inline int32_t RoutingCountRecipients(const RoutingTable* table, const int32_t* matches, int32_t matchCount) {
+    int32_t total = 0;
+    for (int32_t i = 0; i < matchCount; ++i) {
+        const RoutingTopic* filter = &table->topics[matches[i]];
+        total += (int32_t)filter->subscriberCount;
+        for (int32_t group = filter->firstGroup; group != ROUTING_NO_INDEX; group = table->groups[group].nextInFilter) {
+            total += table->groups[group].memberCount > 0;
+        }
+    }
+    return total;
+}
+
+/* Interna un filtro de suscripcion (valida comodines y lo agrega al trie); ROUTING_NO_INDEX si es invalido. */
+static inline int32_t RoutingInternFilter(RoutingTable* table, const char* topic) {
+    char name[ROUTING_TOPIC_LEN];
+    char check[ROUTING_TOPIC_LEN];
+    char* levels[ROUTING_MAX_LEVELS];
+    size_t length = RoutingNormalizeTopic(name, topic, strlen(topic));
+    if (length == 0) {
+        return ROUTING_NO_INDEX;
+    }
+    memcpy(check, name, length + 1);
+    if (RoutingSplitLevels(check, levels, 1) == 0) {
+        return ROUTING_NO_INDEX;
+    }
+
+    int32_t topicId = RoutingInternTopic(table, name);
+    if (topicId == ROUTING_NO_INDEX || !RoutingTrieInsert(table, topicId)) {
+        return ROUTING_NO_INDEX;
+    }
+    return topicId;
+}
+
+static inline int32_t RoutingFindGroup(const RoutingTable* table, int32_t filterId, const char* name) {
+    for (int32_t id = table->topics[filterId].firstGroup; id != ROUTING_NO_INDEX; id = table->groups[id].nextInFilter) {
+        if (strcmp(table->groups[id].name, name) == 0) {
+            return id;
+        }
+    }
+    return ROUTING_NO_INDEX;
+}
+
+static inline int32_t RoutingInternGroup(RoutingTable* table, int32_t filterId, const char* name) {
+    int32_t id = RoutingFindGroup(table, filterId, name);
+    if (id != ROUTING_NO_INDEX) {
+        return id;
+    }
+    if (table->groupCount == table->groupCapacity) {
+        int32_t capacity = table->groupCapacity == 0 ? 8 : table->groupCapacity * 2;
+        RoutingGroup* grown = (RoutingGroup*)realloc(table->groups, sizeof(RoutingGroup) * (size_t)capacity);
+        if (grown == NULL) {
+            return ROUTING_NO_INDEX;
+        }
+        table->groups = grown;
+        table->groupCapacity = capacity;
+    }
+
+    size_t length = strlen(name);
+    char* copy = (char*)malloc(length + 1);
+    if (copy == NULL) {
+        return ROUTING_NO_INDEX;
+    }
+    memcpy(copy, name, length + 1);
+
+    id = table->groupCount++;
+    RoutingGroup* group = &table->groups[id];
+    group->name = copy;
+    group->filterId = filterId;
+    group->firstMember = ROUTING_NO_INDEX;
+    group->memberCount = 0;
+    group->lastPicked = ROUTING_NO_INDEX;
+    group->nextInFilter = table->topics[filterId].firstGroup;
+    table->topics[filterId].firstGroup = id;
+    return id;
+}
+
+/*
+ * Resuelve una suscripcion: un filtro comun o "$share/<grupo>/<filtro>". Con create interna el filtro y el grupo;
+ * sin create solo los busca (para reconocer una suscripcion que ya existe). Devuelve 0 si es invalida o no existe.
+ */
+static inline int RoutingResolveSubscription(RoutingTable* table, const char* topic, int create, int32_t* topicId, int32_t* groupId) {
+    char name[ROUTING_TOPIC_LEN];
+    RoutingNormalizeTopic(name, topic, strlen(topic));
+    *groupId = ROUTING_NO_INDEX;
+    const char* filter = name;
+    const char* groupName = NULL;
+    if (strncmp(name, ROUTING_SHARE_PREFIX, ROUTING_SHARE_PREFIX_LEN) == 0) {
+        char* slash = strchr(name + ROUTING_SHARE_PREFIX_LEN, '/');
+        groupName = name + ROUTING_SHARE_PREFIX_LEN;
+        if (slash == NULL || slash == groupName || slash[1] == '\0') {
+            return 0;
+        }
+        *slash = '\0';
+        filter = slash + 1;
+        if (strpbrk(groupName, "+#") != NULL) {
+            return 0;
+        }
+    }
+
+    if (create) {
+        *topicId = RoutingInternFilter(table, filter);
+    } else {
+        *topicId = RoutingFindTopic(table, filter);
+        if (*topicId != ROUTING_NO_INDEX && !table->topics[*topicId].isFilter) {
+            *topicId = ROUTING_NO_INDEX;
+        }
+    }
+    if (*topicId == ROUTING_NO_INDEX) {
+        return 0;
+    }
+    if (groupName != NULL) {
+        *groupId = create ? RoutingInternGroup(table, *topicId, groupName) : RoutingFindGroup(table, *topicId, groupName);
+        if (*groupId == ROUTING_NO_INDEX) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Nombre del grupo de consumo de la suscripcion, o NULL si no pertenece a ninguno. */
+static inline const char* RoutingEntryGroupName(const RoutingTable* table, int32_t index) {
+    int32_t groupId = table->entries[index].groupId;
+    return groupId != ROUTING_NO_INDEX ? table->groups[groupId].name : NULL;
+}
+
+/* Toma una entrada libre o amplia la tabla (duplicando) hasta maxSubscribers. */
+static inline int32_t RoutingAllocateEntry(RoutingTable* table) {
+    if (table->freeHead != ROUTING_NO_INDEX) {
+        int32_t index = table->freeHead;
+        table->freeHead = table->entries[index].nextInTopic;
+        return index;
+    }
+
+    if (table->highWater == table->capacity) {
+        if (table->capacity >= table->maxSubscribers) {
+            return ROUTING_NO_INDEX;
+        }
+        int32_t capacity = table->capacity == 0 ? table->initialCapacity : table->capacity * 2;
+        if (capacity > table->maxSubscribers) {
+            capacity = table->maxSubscribers;
+        }
+        RoutingEntry* grown = (RoutingEntry*)realloc(table->entries, sizeof(RoutingEntry) * (size_t)capacity);
+        if (grown == NULL) {
+            return ROUTING_NO_INDEX;
+        }
+        table->entries = grown;
+        if (table->extraSize > 0) {
+            uint8_t* extra = (uint8_t*)realloc(table->extra, table->extraSize * (size_t)capacity);
+            if (extra == NULL) {
+                return ROUTING_NO_INDEX;
+            }
+            table->extra = extra;
+        }
+        if (table->transport->Grow != NULL && !table->transport->Grow(table->transport->context, capacity)) {
+            return ROUTING_NO_INDEX;
+        }
+        table->capacity = capacity;
+    }
+
+    int32_t index = table->highWater++;
+    memset(&table->entries[index], 0, sizeof(RoutingEntry));
+    if (table->extraSize > 0) {
+        memset(RoutingEntryExtra(table, index), 0, table->extraSize);
+    }
+    return index;
+}
+
+/* Los miembros de un grupo se enlazan en la lista del grupo; el resto, en la del filtro. */
+static inline void RoutingLinkEntry(RoutingTable* table, int32_t index, int32_t topicId, int32_t groupId) {
+    RoutingEntry* entry = &table->entries[index];
+    int32_t* first = groupId != ROUTING_NO_INDEX ? &table->groups[groupId].firstMember : &table->topics[topicId].firstSubscriber;
+    uint32_t* count = groupId != ROUTING_NO_INDEX ? &table->groups[groupId].memberCount : &table->topics[topicId].subscriberCount;
+
+    entry->topicId = topicId;
+    entry->groupId = groupId;
+    entry->prevInTopic = ROUTING_NO_INDEX;
+    entry->nextInTopic = *first;
+    if (*first != ROUTING_NO_INDEX) {
+        table->entries[*first].prevInTopic = index;
+    }
+    *first = index;
+    (*count)++;
+}
+
+static inline void RoutingUnlinkEntry(RoutingTable* table, int32_t index) {
+    RoutingEntry* entry = &table->entries[index];
+    RoutingGroup* group = entry->groupId != ROUTING_NO_INDEX ? &table->groups[entry->groupId] : NULL;
+    int32_t* first = group != NULL ? &group->firstMember : &table->topics[entry->topicId].firstSubscriber;
+    uint32_t* count = group != NULL ? &group->memberCount : &table->topics[entry->topicId].subscriberCount;
+
+    /* El turno sigue desde el anterior, asi la baja del ultimo elegido no saltea al siguiente. */
+    if (group != NULL && group->lastPicked == index) {
+        group->lastPicked = entry->prevInTopic;
+    }
+    if (entry->prevInTopic != ROUTING_NO_INDEX) {
+        table->entries[entry->prevInTopic].nextInTopic = entry->nextInTopic;
+    } else {
+        *first = entry->nextInTopic;
+    }
+    if (entry->nextInTopic != ROUTING_NO_INDEX) {
+        table->entries[entry->nextInTopic].prevInTopic = entry->prevInTopic;
+    }
+    (*count)--;
+    entry->groupId = ROUTING_NO_INDEX;
+    entry->nextInTopic = ROUTING_NO_INDEX;
+    entry->prevInTopic = ROUTING_NO_INDEX;
+}
+
+/*
+ * Registra una suscripcion al filtro topic (o al grupo de "$share/<grupo>/<filtro>"). Devuelve el indice de la
+ * entrada o ROUTING_NO_INDEX si el filtro es invalido, la tabla esta llena o no hay memoria. El estado extra de una
+ * entrada nueva esta en cero; una entrada reutilizada conserva lo que dejo Release (el transporte puede tener ese
+ * indice en sus propias listas).
+ */
+static inline int32_t RoutingSubscribe(RoutingTable* table, const char* topic, void* handle, void* owner) {
+    int32_t topicId;
+    int32_t groupId;
+    if (!RoutingResolveSubscription(table, topic, 1, &topicId, &groupId)) {
+        return ROUTING_NO_INDEX;
+    }
+
+    int32_t index = RoutingAllocateEntry(table);
+    if (index == ROUTING_NO_INDEX) {
+        return ROUTING_NO_INDEX;
+    }
+
+    RoutingEntry* entry = &table->entries[index];
+    entry->inUse = 1;
+    entry->handle = handle;
+    entry->owner = owner;
+    RoutingLinkEntry(table, index, topicId, groupId);
+    table->active++;
+    return index;
+}
+
+/* Mueve una suscripcion a otro filtro. Devuelve 1 si cambio, 0 si ya era ese filtro, -1 si es invalido o no hay memoria. */
+static inline int RoutingChangeTopic(RoutingTable* table, int32_t index, const char* topic) {
+    int32_t topicId;
+    int32_t groupId;
+    if (!RoutingResolveSubscription(table, topic, 1, &topicId, &groupId)) {
+        return -1;
+    }
+    if (table->entries[index].topicId == topicId && table->entries[index].groupId == groupId) {
+        return 0;
+    }
+    RoutingUnlinkEntry(table, index);
+    RoutingLinkEntry(table, index, topicId, groupId);
+    return 1;
+}
+
+/* Da de baja la suscripcion: el transporte libera su estado (Release) y la entrada vuelve a la lista libre. */
+static inline void RoutingUnsubscribe(RoutingTable* table, int32_t index) {
+    RoutingEntry* entry = &table->entries[index];
+    if (!entry->inUse) {
+        return;
+    }
+    if (table->transport->Release != NULL) {
+        table->transport->Release(table->transport->context, table, index);
+    }
+    RoutingUnlinkEntry(table, index);
+    entry->inUse = 0;
+    entry->handle = NULL;
+    entry->owner = NULL;
+    entry->nextInTopic = table->freeHead;
+    table->freeHead = index;
+    table->active--;
+}
+
+/* Primera suscripcion con ese handle (ROUTING_NO_INDEX si no hay); recorre la tabla completa. */
+static inline int32_t RoutingFindByHandle(const RoutingTable* table, const void* handle) {
+    for (int32_t i = 0; i < table->highWater; ++i) {
+        if (table->entries[i].inUse && table->entries[i].handle == handle) {
+            return i;
+        }
+    }
+    return ROUTING_NO_INDEX;
+}
+
+/*
+ * Elige el miembro del grupo que recibe el proximo mensaje: el siguiente al ultimo elegido o, con
+ * ROUTING_GROUP_LEAST_LOADED y QueueDepth, el de menor cola recorriendo en ese mismo orden (el primero gana los
+ * empates). ROUTING_NO_INDEX si el grupo no tiene miembros.
+ */
+static inline int32_t RoutingPickMember(RoutingTable* table, int32_t groupId) {
+    RoutingGroup* group = &table->groups[groupId];
+    if (group->memberCount == 0) {
+        return ROUTING_NO_INDEX;
+    }
+    int32_t start = group->lastPicked != ROUTING_NO_INDEX ? table->entries[group->lastPicked].nextInTopic : ROUTING_NO_INDEX;
+    if (start == ROUTING_NO_INDEX) {
+        start = group->firstMember;
+    }
+
+    int32_t chosen = start;
+    const RoutingTransport* transport = table->transport;
+    if (table->groupPolicy == ROUTING_GROUP_LEAST_LOADED && transport->QueueDepth != NULL && group->memberCount > 1) {
+        uint32_t best = transport->QueueDepth(transport->context, table, start);
+        int32_t index = start;
+        for (uint32_t seen = 1; best > 0 && seen < group->memberCount; ++seen) {
+            index = table->entries[index].nextInTopic;
+            if (index == ROUTING_NO_INDEX) {
+                index = group->firstMember;
+            }
+            uint32_t depth = transport->QueueDepth(transport->context, table, index);
+            if (depth < best) {
+                best = depth;
+                chosen = index;
+            }
+        }
+    }
+    group->lastPicked = chosen;
+    return chosen;
+}
+
+/*
+ * Planifica el fan-out: copia al plan los indices de los subscriptores de todos los filtros que coinciden con el
+ * topic publicado (ya normalizado) y, por cada grupo de consumo con miembros, el grupo (el miembro se elige al
+ * entregar). Un topic que todavia no esta internado se resuelve primero sobre table->scratch y solo se interna
+ * (para guardar sus coincidencias) si tiene destinatarios. Devuelve la cantidad de destinatarios; 0 si nadie
+ * coincide o el topic tiene comodines, y -1 si no hubo memoria (el mensaje no se entrego a nadie).
+ */
+static inline int32_t RoutingPlanFanout(RoutingTable* table, const char* topic, RoutingPlan* plan) {
+    plan->count = 0;
+    plan->topicId = ROUTING_NO_INDEX;
+    if (table->trie == NULL) {
+        return 0;
+    }
+    plan->topicId = RoutingFindTopicHashed(table, topic, RoutingHashTopic(topic));
+    if (plan->topicId == ROUTING_NO_INDEX) {
+        if (!RoutingCollectMatches(table, topic)) {
+            return -1;
+        }
+        if (RoutingCountRecipients(table, table->scratch, table->scratchCount) == 0) {
+            return 0;
+        }
+        plan->topicId = RoutingInternTopic(table, topic);
+        if (plan->topicId == ROUTING_NO_INDEX || !RoutingStoreMatches(table, plan->topicId)) {
+            return -1;
+        }
+    } else if (!RoutingRefreshMatches(table, plan->topicId)) {
+        return -1;
+    }
+
+    const RoutingTopic* record = &table->topics[plan->topicId];
+    int32_t total = RoutingCountRecipients(table, record->matches, record->matchCount);
+    if (total > plan->capacity) {
+        int32_t capacity = plan->capacity == 0 ? 64 : plan->capacity;
+        while (capacity < total) {
+            capacity *= 2;
+        }
+        int32_t* grown = (int32_t*)realloc(plan->recipients, sizeof(int32_t) * (size_t)capacity);
+        if (grown == NULL) {
+            return -1;
+        }
+        plan->recipients = grown;
+        plan->capacity = capacity;
+    }
+
+    for (int32_t i = 0; i < record->matchCount; ++i) {
+        const RoutingTopic* filter = &table->topics[record->matches[i]];
+        for (int32_t index = filter->firstSubscriber; index != ROUTING_NO_INDEX; index = table->entries[index].nextInTopic) {
+            plan->recipients[plan->count++] = index;
+        }
+        for (int32_t group = filter->firstGroup; group != ROUTING_NO_INDEX; group = table->groups[group].nextInFilter) {
+            if (table->groups[group].memberCount > 0) {
+                plan->recipients[plan->count++] = RoutingGroupRecipient(group);
+            }
+        }
+    }
+    return plan->count;
+}
+
+/* Entrega el mensaje a los destinatarios del plan. Devuelve cuantas entregas tuvieron exito. */
+static inline int32_t RoutingDeliverPlan(RoutingTable* table, const RoutingPlan* plan, const char* message, uint32_t length) {
+    const RoutingTransport* transport = table->transport;
+    int32_t delivered = 0;
+    table->deliveryPriority = plan->priority;
+    for (int32_t i = 0; i < plan->count; ++i) {
+        int32_t index = plan->recipients[i];
+        if (index < ROUTING_NO_INDEX) {
+            /* Grupo: un solo miembro; si la entrega falla se prueba con otro mientras queden. */
+            int32_t groupId = RoutingGroupRecipient(index);
+            while ((index = RoutingPickMember(table, groupId)) != ROUTING_NO_INDEX) {
+                if (transport->Deliver(transport->context, table, index, message, length)) {
+                    delivered++;
+                    break;
+                }
+                RoutingUnsubscribe(table, index);
+            }
+            continue;
+        }
+        if (!table->entries[index].inUse) {
+            continue;
+        }
+        if (transport->Deliver(transport->context, table, index, message, length)) {
+            delivered++;
+        } else {
+            RoutingUnsubscribe(table, index);
+        }
+    }
+    return delivered;
+}
+
+/* Guarda el mensaje en el anillo del topic publicado, reemplazando el mas antiguo cuando esta lleno. */
+static inline void RoutingRetain(RoutingTable* table, const char* topic, const char* message, uint32_t length) {
+    char check[ROUTING_TOPIC_LEN];
+    char* levels[ROUTING_MAX_LEVELS];
+    size_t topicLength = strlen(topic);
+    if (topicLength == 0 || topicLength >= sizeof(check)) {
+        return;
+    }
+    memcpy(check, topic, topicLength + 1);
+    if (RoutingSplitLevels(check, levels, 0) == 0) {
+        return;
+    }
+    int32_t topicId = RoutingInternTopic(table, topic);
+    if (topicId == ROUTING_NO_INDEX) {
+        return;
+    }
+
+    RoutingTopic* record = &table->topics[topicId];
+    if (record->retained == NULL) {
+        record->retained = (RoutingRetained*)calloc(
+            1, sizeof(RoutingRetained) + sizeof(RoutingRetainedSlot) * (table->retainDepth - 1));
+        if (record->retained == NULL) {
+            return;
+        }
+    }
+
+    RoutingRetained* ring = record->retained;
+    RoutingRetainedSlot* slot = &ring->slots[ring->next];
+    if (slot->capacity < length) {
+        char* grown = (char*)realloc(slot->data, length);
+        if (grown == NULL) {
+            return;
+        }
+        slot->data = grown;
+        slot->capacity = length;
+    }
+    memcpy(slot->data, message, length);
+    slot->length = length;
+    ring->next = (ring->next + 1) % table->retainDepth;
+    if (ring->count < table->retainDepth) {
+        ring->count++;
+    }
+}
+
+/* Compara un filtro (con comodines) con un topic concreto, nivel por nivel. */
+static inline int RoutingFilterMatches(const char* filter, const char* topic) {
+    for (;;) {
+        const char* filterEnd = strchr(filter, '/');
+        size_t filterLength = filterEnd != NULL ? (size_t)(filterEnd - filter) : strlen(filter);
+        if (filterLength == 1 && filter[0] == '#') {
+            return 1;
+        }
+        const char* topicEnd = strchr(topic, '/');
+        size_t topicLength = topicEnd != NULL ? (size_t)(topicEnd - topic) : strlen(topic);
+
+        if (!(filterLength == 1 && filter[0] == '+') &&
+            (filterLength != topicLength || memcmp(filter, topic, filterLength) != 0)) {
+            return 0;
+        }
+        if (topicEnd == NULL) {
+            /* "a/#" tambien coincide con "a". */
+            return filterEnd == NULL || strcmp(filterEnd + 1, "#") == 0;
+        }
+        if (filterEnd == NULL) {
+            return 0;
+        }
+        filter = filterEnd + 1;
+        topic = topicEnd + 1;
+    }
+}
+
+static inline int RoutingAppendRetained(RoutingTable* table, const RoutingRetained* ring, int32_t* count) {
+    uint32_t depth = table->retainDepth;
+    if (*count + (int32_t)ring->count > table->spanCapacity) {
+        int32_t capacity = table->spanCapacity == 0 ? 64 : table->spanCapacity;
+        while (capacity < *count + (int32_t)ring->count) {
+            capacity *= 2;
+        }
+        RoutingSpan* grown = (RoutingSpan*)realloc(table->spans, sizeof(RoutingSpan) * (size_t)capacity);
+        if (grown == NULL) {
+            return 0;
+        }
+        table->spans = grown;
+        table->spanCapacity = capacity;
+    }
+
+    /* Del mas antiguo al mas reciente. */
+    uint32_t first = (ring->next + depth - ring->count) % depth;
+    for (uint32_t i = 0; i < ring->count; ++i) {
+        const RoutingRetainedSlot* slot = &ring->slots[(first + i) % depth];
+        table->spans[*count].data = slot->data;
+        table->spans[*count].length = slot->length;
+        (*count)++;
+    }
+    return 1;
+}
+
+/*
+ * Entrega al subscriptor index los mensajes retenidos de los topics que coinciden con su filtro, en un solo envio
+ * agrupado. Llamar justo despues de registrarlo (y de su confirmacion), sin soltar el lock entre ambos pasos para
+ * que ningun evento nuevo se adelante a los retenidos. Devuelve la cantidad de mensajes entregados; si el envio
+ * falla la suscripcion se da de baja y devuelve -1.
+ */
+static inline int32_t RoutingReplayRetained(RoutingTable* table, int32_t index) {
+    if (table->retainDepth == 0 || index == ROUTING_NO_INDEX || !table->entries[index].inUse ||
+        table->entries[index].groupId != ROUTING_NO_INDEX) {
+        return 0;
+    }
+
+    int32_t filterId = table->entries[index].topicId;
+    const char* filter = table->topics[filterId].name;
+    int wildcard = strchr(filter, '+') != NULL || strchr(filter, '#') != NULL;
+
+    int32_t count = 0;
+    if (!wildcard) {
+        if (table->topics[filterId].retained != NULL &&
+            !RoutingAppendRetained(table, table->topics[filterId].retained, &count)) {
+            return 0;
+        }
+    } else {
+        for (int32_t id = 0; id < table->topicCount; ++id) {
+            if (table->topics[id].retained != NULL && RoutingFilterMatches(filter, table->topics[id].name) &&
+                !RoutingAppendRetained(table, table->topics[id].retained, &count)) {
+                return 0;
+            }
+        }
+    }
+    if (count == 0) {
+        return 0;
+    }
+
+    const RoutingTransport* transport = table->transport;
+    int ok = 1;
+    if (transport->DeliverBatch != NULL) {
+        ok = transport->DeliverBatch(transport->context, table, index, table->spans, count);
+    } else {
+        for (int32_t i = 0; ok && i < count; ++i) {
+            ok = transport->Deliver(transport->context, table, index, table->spans[i].data, table->spans[i].length);
+        }
+    }
+    if (!ok) {
+        RoutingUnsubscribe(table, index);
+        return -1;
+    }
+    return count;
+}
+
+/*
+ * Retiene el mensaje (si hay retenidos), planifica y entrega en un solo paso; devuelve cuantas entregas tuvieron
+ * exito, o -1 si no hubo memoria para planificar (el broker lo informa; nadie recibio el mensaje).
+ */
+static inline int32_t RoutingPublishTo(RoutingTable* table, RoutingPlan* plan, const char* topic, const char* message, uint32_t length) {
+    if (table->retainDepth > 0) {
+        RoutingRetain(table, topic, message, length);
+    }
+    int32_t planned = RoutingPlanFanout(table, topic, plan);
+    if (planned <= 0) {
+        return planned;
+    }
+    return RoutingDeliverPlan(table, plan, message, length);
+}
+
+static inline void RoutingFreePlan(RoutingPlan* plan) {
+    free(plan->recipients);
+    memset(plan, 0, sizeof(*plan));
+}
+
+/* Libera las tablas sin llamar a Release: el broker ya cerro sus conexiones. */
+static inline void RoutingTableFree(RoutingTable* table) {
+    for (int32_t id = 0; id < table->topicCount; ++id) {
+        free(table->topics[id].name);
+        free(table->topics[id].matches);
+        if (table->topics[id].retained != NULL) {
+            for (uint32_t i = 0; i < table->retainDepth; ++i) {
+                free(table->topics[id].retained->slots[i].data);
+            }
+            free(table->topics[id].retained);
+        }
+    }
+    for (int32_t node = 0; node < table->trieCount; ++node) {
+        free(table->trie[node].level);
+    }
+    for (int32_t group = 0; group < table->groupCount; ++group) {
+        free(table->groups[group].name);
+    }
+    free(table->groups);
+    free(table->trie);
+    free(table->scratch);
+    free(table->spans);
+    free(table->entries);
+    free(table->extra);
+    free(table->topics);
+    free(table->topicSlots);
+    const RoutingTransport* transport = table->transport;
+    memset(table, 0, sizeof(*table));
+    table->transport = transport;
+    table->freeHead = ROUTING_NO_INDEX;
+}
+
+#endif /* ROUTING_H */
@@ -0,0 +1,341 @@
+/*
+ * Archivo: shm_ring.h
+ * Descripcion: Anillo en memoria compartida con un escritor (el broker) y muchos lectores (subscribers en la misma
+ *              maquina). El broker escribe cada mensaje una sola vez, sin importar cuantos procesos lo lean, y
+ *              cada lector avanza a su propio ritmo sin enviar nada al broker: no hay sockets de loopback ni
+ *              copias al kernel en el camino de los datos.
+ *
+ * FORMATO DEL SEGMENTO:
+ *    Cabecera (SHM_RING_HEADER_BYTES) con la geometria y el contador published, seguida de slotCount ranuras de
+ *    slotSize bytes. La ranura del mensaje numero n (desde 1) es (n - 1) % slotCount y guarda su propia
+ *    secuencia: 2n - 1 mientras el escritor la llena y 2n cuando esta completa. published queda en su propia
+ *    linea de cache para que los lectores que lo consultan no la compartan con las ranuras.
+ *
+ * LECTURA SIN LOCKS:
+ *    El escritor nunca espera a los lectores: cuando el anillo da la vuelta pisa la ranura mas vieja. Cada
+ *    lector recuerda el numero del proximo mensaje; si published ya avanzo slotCount mensajes o mas, los que
+ *    faltan se perdieron y se cuentan en lost. Al leer una ranura compara la secuencia antes y despues de copiar
+ *    el mensaje (seqlock): si cambio, o no es la esperada, el escritor la piso mientras tanto y ese mensaje
+ *    tambien cuenta como perdido. Un lector lento pierde mensajes en lugar de frenar al broker y a los demas.
+ *
+ * TAMANO DE LA RANURA:
+ *    SHM_RING_SLOT_BYTES alcanza para el sobre mas largo que arma el broker: una linea TCP de 1024 bytes sin el
+ *    prefijo "PUBLISHER|", con la marca de ingreso que agrega el broker y el '\n'. Si igual llega un mensaje mas
+ *    largo, el escritor lo trunca y lo marca en la ranura; el lector lo cuenta en truncated para informarlo.
+ *
+ * NOMBRES:
+ *    Windows usa un mapeo con nombre "Local\<nombre>" respaldado por el archivo de paginacion; Linux un objeto
+ *    POSIX "/<nombre>" en /dev/shm. El broker crea el segmento y lo elimina al cerrarlo (en Windows desaparece
+ *    cuando el ultimo proceso lo desmapea); los lectores lo abren solo para lectura.
+ *
+ * LIBRERIAS UTILIZADAS Y JUSTIFICACION:
+ *
+ * 1. stdatomic.h (libreria estandar C11)
+ *    - Por que: Secuencias de las ranuras y contador published con orden acquire/release entre procesos.
+ *    - Funciones usadas: atomic_load_explicit(), atomic_store_explicit(), atomic_thread_fence().
+ *    - Alternativa considerada: Un mutex compartido entre procesos; descartado porque un lector detenido con el
+ *      mutex tomado bloquearia al broker.
+ *
+ * 2. windows.h (Windows) / sys/mman.h, fcntl.h (Linux)
+ *    - Por que: Crear, abrir y mapear el segmento compartido.
+ *    - Funciones usadas: CreateFileMappingA(), OpenFileMappingA(), MapViewOfFile(), UnmapViewOfFile(),
+ *      CloseHandle(), shm_open(), shm_unlink(), ftruncate(), fstat(), mmap(), munmap().
+ *
+ * 3. stdio.h / string.h (libreria estandar)
+ *    - Por que: Nombre del segmento y copia de los mensajes.
+ *    - Funciones usadas: snprintf(), memcpy(), memset().
+ */
+
+#ifndef SHM_RING_H
+#define SHM_RING_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define SHM_RING_MAGIC 0x53484d52u   /* "SHMR" */
+#define SHM_RING_VERSION 2u
+#define SHM_RING_HEADER_BYTES 128u
+#define SHM_RING_SLOT_BYTES 1152u    /* sobre "topic|hora|mensaje\n" de hasta 1136 bytes mas la cabecera */
+#define SHM_RING_DEFAULT_SLOTS 4096u
+#define SHM_RING_NAME_LEN 96
+
+typedef struct ShmRingHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slotCount;            /* Potencia de dos. */
+    uint32_t slotSize;
+    atomic_uint_least32_t closed;  /* El broker dejo de escribir. */
+    char reserved[44];
+    atomic_uint_least64_t published;
+} ShmRingHeader;
+
+typedef struct ShmRingSlot {
+    atomic_uint_least64_t sequence;
+    uint32_t length;
+    uint32_t truncated;   /* El mensaje no entraba y se corto en length bytes. */
+    char data[];
+} ShmRingSlot;
+
+typedef struct ShmRing {
+    ShmRingHeader* header;
+    uint8_t* slots;
+    size_t size;
+    int owner;
+    char name[SHM_RING_NAME_LEN];
+#ifdef _WIN32
+    HANDLE mapping;
+#endif
+} ShmRing;
+
+/* Posicion de un lector; es local a su proceso. */
+typedef struct ShmRingReader {
+    uint64_t next;
+    uint64_t lost;
+    uint64_t truncated;
+} ShmRingReader;
+
+static inline uint32_t ShmRingCapacity(const ShmRing* ring) {
+    return ring->header->slotSize - (uint32_t)offsetof(ShmRingSlot, data);
+}
+
+static inline ShmRingSlot* ShmRingSlotAt(const ShmRing* ring, uint64_t sequence) {
+    uint64_t position = (sequence - 1) & (uint64_t)(ring->header->slotCount - 1);
+    return (ShmRingSlot*)(ring->slots + position * ring->header->slotSize);
+}
+
+/* Nombre del segmento: el puerto identifica al broker y generation evita reabrir un segmento viejo. */
+static inline void ShmRingFormatName(char* name, size_t size, int brokerPort, int channel, uint32_t generation) {
+#ifdef _WIN32
+    snprintf(name, size, "Local\\sports-pubsub-%d-%d-%u", brokerPort, channel, generation);
+#else
+    snprintf(name, size, "/sports-pubsub-%d-%d-%u", brokerPort, channel, generation);
+#endif
+}
+
+static inline void ShmRingUnmap(ShmRing* ring) {
+#ifdef _WIN32
+    if (ring->header != NULL) {
+        UnmapViewOfFile(ring->header);
+    }
+    if (ring->mapping != NULL) {
+        CloseHandle(ring->mapping);
+    }
+#else
+    if (ring->header != NULL) {
+        munmap(ring->header, ring->size);
+    }
+#endif
+    memset(ring, 0, sizeof(*ring));
+}
+
+/* Lo usa el broker. slotCount se redondea a la potencia de dos siguiente. Devuelve 0 si no pudo crearlo. */
+static inline int ShmRingCreate(ShmRing* ring, const char* name, uint32_t slotCount, uint32_t slotSize) {
+    memset(ring, 0, sizeof(*ring));
+    uint32_t count = 1;
+    while (count < slotCount) {
+        count <<= 1;
+    }
+    size_t size = SHM_RING_HEADER_BYTES + (size_t)count * slotSize;
+    snprintf(ring->name, sizeof(ring->name), "%s", name);
+    ring->size = size;
+    ring->owner = 1;
+
+#ifdef _WIN32
+    ring->mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, (DWORD)((uint64_t)size >> 32),
+                                       (DWORD)(size & 0xFFFFFFFFu), name);
+    if (ring->mapping == NULL) {
+        return 0;
+    }
+    ring->header = (ShmRingHeader*)MapViewOfFile(ring->mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+#else
+    shm_unlink(name);  /* restos de un broker anterior que no termino bien */
+    int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0) {
+        return 0;
+    }
+    if (ftruncate(fd, (off_t)size) != 0) {
+        close(fd);
+        shm_unlink(name);
+        return 0;
+    }
+    void* view = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    ring->header = view == MAP_FAILED ? NULL : (ShmRingHeader*)view;
+    if (ring->header == NULL) {
+        shm_unlink(name);
+    }
+#endif
+    if (ring->header == NULL) {
+        ShmRingUnmap(ring);
+        return 0;
+    }
+
+    ring->slots = (uint8_t*)ring->header + SHM_RING_HEADER_BYTES;
+    memset(ring->header, 0, SHM_RING_HEADER_BYTES);
+    ring->header->slotCount = count;
+    ring->header->slotSize = slotSize;
+    ring->header->version = SHM_RING_VERSION;
+    for (uint32_t i = 0; i < count; ++i) {
+        atomic_store_explicit(&ShmRingSlotAt(ring, (uint64_t)i + 1)->sequence, 0, memory_order_relaxed);
+    }
+    atomic_store_explicit(&ring->header->published, 0, memory_order_relaxed);
+    atomic_store_explicit(&ring->header->closed, 0, memory_order_relaxed);
+    /* El magic va al final: un lector que abre el segmento antes de tiempo lo rechaza. */
+    atomic_thread_fence(memory_order_release);
+    ring->header->magic = SHM_RING_MAGIC;
+    return 1;
+}
+
+/* Lo usan los subscribers: mapeo de solo lectura de un segmento que creo el broker. */
+static inline int ShmRingOpen(ShmRing* ring, const char* name) {
+    memset(ring, 0, sizeof(*ring));
+    snprintf(ring->name, sizeof(ring->name), "%s", name);
+
+#ifdef _WIN32
+    ring->mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, name);
+    if (ring->mapping == NULL) {
+        return 0;
+    }
+    ring->header = (ShmRingHeader*)MapViewOfFile(ring->mapping, FILE_MAP_READ, 0, 0, 0);
+    if (ring->header != NULL) {
+        MEMORY_BASIC_INFORMATION info;
+        ring->size = VirtualQuery(ring->header, &info, sizeof(info)) != 0 ? info.RegionSize : 0;
+    }
+#else
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0) {
+        return 0;
+    }
+    struct stat status;
+    if (fstat(fd, &status) != 0 || status.st_size < (off_t)SHM_RING_HEADER_BYTES) {
+        close(fd);
+        return 0;
+    }
+    ring->size = (size_t)status.st_size;
+    void* view = mmap(NULL, ring->size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    ring->header = view == MAP_FAILED ? NULL : (ShmRingHeader*)view;
+#endif
+    if (ring->header == NULL) {
+        ShmRingUnmap(ring);
+        return 0;
+    }
+
+    ShmRingHeader* header = ring->header;
+    int valid = header->magic == SHM_RING_MAGIC && header->version == SHM_RING_VERSION && header->slotCount > 0 &&
+                (header->slotCount & (header->slotCount - 1)) == 0 && header->slotSize > offsetof(ShmRingSlot, data) &&
+                SHM_RING_HEADER_BYTES + (size_t)header->slotCount * header->slotSize <= ring->size;
+    if (!valid) {
+        ShmRingUnmap(ring);
+        return 0;
+    }
+    atomic_thread_fence(memory_order_acquire);
+    ring->slots = (uint8_t*)header + SHM_RING_HEADER_BYTES;
+    return 1;
+}
+
+/* El broker marca el segmento como cerrado y lo elimina; un lector solo lo desmapea. */
+static inline void ShmRingClose(ShmRing* ring) {
+    if (ring->header == NULL) {
+        return;
+    }
+    if (ring->owner) {
+        atomic_store_explicit(&ring->header->closed, 1, memory_order_release);
+#ifndef _WIN32
+        shm_unlink(ring->name);
+#endif
+    }
+    ShmRingUnmap(ring);
+}
+
+/* Solo un escritor por anillo. Un mensaje mas largo que la ranura se trunca y queda marcado. */
+static inline void ShmRingWrite(ShmRing* ring, const char* data, uint32_t length) {
+    ShmRingHeader* header = ring->header;
+    uint64_t sequence = atomic_load_explicit(&header->published, memory_order_relaxed) + 1;
+    ShmRingSlot* slot = ShmRingSlotAt(ring, sequence);
+    uint32_t capacity = ShmRingCapacity(ring);
+    uint32_t truncated = length > capacity;
+    if (truncated) {
+        length = capacity;
+    }
+
+    atomic_store_explicit(&slot->sequence, sequence * 2 - 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    slot->length = length;
+    slot->truncated = truncated;
+    memcpy(slot->data, data, length);
+    atomic_store_explicit(&slot->sequence, sequence * 2, memory_order_release);
+    atomic_store_explicit(&header->published, sequence, memory_order_release);
+}
+
+/* El lector empieza en el proximo mensaje, o hasta backlog mensajes antes si siguen en el anillo. */
+static inline void ShmRingReaderInit(const ShmRing* ring, ShmRingReader* reader, uint32_t backlog) {
+    uint64_t published = atomic_load_explicit(&ring->header->published, memory_order_acquire);
+    if (backlog > ring->header->slotCount) {
+        backlog = ring->header->slotCount;
+    }
+    reader->next = published >= backlog ? published - backlog + 1 : 1;
+    reader->lost = 0;
+    reader->truncated = 0;
+}
+
+static inline int ShmRingClosed(const ShmRing* ring) {
+    return atomic_load_explicit(&ring->header->closed, memory_order_acquire) != 0;
+}
+
+/*
+ * Copia el proximo mensaje a buffer (truncado a capacity) y devuelve 1; devuelve 0 si el lector esta al dia.
+ * Los mensajes que el escritor piso antes de leerlos se saltean y se suman a reader->lost; los que llegan
+ * cortados, por el escritor o por capacity, se entregan igual y se suman a reader->truncated.
+ */
+static inline int ShmRingRead(const ShmRing* ring, ShmRingReader* reader, char* buffer, uint32_t capacity, uint32_t* length) {
+    const ShmRingHeader* header = ring->header;
+    for (;;) {
+        uint64_t published = atomic_load_explicit(&header->published, memory_order_acquire);
+        if (reader->next > published) {
+            return 0;
+        }
+        if (published - reader->next >= header->slotCount) {
+            uint64_t oldest = published - header->slotCount + 1;
+            reader->lost += oldest - reader->next;
+            reader->next = oldest;
+        }
+
+        ShmRingSlot* slot = ShmRingSlotAt(ring, reader->next);
+        uint64_t expected = reader->next * 2;
+        uint64_t before = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        if (before == expected) {
+            uint32_t size = slot->length;
+            uint32_t truncated = slot->truncated;
+            if (size > capacity) {
+                size = capacity;
+                truncated = 1;
+            }
+            memcpy(buffer, slot->data, size);
+            atomic_thread_fence(memory_order_acquire);
+            if (atomic_load_explicit(&slot->sequence, memory_order_relaxed) == before) {
+                reader->next++;
+                reader->truncated += truncated != 0;
+                *length = size;
+                return 1;
+            }
+        }
+        /* El escritor ya dio la vuelta sobre esta ranura. */
+        reader->lost++;
+        reader->next++;
+    }
+}
+
+#endif /* SHM_RING_H */